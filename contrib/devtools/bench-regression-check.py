@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+# Copyright (c) 2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+'''
+Compare bench_bitcoin output against a checked-in baseline and fail on
+regressions, so CI can flag slowdowns on the benchmarks we gate.
+
+Usage:
+    src/bench/bench_bitcoin | contrib/devtools/bench-regression-check.py src/bench/baselines/pow.csv
+    bench-regression-check.py <baseline.csv> [results.csv] [tolerance]
+
+Both files use the CSV format bench_bitcoin prints
+(Benchmark,count,min,max,average). The per-iteration minimum is compared,
+as it is the least sensitive to scheduling noise; a benchmark regresses
+when its minimum exceeds the baseline minimum by more than the tolerance
+factor (default 1.5). Benchmarks present in only one of the files are
+reported but do not fail the check, so unrelated benchmarks can come and
+go without touching the baseline.
+
+Baselines are tied to the reference machine that produced them. To
+regenerate after an accepted performance change (quiesce the machine and
+pin the benchmark to one core):
+    taskset -c 0 src/bench/bench_bitcoin > src/bench/baselines/pow.csv
+then prune the lines for benchmarks that are not gated.
+
+Return value is 0 when no gated benchmark regressed.
+'''
+
+import sys
+
+def parse_bench_csv(fileobj):
+    benchmarks = {}
+    for line in fileobj:
+        parts = line.strip().split(',')
+        if len(parts) != 5 or parts[0] == 'Benchmark':
+            continue
+        try:
+            benchmarks[parts[0]] = float(parts[2])
+        except ValueError:
+            continue
+    return benchmarks
+
+def main():
+    if len(sys.argv) < 2 or len(sys.argv) > 4:
+        print(__doc__)
+        return 1
+    with open(sys.argv[1]) as f:
+        baseline = parse_bench_csv(f)
+    if len(sys.argv) >= 3:
+        with open(sys.argv[2]) as f:
+            results = parse_bench_csv(f)
+    else:
+        results = parse_bench_csv(sys.stdin)
+    tolerance = float(sys.argv[3]) if len(sys.argv) == 4 else 1.5
+
+    if not baseline:
+        print('ERROR: no benchmarks in baseline %s' % sys.argv[1])
+        return 1
+
+    failures = 0
+    for name in sorted(baseline):
+        if name not in results:
+            print('WARNING: gated benchmark %s missing from results' % name)
+            continue
+        ratio = results[name] / baseline[name]
+        status = 'OK'
+        if ratio > tolerance:
+            status = 'REGRESSION'
+            failures += 1
+        print('%s: %s (min %.3gs vs baseline %.3gs, %.2fx)' % (status, name, results[name], baseline[name], ratio))
+    for name in sorted(results):
+        if name not in baseline:
+            print('INFO: %s has no baseline, skipped' % name)
+
+    if failures:
+        print('%d benchmark(s) regressed beyond %.2fx tolerance' % (failures, tolerance))
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -200,6 +200,18 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! packed lists of the occupied tried/new slots, for O(1) uniform selection
+    std::vector<int> vTriedSlots;
+    std::vector<int> vNewSlots;
+
+    //! direct index from packed slot number (bucket * ADDRMAN_BUCKET_SIZE +
+    //! position) to its place in the lists above, -1 if the slot is free
+    std::vector<int> vTriedSlotPos;
+    std::vector<int> vNewSlotPos;
+
+    //! number of updates made to the tables since startup
+    uint64_t nUpdates;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -223,6 +235,40 @@ protected:
     //! Clear a position in a "new" table. This is the only place where entries are actually deleted.
     void ClearNew(int nUBucket, int nUBucketPos);
 
+    //! Write a "tried" bucket slot, keeping the packed occupied-slot list in sync.
+    void SetTried(int nBucket, int nBucketPos, int nId)
+    {
+        int nSlot = nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos;
+        if (vvTried[nBucket][nBucketPos] == -1 && nId != -1) {
+            vTriedSlotPos[nSlot] = vTriedSlots.size();
+            vTriedSlots.push_back(nSlot);
+        } else if (vvTried[nBucket][nBucketPos] != -1 && nId == -1) {
+            int nPos = vTriedSlotPos[nSlot];
+            vTriedSlots[nPos] = vTriedSlots.back();
+            vTriedSlotPos[vTriedSlots[nPos]] = nPos;
+            vTriedSlots.pop_back();
+            vTriedSlotPos[nSlot] = -1;
+        }
+        vvTried[nBucket][nBucketPos] = nId;
+    }
+
+    //! Write a "new" bucket slot, keeping the packed occupied-slot list in sync.
+    void SetNew(int nBucket, int nBucketPos, int nId)
+    {
+        int nSlot = nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos;
+        if (vvNew[nBucket][nBucketPos] == -1 && nId != -1) {
+            vNewSlotPos[nSlot] = vNewSlots.size();
+            vNewSlots.push_back(nSlot);
+        } else if (vvNew[nBucket][nBucketPos] != -1 && nId == -1) {
+            int nPos = vNewSlotPos[nSlot];
+            vNewSlots[nPos] = vNewSlots.back();
+            vNewSlotPos[vNewSlots[nPos]] = nPos;
+            vNewSlots.pop_back();
+            vNewSlotPos[nSlot] = -1;
+        }
+        vvNew[nBucket][nBucketPos] = nId;
+    }
+
     //! Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService &addr, int64_t nTime);
 
@@ -363,7 +409,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -383,7 +429,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -403,7 +449,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -435,6 +481,10 @@ public:
     void Clear()
     {
         std::vector<int>().swap(vRandom);
+        std::vector<int>().swap(vTriedSlots);
+        std::vector<int>().swap(vNewSlots);
+        vTriedSlotPos.assign(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
+        vNewSlotPos.assign(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
@@ -454,6 +504,7 @@ public:
 
     CAddrMan()
     {
+        nUpdates = 0;
         Clear();
     }
 
@@ -468,6 +519,13 @@ public:
         return vRandom.size();
     }
 
+    //! Return the number of updates made to the tables since startup, so
+    //! callers can skip rewriting peers.dat when nothing has changed.
+    uint64_t GetUpdateCount() const
+    {
+        return nUpdates;
+    }
+
     //! Consistency check
     void Check()
     {
@@ -489,6 +547,8 @@ public:
             LOCK(cs);
             Check();
             fRet |= Add_(addr, source, nTimePenalty);
+            if (fRet)
+                nUpdates++;
             Check();
         }
         if (fRet)
@@ -505,6 +565,8 @@ public:
             Check();
             for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
                 nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+            if (nAdd)
+                nUpdates++;
             Check();
         }
         if (nAdd)
@@ -519,6 +581,7 @@ public:
             LOCK(cs);
             Check();
             Good_(addr, nTime);
+            nUpdates++;
             Check();
         }
     }
@@ -530,6 +593,7 @@ public:
             LOCK(cs);
             Check();
             Attempt_(addr, nTime);
+            nUpdates++;
             Check();
         }
     }
@@ -569,6 +633,7 @@ public:
             LOCK(cs);
             Check();
             Connected_(addr, nTime);
+            nUpdates++;
             Check();
         }
     }
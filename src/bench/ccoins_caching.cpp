@@ -0,0 +1,78 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+static const size_t NUM_BENCH_COINS = 100000;
+
+static uint256 BenchTxid(size_t i)
+{
+    uint256 txid;
+    memcpy(txid.begin(), &i, sizeof(i));
+    return txid;
+}
+
+static void PopulateCoinsCache(CCoinsViewCache& cache)
+{
+    for (size_t i = 0; i < NUM_BENCH_COINS; i++) {
+        CCoinsModifier modifier = cache.ModifyCoins(BenchTxid(i));
+        modifier->vout.resize(2);
+        modifier->vout[0].nValue = 1000 + (CAmount)i;
+        modifier->vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        modifier->vout[1].nValue = 2000 + (CAmount)i;
+        modifier->vout[1].scriptPubKey = modifier->vout[0].scriptPubKey;
+        modifier->nHeight = (int)i + 1;
+    }
+}
+
+static void CCoinsCacheHit(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    PopulateCoinsCache(cache);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const CCoins* coins = cache.AccessCoins(BenchTxid(i % NUM_BENCH_COINS));
+        assert(coins != NULL);
+        i++;
+    }
+}
+
+static void CCoinsCacheMiss(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    PopulateCoinsCache(cache);
+    size_t i = NUM_BENCH_COINS;
+    while (state.KeepRunning()) {
+        const CCoins* coins = cache.AccessCoins(BenchTxid(i));
+        assert(coins == NULL);
+        i++;
+    }
+}
+
+static void CCoinsCacheModify(benchmark::State& state)
+{
+    CCoinsView base;
+    CCoinsViewCache cache(&base);
+    PopulateCoinsCache(cache);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        CCoinsModifier modifier = cache.ModifyCoins(BenchTxid(i % NUM_BENCH_COINS));
+        modifier->vout.resize(2);
+        modifier->vout[1].nValue++;
+        i++;
+    }
+}
+
+BENCHMARK(CCoinsCacheHit);
+BENCHMARK(CCoinsCacheMiss);
+BENCHMARK(CCoinsCacheModify);
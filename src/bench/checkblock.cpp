@@ -0,0 +1,59 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "random.h"
+
+// ConnectBlock needs a populated chainstate, so block-level validation is
+// benchmarked through CheckBlock on a synthetic full block: transaction
+// hashing, per-transaction sanity checks and the merkle root computation are
+// the pieces that scale with block size.
+
+static CBlock BuildBenchBlock(size_t nTxCount)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    block.vtx.push_back(CTransaction(coinbase));
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 1 * COIN;
+    tx.vout[1].scriptPubKey = tx.vout[0].scriptPubKey;
+    for (size_t i = 1; i < nTxCount; i++) {
+        block.vtx.push_back(CTransaction(tx));
+        tx.vin[0].prevout.hash = block.vtx.back().GetHash();
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static void CheckBlockBench(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    CBlock block = BuildBenchBlock(1000);
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        bool fOk = CheckBlock(block, validationState, false, true);
+        assert(fOk);
+    }
+}
+
+BENCHMARK(CheckBlockBench);
@@ -0,0 +1,110 @@
+#include "bench.h"
+
+#include "chainparams.h"
+#include "claimtrie.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <string>
+#include <vector>
+
+// Number of names used by the trie benchmarks. Mainnet has a few million
+// claims; this is scaled down so a single iteration stays in the millisecond
+// range while still being deep enough to exercise node splitting.
+static const size_t NUM_BENCH_NAMES = 5000;
+
+/** Deterministically generate a prefix-heavy name set resembling mainnet
+ * (many claims share leading characters). */
+static std::vector<std::string> GenerateBenchNames()
+{
+    std::vector<std::string> vNames;
+    vNames.reserve(NUM_BENCH_NAMES);
+    uint32_t nSeed = 0x1badcafe;
+    for (size_t i = 0; i < NUM_BENCH_NAMES; i++) {
+        // xorshift keeps the set stable across runs and platforms
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+        vNames.push_back(strprintf("%s-%u", (i % 3 == 0) ? "what-is" : (i % 3 == 1) ? "how-to" : "lbry", nSeed % 100000));
+    }
+    return vNames;
+}
+
+static CClaimValue BenchClaimValue(size_t i)
+{
+    COutPoint outPoint(uint256S(strprintf("%064x", i + 1)), 0);
+    uint160 claimId;
+    memcpy(claimId.begin(), &i, sizeof(i));
+    return CClaimValue(outPoint, claimId, 100000 + (CAmount)i, 100, 200);
+}
+
+static void ClaimTrieInsert(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const std::vector<std::string> vNames = GenerateBenchNames();
+    CClaimTrie trie(true, false, 1);
+    while (state.KeepRunning()) {
+        CClaimTrieCache cache(&trie, false);
+        for (size_t i = 0; i < vNames.size(); i++)
+            cache.insertClaimIntoTrie(vNames[i], BenchClaimValue(i));
+    }
+}
+
+static void ClaimTrieMerkleHash(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const std::vector<std::string> vNames = GenerateBenchNames();
+    CClaimTrie trie(true, false, 1);
+    CClaimTrieCache cache(&trie, false);
+    for (size_t i = 0; i < vNames.size(); i++)
+        cache.insertClaimIntoTrie(vNames[i], BenchClaimValue(i));
+    cache.getMerkleHash();
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        // Dirty one name, then time the incremental re-hash of the trie
+        cache.insertClaimIntoTrie(vNames[i % vNames.size()], BenchClaimValue(NUM_BENCH_NAMES + i));
+        cache.getMerkleHash();
+        i++;
+    }
+}
+
+static void ClaimTrieFlush(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const std::vector<std::string> vNames = GenerateBenchNames();
+    CClaimTrie trie(true, false, 1);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        CClaimTrieCache cache(&trie, false);
+        for (size_t j = 0; j < 100; j++)
+            cache.insertClaimIntoTrie(vNames[(i + j) % vNames.size()], BenchClaimValue(i + j));
+        cache.getMerkleHash();
+        cache.flush();
+        i += 100;
+    }
+}
+
+static void ClaimTrieGetClaimsForName(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const std::vector<std::string> vNames = GenerateBenchNames();
+    CClaimTrie trie(true, false, 1);
+    {
+        CClaimTrieCache cache(&trie, false);
+        for (size_t i = 0; i < vNames.size(); i++)
+            cache.insertClaimIntoTrie(vNames[i], BenchClaimValue(i));
+        cache.getMerkleHash();
+        cache.flush();
+    }
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        claimsForNameType claims = trie.getClaimsForName(vNames[i % vNames.size()]);
+        assert(!claims.claims.empty());
+        i++;
+    }
+}
+
+BENCHMARK(ClaimTrieInsert);
+BENCHMARK(ClaimTrieMerkleHash);
+BENCHMARK(ClaimTrieFlush);
+BENCHMARK(ClaimTrieGetClaimsForName);
@@ -0,0 +1,111 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "lbry.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <vector>
+
+// Headers per iteration of the chain benchmarks. LBRY retargets every block,
+// so this covers as many difficulty recalculations.
+static const size_t NUM_BENCH_HEADERS = 1000;
+
+/** Build a synthetic header chain with solve times jittered around the 150s
+ * target so the retarget hits the modulation and both clamping branches. */
+static std::vector<CBlockIndex> BuildBenchIndex(const Consensus::Params& params)
+{
+    std::vector<CBlockIndex> vIndex(NUM_BENCH_HEADERS);
+    uint32_t nSeed = 0x50575221;
+    int64_t nTime = 1464000000;
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        nSeed ^= nSeed << 13;
+        nSeed ^= nSeed >> 17;
+        nSeed ^= nSeed << 5;
+        nTime += 30 + nSeed % 300;
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = nTime;
+        vIndex[i].nBits = UintToArith256(params.powLimit).GetCompact();
+        if (i > 0)
+            vIndex[i].pprev = &vIndex[i - 1];
+    }
+    return vIndex;
+}
+
+/** Difficulty recalculation over a full synthetic chain; dominated by the
+ * arith_uint256 multiply/divide in CalculateLbryNextWorkRequired. */
+static void LbryNextWorkRequired(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+    std::vector<CBlockIndex> vIndex = BuildBenchIndex(params);
+    while (state.KeepRunning()) {
+        for (size_t i = 1; i < vIndex.size(); i++)
+            vIndex[i].nBits = CalculateLbryNextWorkRequired(&vIndex[i], vIndex[i - 1].GetBlockTime(), params);
+    }
+}
+
+/** The arith_uint256 retarget arithmetic in isolation: SetCompact, a 64-bit
+ * multiply and the long division that showed up in header-sync profiles. */
+static void ArithUint256Retarget(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+    const unsigned int nBits = UintToArith256(params.powLimit).GetCompact();
+    while (state.KeepRunning()) {
+        arith_uint256 bnNew;
+        bnNew.SetCompact(nBits);
+        bnNew *= 161; // a modulated timespan the clamps allow
+        bnNew /= params.nPowTargetTimespan;
+        bnNew.GetCompact();
+    }
+}
+
+/** One LBRY proof-of-work hash (sha256d -> sha512 -> ripemd160 halves ->
+ * sha256d) including header serialization, as paid per header received. */
+static void LbryPoWHash(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashPrevBlock = uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    header.hashMerkleRoot = uint256S("fedcba9876543210fedcba9876543210fedcba9876543210fedcba9876543210");
+    header.hashClaimTrie = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+    header.nTime = 1464000000;
+    header.nBits = 0x1f00ffff;
+    header.nNonce = 0;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetPoWHash();
+    }
+}
+
+/** Full header PoW validation as done during headers sync: the hash chain
+ * plus the compact-target expansion and comparison in CheckProofOfWork.
+ * Regtest's permissive powLimit keeps the check on its success path. */
+static void LbryCheckProofOfWork(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = Params().GetConsensus();
+    const unsigned int nBits = UintToArith256(params.powLimit).GetCompact();
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.nTime = 1464000000;
+    header.nBits = nBits;
+    header.nNonce = 0;
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        CheckProofOfWork(header.GetPoWHash(), nBits, params);
+    }
+}
+
+BENCHMARK(LbryNextWorkRequired);
+BENCHMARK(ArithUint256Retarget);
+BENCHMARK(LbryPoWHash);
+BENCHMARK(LbryCheckProofOfWork);
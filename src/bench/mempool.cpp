@@ -0,0 +1,70 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// Full AcceptToMemoryPool needs chainstate, so these benchmarks drive the
+// mempool data structure directly: entry bookkeeping, the ancestor/descendant
+// tracking done on every admission, and removal. Script checks are covered by
+// the signature benchmarks.
+
+static std::vector<CTransaction> BuildChainedTransactions(size_t nCount)
+{
+    std::vector<CTransaction> vtx;
+    vtx.reserve(nCount);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 50 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    for (size_t i = 0; i < nCount; i++) {
+        vtx.push_back(CTransaction(tx));
+        // Each transaction spends its predecessor, building an ancestor chain
+        tx.vin[0].prevout.hash = vtx.back().GetHash();
+        tx.vout[0].nValue -= 1000;
+    }
+    return vtx;
+}
+
+static CTxMemPoolEntry BenchMemPoolEntry(const CTransaction& tx)
+{
+    return CTxMemPoolEntry(tx, 1000, 0, 0.0, 1, false, tx.vout[0].nValue, false, 1, 0, LockPoints());
+}
+
+static void MemPoolAddUnchecked(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = BuildChainedTransactions(100);
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        for (size_t i = 0; i < vtx.size(); i++)
+            pool.addUnchecked(vtx[i].GetHash(), BenchMemPoolEntry(vtx[i]), false);
+    }
+}
+
+static void MemPoolRemoveRecursive(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx = BuildChainedTransactions(100);
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        for (size_t i = 0; i < vtx.size(); i++)
+            pool.addUnchecked(vtx[i].GetHash(), BenchMemPoolEntry(vtx[i]), false);
+        // Removing the chain head evicts every descendant
+        std::list<CTransaction> removed;
+        pool.removeRecursive(vtx[0], removed);
+        assert(removed.size() == vtx.size());
+    }
+}
+
+BENCHMARK(MemPoolAddUnchecked);
+BENCHMARK(MemPoolRemoveRecursive);
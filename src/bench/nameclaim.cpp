@@ -0,0 +1,63 @@
+#include "bench.h"
+
+#include "nameclaim.h"
+#include "script/script.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+static void DecodeClaimName(benchmark::State& state)
+{
+    CScript script = ClaimNameScript("benchmark-name", std::string(1024, 'x'));
+    int op;
+    std::vector<std::vector<unsigned char> > vvchParams;
+    while (state.KeepRunning()) {
+        vvchParams.clear();
+        bool fDecoded = DecodeClaimScript(script, op, vvchParams);
+        assert(fDecoded);
+    }
+}
+
+static void DecodeClaimUpdate(benchmark::State& state)
+{
+    CScript script = UpdateClaimScript("benchmark-name", uint160(), std::string(1024, 'x'));
+    int op;
+    std::vector<std::vector<unsigned char> > vvchParams;
+    while (state.KeepRunning()) {
+        vvchParams.clear();
+        bool fDecoded = DecodeClaimScript(script, op, vvchParams);
+        assert(fDecoded);
+    }
+}
+
+static void DecodeClaimSupport(benchmark::State& state)
+{
+    CScript script = SupportClaimScript("benchmark-name", uint160());
+    int op;
+    std::vector<std::vector<unsigned char> > vvchParams;
+    while (state.KeepRunning()) {
+        vvchParams.clear();
+        bool fDecoded = DecodeClaimScript(script, op, vvchParams);
+        assert(fDecoded);
+    }
+}
+
+// The rejection path runs on every non-claim output in every connected block,
+// so it matters as much as the accepting paths.
+static void DecodeClaimNonClaim(benchmark::State& state)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    int op;
+    std::vector<std::vector<unsigned char> > vvchParams;
+    while (state.KeepRunning()) {
+        vvchParams.clear();
+        bool fDecoded = DecodeClaimScript(script, op, vvchParams);
+        assert(!fDecoded);
+    }
+}
+
+BENCHMARK(DecodeClaimName);
+BENCHMARK(DecodeClaimUpdate);
+BENCHMARK(DecodeClaimSupport);
+BENCHMARK(DecodeClaimNonClaim);
@@ -0,0 +1,151 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "main.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+
+// No serialized transaction can be smaller than this; used to bound the
+// transaction count a compact block may claim.
+static const unsigned int MIN_TRANSACTION_SIZE = 60;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
+        nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+    FillShortTxIDSelector();
+    // Prefill the coinbase: no peer will have it in their mempool.
+    prefilledtxn[0].index = 0;
+    prefilledtxn[0].tx = block.vtx[0];
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        shorttxids[i - 1] = GetShortID(tx.GetHash());
+    }
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((unsigned char*)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    shorttxidk0 = shorttxidhash.GetUint64(0);
+    shorttxidk1 = shorttxidhash.GetUint64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock) {
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_SIZE / MIN_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn_available.empty());
+    header = cmpctblock.header;
+    txn_available.resize(cmpctblock.BlockTxCount());
+    have_txn.assign(cmpctblock.BlockTxCount(), false);
+
+    BOOST_FOREACH(const PrefilledTransaction& prefilled, cmpctblock.prefilledtxn) {
+        if (prefilled.tx.IsNull())
+            return READ_STATUS_INVALID;
+        if (prefilled.index >= txn_available.size())
+            return READ_STATUS_INVALID;
+        txn_available[prefilled.index] = prefilled.tx;
+        have_txn[prefilled.index] = true;
+        prefilled_count++;
+    }
+
+    // Map each short ID to its position in the block, skipping the slots
+    // occupied by prefilled transactions.
+    std::map<uint64_t, uint32_t> shorttxids;
+    {
+        size_t short_idx = 0;
+        for (size_t i = 0; i < txn_available.size() && short_idx < cmpctblock.shorttxids.size(); i++) {
+            if (have_txn[i])
+                continue;
+            uint64_t shortid = cmpctblock.shorttxids[short_idx++];
+            if (!shorttxids.insert(std::make_pair(shortid, (uint32_t)i)).second) {
+                // Two txn in the block had the same short id; request a full
+                // block instead of trying to sort that out.
+                return READ_STATUS_FAILED;
+            }
+        }
+    }
+
+    {
+        LOCK(pool->cs);
+        std::vector<bool> seen(txn_available.size(), false);
+        for (CTxMemPool::indexed_transaction_set::const_iterator mi = pool->mapTx.begin(); mi != pool->mapTx.end(); ++mi) {
+            std::map<uint64_t, uint32_t>::iterator idit = shorttxids.find(cmpctblock.GetShortID(mi->GetTx().GetHash()));
+            if (idit == shorttxids.end())
+                continue;
+            if (!seen[idit->second]) {
+                seen[idit->second] = true;
+                txn_available[idit->second] = mi->GetTx();
+                have_txn[idit->second] = true;
+                mempool_count++;
+            } else {
+                // A second mempool transaction matched this short id. Treat
+                // the slot as unfilled; if it was already counted, uncount it.
+                if (have_txn[idit->second]) {
+                    txn_available[idit->second] = CTransaction();
+                    have_txn[idit->second] = false;
+                    mempool_count--;
+                }
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n", cmpctblock.header.GetHash().ToString(), cmpctblock.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const {
+    assert(!header.IsNull());
+    assert(index < txn_available.size());
+    return have_txn[index];
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) const {
+    assert(!header.IsNull());
+    block = header;
+    block.vtx.resize(txn_available.size());
+
+    size_t tx_missing_offset = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (!have_txn[i]) {
+            if (vtx_missing.size() <= tx_missing_offset)
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtx_missing[tx_missing_offset++];
+        } else
+            block.vtx[i] = txn_available[i];
+    }
+    if (vtx_missing.size() != tx_missing_offset)
+        return READ_STATUS_INVALID;
+
+    // If the merkle root doesn't check out, a short id collision probably
+    // slotted in the wrong mempool transaction; the caller should fall back
+    // to requesting the full block.
+    bool mutated;
+    uint256 hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    if (hashMerkleRoot != header.hashMerkleRoot || mutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool and %lu txn requested\n", header.GetHash().ToString(), prefilled_count, mempool_count, vtx_missing.size());
+
+    return READ_STATUS_OK;
+}
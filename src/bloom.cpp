@@ -133,34 +133,78 @@ bool CBloomFilter::IsWithinSizeConstraints() const
     return vData.size() <= MAX_BLOOM_FILTER_SIZE && nHashFuncs <= MAX_HASH_FUNCS;
 }
 
+/** Collect the non-empty pushed data elements of a script. Parsing stops at
+ * the first unparseable opcode, matching the behaviour of the old per-filter
+ * GetOp loops. */
+static void ExtractScriptPushes(const CScript& script, vector<vector<unsigned char> >& vPushes)
+{
+    CScript::const_iterator pc = script.begin();
+    vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            vPushes.push_back(data);
+    }
+}
+
+CTxFilterElements::CTxFilterElements(const CTransaction& txIn) : ptx(&txIn)
+{
+    const uint256& hash = txIn.GetHash();
+    vchTxHash.assign(hash.begin(), hash.end());
+
+    vOutputPushes.resize(txIn.vout.size());
+    for (unsigned int i = 0; i < txIn.vout.size(); i++)
+        ExtractScriptPushes(txIn.vout[i].scriptPubKey, vOutputPushes[i]);
+
+    vPrevOuts.resize(txIn.vin.size());
+    vInputPushes.resize(txIn.vin.size());
+    for (unsigned int i = 0; i < txIn.vin.size(); i++)
+    {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txIn.vin[i].prevout;
+        vPrevOuts[i].assign(stream.begin(), stream.end());
+        ExtractScriptPushes(txIn.vin[i].scriptSig, vInputPushes[i]);
+    }
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
 {
-    bool fFound = false;
     // Match if the filter contains the hash of tx
     //  for finding tx when they appear in a block
     if (isFull)
         return true;
     if (isEmpty)
         return false;
+    // Single-filter callers pay the extraction cost either way, so just
+    // delegate to the precomputed-elements path.
+    return IsRelevantAndUpdate(CTxFilterElements(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CTxFilterElements& elems)
+{
+    bool fFound = false;
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    const CTransaction& tx = *elems.ptx;
     const uint256& hash = tx.GetHash();
-    if (contains(hash))
+    if (contains(elems.vchTxHash))
         fFound = true;
 
-    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    for (unsigned int i = 0; i < elems.vOutputPushes.size(); i++)
     {
-        const CTxOut& txout = tx.vout[i];
         // Match if the filter contains any arbitrary script data element in any scriptPubKey in tx
         // If this matches, also add the specific output that was matched.
-        // This means clients don't have to update the filter themselves when a new relevant tx 
+        // This means clients don't have to update the filter themselves when a new relevant tx
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end())
+        const vector<vector<unsigned char> >& vPushes = elems.vOutputPushes[i];
+        for (unsigned int j = 0; j < vPushes.size(); j++)
         {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+            if (contains(vPushes[j]))
             {
                 fFound = true;
                 if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
@@ -169,7 +213,7 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
                 {
                     txnouttype type;
                     vector<vector<unsigned char> > vSolutions;
-                    if (Solver(txout.scriptPubKey, type, vSolutions) &&
+                    if (Solver(tx.vout[i].scriptPubKey, type, vSolutions) &&
                             (type == TX_PUBKEY || type == TX_MULTISIG))
                         insert(COutPoint(hash, i));
                 }
@@ -181,23 +225,17 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    for (unsigned int i = 0; i < elems.vPrevOuts.size(); i++)
     {
         // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
+        if (contains(elems.vPrevOuts[i]))
             return true;
 
         // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        vector<unsigned char> data;
-        while (pc < txin.scriptSig.end())
-        {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data))
+        const vector<vector<unsigned char> >& vPushes = elems.vInputPushes[i];
+        for (unsigned int j = 0; j < vPushes.size(); j++)
+            if (contains(vPushes[j]))
                 return true;
-        }
     }
 
     return false;
@@ -244,20 +282,25 @@ inline unsigned int CRollingBloomFilter::Hash(unsigned int nHashNum, const std::
     return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (data.size() * 16);
 }
 
+void CRollingBloomFilter::rollGeneration()
+{
+    nEntriesThisGeneration = 0;
+    nGeneration++;
+    if (nGeneration == 4) {
+        nGeneration = 1;
+    }
+    /* Wipe old entries that used this generation number. */
+    for (uint32_t p = 0; p < data.size() * 16; p++) {
+        if (get(p) == nGeneration) {
+            put(p, 0);
+        }
+    }
+}
+
 void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
 {
     if (nEntriesThisGeneration == nEntriesPerGeneration) {
-        nEntriesThisGeneration = 0;
-        nGeneration++;
-        if (nGeneration == 4) {
-            nGeneration = 1;
-        }
-        /* Wipe old entries that used this generation number. */
-        for (uint32_t p = 0; p < data.size() * 16; p++) {
-            if (get(p) == nGeneration) {
-                put(p, 0);
-            }
-        }
+        rollGeneration();
     }
     nEntriesThisGeneration++;
 
@@ -269,8 +312,20 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
 
 void CRollingBloomFilter::insert(const uint256& hash)
 {
-    vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    if (nEntriesThisGeneration == nEntriesPerGeneration) {
+        rollGeneration();
+    }
+    nEntriesThisGeneration++;
+
+    /* Fast path for hashes: a single salted SipHash provides every probe
+     * position via double hashing, instead of copying the hash into a
+     * temporary vector and running MurmurHash3 once per hash function. */
+    uint64_t h = SipHashUint256(nTweak, nTweak * 0x9E3779B97F4A7C15ULL + 1, hash);
+    uint32_t h1 = h & 0xffffffff;
+    uint32_t h2 = h >> 32;
+    for (int n = 0; n < nHashFuncs; n++) {
+        put((h1 + (uint32_t)n * h2) % (data.size() * 16), nGeneration);
+    }
 }
 
 bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
@@ -286,8 +341,16 @@ bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 
 bool CRollingBloomFilter::contains(const uint256& hash) const
 {
-    vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    /* Must mirror the probe derivation in insert(const uint256&). */
+    uint64_t h = SipHashUint256(nTweak, nTweak * 0x9E3779B97F4A7C15ULL + 1, hash);
+    uint32_t h1 = h & 0xffffffff;
+    uint32_t h2 = h >> 32;
+    for (int n = 0; n < nHashFuncs; n++) {
+        if (get((h1 + (uint32_t)n * h2) % (data.size() * 16)) == 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void CRollingBloomFilter::reset()
@@ -30,6 +30,34 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+class CBloomFilter;
+
+/**
+ * The data elements of one transaction that a bloom filter can match:
+ * the tx hash, every pushed script element per output and input, and
+ * every serialized prevout. Extracting them is the same for every
+ * filter, so the relay path does it once per transaction and matches
+ * the result against each SPV peer's filter, instead of re-parsing
+ * every script and re-serializing every outpoint per peer.
+ * The transaction must outlive this object.
+ */
+class CTxFilterElements
+{
+private:
+    friend class CBloomFilter;
+    const CTransaction* ptx;
+    std::vector<unsigned char> vchTxHash;
+    //! pushed data elements per output script
+    std::vector<std::vector<std::vector<unsigned char> > > vOutputPushes;
+    //! serialized prevout per input
+    std::vector<std::vector<unsigned char> > vPrevOuts;
+    //! pushed data elements per input script
+    std::vector<std::vector<std::vector<unsigned char> > > vInputPushes;
+
+public:
+    CTxFilterElements(const CTransaction& txIn);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -97,6 +125,9 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! Same, but matches against pre-extracted elements so the relay code can
+    //! test one transaction against many peers' filters without re-parsing it
+    bool IsRelevantAndUpdate(const CTxFilterElements& elems);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -131,6 +162,21 @@ public:
 
     void reset();
 
+    ADD_SERIALIZE_METHODS;
+
+    // Serialization carries the random tweak and the generation counters, so
+    // a filter persisted across a restart keeps its salt and its rotation
+    // schedule instead of starting a fresh epoch.
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nEntriesPerGeneration);
+        READWRITE(nEntriesThisGeneration);
+        READWRITE(nGeneration);
+        READWRITE(data);
+        READWRITE(nTweak);
+        READWRITE(nHashFuncs);
+    }
+
 private:
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
@@ -141,6 +187,10 @@ private:
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
 
+    /* Start a new generation once the current one is full, wiping the
+     * entries inserted three generations ago. */
+    void rollGeneration();
+
     inline int get(uint32_t position) const {
         return (data[(position >> 4) % data.size()] >> (2 * (position & 0xF))) & 0x3;
     }
@@ -5,8 +5,58 @@
 
 #include "chain.h"
 
+#include "sync.h"
+
 using namespace std;
 
+/** Number of CBlockIndex slots carved out of each pool chunk */
+static const size_t BLOCK_INDEX_POOL_CHUNK = 16384;
+
+static CCriticalSection cs_blockIndexPool;
+static std::vector<char*> vBlockIndexChunks;
+static size_t nIndexesUsedInLastChunk = BLOCK_INDEX_POOL_CHUNK;
+
+void* CBlockIndexPool::Allocate()
+{
+    LOCK(cs_blockIndexPool);
+    if (nIndexesUsedInLastChunk == BLOCK_INDEX_POOL_CHUNK)
+    {
+        vBlockIndexChunks.push_back(new char[BLOCK_INDEX_POOL_CHUNK * sizeof(CBlockIndex)]);
+        nIndexesUsedInLastChunk = 0;
+    }
+    return vBlockIndexChunks.back() + (nIndexesUsedInLastChunk++) * sizeof(CBlockIndex);
+}
+
+CBlockIndex* CBlockIndexPool::New()
+{
+    return new (Allocate()) CBlockIndex();
+}
+
+CBlockIndex* CBlockIndexPool::New(const CBlockHeader& block)
+{
+    return new (Allocate()) CBlockIndex(block);
+}
+
+void CBlockIndexPool::FreeAll()
+{
+    LOCK(cs_blockIndexPool);
+    for (size_t i = 0; i < vBlockIndexChunks.size(); i++)
+    {
+        size_t nUsed = (i + 1 == vBlockIndexChunks.size()) ? nIndexesUsedInLastChunk : BLOCK_INDEX_POOL_CHUNK;
+        for (size_t j = 0; j < nUsed; j++)
+            ((CBlockIndex*)(vBlockIndexChunks[i] + j * sizeof(CBlockIndex)))->~CBlockIndex();
+        delete[] vBlockIndexChunks[i];
+    }
+    vBlockIndexChunks.clear();
+    nIndexesUsedInLastChunk = BLOCK_INDEX_POOL_CHUNK;
+}
+
+size_t CBlockIndexPool::MemoryUsage()
+{
+    LOCK(cs_blockIndexPool);
+    return vBlockIndexChunks.size() * BLOCK_INDEX_POOL_CHUNK * sizeof(CBlockIndex);
+}
+
 /**
  * CChain implementation
  */
@@ -83,6 +133,16 @@ CBlockIndex* CBlockIndex::GetAncestor(int height)
     CBlockIndex* pindexWalk = this;
     int heightWalk = nHeight;
     while (heightWalk > height) {
+        // Take the largest precomputed fixed-distance jump that does not
+        // overshoot; only the last few blocks fall through to the skip list.
+        int k = nAncestorLevels;
+        while (k > 0 && (heightWalk - (1 << (4 * k)) < height || pindexWalk->pancestors[k - 1] == NULL))
+            k--;
+        if (k > 0) {
+            heightWalk -= 1 << (4 * k);
+            pindexWalk = pindexWalk->pancestors[k - 1];
+            continue;
+        }
         int heightSkip = GetSkipHeight(heightWalk);
         int heightSkipPrev = GetSkipHeight(heightWalk - 1);
         if (pindexWalk->pskip != NULL &&
@@ -109,6 +169,18 @@ void CBlockIndex::BuildSkip()
 {
     if (pprev)
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+    // Fill the ancestor table nearest level first, so each farther level
+    // can descend through the jumps built just before it.
+    for (int k = 0; k < nAncestorLevels; k++) {
+        int nDistance = 1 << (4 * (k + 1));
+        pancestors[k] = nHeight >= nDistance ? GetAncestor(nHeight - nDistance) : NULL;
+    }
+}
+
+void CBlockIndex::BuildVersionTally()
+{
+    for (int k = 0; k < 3; k++)
+        nVersionTally[k] = (pprev ? pprev->nVersionTally[k] : 0) + (nVersion >= k + 2 ? 1 : 0);
 }
 
 arith_uint256 GetBlockProof(const CBlockIndex& block)
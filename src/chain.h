@@ -109,6 +109,16 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    //! Number of precomputed ancestor levels; level k jumps 16^(k+1) blocks back
+    static const int nAncestorLevels = 4;
+
+    //! (memory only) precomputed ancestor table: pancestors[k] is the
+    //! ancestor 16^(k+1) blocks back, or NULL below that height. GetAncestor
+    //! descends through these fixed-distance jumps and only falls back to
+    //! the pskip list for the last few blocks, so ancestor queries are a
+    //! short branch-free pointer chase.
+    CBlockIndex* pancestors[nAncestorLevels];
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -147,11 +157,19 @@ public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId;
 
+    //! (memory only) Cumulative count, from genesis through this block, of
+    //! ancestors with nVersion >= 2/3/4. The supermajority window check
+    //! becomes a subtraction of two tallies instead of a walk over the
+    //! last nMajorityWindow block indexes.
+    unsigned int nVersionTally[3];
+
     void SetNull()
     {
         phashBlock = NULL;
         pprev = NULL;
         pskip = NULL;
+        for (int k = 0; k < nAncestorLevels; k++)
+            pancestors[k] = NULL;
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -161,6 +179,8 @@ public:
         nChainTx = 0;
         nStatus = 0;
         nSequenceId = 0;
+        for (int k = 0; k < 3; k++)
+            nVersionTally[k] = 0;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -285,6 +305,9 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Fill nVersionTally from pprev; requires the parent's tally to be built.
+    void BuildVersionTally();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
@@ -294,6 +317,25 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 
+/** Chunked arena for CBlockIndex allocations. The block index holds one
+ *  entry per known header (around a million on mainnet) and entries live
+ *  until UnloadBlockIndex, so they are carved out of large contiguous
+ *  chunks instead of being individual heap allocations. This removes the
+ *  per-entry allocator overhead and keeps entries packed together, so
+ *  pprev/pskip chain walks touch far fewer cache lines. FreeAll releases
+ *  the chunks wholesale when the whole index is unloaded. */
+class CBlockIndexPool
+{
+public:
+    static CBlockIndex* New();
+    static CBlockIndex* New(const CBlockHeader& block);
+    static void FreeAll();
+    static size_t MemoryUsage();
+
+private:
+    static void* Allocate();
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
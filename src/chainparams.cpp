@@ -13,6 +13,7 @@
 #include <assert.h>
 
 #include <boost/assign/list_of.hpp>
+#include <limits>
 #include <stdio.h>
 
 #include "chainparamsseeds.h"
@@ -134,6 +135,8 @@ public:
         consensus.nOriginalClaimExpirationTime = 262974;
         consensus.nExtendedClaimExpirationTime = 2102400;
         consensus.nExtendedClaimExpirationForkHeight = 400155;
+        // dual-commitment window not yet scheduled on mainnet
+        consensus.nClaimTrieCompactHashForkHeight = std::numeric_limits<int64_t>::max();
         consensus.fPowAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
         consensus.nRuleChangeActivationThreshold = 1916; // 95% of 2016
@@ -221,6 +224,8 @@ public:
         consensus.nOriginalClaimExpirationTime = 262974;
         consensus.nExtendedClaimExpirationTime = 2102400;
         consensus.nExtendedClaimExpirationForkHeight = 278160;
+        // dual-commitment window not yet scheduled on testnet
+        consensus.nClaimTrieCompactHashForkHeight = std::numeric_limits<int64_t>::max();
         consensus.fPowAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = false;
         consensus.nRuleChangeActivationThreshold = 1512; // 75% for testchains
@@ -301,6 +306,8 @@ public:
         consensus.nOriginalClaimExpirationTime = 500;
         consensus.nExtendedClaimExpirationTime = 600;
         consensus.nExtendedClaimExpirationForkHeight = 800;
+        // active from genesis so the dual-computation machinery is exercised
+        consensus.nClaimTrieCompactHashForkHeight = 1;
         consensus.fPowAllowMinDifficultyBlocks = false;
         consensus.fPowNoRetargeting = false;
         consensus.nRuleChangeActivationThreshold = 108; // 75% for testchains
@@ -65,6 +65,14 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Sequence used to hand each worker a stable id on its first iteration.
+    int nWorkerSeq;
+
+    //! Workers with id >= this park instead of taking work; -1 means no
+    //! limit. Lets the active budget shrink at runtime without tearing the
+    //! spawned threads down.
+    int nMaxActiveWorkers;
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
@@ -73,6 +81,7 @@ private:
         vChecks.reserve(nBatchSize);
         unsigned int nNow = 0;
         bool fOk = true;
+        int nWorkerId = -1;
         do {
             {
                 boost::unique_lock<boost::mutex> lock(mutex);
@@ -86,9 +95,13 @@ private:
                 } else {
                     // first iteration
                     nTotal++;
+                    if (!fMaster)
+                        nWorkerId = nWorkerSeq++;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
+                // logically, the do loop starts here; a worker beyond the
+                // active budget keeps waiting even while work is queued
+                while (queue.empty() ||
+                       (!fMaster && nMaxActiveWorkers >= 0 && nWorkerId >= nMaxActiveWorkers)) {
                     if ((fMaster || fQuit) && nTodo == 0) {
                         nTotal--;
                         bool fRet = fAllOk;
@@ -128,7 +141,18 @@ private:
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), nWorkerSeq(0), nMaxActiveWorkers(-1) {}
+
+    //! Limit how many workers take part in verification (-1 for all).
+    //! Parked workers stay alive and resume when the limit is raised.
+    void SetMaxActiveWorkers(int nMax)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nMaxActiveWorkers = nMax;
+        }
+        condWorker.notify_all();
+    }
 
     //! Worker thread
     void Thread()
@@ -180,6 +204,23 @@ private:
     CCheckQueue<T>* pqueue;
     bool fDone;
 
+    //! Checks accumulated locally and handed to the queue in bulk. The
+    //! master used to take the queue mutex once per transaction, which is
+    //! where the contention at high worker counts actually came from;
+    //! buffering amortizes that to one acquisition per BUFFER_FLUSH_SIZE
+    //! checks without touching the worker loop.
+    std::vector<T> vBuffered;
+
+    static const unsigned int BUFFER_FLUSH_SIZE = 64;
+
+    void Flush()
+    {
+        if (!vBuffered.empty()) {
+            pqueue->Add(vBuffered);
+            vBuffered.clear();
+        }
+    }
+
 public:
     CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
@@ -194,6 +235,7 @@ public:
     {
         if (pqueue == NULL)
             return true;
+        Flush();
         bool fRet = pqueue->Wait();
         fDone = true;
         return fRet;
@@ -201,8 +243,14 @@ public:
 
     void Add(std::vector<T>& vChecks)
     {
-        if (pqueue != NULL)
-            pqueue->Add(vChecks);
+        if (pqueue == NULL)
+            return;
+        for (size_t i = 0; i < vChecks.size(); i++) {
+            vBuffered.push_back(T());
+            vChecks[i].swap(vBuffered.back());
+        }
+        if (vBuffered.size() >= BUFFER_FLUSH_SIZE)
+            Flush();
     }
 
     ~CCheckQueueControl()
@@ -1,11 +1,74 @@
 #include "claimtrie.h"
 #include "coins.h"
 #include "hash.h"
+#include "memusage.h"
+#include "perf.h"
+#include "sync.h"
+#include "trace.h"
 
+#include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 #include <algorithm>
 
+int nClaimTrieHashThreads = DEFAULT_CLAIMTRIE_HASH_THREADS;
+
+CClaimTrieStats claimTrieStats;
+
+/** Number of CClaimTrieNode slots carved out of each pool chunk */
+static const size_t POOL_CHUNK_NODES = 4096;
+
+static CCriticalSection cs_nodePool;
+static std::vector<void*> vNodeFreeList;
+static std::vector<char*> vNodeChunks;
+static size_t nNodesUsedInLastChunk = POOL_CHUNK_NODES;
+
+void* CClaimTrieNodePool::Allocate()
+{
+    LOCK(cs_nodePool);
+    if (!vNodeFreeList.empty())
+    {
+        void* slot = vNodeFreeList.back();
+        vNodeFreeList.pop_back();
+        return slot;
+    }
+    if (nNodesUsedInLastChunk == POOL_CHUNK_NODES)
+    {
+        vNodeChunks.push_back(new char[POOL_CHUNK_NODES * sizeof(CClaimTrieNode)]);
+        nNodesUsedInLastChunk = 0;
+    }
+    return vNodeChunks.back() + (nNodesUsedInLastChunk++) * sizeof(CClaimTrieNode);
+}
+
+CClaimTrieNode* CClaimTrieNodePool::New()
+{
+    return new (Allocate()) CClaimTrieNode();
+}
+
+CClaimTrieNode* CClaimTrieNodePool::New(const CClaimTrieNode& other)
+{
+    return new (Allocate()) CClaimTrieNode(other);
+}
+
+size_t CClaimTrieNodePool::MemoryUsage()
+{
+    LOCK(cs_nodePool);
+    return vNodeChunks.size() * POOL_CHUNK_NODES * sizeof(CClaimTrieNode);
+}
+
+void CClaimTrieNodePool::Free(CClaimTrieNode* node)
+{
+    if (!node)
+        return;
+    node->~CClaimTrieNode();
+    LOCK(cs_nodePool);
+    vNodeFreeList.push_back(node);
+}
+
+/** Minimum number of dirty nodes at one depth before fanning out to threads */
+static const size_t MIN_PARALLEL_HASH_NODES = 64;
+
 std::vector<unsigned char> heightToVch(int n)
 {
     std::vector<unsigned char> vchHeight;
@@ -23,36 +86,70 @@ std::vector<unsigned char> heightToVch(int n)
 
 uint256 getValueHash(COutPoint outPoint, int nHeightOfLastTakeover)
 {
-    CHash256 txHasher;
-    txHasher.Write(outPoint.hash.begin(), outPoint.hash.size());
-    std::vector<unsigned char> vchtxHash(txHasher.OUTPUT_SIZE);
-    txHasher.Finalize(&(vchtxHash[0]));
-        
-    CHash256 nOutHasher;
-    std::stringstream ss;
-    ss << outPoint.n;
-    std::string snOut = ss.str();
-    nOutHasher.Write((unsigned char*) snOut.data(), snOut.size());
-    std::vector<unsigned char> vchnOutHash(nOutHasher.OUTPUT_SIZE);
-    nOutHasher.Finalize(&(vchnOutHash[0]));
-
-    CHash256 takeoverHasher;
-    std::vector<unsigned char> vchTakeoverHeightToHash = heightToVch(nHeightOfLastTakeover);
-    takeoverHasher.Write(vchTakeoverHeightToHash.data(), vchTakeoverHeightToHash.size());
-    std::vector<unsigned char> vchTakeoverHash(takeoverHasher.OUTPUT_SIZE);
-    takeoverHasher.Finalize(&(vchTakeoverHash[0]));
+    // Runs for every claim-bearing node in the trie hashing pass, so the
+    // whole computation stays on stack buffers.
+    unsigned char vchHashes[3 * CHash256::OUTPUT_SIZE];
 
-    CHash256 hasher;
-    hasher.Write(vchtxHash.data(), vchtxHash.size());
-    hasher.Write(vchnOutHash.data(), vchnOutHash.size());
-    hasher.Write(vchTakeoverHash.data(), vchTakeoverHash.size());
-    std::vector<unsigned char> vchHash(hasher.OUTPUT_SIZE);
-    hasher.Finalize(&(vchHash[0]));
-    
-    uint256 valueHash(vchHash);
+    CHash256().Write(outPoint.hash.begin(), outPoint.hash.size()).Finalize(vchHashes);
+
+    char snOut[16];
+    int nOutLen = snprintf(snOut, sizeof(snOut), "%u", outPoint.n);
+    CHash256().Write((const unsigned char*)snOut, nOutLen).Finalize(vchHashes + CHash256::OUTPUT_SIZE);
+
+    unsigned char vchHeight[8];
+    uint32_t n = nHeightOfLastTakeover;
+    vchHeight[0] = vchHeight[1] = vchHeight[2] = vchHeight[3] = 0;
+    vchHeight[4] = n >> 24;
+    vchHeight[5] = n >> 16;
+    vchHeight[6] = n >> 8;
+    vchHeight[7] = n;
+    CHash256().Write(vchHeight, sizeof(vchHeight)).Finalize(vchHashes + 2 * CHash256::OUTPUT_SIZE);
+
+    uint256 valueHash;
+    CHash256().Write(vchHashes, sizeof(vchHashes)).Finalize(valueHash.begin());
     return valueHash;
 }
 
+uint256 getValueHashCompact(const COutPoint& outPoint, int nHeightOfLastTakeover)
+{
+    // fixed layout: txid || LE32 vout || LE32 takeover height, one SHA256
+    unsigned char vchData[40];
+    memcpy(vchData, outPoint.hash.begin(), outPoint.hash.size());
+    WriteLE32(vchData + 32, outPoint.n);
+    WriteLE32(vchData + 36, (uint32_t)nHeightOfLastTakeover);
+    uint256 valueHash;
+    CSHA256().Write(vchData, sizeof(vchData)).Finalize(valueHash.begin());
+    return valueHash;
+}
+
+/** Compact subtree commitment: single SHA256 over the child entries (1-byte
+ *  character || 32-byte child commitment) followed by the 32-byte compact
+ *  value hash when the node carries a claim. Memoized on the node and
+ *  invalidated whenever the node is mutated at flush; distinct dirty
+ *  positions own disjoint clean subtrees, so the lazy fill is safe from
+ *  the parallel hashing workers without locks. */
+static uint256 compactHashForSubtree(CClaimTrieNode* node)
+{
+    if (!node->hashCompact.IsNull())
+        return node->hashCompact;
+    std::vector<unsigned char> vchToHash;
+    vchToHash.reserve(node->children.size() * 33 + 32);
+    for (nodeMapType::iterator it = node->children.begin(); it != node->children.end(); ++it)
+    {
+        vchToHash.push_back(it->first);
+        uint256 childHash = compactHashForSubtree(it->second);
+        vchToHash.insert(vchToHash.end(), childHash.begin(), childHash.end());
+    }
+    CClaimValue claim;
+    if (node->getBestClaim(claim))
+    {
+        uint256 valueHash = getValueHashCompact(claim.outPoint, node->nHeightOfLastTakeover);
+        vchToHash.insert(vchToHash.end(), valueHash.begin(), valueHash.end());
+    }
+    CSHA256().Write(vchToHash.data(), vchToHash.size()).Finalize(node->hashCompact.begin());
+    return node->hashCompact;
+}
+
 bool CClaimTrieNode::insertClaim(CClaimValue claim)
 {
     LogPrintf("%s: Inserting %s:%d (amount: %d)  into the claim trie\n", __func__, claim.outPoint.hash.ToString(), claim.outPoint.n, claim.nAmount);
@@ -134,7 +231,13 @@ void CClaimTrieNode::reorderClaims(supportMapEntryType& supports)
         }
     }
     
-    std::make_heap(claims.begin(), claims.end());
+    // Keep the whole vector ordered by descending effective amount rather
+    // than heap-ordered: the winner is still claims.front(), but consumers
+    // that list a name's claims (getclaimsforname and friends) get them in
+    // rank order without re-sorting on every query. operator< is a strict
+    // total order (amount, then height, then outpoint), so the front
+    // element is the same one make_heap used to surface.
+    std::sort(claims.rbegin(), claims.rend());
 }
 
 uint256 CClaimTrie::getMerkleHash()
@@ -142,6 +245,13 @@ uint256 CClaimTrie::getMerkleHash()
     return root.hash;
 }
 
+uint256 CClaimTrie::getMerkleHashCompact()
+{
+    if (empty())
+        return uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+    return compactHashForSubtree(&root);
+}
+
 bool CClaimTrie::empty() const
 {
     return root.empty();
@@ -173,6 +283,7 @@ template<typename K> bool CClaimTrie::keyTypeEmpty(char keyType, K& dummy) const
 
 bool CClaimTrie::queueEmpty() const
 {
+    waitForPendingFlush();
     for (claimQueueType::const_iterator itRow = dirtyQueueRows.begin(); itRow != dirtyQueueRows.end(); ++itRow)
     {
         if (!itRow->second.empty())
@@ -184,6 +295,7 @@ bool CClaimTrie::queueEmpty() const
 
 bool CClaimTrie::expirationQueueEmpty() const
 {
+    waitForPendingFlush();
     for (expirationQueueType::const_iterator itRow = dirtyExpirationQueueRows.begin(); itRow != dirtyExpirationQueueRows.end(); ++itRow)
     {
         if (!itRow->second.empty())
@@ -195,6 +307,7 @@ bool CClaimTrie::expirationQueueEmpty() const
 
 bool CClaimTrie::supportEmpty() const
 {
+    waitForPendingFlush();
     for (supportMapType::const_iterator itNode = dirtySupportNodes.begin(); itNode != dirtySupportNodes.end(); ++itNode)
     {
         if (!itNode->second.empty())
@@ -206,6 +319,7 @@ bool CClaimTrie::supportEmpty() const
 
 bool CClaimTrie::supportQueueEmpty() const
 {
+    waitForPendingFlush();
     for (supportQueueType::const_iterator itRow = dirtySupportQueueRows.begin(); itRow != dirtySupportQueueRows.end(); ++itRow)
     {
         if (!itRow->second.empty())
@@ -215,6 +329,18 @@ bool CClaimTrie::supportQueueEmpty() const
     return keyTypeEmpty(SUPPORT_QUEUE_ROW, dummy);
 }
 
+bool CClaimTrie::supportExpirationQueueEmpty() const
+{
+    waitForPendingFlush();
+    for (expirationQueueType::const_iterator itRow = dirtySupportExpirationQueueRows.begin(); itRow != dirtySupportExpirationQueueRows.end(); ++itRow)
+    {
+        if (!itRow->second.empty())
+            return false;
+    }
+    int dummy;
+    return keyTypeEmpty(SUPPORT_EXP_QUEUE_ROW, dummy);
+}
+
 void CClaimTrie::setExpirationTime(int t)
 {
     nExpirationTime = t;
@@ -223,7 +349,12 @@ void CClaimTrie::setExpirationTime(int t)
 
 void CClaimTrie::clear()
 {
+    resolveCache.clear();
     clear(&root);
+    nTotalNames = 0;
+    nTotalClaims = 0;
+    nTotalClaimsValue = 0;
+    nTotalControllingValue = 0;
 }
 
 void CClaimTrie::clear(CClaimTrieNode* current)
@@ -231,8 +362,9 @@ void CClaimTrie::clear(CClaimTrieNode* current)
     for (nodeMapType::const_iterator itchildren = current->children.begin(); itchildren != current->children.end(); ++itchildren)
     {
         clear(itchildren->second);
-        delete itchildren->second;
+        CClaimTrieNodePool::Free(itchildren->second);
     }
+    current->children.clear();
 }
 
 bool CClaimTrie::haveClaim(const std::string& name, const COutPoint& outPoint) const
@@ -245,6 +377,11 @@ bool CClaimTrie::haveClaim(const std::string& name, const COutPoint& outPoint) c
             return false;
         current = itchildren->second;
     }
+    if (current->haveClaim(outPoint))
+        return true;
+    // the outpoint may be one of the shed non-winning claims
+    if (current->nShedClaims == 0 || !restoreShedClaims(name, current))
+        return false;
     return current->haveClaim(outPoint);
 }
 
@@ -341,12 +478,100 @@ bool CClaimTrie::haveSupportInQueue(const std::string& name, const COutPoint& ou
     return false;
 }
 
+void CClaimTrie::statsAddNodeClaims(const std::vector<CClaimValue>& claims)
+{
+    if (claims.empty())
+        return;
+    nTotalNames += 1;
+    nTotalClaims += claims.size();
+    for (std::vector<CClaimValue>::const_iterator itclaim = claims.begin(); itclaim != claims.end(); ++itclaim)
+        nTotalClaimsValue += itclaim->nAmount;
+    nTotalControllingValue += claims.front().nAmount;
+}
+
+void CClaimTrie::statsRemoveNodeClaims(const std::vector<CClaimValue>& claims)
+{
+    if (claims.empty())
+        return;
+    nTotalNames -= 1;
+    nTotalClaims -= claims.size();
+    for (std::vector<CClaimValue>::const_iterator itclaim = claims.begin(); itclaim != claims.end(); ++itclaim)
+        nTotalClaimsValue -= itclaim->nAmount;
+    nTotalControllingValue -= claims.front().nAmount;
+}
+
+void CClaimTrie::statsDropShedClaims(CClaimTrieNode* node)
+{
+    if (node->nShedClaims == 0)
+        return;
+    // the shed tail is being discarded without ever coming back into
+    // memory, so fold its share out of the aggregates directly
+    nTotalClaims -= node->nShedClaims;
+    nTotalClaimsValue -= node->nShedValue;
+    node->nShedClaims = 0;
+    node->nShedValue = 0;
+}
+
+void CClaimTrie::recomputeClaimsStats()
+{
+    nTotalNames = empty() ? 0 : getTotalNamesRecursive(&root);
+    nTotalClaims = empty() ? 0 : getTotalClaimsRecursive(&root);
+    nTotalClaimsValue = empty() ? 0 : getTotalValueOfClaimsRecursive(&root, false);
+    nTotalControllingValue = empty() ? 0 : getTotalValueOfClaimsRecursive(&root, true);
+}
+
+void CClaimTrie::recursiveShedClaimPayloads(CClaimTrieNode* current, uint64_t& nNodesShed, uint64_t& nClaimsShed)
+{
+    if (current->claims.size() > 1)
+    {
+        for (std::vector<CClaimValue>::const_iterator itclaim = current->claims.begin() + 1; itclaim != current->claims.end(); ++itclaim)
+        {
+            current->nShedClaims++;
+            current->nShedValue += itclaim->nAmount;
+        }
+        current->claims.resize(1);
+        // resize() keeps the old capacity; swap with a right-sized copy to
+        // actually give the memory back
+        std::vector<CClaimValue>(current->claims).swap(current->claims);
+        nNodesShed++;
+        nClaimsShed += current->nShedClaims;
+    }
+    for (nodeMapType::iterator it = current->children.begin(); it != current->children.end(); ++it)
+        recursiveShedClaimPayloads(it->second, nNodesShed, nClaimsShed);
+}
+
+void CClaimTrie::shedClaimPayloads()
+{
+    uint64_t nNodesShed = 0;
+    uint64_t nClaimsShed = 0;
+    recursiveShedClaimPayloads(&root, nNodesShed, nClaimsShed);
+    LogPrintf("%s: shed %u non-winning claims from %u nodes; they will be reloaded from disk on demand\n",
+              __func__, nClaimsShed, nNodesShed);
+}
+
+bool CClaimTrie::restoreShedClaims(const std::string& name, const CClaimTrieNode* node) const
+{
+    if (node->nShedClaims == 0)
+        return true;
+    CClaimTrieNode diskNode;
+    if (!db.Read(std::make_pair(TRIE_NODE, name), diskNode))
+        return error("%s(): failed to reload shed claims for %s", __func__, name);
+    // shed nodes are always clean, so the row holds the same list the node
+    // was loaded with; swapping it back in does not change observable state
+    CClaimTrieNode* target = const_cast<CClaimTrieNode*>(node);
+    target->claims.swap(diskNode.claims);
+    // nEffectiveAmount is not part of the on-disk format; reset it the way
+    // a fresh reorderClaims would before supports are applied
+    for (std::vector<CClaimValue>::iterator itclaim = target->claims.begin(); itclaim != target->claims.end(); ++itclaim)
+        itclaim->nEffectiveAmount = itclaim->nAmount;
+    target->nShedClaims = 0;
+    target->nShedValue = 0;
+    return true;
+}
+
 unsigned int CClaimTrie::getTotalNamesInTrie() const
 {
-    if (empty())
-        return 0;
-    const CClaimTrieNode* current = &root;
-    return getTotalNamesRecursive(current);
+    return nTotalNames;
 }
 
 unsigned int CClaimTrie::getTotalNamesRecursive(const CClaimTrieNode* current) const
@@ -363,15 +588,12 @@ unsigned int CClaimTrie::getTotalNamesRecursive(const CClaimTrieNode* current) c
 
 unsigned int CClaimTrie::getTotalClaimsInTrie() const
 {
-    if (empty())
-        return 0;
-    const CClaimTrieNode* current = &root;
-    return getTotalClaimsRecursive(current);
+    return nTotalClaims;
 }
 
 unsigned int CClaimTrie::getTotalClaimsRecursive(const CClaimTrieNode* current) const
 {
-    unsigned int claims_in_subtrie = current->claims.size();
+    unsigned int claims_in_subtrie = current->claims.size() + current->nShedClaims;
     for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
     {
         claims_in_subtrie += getTotalClaimsRecursive(it->second);
@@ -381,10 +603,7 @@ unsigned int CClaimTrie::getTotalClaimsRecursive(const CClaimTrieNode* current)
 
 CAmount CClaimTrie::getTotalValueOfClaimsInTrie(bool fControllingOnly) const
 {
-    if (empty())
-        return 0;
-    const CClaimTrieNode* current = &root;
-    return getTotalValueOfClaimsRecursive(current, fControllingOnly);
+    return fControllingOnly ? nTotalControllingValue : nTotalClaimsValue;
 }
 
 CAmount CClaimTrie::getTotalValueOfClaimsRecursive(const CClaimTrieNode* current, bool fControllingOnly) const
@@ -396,6 +615,8 @@ CAmount CClaimTrie::getTotalValueOfClaimsRecursive(const CClaimTrieNode* current
         if (fControllingOnly)
             break;
     }
+    if (!fControllingOnly)
+        value_in_subtrie += current->nShedValue;
     for (nodeMapType::const_iterator itchild = current->children.begin(); itchild != current->children.end(); ++itchild)
      {
          value_in_subtrie += getTotalValueOfClaimsRecursive(itchild->second, fControllingOnly);
@@ -405,6 +626,7 @@ CAmount CClaimTrie::getTotalValueOfClaimsRecursive(const CClaimTrieNode* current
 
 bool CClaimTrie::recursiveFlattenTrie(const std::string& name, const CClaimTrieNode* current, std::vector<namedNodeType>& nodes) const
 {
+    restoreShedClaims(name, current);
     namedNodeType node(name, *current);
     nodes.push_back(node);
     for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
@@ -425,6 +647,68 @@ std::vector<namedNodeType> CClaimTrie::flattenTrie() const
     return nodes;
 }
 
+void CClaimTrie::recursiveCollectClaimedNames(const std::string& name, const CClaimTrieNode* current, const std::string& sStart, size_t nMaxNames, std::vector<namedNodeType>& nodes) const
+{
+    if (nodes.size() >= nMaxNames)
+        return;
+    if (!current->claims.empty() && name >= sStart)
+    {
+        restoreShedClaims(name, current);
+        nodes.push_back(namedNodeType(name, *current));
+    }
+    for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
+    {
+        if (nodes.size() >= nMaxNames)
+            return;
+        std::string sNextName = name;
+        sNextName += static_cast<char>(it->first);
+        // every name in this subtree starts with sNextName, so the whole
+        // subtree can be skipped when it sorts entirely before sStart
+        if (sNextName < sStart && sStart.compare(0, sNextName.size(), sNextName) != 0)
+            continue;
+        recursiveCollectClaimedNames(sNextName, it->second, sStart, nMaxNames, nodes);
+    }
+}
+
+std::vector<namedNodeType> CClaimTrie::getClaimedNames(const std::string& sStart, size_t nMaxNames) const
+{
+    std::vector<namedNodeType> nodes;
+    recursiveCollectClaimedNames("", &root, sStart, nMaxNames, nodes);
+    return nodes;
+}
+
+void CClaimTrie::recursiveCollectNamesByPrefix(const std::string& name, const CClaimTrieNode* current, const std::string& sStart, size_t nMaxNames, std::vector<std::string>& names) const
+{
+    if (names.size() >= nMaxNames)
+        return;
+    if (!current->claims.empty() && name >= sStart)
+        names.push_back(name);
+    for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
+    {
+        if (names.size() >= nMaxNames)
+            return;
+        std::string sNextName = name;
+        sNextName += static_cast<char>(it->first);
+        // every name in this subtree starts with sNextName, so the whole
+        // subtree can be skipped when it sorts entirely before sStart
+        if (sNextName < sStart && sStart.compare(0, sNextName.size(), sNextName) != 0)
+            continue;
+        recursiveCollectNamesByPrefix(sNextName, it->second, sStart, nMaxNames, names);
+    }
+}
+
+std::vector<std::string> CClaimTrie::getNamesByPrefix(const std::string& sPrefix, const std::string& sStart, size_t nMaxNames) const
+{
+    std::vector<std::string> names;
+    // the trie is its own prefix index: the subtree under the prefix node
+    // holds exactly the claimed names beginning with the prefix
+    const CClaimTrieNode* current = getNodeForName(sPrefix);
+    if (!current)
+        return names;
+    recursiveCollectNamesByPrefix(sPrefix, current, sStart < sPrefix ? sPrefix : sStart, nMaxNames, names);
+    return names;
+}
+
 const CClaimTrieNode* CClaimTrie::getNodeForName(const std::string& name) const
 {
     const CClaimTrieNode* current = &root;
@@ -440,10 +724,19 @@ const CClaimTrieNode* CClaimTrie::getNodeForName(const std::string& name) const
 
 bool CClaimTrie::getInfoForName(const std::string& name, CClaimValue& claim) const
 {
+    boost::unordered_map<std::string, CClaimValue>::const_iterator itResolve = resolveCache.find(name);
+    if (itResolve != resolveCache.end())
+    {
+        claim = itResolve->second;
+        return true;
+    }
     const CClaimTrieNode* current = getNodeForName(name);
-    if (current)
+    if (current && current->getBestClaim(claim))
     {
-        return current->getBestClaim(claim);
+        if (resolveCache.size() >= MAX_RESOLVE_CACHE_SIZE)
+            resolveCache.clear();
+        resolveCache[name] = claim;
+        return true;
     }
     return false;
 }
@@ -461,12 +754,15 @@ bool CClaimTrie::getLastTakeoverForName(const std::string& name, int& lastTakeov
 
 claimsForNameType CClaimTrie::getClaimsForName(const std::string& name) const
 {
+    static CStatCounter& counter = StatCounter("claimtrie.lookups");
+    counter.Increment();
     std::vector<CClaimValue> claims;
     std::vector<CSupportValue> supports;
     int nLastTakeoverHeight = 0;
     const CClaimTrieNode* current = getNodeForName(name);
     if (current)
     {
+        restoreShedClaims(name, current);
         if (!current->claims.empty())
         {
             nLastTakeoverHeight = current->nHeightOfLastTakeover;
@@ -526,6 +822,56 @@ claimsForNameType CClaimTrie::getClaimsForName(const std::string& name) const
     return allClaims;
 }
 
+bool CClaimTrie::getPendingClaimsForName(const std::string& name, std::vector<CClaimValue>& claims) const
+{
+    queueNameRowType namedClaimRow;
+    if (!getQueueNameRow(name, namedClaimRow))
+    {
+        return false;
+    }
+    for (queueNameRowType::const_iterator itClaimsForName = namedClaimRow.begin(); itClaimsForName != namedClaimRow.end(); ++itClaimsForName)
+    {
+        claimQueueRowType claimRow;
+        if (getQueueRow(itClaimsForName->nHeight, claimRow))
+        {
+            for (claimQueueRowType::const_iterator itClaimRow = claimRow.begin(); itClaimRow != claimRow.end(); ++itClaimRow)
+            {
+                if (itClaimRow->first == name && itClaimRow->second.outPoint == itClaimsForName->outPoint)
+                {
+                    claims.push_back(itClaimRow->second);
+                    break;
+                }
+            }
+        }
+    }
+    return !claims.empty();
+}
+
+bool CClaimTrie::getPendingSupportsForName(const std::string& name, std::vector<CSupportValue>& supports) const
+{
+    queueNameRowType namedSupportRow;
+    if (!getSupportQueueNameRow(name, namedSupportRow))
+    {
+        return false;
+    }
+    for (queueNameRowType::const_iterator itSupportsForName = namedSupportRow.begin(); itSupportsForName != namedSupportRow.end(); ++itSupportsForName)
+    {
+        supportQueueRowType supportRow;
+        if (getSupportQueueRow(itSupportsForName->nHeight, supportRow))
+        {
+            for (supportQueueRowType::const_iterator itSupportRow = supportRow.begin(); itSupportRow != supportRow.end(); ++itSupportRow)
+            {
+                if (itSupportRow->first == name && itSupportRow->second.outPoint == itSupportsForName->outPoint)
+                {
+                    supports.push_back(itSupportRow->second);
+                    break;
+                }
+            }
+        }
+    }
+    return !supports.empty();
+}
+
 //return effective amount form claim, retuns 0 if claim is not found
 CAmount CClaimTrie::getEffectiveAmountForClaim(const std::string& name, uint160 claimId) const
 {
@@ -553,11 +899,67 @@ CAmount CClaimTrie::getEffectiveAmountForClaim(const std::string& name, uint160
 
 }
 
-bool CClaimTrie::checkConsistency() const
+bool CClaimTrie::checkConsistency(bool fIncremental) const
 {
     if (empty())
+    {
+        subtreesDirtiedSinceCheck.clear();
         return true;
-    return recursiveCheckConsistency(&root);
+    }
+    std::vector<const CClaimTrieNode*> subtrees;
+    for (nodeMapType::const_iterator it = root.children.begin(); it != root.children.end(); ++it)
+    {
+        if (fIncremental && subtreesDirtiedSinceCheck.count(it->first) == 0)
+            continue;
+        subtrees.push_back(it->second);
+    }
+    std::vector<char> results(subtrees.size(), 0);
+    if (nClaimTrieHashThreads > 1 && subtrees.size() > 1)
+    {
+        size_t nShards = std::min(static_cast<size_t>(nClaimTrieHashThreads), subtrees.size());
+        boost::thread_group threads;
+        for (size_t nShard = 0; nShard < nShards; ++nShard)
+            threads.create_thread(boost::bind(&CClaimTrie::checkConsistencyShard, this, &subtrees, nShard, nShards, &results));
+        threads.join_all();
+    }
+    else
+    {
+        checkConsistencyShard(&subtrees, 0, 1, &results);
+    }
+    for (std::vector<char>::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        if (!*it)
+            return false;
+    }
+    // verify the root node itself against its children's stored hashes;
+    // subtrees skipped by an incremental check were vouched for by the
+    // last full check
+    std::vector<unsigned char> vchToHash;
+    for (nodeMapType::const_iterator it = root.children.begin(); it != root.children.end(); ++it)
+    {
+        vchToHash.push_back(it->first);
+        vchToHash.insert(vchToHash.end(), it->second->hash.begin(), it->second->hash.end());
+    }
+    CClaimValue claim;
+    if (root.getBestClaim(claim))
+    {
+        uint256 valueHash = getValueHash(claim.outPoint, root.nHeightOfLastTakeover);
+        vchToHash.insert(vchToHash.end(), valueHash.begin(), valueHash.end());
+    }
+    CHash256 hasher;
+    std::vector<unsigned char> vchHash(hasher.OUTPUT_SIZE);
+    hasher.Write(vchToHash.data(), vchToHash.size());
+    hasher.Finalize(&(vchHash[0]));
+    if (uint256(vchHash) != root.hash)
+        return false;
+    subtreesDirtiedSinceCheck.clear();
+    return true;
+}
+
+void CClaimTrie::checkConsistencyShard(const std::vector<const CClaimTrieNode*>* subtrees, size_t nShard, size_t nShards, std::vector<char>* results) const
+{
+    for (size_t i = nShard; i < subtrees->size(); i += nShards)
+        (*results)[i] = recursiveCheckConsistency((*subtrees)[i]) ? 1 : 0;
 }
 
 bool CClaimTrie::recursiveCheckConsistency(const CClaimTrieNode* node) const
@@ -597,24 +999,47 @@ void CClaimTrie::addToClaimIndex(const std::string& name, const CClaimValue& cla
     CClaimIndexElement element = { name, claim };
     LogPrintf("%s: ClaimIndex[%s] updated %s\n", __func__, claim.claimId.GetHex(), name);
 
-    db.Write(std::make_pair(CLAIM_BY_ID, claim.claimId), element);
+    claimIndex[claim.claimId] = element;
+    dirtyClaimIndexAdds[claim.claimId] = element;
+    dirtyClaimIndexErases.erase(claim.claimId);
 }
 
 void CClaimTrie::removeFromClaimIndex(const CClaimValue& claim)
 {
-    db.Erase(std::make_pair(CLAIM_BY_ID, claim.claimId));
+    claimIndex.erase(claim.claimId);
+    dirtyClaimIndexAdds.erase(claim.claimId);
+    dirtyClaimIndexErases.insert(claim.claimId);
 }
 
 bool CClaimTrie::getClaimById(const uint160 claimId, std::string& name, CClaimValue& claim) const
 {
-    CClaimIndexElement element;
-    if (db.Read(std::make_pair(CLAIM_BY_ID, claimId), element))
+    claimIndexType::const_iterator itIndex = claimIndex.find(claimId);
+    if (itIndex == claimIndex.end())
+        return false;
+    name = itIndex->second.name;
+    claim = itIndex->second.claim;
+    return true;
+}
+
+void CClaimTrie::loadClaimIndex()
+{
+    claimIndex.clear();
+
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->SeekToFirst();
+    while (pcursor->Valid())
     {
-        name = element.name;
-        claim = element.claim;
-        return true;
+        std::pair<char, uint160> key;
+        if (pcursor->GetKey(key) && key.first == CLAIM_BY_ID)
+        {
+            // deserialize in place; the element carries the claim name, so
+            // this saves a string copy per indexed claim
+            if (!pcursor->GetValue(claimIndex[key.second]))
+                claimIndex.erase(key.second);
+        }
+        pcursor->Next();
     }
-    return false;
+    LogPrintf("%s: loaded %u claims into the claim id index\n", __func__, claimIndex.size());
 }
 
 bool CClaimTrie::getQueueRow(int nHeight, claimQueueRowType& row) const
@@ -625,6 +1050,25 @@ bool CClaimTrie::getQueueRow(int nHeight, claimQueueRowType& row) const
         row = itQueueRow->second;
         return true;
     }
+    {
+        LOCK(cs_flushingState);
+        claimQueueType::const_iterator itFlushing = flushingQueueRows.find(nHeight);
+        if (itFlushing != flushingQueueRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
+    if (nHeight == nReadAheadEnd || nReadAheadStart == nReadAheadEnd)
+        readAheadQueues(nHeight);
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        claimQueueType::const_iterator itReadAhead = readAheadClaimRows.find(nHeight);
+        if (itReadAhead == readAheadClaimRows.end())
+            return false;
+        row = itReadAhead->second;
+        return true;
+    }
     return db.Read(std::make_pair(CLAIM_QUEUE_ROW, nHeight), row);
 }
 
@@ -636,6 +1080,15 @@ bool CClaimTrie::getQueueNameRow(const std::string& name, queueNameRowType& row)
         row = itQueueNameRow->second;
         return true;
     }
+    {
+        LOCK(cs_flushingState);
+        queueNameType::const_iterator itFlushing = flushingQueueNameRows.find(name);
+        if (itFlushing != flushingQueueNameRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
     return db.Read(std::make_pair(CLAIM_QUEUE_NAME_ROW, name), row);
 }
 
@@ -647,6 +1100,23 @@ bool CClaimTrie::getExpirationQueueRow(int nHeight, expirationQueueRowType& row)
         row = itQueueRow->second;
         return true;
     }
+    {
+        LOCK(cs_flushingState);
+        expirationQueueType::const_iterator itFlushing = flushingExpirationQueueRows.find(nHeight);
+        if (itFlushing != flushingExpirationQueueRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        expirationQueueType::const_iterator itReadAhead = readAheadExpirationRows.find(nHeight);
+        if (itReadAhead == readAheadExpirationRows.end())
+            return false;
+        row = itReadAhead->second;
+        return true;
+    }
     return db.Read(std::make_pair(EXP_QUEUE_ROW, nHeight), row);
 }
 
@@ -662,6 +1132,13 @@ void CClaimTrie::updateQueueRow(int nHeight, claimQueueRowType& row)
         itQueueRow = ret.first;
     }
     itQueueRow->second.swap(row);
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        if (itQueueRow->second.empty())
+            readAheadClaimRows.erase(nHeight);
+        else
+            readAheadClaimRows[nHeight] = itQueueRow->second;
+    }
 }
 
 void CClaimTrie::updateQueueNameRow(const std::string& name, queueNameRowType& row)
@@ -690,6 +1167,13 @@ void CClaimTrie::updateExpirationRow(int nHeight, expirationQueueRowType& row)
         itQueueRow = ret.first;
     }
     itQueueRow->second.swap(row);
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        if (itQueueRow->second.empty())
+            readAheadExpirationRows.erase(nHeight);
+        else
+            readAheadExpirationRows[nHeight] = itQueueRow->second;
+    }
 }
 
 void CClaimTrie::updateSupportMap(const std::string& name, supportMapEntryType& node)
@@ -718,6 +1202,13 @@ void CClaimTrie::updateSupportQueue(int nHeight, supportQueueRowType& row)
         itQueueRow = ret.first;
     }
     itQueueRow->second.swap(row);
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        if (itQueueRow->second.empty())
+            readAheadSupportRows.erase(nHeight);
+        else
+            readAheadSupportRows[nHeight] = itQueueRow->second;
+    }
 }
 
 void CClaimTrie::updateSupportNameQueue(const std::string& name, queueNameRowType& row)
@@ -734,66 +1225,339 @@ void CClaimTrie::updateSupportNameQueue(const std::string& name, queueNameRowTyp
     itQueueRow->second.swap(row);
 }
 
-void CClaimTrie::updateSupportExpirationQueue(int nHeight, expirationQueueRowType& row)
+void CClaimTrie::updateSupportExpirationQueue(int nHeight, expirationQueueRowType& row)
+{
+    expirationQueueType::iterator itQueueRow = dirtySupportExpirationQueueRows.find(nHeight);
+    if (itQueueRow == dirtySupportExpirationQueueRows.end())
+    {
+        expirationQueueRowType newRow;
+        std::pair<expirationQueueType::iterator, bool> ret;
+        ret = dirtySupportExpirationQueueRows.insert(std::pair<int, expirationQueueRowType >(nHeight, newRow));
+        assert(ret.second);
+        itQueueRow = ret.first;
+    }
+    itQueueRow->second.swap(row);
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        if (itQueueRow->second.empty())
+            readAheadSupportExpirationRows.erase(nHeight);
+        else
+            readAheadSupportExpirationRows[nHeight] = itQueueRow->second;
+    }
+}
+
+void CClaimTrie::readAheadQueues(int nHeight) const
+{
+    readAheadClaimRows.clear();
+    readAheadExpirationRows.clear();
+    readAheadSupportRows.clear();
+    readAheadSupportExpirationRows.clear();
+    nReadAheadStart = nHeight;
+    nReadAheadEnd = nHeight + QUEUE_READ_AHEAD_HEIGHTS;
+    // heights are serialized little-endian, so the keys of one keyspace are
+    // not ordered numerically and a plain range scan cannot be used; batch
+    // the exact window keys instead, which ReadBatch sorts and services
+    // from one iterator pass per keyspace
+    std::vector<std::pair<char, int> > vClaimKeys;
+    std::vector<std::pair<char, int> > vExpKeys;
+    std::vector<std::pair<char, int> > vSupportKeys;
+    std::vector<std::pair<char, int> > vSupportExpKeys;
+    for (int i = nReadAheadStart; i < nReadAheadEnd; ++i)
+    {
+        vClaimKeys.push_back(std::make_pair(CLAIM_QUEUE_ROW, i));
+        vExpKeys.push_back(std::make_pair(EXP_QUEUE_ROW, i));
+        vSupportKeys.push_back(std::make_pair(SUPPORT_QUEUE_ROW, i));
+        vSupportExpKeys.push_back(std::make_pair(SUPPORT_EXP_QUEUE_ROW, i));
+    }
+    std::map<std::pair<char, int>, claimQueueRowType> mapClaimRows;
+    std::map<std::pair<char, int>, expirationQueueRowType> mapExpRows;
+    std::map<std::pair<char, int>, supportQueueRowType> mapSupportRows;
+    std::map<std::pair<char, int>, expirationQueueRowType> mapSupportExpRows;
+    db.ReadBatch(vClaimKeys, mapClaimRows);
+    db.ReadBatch(vExpKeys, mapExpRows);
+    db.ReadBatch(vSupportKeys, mapSupportRows);
+    db.ReadBatch(vSupportExpKeys, mapSupportExpRows);
+    for (std::map<std::pair<char, int>, claimQueueRowType>::iterator it = mapClaimRows.begin(); it != mapClaimRows.end(); ++it)
+        readAheadClaimRows[it->first.second].swap(it->second);
+    for (std::map<std::pair<char, int>, expirationQueueRowType>::iterator it = mapExpRows.begin(); it != mapExpRows.end(); ++it)
+        readAheadExpirationRows[it->first.second].swap(it->second);
+    for (std::map<std::pair<char, int>, supportQueueRowType>::iterator it = mapSupportRows.begin(); it != mapSupportRows.end(); ++it)
+        readAheadSupportRows[it->first.second].swap(it->second);
+    for (std::map<std::pair<char, int>, expirationQueueRowType>::iterator it = mapSupportExpRows.begin(); it != mapSupportExpRows.end(); ++it)
+        readAheadSupportExpirationRows[it->first.second].swap(it->second);
+}
+
+bool CClaimTrie::getSupportNode(std::string name, supportMapEntryType& node) const
+{
+    supportMapType::const_iterator itNode = dirtySupportNodes.find(name);
+    if (itNode != dirtySupportNodes.end())
+    {
+        node = itNode->second;
+        return true;
+    }
+    {
+        LOCK(cs_flushingState);
+        supportMapType::const_iterator itFlushing = flushingSupportNodes.find(name);
+        if (itFlushing != flushingSupportNodes.end())
+        {
+            node = itFlushing->second;
+            return true;
+        }
+    }
+    bool fFound = false;
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(std::make_pair(SUPPORT, std::make_pair(name, COutPoint(uint256(), 0))));
+    while (pcursor->Valid())
+    {
+        std::pair<char, std::pair<std::string, COutPoint> > key;
+        if (!pcursor->GetKey(key) || key.first != SUPPORT || key.second.first != name)
+            break;
+        CSupportValue support;
+        if (pcursor->GetValue(support))
+        {
+            node.push_back(support);
+            fFound = true;
+        }
+        pcursor->Next();
+    }
+    if (fFound)
+        return true;
+    // fall back to the whole-row record written before supports were
+    // keyed individually
+    return db.Read(std::make_pair(SUPPORT, name), node);
+}
+
+bool CClaimTrie::getSupportQueueRow(int nHeight, supportQueueRowType& row) const
+{
+    supportQueueType::const_iterator itQueueRow = dirtySupportQueueRows.find(nHeight);
+    if (itQueueRow != dirtySupportQueueRows.end())
+    {
+        row = itQueueRow->second;
+        return true;
+    }
+    {
+        LOCK(cs_flushingState);
+        supportQueueType::const_iterator itFlushing = flushingSupportQueueRows.find(nHeight);
+        if (itFlushing != flushingSupportQueueRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        supportQueueType::const_iterator itReadAhead = readAheadSupportRows.find(nHeight);
+        if (itReadAhead == readAheadSupportRows.end())
+            return false;
+        row = itReadAhead->second;
+        return true;
+    }
+    return db.Read(std::make_pair(SUPPORT_QUEUE_ROW, nHeight), row);
+}
+
+bool CClaimTrie::getSupportQueueNameRow(const std::string& name, queueNameRowType& row) const
+{
+    queueNameType::const_iterator itQueueNameRow = dirtySupportQueueNameRows.find(name);
+    if (itQueueNameRow != dirtySupportQueueNameRows.end())
+    {
+        row = itQueueNameRow->second;
+        return true;
+    }
+    {
+        LOCK(cs_flushingState);
+        queueNameType::const_iterator itFlushing = flushingSupportQueueNameRows.find(name);
+        if (itFlushing != flushingSupportQueueNameRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
+    return db.Read(std::make_pair(SUPPORT_QUEUE_NAME_ROW, name), row);
+}
+
+bool CClaimTrie::getSupportExpirationQueueRow(int nHeight, expirationQueueRowType& row) const
+{
+    expirationQueueType::const_iterator itQueueRow = dirtySupportExpirationQueueRows.find(nHeight);
+    if (itQueueRow != dirtySupportExpirationQueueRows.end())
+    {
+        row = itQueueRow->second;
+        return true;
+    }
+    {
+        LOCK(cs_flushingState);
+        expirationQueueType::const_iterator itFlushing = flushingSupportExpirationQueueRows.find(nHeight);
+        if (itFlushing != flushingSupportExpirationQueueRows.end())
+        {
+            row = itFlushing->second;
+            return true;
+        }
+    }
+    if (nHeight >= nReadAheadStart && nHeight < nReadAheadEnd)
+    {
+        expirationQueueType::const_iterator itReadAhead = readAheadSupportExpirationRows.find(nHeight);
+        if (itReadAhead == readAheadSupportExpirationRows.end())
+            return false;
+        row = itReadAhead->second;
+        return true;
+    }
+    return db.Read(std::make_pair(SUPPORT_EXP_QUEUE_ROW, nHeight), row);
+}
+
+bool CClaimTrie::getClaimOpJournal(int nHeight, claimOpJournalRowType& row) const
+{
+    return db.Read(std::make_pair(CLAIM_OP_JOURNAL_ROW, nHeight), row);
+}
+
+void CClaimTrie::writeClaimOpJournal(int nHeight, const claimOpJournalRowType& row)
+{
+    if (row.empty())
+        db.Erase(std::make_pair(CLAIM_OP_JOURNAL_ROW, nHeight));
+    else
+        db.Write(std::make_pair(CLAIM_OP_JOURNAL_ROW, nHeight), row);
+}
+
+void CClaimTrie::eraseClaimOpJournal(int nHeight)
+{
+    db.Erase(std::make_pair(CLAIM_OP_JOURNAL_ROW, nHeight));
+}
+
+bool CClaimTrie::getClaimHistory(const std::string& name, claimHistoryRowType& row) const
 {
-    expirationQueueType::iterator itQueueRow = dirtySupportExpirationQueueRows.find(nHeight);
-    if (itQueueRow == dirtySupportExpirationQueueRows.end())
-    {
-        expirationQueueRowType newRow;
-        std::pair<expirationQueueType::iterator, bool> ret;
-        ret = dirtySupportExpirationQueueRows.insert(std::pair<int, expirationQueueRowType >(nHeight, newRow));
-        assert(ret.second);
-        itQueueRow = ret.first;
-    }
-    itQueueRow->second.swap(row);
+    return db.Read(std::make_pair(CLAIM_HISTORY_ROW, name), row);
 }
 
-bool CClaimTrie::getSupportNode(std::string name, supportMapEntryType& node) const
+void CClaimTrie::appendClaimHistory(int nHeight, const claimOpJournalRowType& vOps)
 {
-    supportMapType::const_iterator itNode = dirtySupportNodes.find(name);
-    if (itNode != dirtySupportNodes.end())
+    if (vOps.empty())
+        return;
+    std::map<std::string, claimHistoryRowType> mapRows;
+    for (claimOpJournalRowType::const_iterator it = vOps.begin(); it != vOps.end(); ++it)
     {
-        node = itNode->second;
-        return true;
+        std::map<std::string, claimHistoryRowType>::iterator itRow = mapRows.find(it->name);
+        if (itRow == mapRows.end())
+        {
+            claimHistoryRowType row;
+            getClaimHistory(it->name, row);
+            itRow = mapRows.insert(std::make_pair(it->name, row)).first;
+        }
+        itRow->second.push_back(CClaimHistoryEntry(nHeight, it->nOp, it->outPoint, it->claimId, it->nAmount));
     }
-    return db.Read(std::make_pair(SUPPORT, name), node);
+    CDBBatch batch(&db.GetObfuscateKey());
+    for (std::map<std::string, claimHistoryRowType>::const_iterator itRow = mapRows.begin(); itRow != mapRows.end(); ++itRow)
+        batch.Write(std::make_pair(CLAIM_HISTORY_ROW, itRow->first), itRow->second);
+    db.WriteBatch(batch);
 }
 
-bool CClaimTrie::getSupportQueueRow(int nHeight, supportQueueRowType& row) const
+void CClaimTrie::trimClaimHistory(int nHeight, const std::set<std::string>& names)
 {
-    supportQueueType::const_iterator itQueueRow = dirtySupportQueueRows.find(nHeight);
-    if (itQueueRow != dirtySupportQueueRows.end())
+    CDBBatch batch(&db.GetObfuscateKey());
+    for (std::set<std::string>::const_iterator itName = names.begin(); itName != names.end(); ++itName)
     {
-        row = itQueueRow->second;
-        return true;
+        claimHistoryRowType row;
+        if (!getClaimHistory(*itName, row))
+            continue;
+        // disconnects walk the chain tip-down, so everything at or past
+        // the disconnected height is stale
+        while (!row.empty() && row.back().nHeight >= nHeight)
+            row.pop_back();
+        if (row.empty())
+            batch.Erase(std::make_pair(CLAIM_HISTORY_ROW, *itName));
+        else
+            batch.Write(std::make_pair(CLAIM_HISTORY_ROW, *itName), row);
     }
-    return db.Read(std::make_pair(SUPPORT_QUEUE_ROW, nHeight), row);
+    db.WriteBatch(batch);
 }
 
-bool CClaimTrie::getSupportQueueNameRow(const std::string& name, queueNameRowType& row) const
+bool CClaimTrie::getClaimsForScriptHash(const uint160& hashScript, std::vector<uint160>& claimIds) const
 {
-    queueNameType::const_iterator itQueueNameRow = dirtySupportQueueNameRows.find(name);
-    if (itQueueNameRow != dirtySupportQueueNameRows.end())
+    return db.Read(std::make_pair(CLAIM_SCRIPT_INDEX_ROW, hashScript), claimIds);
+}
+
+void CClaimTrie::applyClaimScriptIndexOps(const std::vector<CClaimScriptIndexOp>& vOps)
+{
+    if (vOps.empty())
+        return;
+    std::map<uint160, std::vector<uint160> > mapRows;
+    for (std::vector<CClaimScriptIndexOp>::const_iterator it = vOps.begin(); it != vOps.end(); ++it)
     {
-        row = itQueueNameRow->second;
-        return true;
+        std::map<uint160, std::vector<uint160> >::iterator itRow = mapRows.find(it->hashScript);
+        if (itRow == mapRows.end())
+        {
+            std::vector<uint160> row;
+            getClaimsForScriptHash(it->hashScript, row);
+            itRow = mapRows.insert(std::make_pair(it->hashScript, row)).first;
+        }
+        std::vector<uint160>::iterator itId = std::find(itRow->second.begin(), itRow->second.end(), it->claimId);
+        if (it->fAdd)
+        {
+            if (itId == itRow->second.end())
+                itRow->second.push_back(it->claimId);
+        }
+        else if (itId != itRow->second.end())
+            itRow->second.erase(itId);
     }
-    return db.Read(std::make_pair(SUPPORT_QUEUE_NAME_ROW, name), row);
+    CDBBatch batch(&db.GetObfuscateKey());
+    for (std::map<uint160, std::vector<uint160> >::const_iterator itRow = mapRows.begin(); itRow != mapRows.end(); ++itRow)
+    {
+        if (itRow->second.empty())
+            batch.Erase(std::make_pair(CLAIM_SCRIPT_INDEX_ROW, itRow->first));
+        else
+            batch.Write(std::make_pair(CLAIM_SCRIPT_INDEX_ROW, itRow->first), itRow->second);
+    }
+    db.WriteBatch(batch);
 }
 
-bool CClaimTrie::getSupportExpirationQueueRow(int nHeight, expirationQueueRowType& row) const
+void CClaimTrie::getExpirationForecast(int nStartHeight, int nEndHeight, expirationQueueType& mapClaimExpirations, expirationQueueType& mapSupportExpirations) const
 {
-    expirationQueueType::const_iterator itQueueRow = dirtySupportExpirationQueueRows.find(nHeight);
-    if (itQueueRow != dirtySupportExpirationQueueRows.end())
+    // heights are serialized little-endian, so a plain range scan over one
+    // keyspace cannot be used (see readAheadQueues); batch the exact window
+    // keys instead, then overlay the flushing and dirty caches, which
+    // supersede what is on disk
+    std::vector<std::pair<char, int> > vExpKeys;
+    std::vector<std::pair<char, int> > vSupportExpKeys;
+    for (int i = nStartHeight; i < nEndHeight; ++i)
     {
-        row = itQueueRow->second;
-        return true;
+        vExpKeys.push_back(std::make_pair(EXP_QUEUE_ROW, i));
+        vSupportExpKeys.push_back(std::make_pair(SUPPORT_EXP_QUEUE_ROW, i));
+    }
+    std::map<std::pair<char, int>, expirationQueueRowType> mapExpRows;
+    std::map<std::pair<char, int>, expirationQueueRowType> mapSupportExpRows;
+    db.ReadBatch(vExpKeys, mapExpRows);
+    db.ReadBatch(vSupportExpKeys, mapSupportExpRows);
+    for (std::map<std::pair<char, int>, expirationQueueRowType>::iterator it = mapExpRows.begin(); it != mapExpRows.end(); ++it)
+        mapClaimExpirations[it->first.second].swap(it->second);
+    for (std::map<std::pair<char, int>, expirationQueueRowType>::iterator it = mapSupportExpRows.begin(); it != mapSupportExpRows.end(); ++it)
+        mapSupportExpirations[it->first.second].swap(it->second);
+    {
+        LOCK(cs_flushingState);
+        for (int i = nStartHeight; i < nEndHeight; ++i)
+        {
+            expirationQueueType::const_iterator itFlushing = flushingExpirationQueueRows.find(i);
+            if (itFlushing != flushingExpirationQueueRows.end())
+                mapClaimExpirations[i] = itFlushing->second;
+            itFlushing = flushingSupportExpirationQueueRows.find(i);
+            if (itFlushing != flushingSupportExpirationQueueRows.end())
+                mapSupportExpirations[i] = itFlushing->second;
+        }
+    }
+    for (int i = nStartHeight; i < nEndHeight; ++i)
+    {
+        expirationQueueType::const_iterator itDirty = dirtyExpirationQueueRows.find(i);
+        if (itDirty != dirtyExpirationQueueRows.end())
+            mapClaimExpirations[i] = itDirty->second;
+        itDirty = dirtySupportExpirationQueueRows.find(i);
+        if (itDirty != dirtySupportExpirationQueueRows.end())
+            mapSupportExpirations[i] = itDirty->second;
+        if (mapClaimExpirations.count(i) && mapClaimExpirations[i].empty())
+            mapClaimExpirations.erase(i);
+        if (mapSupportExpirations.count(i) && mapSupportExpirations[i].empty())
+            mapSupportExpirations.erase(i);
     }
-    return db.Read(std::make_pair(SUPPORT_EXP_QUEUE_ROW, nHeight), row);
 }
 
-bool CClaimTrie::update(nodeCacheType& cache, hashMapType& hashes, std::map<std::string, int>& takeoverHeights, const uint256& hashBlockIn, claimQueueType& queueCache, queueNameType& queueNameCache, expirationQueueType& expirationQueueCache, int nNewHeight, supportMapType& supportCache, supportQueueType& supportQueueCache, queueNameType& supportQueueNameCache, expirationQueueType& supportExpirationQueueCache)
+bool CClaimTrie::update(nodeCacheType& cache, hashMapType& hashes, hashMapType& compactHashes, std::map<std::string, int>& takeoverHeights, const uint256& hashBlockIn, claimQueueType& queueCache, queueNameType& queueNameCache, expirationQueueType& expirationQueueCache, int nNewHeight, supportMapType& supportCache, supportQueueType& supportQueueCache, queueNameType& supportQueueNameCache, expirationQueueType& supportExpirationQueueCache)
 {
+    resolveCache.clear();
     for (nodeCacheType::iterator itcache = cache.begin(); itcache != cache.end(); ++itcache)
     {
         if (!updateName(itcache->first, itcache->second))
@@ -810,6 +1574,16 @@ bool CClaimTrie::update(nodeCacheType& cache, hashMapType& hashes, std::map<std:
             return false;
         }
     }
+    // applied after the legacy hashes, whose application invalidates the
+    // memoized compact commitment on each touched node
+    for (hashMapType::iterator ithash = compactHashes.begin(); ithash != compactHashes.end(); ++ithash)
+    {
+        if (!updateHashCompact(ithash->first, ithash->second))
+        {
+            LogPrintf("%s: Failed to update compact hash for:%s\n", __func__, ithash->first);
+            return false;
+        }
+    }
     for (std::map<std::string, int>::iterator itheight = takeoverHeights.begin(); itheight != takeoverHeights.end(); ++itheight)
     {
         if (!updateTakeoverHeight(itheight->first, itheight->second))
@@ -853,6 +1627,10 @@ bool CClaimTrie::update(nodeCacheType& cache, hashMapType& hashes, std::map<std:
 
 void CClaimTrie::markNodeDirty(const std::string &name, CClaimTrieNode* node)
 {
+    // a dirty node is rewritten in full at the next flush, so any shed
+    // claims have to be brought back first or the row would lose them
+    if (node)
+        restoreShedClaims(name, node);
     std::pair<nodeCacheType::iterator, bool> ret;
     ret = dirtyNodes.insert(std::pair<std::string, CClaimTrieNode*>(name, node));
     if (ret.second == false)
@@ -861,6 +1639,8 @@ void CClaimTrie::markNodeDirty(const std::string &name, CClaimTrieNode* node)
 
 bool CClaimTrie::updateName(const std::string &name, CClaimTrieNode* updatedNode)
 {
+    if (!name.empty())
+        subtreesDirtiedSinceCheck.insert(static_cast<unsigned char>(name[0]));
     CClaimTrieNode* current = &root;
     for (std::string::const_iterator itname = name.begin(); itname != name.end(); ++itname)
     {
@@ -869,7 +1649,7 @@ bool CClaimTrie::updateName(const std::string &name, CClaimTrieNode* updatedNode
         {
             if (itname + 1 == name.end())
             {
-                CClaimTrieNode* newNode = new CClaimTrieNode();
+                CClaimTrieNode* newNode = CClaimTrieNodePool::New();
                 current->children[*itname] = newNode;
                 current = newNode;
             }
@@ -882,7 +1662,11 @@ bool CClaimTrie::updateName(const std::string &name, CClaimTrieNode* updatedNode
         }
     }
     assert(current != NULL);
+    statsDropShedClaims(current);
+    statsRemoveNodeClaims(current->claims);
     current->claims.swap(updatedNode->claims);
+    statsAddNodeClaims(current->claims);
+    current->hashCompact.SetNull();
     markNodeDirty(name, current);
     for (nodeMapType::iterator itchild = current->children.begin(); itchild != current->children.end();)
     {
@@ -896,7 +1680,7 @@ bool CClaimTrie::updateName(const std::string &name, CClaimTrieNode* updatedNode
             std::string newName = ss.str();
             if (!recursiveNullify(itchild->second, newName))
                 return false;
-            current->children.erase(itchild++);
+            itchild = current->children.erase(itchild);
         }
         else
             ++itchild;
@@ -916,8 +1700,10 @@ bool CClaimTrie::recursiveNullify(CClaimTrieNode* node, std::string& name)
             return false;
     }
     node->children.clear();
+    statsDropShedClaims(node);
+    statsRemoveNodeClaims(node->claims);
     markNodeDirty(name, NULL);
-    delete node;
+    CClaimTrieNodePool::Free(node);
     return true;
 }
 
@@ -933,10 +1719,28 @@ bool CClaimTrie::updateHash(const std::string& name, uint256& hash)
     }
     assert(current != NULL);
     current->hash = hash;
+    current->hashCompact.SetNull();
     markNodeDirty(name, current);
     return true;
 }
 
+bool CClaimTrie::updateHashCompact(const std::string& name, uint256& hash)
+{
+    CClaimTrieNode* current = &root;
+    for (std::string::const_iterator itname = name.begin(); itname != name.end(); ++itname)
+    {
+        nodeMapType::iterator itchild = current->children.find(*itname);
+        if (itchild == current->children.end())
+            return false;
+        current = itchild->second;
+    }
+    assert(current != NULL);
+    // in-memory only; the node is not marked dirty because the compact
+    // commitment is not part of the persisted node format
+    current->hashCompact = hash;
+    return true;
+}
+
 bool CClaimTrie::updateTakeoverHeight(const std::string& name, int nTakeoverHeight)
 {
     CClaimTrieNode* current = &root;
@@ -949,6 +1753,7 @@ bool CClaimTrie::updateTakeoverHeight(const std::string& name, int nTakeoverHeig
     }
     assert(current != NULL);
     current->nHeightOfLastTakeover = nTakeoverHeight;
+    current->hashCompact.SetNull();
     markNodeDirty(name, current);
     return true;
 }
@@ -965,9 +1770,23 @@ void CClaimTrie::BatchWriteNode(CDBBatch& batch, const std::string& name, const
         batch.Erase(std::make_pair(TRIE_NODE, name));
 }
 
+void CClaimTrie::BatchWriteClaimIndex(CDBBatch& batch)
+{
+    for (std::map<uint160, CClaimIndexElement>::iterator itAdds = dirtyClaimIndexAdds.begin(); itAdds != dirtyClaimIndexAdds.end(); ++itAdds)
+    {
+        batch.Write(std::make_pair(CLAIM_BY_ID, itAdds->first), itAdds->second);
+    }
+    dirtyClaimIndexAdds.clear();
+    for (std::set<uint160>::iterator itErases = dirtyClaimIndexErases.begin(); itErases != dirtyClaimIndexErases.end(); ++itErases)
+    {
+        batch.Erase(std::make_pair(CLAIM_BY_ID, *itErases));
+    }
+    dirtyClaimIndexErases.clear();
+}
+
 void CClaimTrie::BatchWriteQueueRows(CDBBatch& batch)
 {
-    for (claimQueueType::iterator itQueue = dirtyQueueRows.begin(); itQueue != dirtyQueueRows.end(); ++itQueue)
+    for (claimQueueType::iterator itQueue = flushingQueueRows.begin(); itQueue != flushingQueueRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -982,7 +1801,7 @@ void CClaimTrie::BatchWriteQueueRows(CDBBatch& batch)
 
 void CClaimTrie::BatchWriteQueueNameRows(CDBBatch& batch)
 {
-    for (queueNameType::iterator itQueue = dirtyQueueNameRows.begin(); itQueue != dirtyQueueNameRows.end(); ++itQueue)
+    for (queueNameType::iterator itQueue = flushingQueueNameRows.begin(); itQueue != flushingQueueNameRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -997,7 +1816,7 @@ void CClaimTrie::BatchWriteQueueNameRows(CDBBatch& batch)
 
 void CClaimTrie::BatchWriteExpirationQueueRows(CDBBatch& batch)
 {
-    for (expirationQueueType::iterator itQueue = dirtyExpirationQueueRows.begin(); itQueue != dirtyExpirationQueueRows.end(); ++itQueue)
+    for (expirationQueueType::iterator itQueue = flushingExpirationQueueRows.begin(); itQueue != flushingExpirationQueueRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -1012,22 +1831,45 @@ void CClaimTrie::BatchWriteExpirationQueueRows(CDBBatch& batch)
 
 void CClaimTrie::BatchWriteSupportNodes(CDBBatch& batch)
 {
-    for (supportMapType::iterator itSupport = dirtySupportNodes.begin(); itSupport != dirtySupportNodes.end(); ++itSupport)
+    // supports are keyed individually by (name, outpoint), so only the
+    // supports that actually changed are written or erased; heavily
+    // supported names no longer have their whole list reserialized on
+    // every add or remove
+    for (supportMapType::iterator itSupport = flushingSupportNodes.begin(); itSupport != flushingSupportNodes.end(); ++itSupport)
     {
-        if (itSupport->second.empty())
+        const std::string& name = itSupport->first;
+        std::map<COutPoint, CSupportValue> mapOnDisk;
+        boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+        pcursor->Seek(std::make_pair(SUPPORT, std::make_pair(name, COutPoint(uint256(), 0))));
+        while (pcursor->Valid())
         {
-            batch.Erase(std::make_pair(SUPPORT, itSupport->first));
+            std::pair<char, std::pair<std::string, COutPoint> > key;
+            if (!pcursor->GetKey(key) || key.first != SUPPORT || key.second.first != name)
+                break;
+            CSupportValue support;
+            if (pcursor->GetValue(support))
+                mapOnDisk[key.second.second] = support;
+            pcursor->Next();
         }
-        else
+        // drop the whole-row record written before supports were keyed
+        // individually, if one is still around
+        batch.Erase(std::make_pair(SUPPORT, name));
+        for (supportMapEntryType::const_iterator itValue = itSupport->second.begin(); itValue != itSupport->second.end(); ++itValue)
         {
-            batch.Write(std::make_pair(SUPPORT, itSupport->first), itSupport->second);
+            std::map<COutPoint, CSupportValue>::iterator itOnDisk = mapOnDisk.find(itValue->outPoint);
+            if (itOnDisk == mapOnDisk.end() || itOnDisk->second != *itValue)
+                batch.Write(std::make_pair(SUPPORT, std::make_pair(name, itValue->outPoint)), *itValue);
+            if (itOnDisk != mapOnDisk.end())
+                mapOnDisk.erase(itOnDisk);
         }
+        for (std::map<COutPoint, CSupportValue>::const_iterator itOnDisk = mapOnDisk.begin(); itOnDisk != mapOnDisk.end(); ++itOnDisk)
+            batch.Erase(std::make_pair(SUPPORT, std::make_pair(name, itOnDisk->first)));
     }
 }
 
 void CClaimTrie::BatchWriteSupportQueueRows(CDBBatch& batch)
 {
-    for (supportQueueType::iterator itQueue = dirtySupportQueueRows.begin(); itQueue != dirtySupportQueueRows.end(); ++itQueue)
+    for (supportQueueType::iterator itQueue = flushingSupportQueueRows.begin(); itQueue != flushingSupportQueueRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -1042,7 +1884,7 @@ void CClaimTrie::BatchWriteSupportQueueRows(CDBBatch& batch)
 
 void CClaimTrie::BatchWriteSupportQueueNameRows(CDBBatch& batch)
 {
-    for (queueNameType::iterator itQueue = dirtySupportQueueNameRows.begin(); itQueue != dirtySupportQueueNameRows.end(); ++itQueue)
+    for (queueNameType::iterator itQueue = flushingSupportQueueNameRows.begin(); itQueue != flushingSupportQueueNameRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -1057,7 +1899,7 @@ void CClaimTrie::BatchWriteSupportQueueNameRows(CDBBatch& batch)
 
 void CClaimTrie::BatchWriteSupportExpirationQueueRows(CDBBatch& batch)
 {
-    for (expirationQueueType::iterator itQueue = dirtySupportExpirationQueueRows.begin(); itQueue != dirtySupportExpirationQueueRows.end(); ++itQueue)
+    for (expirationQueueType::iterator itQueue = flushingSupportExpirationQueueRows.begin(); itQueue != flushingSupportExpirationQueueRows.end(); ++itQueue)
     {
         if (itQueue->second.empty())
         {
@@ -1070,29 +1912,98 @@ void CClaimTrie::BatchWriteSupportExpirationQueueRows(CDBBatch& batch)
     }
 }
 
-bool CClaimTrie::WriteToDisk()
+void CClaimTrie::waitForPendingFlush() const
 {
-    CDBBatch batch(&db.GetObfuscateKey());
+    if (flushThread.joinable())
+        flushThread.join();
+}
+
+void CClaimTrie::commitFlushBatch(CDBBatch* batch)
+{
+    bool fOk = db.WriteBatch(*batch);
+    delete batch;
+    LOCK(cs_flushingState);
+    flushingQueueRows.clear();
+    flushingQueueNameRows.clear();
+    flushingExpirationQueueRows.clear();
+    flushingSupportQueueRows.clear();
+    flushingSupportQueueNameRows.clear();
+    flushingSupportExpirationQueueRows.clear();
+    flushingSupportNodes.clear();
+    fPendingFlushOk = fOk;
+}
+
+void CClaimTrie::recursiveNodeStats(const CClaimTrieNode* current, uint32_t nDepth, uint64_t& nNodes, uint64_t& nNodesWithClaims, uint32_t& nMaxDepth) const
+{
+    nNodes++;
+    if (!current->claims.empty())
+        nNodesWithClaims++;
+    if (nDepth > nMaxDepth)
+        nMaxDepth = nDepth;
+    for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
+        recursiveNodeStats(it->second, nDepth + 1, nNodes, nNodesWithClaims, nMaxDepth);
+}
+
+void CClaimTrie::getNodeStats(uint64_t& nNodes, uint64_t& nNodesWithClaims, uint32_t& nMaxDepth) const
+{
+    nNodes = 0;
+    nNodesWithClaims = 0;
+    nMaxDepth = 0;
+    recursiveNodeStats(&root, 0, nNodes, nNodesWithClaims, nMaxDepth);
+}
+
+size_t CClaimTrie::DynamicMemoryUsage() const
+{
+    // every live node (including the cache's working copies) lives in the
+    // node pool, so its chunk footprint covers the bulk of the trie; the
+    // claim index is the other resident structure that grows with history
+    return CClaimTrieNodePool::MemoryUsage() + memusage::DynamicUsage(claimIndex);
+}
+
+bool CClaimTrie::WriteToDisk(bool fAsync)
+{
+    waitForPendingFlush();
+    if (!fPendingFlushOk)
+        return false;
+    {
+        // move the dirty rows aside; the getters keep serving them from
+        // the flushing maps until the batch has landed in leveldb
+        LOCK(cs_flushingState);
+        flushingQueueRows.swap(dirtyQueueRows);
+        flushingQueueNameRows.swap(dirtyQueueNameRows);
+        flushingExpirationQueueRows.swap(dirtyExpirationQueueRows);
+        flushingSupportQueueRows.swap(dirtySupportQueueRows);
+        flushingSupportQueueNameRows.swap(dirtySupportQueueNameRows);
+        flushingSupportExpirationQueueRows.swap(dirtySupportExpirationQueueRows);
+        flushingSupportNodes.swap(dirtySupportNodes);
+    }
+    claimTrieStats.nFlushes++;
+    claimTrieStats.nLastFlushRows = dirtyNodes.size() + dirtyClaimIndexAdds.size() + dirtyClaimIndexErases.size()
+        + flushingQueueRows.size() + flushingQueueNameRows.size() + flushingExpirationQueueRows.size()
+        + flushingSupportNodes.size() + flushingSupportQueueRows.size() + flushingSupportQueueNameRows.size()
+        + flushingSupportExpirationQueueRows.size();
+    LogPrint("claimtrieperf", "%s: flushing %d rows (%u nodes) at height %d\n", __func__, claimTrieStats.nLastFlushRows, dirtyNodes.size(), nCurrentHeight);
+    CDBBatch* batch = new CDBBatch(&db.GetObfuscateKey());
     for (nodeCacheType::iterator itcache = dirtyNodes.begin(); itcache != dirtyNodes.end(); ++itcache)
-        BatchWriteNode(batch, itcache->first, itcache->second);
+        BatchWriteNode(*batch, itcache->first, itcache->second);
     dirtyNodes.clear();
-    BatchWriteQueueRows(batch);
-    dirtyQueueRows.clear();
-    BatchWriteQueueNameRows(batch);
-    dirtyQueueNameRows.clear();
-    BatchWriteExpirationQueueRows(batch);
-    dirtyExpirationQueueRows.clear();
-    BatchWriteSupportNodes(batch);
-    dirtySupportNodes.clear();
-    BatchWriteSupportQueueRows(batch);
-    dirtySupportQueueRows.clear();
-    BatchWriteSupportQueueNameRows(batch);
-    dirtySupportQueueNameRows.clear();
-    BatchWriteSupportExpirationQueueRows(batch);
-    dirtySupportExpirationQueueRows.clear();
-    batch.Write(HASH_BLOCK, hashBlock);
-    batch.Write(CURRENT_HEIGHT, nCurrentHeight);
-    return db.WriteBatch(batch);
+    BatchWriteClaimIndex(*batch);
+    BatchWriteQueueRows(*batch);
+    BatchWriteQueueNameRows(*batch);
+    BatchWriteExpirationQueueRows(*batch);
+    BatchWriteSupportNodes(*batch);
+    BatchWriteSupportQueueRows(*batch);
+    BatchWriteSupportQueueNameRows(*batch);
+    BatchWriteSupportExpirationQueueRows(*batch);
+    batch->Write(HASH_BLOCK, hashBlock);
+    batch->Write(CURRENT_HEIGHT, nCurrentHeight);
+    if (fAsync)
+    {
+        flushThread = boost::thread(&CClaimTrie::commitFlushBatch, this, batch);
+        return true;
+    }
+    commitFlushBatch(batch);
+    return fPendingFlushOk;
 }
 
 bool CClaimTrie::InsertFromDisk(const std::string& name, CClaimTrieNode* node)
@@ -1114,6 +2025,148 @@ bool CClaimTrie::InsertFromDisk(const std::string& name, CClaimTrieNode* node)
     return true;
 }
 
+static const char* CLAIMTRIE_SNAPSHOT_FILENAME = "claimtrie.dat";
+static const int CLAIMTRIE_SNAPSHOT_VERSION = 2;
+
+// the hash of a claimless node with a single child, as computed by
+// CClaimTrieCache::computeMerkleHashForNode, depends only on the child's
+// character and hash, so the hashes of a compressed chain of such nodes
+// can be regenerated from the bottom up when the chain is expanded
+static uint256 HashChainLink(unsigned char childChar, const uint256& childHash)
+{
+    unsigned char vchToHash[33];
+    vchToHash[0] = childChar;
+    memcpy(vchToHash + 1, childHash.begin(), 32);
+    uint256 result;
+    CHash256().Write(vchToHash, sizeof(vchToHash)).Finalize(result.begin());
+    return result;
+}
+
+uint64_t CClaimTrie::countSnapshotRecordsRecursive(const CClaimTrieNode* current, bool fRoot) const
+{
+    if (!fRoot)
+    {
+        while (current->claims.empty() && current->children.size() == 1)
+            current = current->children.begin()->second;
+    }
+    uint64_t nRecords = 1;
+    for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
+        nRecords += countSnapshotRecordsRecursive(it->second, false);
+    return nRecords;
+}
+
+void CClaimTrie::recursiveWriteSnapshot(CAutoFile& fileout, const std::string& name, const CClaimTrieNode* current) const
+{
+    // collapse chains of claimless single-child nodes into one record
+    // holding the skipped substring; most of the trie is such chains,
+    // one node per character of every claim name
+    std::string skip;
+    if (!name.empty())
+    {
+        while (current->claims.empty() && current->children.size() == 1)
+        {
+            skip += static_cast<char>(current->children.begin()->first);
+            current = current->children.begin()->second;
+        }
+    }
+    fileout << name;
+    fileout << skip;
+    // the snapshot holds full nodes; bring back any shed claims first
+    restoreShedClaims(name + skip, current);
+    fileout << *current;
+    for (nodeMapType::const_iterator it = current->children.begin(); it != current->children.end(); ++it)
+    {
+        std::string sNextName = name + skip;
+        sNextName += static_cast<char>(it->first);
+        recursiveWriteSnapshot(fileout, sNextName, it->second);
+    }
+}
+
+bool CClaimTrie::WriteSnapshot()
+{
+    boost::filesystem::path path = GetDataDir() / CLAIMTRIE_SNAPSHOT_FILENAME;
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s(): unable to open %s for writing", __func__, path.string());
+    fileout << CLAIMTRIE_SNAPSHOT_VERSION;
+    fileout << hashBlock;
+    fileout << nCurrentHeight;
+    fileout << countSnapshotRecordsRecursive(&root, true);
+    recursiveWriteSnapshot(fileout, "", &root);
+    return true;
+}
+
+bool CClaimTrie::ReadSnapshot()
+{
+    boost::filesystem::path path = GetDataDir() / CLAIMTRIE_SNAPSHOT_FILENAME;
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+    try {
+        int nVersionRequired;
+        uint256 hashSnapshot;
+        int nHeightSnapshot;
+        uint64_t nRecords;
+        filein >> nVersionRequired;
+        if (nVersionRequired != CLAIMTRIE_SNAPSHOT_VERSION)
+        {
+            LogPrintf("%s: snapshot format version mismatch (%d), falling back to full load\n", __func__, nVersionRequired);
+            return false;
+        }
+        filein >> hashSnapshot;
+        filein >> nHeightSnapshot;
+        if (hashSnapshot != hashBlock || nHeightSnapshot != nCurrentHeight)
+        {
+            LogPrintf("%s: claim trie snapshot is stale, falling back to full load\n", __func__);
+            return false;
+        }
+        filein >> nRecords;
+        clear();
+        // records arrive in preorder, so the parent of each record is always
+        // the deepest entry on the stack whose name is one character shorter
+        std::vector<std::pair<std::string, CClaimTrieNode*> > stack;
+        for (uint64_t i = 0; i < nRecords; ++i)
+        {
+            std::string name;
+            std::string skip;
+            filein >> name;
+            filein >> skip;
+            if (name.empty())
+            {
+                filein >> root;
+                stack.push_back(std::make_pair(std::string(), &root));
+                continue;
+            }
+            CClaimTrieNode* node = CClaimTrieNodePool::New();
+            filein >> *node;
+            // expand the compressed chain: each skipped character becomes a
+            // claimless single-child node whose hash is regenerated from its
+            // child's
+            CClaimTrieNode* front = node;
+            for (size_t j = skip.size(); j > 0; --j)
+            {
+                CClaimTrieNode* link = CClaimTrieNodePool::New();
+                link->children[static_cast<unsigned char>(skip[j - 1])] = front;
+                link->hash = HashChainLink(static_cast<unsigned char>(skip[j - 1]), front->hash);
+                front = link;
+            }
+            while (!stack.empty() && stack.back().first.size() + 1 != name.size())
+                stack.pop_back();
+            if (stack.empty())
+            {
+                clear(front);
+                CClaimTrieNodePool::Free(front);
+                return error("%s(): corrupt snapshot, orphaned node %s", __func__, name);
+            }
+            stack.back().second->children[static_cast<unsigned char>(name[name.size() - 1])] = front;
+            stack.push_back(std::make_pair(name + skip, node));
+        }
+    } catch (const std::exception& e) {
+        return error("%s(): deserialize error %s, falling back to full load", __func__, e.what());
+    }
+    return true;
+}
+
 bool CClaimTrie::ReadFromDisk(bool check)
 {
     if (!db.Read(HASH_BLOCK, hashBlock))
@@ -1122,33 +2175,54 @@ bool CClaimTrie::ReadFromDisk(bool check)
         LogPrintf("%s: Couldn't read the current height\n", __func__);
     setExpirationTime(Params().GetConsensus().GetExpirationTime(nCurrentHeight-1));
 
-    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-
-    pcursor->SeekToFirst();
-    while (pcursor->Valid())
+    if (ReadSnapshot())
     {
-        std::pair<char, std::string> key;
-        if (pcursor->GetKey(key))
+        LogPrintf("%s: loaded the claim trie from its snapshot file\n", __func__);
+    }
+    else
+    {
+        clear();
+
+        boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+
+        pcursor->SeekToFirst();
+        while (pcursor->Valid())
         {
-            if (key.first == TRIE_NODE)
+            std::pair<char, std::string> key;
+            if (pcursor->GetKey(key))
             {
-                CClaimTrieNode* node = new CClaimTrieNode();
-                if (pcursor->GetValue(*node))
+                if (key.first == TRIE_NODE)
                 {
-                    if (!InsertFromDisk(key.second, node))
+                    CClaimTrieNode* node = CClaimTrieNodePool::New();
+                    if (pcursor->GetValue(*node))
                     {
-                        return error("%s(): error restoring claim trie from disk", __func__);
+                        if (!InsertFromDisk(key.second, node))
+                        {
+                            return error("%s(): error restoring claim trie from disk", __func__);
+                        }
+                    }
+                    else
+                    {
+                        return error("%s(): error reading claim trie from disk", __func__);
                     }
-                }
-                else
-                {
-                    return error("%s(): error reading claim trie from disk", __func__);
                 }
             }
+            pcursor->Next();
         }
-        pcursor->Next();
     }
 
+    // one walk at load time; updateName and recursiveNullify keep the
+    // aggregates current from here on
+    recomputeClaimsStats();
+
+    // once the aggregates are in place the losing claims of every name are
+    // cold: hashing commits only to the winner, so their payloads can live
+    // on disk until some consumer asks for the full list
+    if (GetBoolArg("-claimtriecoldshed", DEFAULT_CLAIMTRIE_COLD_SHED))
+        shedClaimPayloads();
+
+    loadClaimIndex();
+
     if (check)
     {
         LogPrintf("Checking Claim trie consistency...");
@@ -1163,32 +2237,56 @@ bool CClaimTrie::ReadFromDisk(bool check)
     return true;
 }
 
-bool CClaimTrieCache::recursiveComputeMerkleHash(CClaimTrieNode* tnCurrent, std::string sPos) const
+CClaimTrieNode* CClaimTrieCache::nodeForPosition(const std::string& position) const
+{
+    nodeCacheType::iterator cachedNode = cache.find(position);
+    if (cachedNode != cache.end())
+        return cachedNode->second;
+    CClaimTrieNode* currentNode = &(base->root);
+    cachedNode = cache.find("");
+    if (cachedNode != cache.end())
+        currentNode = cachedNode->second;
+    for (std::string::const_iterator itCur = position.begin(); itCur != position.end(); ++itCur)
+    {
+        std::string sNextSubstring(position.begin(), itCur + 1);
+        cachedNode = cache.find(sNextSubstring);
+        if (cachedNode != cache.end())
+        {
+            currentNode = cachedNode->second;
+            continue;
+        }
+        nodeMapType::iterator childNode = currentNode->children.find(*itCur);
+        if (childNode == currentNode->children.end())
+            return NULL;
+        currentNode = childNode->second;
+    }
+    return currentNode;
+}
+
+bool CClaimTrieCache::computeMerkleHashForNode(CClaimTrieNode* tnCurrent, const std::string& sPos, hashMapType& results, hashMapType& resultsCompact, bool fCompact) const
 {
     if (sPos == "" && tnCurrent->empty())
     {
-        cacheHashes[""] = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+        results[""] = uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+        if (fCompact)
+            resultsCompact[""] = results[""];
         return true;
     }
     std::vector<unsigned char> vchToHash;
-    nodeCacheType::iterator cachedNode;
-
-
+    vchToHash.reserve(tnCurrent->children.size() * 33 + 32);
+    std::vector<unsigned char> vchToHashCompact;
+    if (fCompact)
+        vchToHashCompact.reserve(tnCurrent->children.size() * 33 + 32);
+
+    // one reusable child-position string; only its last character varies
+    std::string sNextPos = sPos;
+    sNextPos.push_back(' ');
     for (nodeMapType::iterator it = tnCurrent->children.begin(); it != tnCurrent->children.end(); ++it)
     {
-        std::stringstream ss;
-        ss << it->first;
-        std::string sNextPos = sPos + ss.str();
-        if (dirtyHashes.count(sNextPos) != 0)
-        {
-            // the child might be in the cache, so look for it there
-            cachedNode = cache.find(sNextPos);
-            if (cachedNode != cache.end())
-                recursiveComputeMerkleHash(cachedNode->second, sNextPos);
-            else
-                recursiveComputeMerkleHash(it->second, sNextPos);
-        }
+        sNextPos[sNextPos.size() - 1] = static_cast<char>(it->first);
         vchToHash.push_back(it->first);
+        // a dirty child's hash has already been recomputed and memoized
+        // in cacheHashes, since dirty positions are processed deepest-first
         hashMapType::iterator ithash = cacheHashes.find(sNextPos);
         if (ithash != cacheHashes.end())
         {
@@ -1198,8 +2296,16 @@ bool CClaimTrieCache::recursiveComputeMerkleHash(CClaimTrieNode* tnCurrent, std:
         {
             vchToHash.insert(vchToHash.end(), it->second->hash.begin(), it->second->hash.end());
         }
+        if (fCompact)
+        {
+            vchToHashCompact.push_back(it->first);
+            hashMapType::iterator itCompact = cacheCompactHashes.find(sNextPos);
+            uint256 childCompact = (itCompact != cacheCompactHashes.end()) ?
+                itCompact->second : compactHashForSubtree(it->second);
+            vchToHashCompact.insert(vchToHashCompact.end(), childCompact.begin(), childCompact.end());
+        }
     }
-    
+
     CClaimValue claim;
     bool hasClaim = tnCurrent->getBestClaim(claim);
 
@@ -1209,19 +2315,26 @@ bool CClaimTrieCache::recursiveComputeMerkleHash(CClaimTrieNode* tnCurrent, std:
         assert(getLastTakeoverForName(sPos, nHeightOfLastTakeover));
         uint256 valueHash = getValueHash(claim.outPoint, nHeightOfLastTakeover);
         vchToHash.insert(vchToHash.end(), valueHash.begin(), valueHash.end());
+        if (fCompact)
+        {
+            uint256 valueHashCompact = getValueHashCompact(claim.outPoint, nHeightOfLastTakeover);
+            vchToHashCompact.insert(vchToHashCompact.end(), valueHashCompact.begin(), valueHashCompact.end());
+        }
     }
 
-    CHash256 hasher;
-    std::vector<unsigned char> vchHash(hasher.OUTPUT_SIZE);
-    hasher.Write(vchToHash.data(), vchToHash.size());
-    hasher.Finalize(&(vchHash[0]));
-    cacheHashes[sPos] = uint256(vchHash);
-    std::set<std::string>::iterator itDirty = dirtyHashes.find(sPos);
-    if (itDirty != dirtyHashes.end())
-        dirtyHashes.erase(itDirty);
+    CHash256().Write(vchToHash.data(), vchToHash.size()).Finalize(results[sPos].begin());
+    if (fCompact)
+        CSHA256().Write(vchToHashCompact.data(), vchToHashCompact.size()).Finalize(resultsCompact[sPos].begin());
+    claimTrieStats.nHashesComputed++;
     return true;
 }
 
+void CClaimTrieCache::hashDirtyLevelShard(const std::vector<std::pair<std::string, CClaimTrieNode*> >* level, size_t nShard, size_t nShards, hashMapType* results, hashMapType* resultsCompact, bool fCompact) const
+{
+    for (size_t i = nShard; i < level->size(); i += nShards)
+        computeMerkleHashForNode((*level)[i].second, (*level)[i].first, *results, *resultsCompact, fCompact);
+}
+
 uint256 CClaimTrieCache::getMerkleHash() const
 {
     if (empty())
@@ -1231,11 +2344,63 @@ uint256 CClaimTrieCache::getMerkleHash() const
     }
     if (dirty())
     {
-        nodeCacheType::iterator cachedNode = cache.find("");
-        if (cachedNode != cache.end())
-            recursiveComputeMerkleHash(cachedNode->second, "");
-        else
-            recursiveComputeMerkleHash(&(base->root), "");
+        // inside the transition window the compact commitment is maintained
+        // in the same dirty walk, roughly halving its long-term cost once
+        // the legacy hash can be retired
+        const bool fCompact = compactHashesActive();
+        // a tracer computes the recompute duration from the timestamps of
+        // the paired hash_start/hash_end probes
+        TRACE1(claimtrie, hash_start, (uint64_t)dirtyHashes.size());
+        // dirtyHashes orders a position before any of its descendants, so
+        // walking it in reverse recomputes each dirty node only after all of
+        // its dirty children, touching exactly the changed set of nodes and
+        // reusing memoized sibling hashes for everything else. Positions of
+        // equal depth are independent of each other, so each depth level can
+        // be hashed in parallel before its parents are processed.
+        dirtyHashesType::reverse_iterator itDirty = dirtyHashes.rbegin();
+        while (itDirty != dirtyHashes.rend())
+        {
+            std::vector<std::pair<std::string, CClaimTrieNode*> > level;
+            const size_t nDepth = itDirty->size();
+            for (; itDirty != dirtyHashes.rend() && itDirty->size() == nDepth; ++itDirty)
+            {
+                CClaimTrieNode* node = nodeForPosition(*itDirty);
+                if (node)
+                    level.push_back(std::make_pair(*itDirty, node));
+                else // the node was pruned; drop any stale memoized hash
+                {
+                    cacheHashes.erase(*itDirty);
+                    cacheCompactHashes.erase(*itDirty);
+                }
+            }
+            if (nClaimTrieHashThreads > 1 && level.size() >= MIN_PARALLEL_HASH_NODES)
+            {
+                size_t nShards = std::min(static_cast<size_t>(nClaimTrieHashThreads), level.size() / (MIN_PARALLEL_HASH_NODES / 2));
+                // each worker hashes its shard into a private map; the shared
+                // cacheHashes is only merged between levels, so workers can
+                // read it without locking
+                std::vector<hashMapType> results(nShards);
+                std::vector<hashMapType> resultsCompact(nShards);
+                boost::thread_group threadGroup;
+                for (size_t nShard = 1; nShard < nShards; ++nShard)
+                    threadGroup.create_thread(boost::bind(&CClaimTrieCache::hashDirtyLevelShard, this, &level, nShard, nShards, &results[nShard], &resultsCompact[nShard], fCompact));
+                hashDirtyLevelShard(&level, 0, nShards, &results[0], &resultsCompact[0], fCompact);
+                threadGroup.join_all();
+                for (std::vector<hashMapType>::iterator itResult = results.begin(); itResult != results.end(); ++itResult)
+                    for (hashMapType::iterator ithash = itResult->begin(); ithash != itResult->end(); ++ithash)
+                        cacheHashes[ithash->first] = ithash->second;
+                for (std::vector<hashMapType>::iterator itResult = resultsCompact.begin(); itResult != resultsCompact.end(); ++itResult)
+                    for (hashMapType::iterator ithash = itResult->begin(); ithash != itResult->end(); ++ithash)
+                        cacheCompactHashes[ithash->first] = ithash->second;
+            }
+            else
+            {
+                for (std::vector<std::pair<std::string, CClaimTrieNode*> >::iterator itLevel = level.begin(); itLevel != level.end(); ++itLevel)
+                    computeMerkleHashForNode(itLevel->second, itLevel->first, cacheHashes, cacheCompactHashes, fCompact);
+            }
+        }
+        TRACE1(claimtrie, hash_end, (uint64_t)dirtyHashes.size());
+        dirtyHashes.clear();
     }
     hashMapType::iterator ithash = cacheHashes.find("");
     if (ithash != cacheHashes.end())
@@ -1244,6 +2409,27 @@ uint256 CClaimTrieCache::getMerkleHash() const
         return base->root.hash;
 }
 
+bool CClaimTrieCache::compactHashesActive() const
+{
+    return nCurrentHeight >= Params().GetConsensus().nClaimTrieCompactHashForkHeight;
+}
+
+uint256 CClaimTrieCache::getMerkleHashCompact() const
+{
+    if (empty())
+        return uint256S("0000000000000000000000000000000000000000000000000000000000000001");
+    // before the window opens the compact commitment is not maintained
+    // through the incremental walk, so there is no current root to report
+    if (!compactHashesActive())
+        return uint256();
+    if (dirty())
+        getMerkleHash();
+    hashMapType::iterator ithash = cacheCompactHashes.find("");
+    if (ithash != cacheCompactHashes.end())
+        return ithash->second;
+    return compactHashForSubtree(&base->root);
+}
+
 bool CClaimTrieCache::empty() const
 {
     return base->empty() && cache.empty();
@@ -1254,39 +2440,57 @@ CClaimTrieNode* CClaimTrieCache::addNodeToCache(const std::string& position, CCl
     // create a copy of the node in the cache, if new node, create empty node
     CClaimTrieNode* cacheCopy;
     if(!original)
-        cacheCopy = new CClaimTrieNode();
+        cacheCopy = CClaimTrieNodePool::New();
     else
-        cacheCopy = new CClaimTrieNode(*original);
+    {
+        // the cache mutates and reorders the full claim list, so a node
+        // with shed claims has to be made whole before it is copied
+        base->restoreShedClaims(position, original);
+        cacheCopy = CClaimTrieNodePool::New(*original);
+    }
     cache[position] = cacheCopy;
 
     // check to see if there is the original node in block_originals,
     // if not, add it to block_originals cache
-    nodeCacheType::const_iterator itOriginals = block_originals.find(position);
-    if (block_originals.end() == itOriginals)
-    {
-        CClaimTrieNode* originalCopy;
-        if(!original)
-            originalCopy = new CClaimTrieNode();
-        else
-            originalCopy = new CClaimTrieNode(*original);
-        block_originals[position] = originalCopy;
-    }
+    if (original)
+        saveBlockOriginal(position, original);
+    else if (block_originals.find(position) == block_originals.end())
+        block_originals[position] = CClaimTrieNodePool::New();
     return cacheCopy;
 }
 
+void CClaimTrieCache::saveBlockOriginal(const std::string& name, const CClaimTrieNode* node) const
+{
+    if (block_originals.find(name) == block_originals.end())
+        block_originals[name] = CClaimTrieNodePool::New(*node);
+}
+
+bool CClaimTrieCache::getInfoForName(const std::string& name, CClaimValue& claim) const
+{
+    nodeCacheType::const_iterator itCache = cache.find(name);
+    if (itCache != cache.end())
+        return itCache->second->getBestClaim(claim);
+    return base->getInfoForName(name, claim);
+}
+
 bool CClaimTrieCache::getOriginalInfoForName(const std::string& name, CClaimValue& claim) const
 {
     nodeCacheType::const_iterator itOriginalCache = block_originals.find(name);
-    if (itOriginalCache == block_originals.end())
-    {
-        return base->getInfoForName(name, claim);
-    }
-    return itOriginalCache->second->getBestClaim(claim);
+    if (itOriginalCache != block_originals.end())
+        return itOriginalCache->second->getBestClaim(claim);
+    // a cached node with no saved original has not been touched this
+    // block, so its current state is its start-of-block state
+    nodeCacheType::const_iterator itCache = cache.find(name);
+    if (itCache != cache.end())
+        return itCache->second->getBestClaim(claim);
+    return base->getInfoForName(name, claim);
 }
 
 bool CClaimTrieCache::insertClaimIntoTrie(const std::string& name, CClaimValue claim, bool fCheckTakeover) const
 {
     assert(base);
+    static CStatCounter& counter = StatCounter("claimtrie.inserts");
+    counter.Increment();
     CClaimTrieNode* currentNode = &(base->root);
     nodeCacheType::iterator cachedNode;
     cachedNode = cache.find("");
@@ -1337,6 +2541,7 @@ bool CClaimTrieCache::insertClaimIntoTrie(const std::string& name, CClaimValue c
     if (cachedNode != cache.end())
     {
         assert(cachedNode->second == currentNode);
+        saveBlockOriginal(name, currentNode);
     }
     else
     {
@@ -1376,6 +2581,8 @@ bool CClaimTrieCache::insertClaimIntoTrie(const std::string& name, CClaimValue c
 bool CClaimTrieCache::removeClaimFromTrie(const std::string& name, const COutPoint& outPoint, CClaimValue& claim, bool fCheckTakeover) const
 {
     assert(base);
+    static CStatCounter& counter = StatCounter("claimtrie.removes");
+    counter.Increment();
     CClaimTrieNode* currentNode = &(base->root);
     nodeCacheType::iterator cachedNode;
     cachedNode = cache.find("");
@@ -1405,7 +2612,10 @@ bool CClaimTrieCache::removeClaimFromTrie(const std::string& name, const COutPoi
 
     cachedNode = cache.find(name);
     if (cachedNode != cache.end())
+    {
         assert(cachedNode->second == currentNode);
+        saveBlockOriginal(name, currentNode);
+    }
     else
     {
         currentNode = addNodeToCache(name, currentNode);
@@ -1523,7 +2733,7 @@ bool CClaimTrieCache::recursivePruneName(CClaimTrieNode* tnCurrent, unsigned int
         if (cachedNode != cache.end())
         {
             assert(tnCurrent == cachedNode->second);
-            delete tnCurrent;
+            CClaimTrieNodePool::Free(tnCurrent);
             cache.erase(cachedNode);
         }
         fNullified = true;
@@ -1780,7 +2990,8 @@ bool CClaimTrieCache::reorderTrieNode(const std::string& name, bool fCheckTakeov
             // The node doesn't exist, so it can't be reordered.
             return true;
         }
-        currentNode = new CClaimTrieNode(*currentNode);
+        base->restoreShedClaims(name, currentNode);
+        currentNode = CClaimTrieNodePool::New(*currentNode);
         std::pair<nodeCacheType::iterator, bool> ret;
         ret = cache.insert(std::pair<std::string, CClaimTrieNode*>(name, currentNode));
         assert(ret.second);
@@ -1794,6 +3005,7 @@ bool CClaimTrieCache::reorderTrieNode(const std::string& name, bool fCheckTakeov
     }
     else
     {
+        saveBlockOriginal(name, cachedNode->second);
         CClaimValue currentTop = cachedNode->second->claims.front();
         supportMapEntryType node;
         getSupportsForName(name, node);
@@ -2352,14 +3564,13 @@ bool CClaimTrieCache::incrementBlock(insertUndoType& insertUndo, claimQueueRowTy
     }
     for (nodeCacheType::const_iterator itOriginals = block_originals.begin(); itOriginals != block_originals.end(); ++itOriginals)
     {
-        delete itOriginals->second;
+        CClaimTrieNodePool::Free(itOriginals->second);
     }
     block_originals.clear();
-    for (nodeCacheType::const_iterator itCache = cache.begin(); itCache != cache.end(); ++itCache)
-    {
-        block_originals[itCache->first] = new CClaimTrieNode(*(itCache->second));
-    }
     namesToCheckForTakeover.clear();
+    claimTrieStats.nBlocksIncremented++;
+    claimTrieStats.nLastDirtyNodes = cache.size();
+    LogPrint("claimtrieperf", "%s: height %d, %u cached nodes, %u dirty hashes\n", __func__, nCurrentHeight, cache.size(), dirtyHashes.size());
     nCurrentHeight++;
     return true;
 }
@@ -2421,13 +3632,9 @@ bool CClaimTrieCache::finalizeDecrement() const
 {
     for (nodeCacheType::iterator itOriginals = block_originals.begin(); itOriginals != block_originals.end(); ++itOriginals)
     {
-        delete itOriginals->second;
+        CClaimTrieNodePool::Free(itOriginals->second);
     }
     block_originals.clear();
-    for (nodeCacheType::const_iterator itCache = cache.begin(); itCache != cache.end(); ++itCache)
-    {
-        block_originals[itCache->first] = new CClaimTrieNode(*(itCache->second));
-    }
     return true;
 }
 
@@ -2495,16 +3702,17 @@ bool CClaimTrieCache::clear() const
 {
     for (nodeCacheType::iterator itcache = cache.begin(); itcache != cache.end(); ++itcache)
     {
-        delete itcache->second;
+        CClaimTrieNodePool::Free(itcache->second);
     }
     cache.clear();
     for (nodeCacheType::iterator itOriginals = block_originals.begin(); itOriginals != block_originals.end(); ++itOriginals)
     {
-        delete itOriginals->second;
+        CClaimTrieNodePool::Free(itOriginals->second);
     }
     block_originals.clear();
     dirtyHashes.clear();
     cacheHashes.clear();
+    cacheCompactHashes.clear();
     claimQueueCache.clear();
     claimQueueNameCache.clear();
     expirationQueueCache.clear();
@@ -2521,7 +3729,7 @@ bool CClaimTrieCache::flush()
 {
     if (dirty())
         getMerkleHash();
-    bool success = base->update(cache, cacheHashes, cacheTakeoverHeights, getBestBlock(), claimQueueCache, claimQueueNameCache, expirationQueueCache, nCurrentHeight, supportCache, supportQueueCache, supportQueueNameCache, supportExpirationQueueCache);
+    bool success = base->update(cache, cacheHashes, cacheCompactHashes, cacheTakeoverHeights, getBestBlock(), claimQueueCache, claimQueueNameCache, expirationQueueCache, nCurrentHeight, supportCache, supportQueueCache, supportQueueNameCache, supportExpirationQueueCache);
     if (success)
     {
         success = clear();
@@ -2,17 +2,23 @@
 #define BITCOIN_CLAIMTRIE_H
 
 #include "amount.h"
+#include "crypto/common.h"
 #include "serialize.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 #include "dbwrapper.h"
 #include "chainparams.h"
 #include "primitives/transaction.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
 
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+
 // leveldb keys
 #define HASH_BLOCK 'h'
 #define CURRENT_HEIGHT 't'
@@ -25,9 +31,40 @@
 #define SUPPORT_QUEUE_ROW 'u'
 #define SUPPORT_QUEUE_NAME_ROW 'p'
 #define SUPPORT_EXP_QUEUE_ROW 'x'
+#define CLAIM_OP_JOURNAL_ROW 'j'
+#define CLAIM_HISTORY_ROW 'y'
+#define CLAIM_SCRIPT_INDEX_ROW 'a'
 
 uint256 getValueHash(COutPoint outPoint, int nHeightOfLastTakeover);
 
+/** Compact claim commitment for the planned hash upgrade fork: a single
+ *  SHA256 over fixed-layout binary fields (txid || LE32 vout || LE32
+ *  takeover height) instead of double-SHA256 over decimal strings. */
+uint256 getValueHashCompact(const COutPoint& outPoint, int nHeightOfLastTakeover);
+
+/** Running counters over claim trie hot paths, exposed by gettrieinfo */
+struct CClaimTrieStats
+{
+    int64_t nHashesComputed;
+    int64_t nBlocksIncremented;
+    int64_t nLastDirtyNodes;
+    int64_t nLastFlushRows;
+    int64_t nFlushes;
+
+    CClaimTrieStats()
+        : nHashesComputed(0), nBlocksIncremented(0), nLastDirtyNodes(0)
+        , nLastFlushRows(0), nFlushes(0) {}
+};
+extern CClaimTrieStats claimTrieStats;
+
+/** Number of threads used to hash independent dirty claim trie subtrees */
+extern int nClaimTrieHashThreads;
+static const int DEFAULT_CLAIMTRIE_HASH_THREADS = 0;
+/** Default for -claimtriecoldshed: drop non-winning claim payloads from
+ *  resident trie nodes at load and reload them from disk on demand */
+static const bool DEFAULT_CLAIMTRIE_COLD_SHED = true;
+static const int MAX_CLAIMTRIE_HASH_THREADS = 16;
+
 class CClaimValue
 {
 public:
@@ -130,19 +167,122 @@ class CClaimTrie;
 
 typedef std::vector<CSupportValue> supportMapEntryType;
 
-typedef std::map<unsigned char, CClaimTrieNode*> nodeMapType;
+/** Children of a trie node, keyed by the next character of the name.
+ *  Stored as a flat vector kept sorted by character: nodes rarely have
+ *  more than a handful of children, so probing a couple of contiguous
+ *  cache lines beats walking a red-black tree of heap-allocated map
+ *  nodes on every lookup, and iteration stays in character order for
+ *  hashing and flattening.
+ */
+class CNodeChildMap
+{
+public:
+    typedef std::pair<unsigned char, CClaimTrieNode*> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    iterator begin() { return vchChildren.begin(); }
+    iterator end() { return vchChildren.end(); }
+    const_iterator begin() const { return vchChildren.begin(); }
+    const_iterator end() const { return vchChildren.end(); }
+
+    bool empty() const { return vchChildren.empty(); }
+    size_t size() const { return vchChildren.size(); }
+    void clear() { vchChildren.clear(); }
+
+    iterator find(unsigned char c)
+    {
+        iterator it = lowerBound(c);
+        if (it != vchChildren.end() && it->first == c)
+            return it;
+        return vchChildren.end();
+    }
+
+    const_iterator find(unsigned char c) const
+    {
+        const_iterator it = lowerBound(c);
+        if (it != vchChildren.end() && it->first == c)
+            return it;
+        return vchChildren.end();
+    }
+
+    CClaimTrieNode*& operator[](unsigned char c)
+    {
+        iterator it = lowerBound(c);
+        if (it == vchChildren.end() || it->first != c)
+            it = vchChildren.insert(it, value_type(c, NULL));
+        return it->second;
+    }
+
+    iterator erase(iterator it) { return vchChildren.erase(it); }
+
+private:
+    struct ChildKeyLess
+    {
+        bool operator()(const value_type& child, unsigned char c) const
+        {
+            return child.first < c;
+        }
+    };
+
+    iterator lowerBound(unsigned char c)
+    {
+        return std::lower_bound(vchChildren.begin(), vchChildren.end(), c, ChildKeyLess());
+    }
+
+    const_iterator lowerBound(unsigned char c) const
+    {
+        return std::lower_bound(vchChildren.begin(), vchChildren.end(), c, ChildKeyLess());
+    }
+
+    std::vector<value_type> vchChildren;
+};
+
+typedef CNodeChildMap nodeMapType;
 
 typedef std::pair<std::string, CClaimTrieNode> namedNodeType;
 
+/** Pooled allocator for CClaimTrieNode. Nodes are carved out of large
+ *  chunks and recycled through a free list instead of being returned to
+ *  the heap, so the churn of cache copies made and thrown away on every
+ *  block stops hammering the general-purpose allocator and keeps nodes
+ *  packed together in memory.
+ */
+class CClaimTrieNodePool
+{
+public:
+    static CClaimTrieNode* New();
+    static CClaimTrieNode* New(const CClaimTrieNode& other);
+    static void Free(CClaimTrieNode* node);
+    static size_t MemoryUsage();
+
+private:
+    static void* Allocate();
+};
+
 class CClaimTrieNode
 {
 public:
-    CClaimTrieNode() : nHeightOfLastTakeover(0) {}
-    CClaimTrieNode(uint256 hash) : hash(hash), nHeightOfLastTakeover(0) {}
+    CClaimTrieNode() : nHeightOfLastTakeover(0), nShedClaims(0), nShedValue(0) {}
+    CClaimTrieNode(uint256 hash) : hash(hash), nHeightOfLastTakeover(0), nShedClaims(0), nShedValue(0) {}
     uint256 hash;
+    //! Compact (single-SHA256) commitment over this subtree, maintained in
+    //! memory only; null means "not yet computed" and subtrees are filled
+    //! in lazily. Deliberately absent from the on-disk node format and from
+    //! operator== -- the legacy hash stays authoritative until the fork.
+    uint256 hashCompact;
     nodeMapType children;
     int nHeightOfLastTakeover;
     std::vector<CClaimValue> claims;
+    //! (memory only) When non-zero, the non-winning claims of this node have
+    //! been shed from memory: `claims` holds only the controlling claim and
+    //! this is the count of claims dropped, with nShedValue their summed
+    //! nAmount (so the trie-wide aggregates stay exact). The full list still
+    //! lives in the node's TRIE_NODE row and hashing only ever commits to the
+    //! winner, so shed nodes are reloaded lazily via
+    //! CClaimTrie::restoreShedClaims before anything needs the whole list.
+    unsigned int nShedClaims;
+    CAmount nShedValue;
 
     bool insertClaim(CClaimValue claim);
     bool removeClaim(const COutPoint& outPoint, CClaimValue& claim);
@@ -259,6 +399,18 @@ class CClaimIndexElement
     CClaimValue claim;
 };
 
+struct CClaimIdHasher
+{
+    size_t operator()(const uint160& claimId) const
+    {
+        // claim ids are ripemd160 outputs, so any 8 bytes of one are
+        // already well distributed
+        return ReadLE64(claimId.begin());
+    }
+};
+
+typedef boost::unordered_map<uint160, CClaimIndexElement, CClaimIdHasher> claimIndexType;
+
 typedef std::pair<std::string, CClaimValue> claimQueueEntryType;
 
 typedef std::pair<std::string, CSupportValue> supportQueueEntryType;
@@ -279,10 +431,107 @@ typedef std::map<int, claimQueueRowType> claimQueueType;
 typedef std::vector<supportQueueEntryType> supportQueueRowType;
 typedef std::map<int, supportQueueRowType> supportQueueType;
 
+/** One claim trie state change recorded in the per-block operation journal
+ *  (-claimjournal). claimId is the supported claim for support ops, the new
+ *  winner for takeovers, and zero where it is not known (activations).
+ *  nValidAtHeight is only meaningful for ops taken from the queues. */
+struct CClaimOpJournalEntry
+{
+    static const unsigned char CLAIM_ADDED = 1;
+    static const unsigned char CLAIM_UPDATED = 2;
+    static const unsigned char CLAIM_SPENT = 3;
+    static const unsigned char CLAIM_EXPIRED = 4;
+    static const unsigned char CLAIM_ACTIVATED = 5;
+    static const unsigned char SUPPORT_ADDED = 6;
+    static const unsigned char SUPPORT_SPENT = 7;
+    static const unsigned char SUPPORT_EXPIRED = 8;
+    static const unsigned char SUPPORT_ACTIVATED = 9;
+    static const unsigned char NAME_TAKEOVER = 10;
+
+    unsigned char nOp;
+    std::string name;
+    COutPoint outPoint;
+    uint160 claimId;
+    CAmount nAmount;
+    int nValidAtHeight;
+
+    CClaimOpJournalEntry() : nOp(0), nAmount(0), nValidAtHeight(0) {}
+
+    CClaimOpJournalEntry(unsigned char nOp, const std::string& name,
+                         const COutPoint& outPoint, const uint160& claimId,
+                         CAmount nAmount, int nValidAtHeight)
+    : nOp(nOp), name(name), outPoint(outPoint), claimId(claimId)
+    , nAmount(nAmount), nValidAtHeight(nValidAtHeight) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nOp);
+        READWRITE(name);
+        READWRITE(outPoint);
+        READWRITE(claimId);
+        READWRITE(nAmount);
+        READWRITE(nValidAtHeight);
+    }
+};
+
+typedef std::vector<CClaimOpJournalEntry> claimOpJournalRowType;
+
+/** One -claimhistoryindex record; the name is the row key, so unlike
+ *  CClaimOpJournalEntry it is not repeated in every entry. nOp uses the
+ *  CClaimOpJournalEntry op codes. */
+struct CClaimHistoryEntry
+{
+    int nHeight;
+    unsigned char nOp;
+    COutPoint outPoint;
+    uint160 claimId;
+    CAmount nAmount;
+
+    CClaimHistoryEntry() : nHeight(0), nOp(0), nAmount(0) {}
+
+    CClaimHistoryEntry(int nHeight, unsigned char nOp, const COutPoint& outPoint,
+                       const uint160& claimId, CAmount nAmount)
+    : nHeight(nHeight), nOp(nOp), outPoint(outPoint), claimId(claimId)
+    , nAmount(nAmount) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nHeight);
+        READWRITE(nOp);
+        READWRITE(outPoint);
+        READWRITE(claimId);
+        READWRITE(nAmount);
+    }
+};
+
+typedef std::vector<CClaimHistoryEntry> claimHistoryRowType;
+
+/** One pending mutation of the -claimaddressindex keyspace: add or remove
+ *  a claimId under the Hash160 of the claim output's stripped scriptPubKey. */
+struct CClaimScriptIndexOp
+{
+    uint160 hashScript;
+    uint160 claimId;
+    bool fAdd;
+
+    CClaimScriptIndexOp() : fAdd(false) {}
+
+    CClaimScriptIndexOp(const uint160& hashScript, const uint160& claimId, bool fAdd)
+    : hashScript(hashScript), claimId(claimId), fAdd(fAdd) {}
+};
+
 typedef std::map<std::string, CClaimTrieNode*, nodenamecompare> nodeCacheType;
 
 typedef std::map<std::string, uint256> hashMapType;
 
+typedef std::set<std::string, nodenamecompare> dirtyHashesType;
+
 struct claimsForNameType
 {
     std::vector<CClaimValue> claims;
@@ -303,24 +552,56 @@ public:
                , nCurrentHeight(0), nExpirationTime(Params().GetConsensus().nOriginalClaimExpirationTime)
                , nProportionalDelayFactor(nProportionalDelayFactor)
                , root(uint256S("0000000000000000000000000000000000000000000000000000000000000001"))
+               , fPendingFlushOk(true)
+               , nReadAheadStart(0)
+               , nReadAheadEnd(0)
+               , nTotalNames(0)
+               , nTotalClaims(0)
+               , nTotalClaimsValue(0)
+               , nTotalControllingValue(0)
     {}
 
     uint256 getMerkleHash();
+    uint256 getMerkleHashCompact();
 
     bool empty() const;
     void clear();
 
-    bool checkConsistency() const;
+    bool checkConsistency(bool fIncremental = false) const;
+
+    ~CClaimTrie() { waitForPendingFlush(); }
 
-    bool WriteToDisk();
+    bool WriteToDisk(bool fAsync = false);
+    size_t DynamicMemoryUsage() const;
+    void getNodeStats(uint64_t& nNodes, uint64_t& nNodesWithClaims, uint32_t& nMaxDepth) const;
     bool ReadFromDisk(bool check = false);
+    void waitForPendingFlush() const;
+
+    bool WriteSnapshot();
+    bool ReadSnapshot();
 
     std::vector<namedNodeType> flattenTrie() const;
+    std::vector<namedNodeType> getClaimedNames(const std::string& sStart,
+                                               size_t nMaxNames) const;
+    std::vector<std::string> getNamesByPrefix(const std::string& sPrefix,
+                                              const std::string& sStart,
+                                              size_t nMaxNames) const;
     bool getInfoForName(const std::string& name, CClaimValue& claim) const;
     bool getLastTakeoverForName(const std::string& name, int& lastTakeoverHeight) const;
 
     claimsForNameType getClaimsForName(const std::string& name) const;
-    CAmount getEffectiveAmountForClaim(const std::string& name, uint160 claimId) const;   
+    CAmount getEffectiveAmountForClaim(const std::string& name, uint160 claimId) const;
+
+    /** Reload the shed (non-winning) claims of a node from its TRIE_NODE
+     *  row. A no-op for fully resident nodes. The reloaded list is exactly
+     *  what a fresh load from disk would hold, so this is logically const.
+     */
+    bool restoreShedClaims(const std::string& name, const CClaimTrieNode* node) const;
+
+    bool getPendingClaimsForName(const std::string& name,
+                                 std::vector<CClaimValue>& claims) const;
+    bool getPendingSupportsForName(const std::string& name,
+                                   std::vector<CSupportValue>& supports) const;
 
     bool queueEmpty() const;
     bool supportEmpty() const;
@@ -341,6 +622,21 @@ public:
     bool getSupportQueueRow(int nHeight, supportQueueRowType& row) const;
     bool getSupportQueueNameRow(const std::string& name, queueNameRowType& row) const;
     bool getSupportExpirationQueueRow(int nHeight, expirationQueueRowType& row) const;
+    void getExpirationForecast(int nStartHeight, int nEndHeight,
+                               expirationQueueType& mapClaimExpirations,
+                               expirationQueueType& mapSupportExpirations) const;
+
+    bool getClaimOpJournal(int nHeight, claimOpJournalRowType& row) const;
+    void writeClaimOpJournal(int nHeight, const claimOpJournalRowType& row);
+    void eraseClaimOpJournal(int nHeight);
+
+    bool getClaimHistory(const std::string& name, claimHistoryRowType& row) const;
+    void appendClaimHistory(int nHeight, const claimOpJournalRowType& vOps);
+    void trimClaimHistory(int nHeight, const std::set<std::string>& names);
+
+    bool getClaimsForScriptHash(const uint160& hashScript,
+                                std::vector<uint160>& claimIds) const;
+    void applyClaimScriptIndexOps(const std::vector<CClaimScriptIndexOp>& vOps);
 
 
     bool haveClaim(const std::string& name, const COutPoint& outPoint) const;
@@ -367,6 +663,7 @@ private:
     const CClaimTrieNode* getNodeForName(const std::string& name) const;
 
     bool update(nodeCacheType& cache, hashMapType& hashes,
+                hashMapType& compactHashes,
                 std::map<std::string, int>& takeoverHeights,
                 const uint256& hashBlock, claimQueueType& queueCache,
                 queueNameType& queueNameCache,
@@ -377,20 +674,47 @@ private:
                 expirationQueueType& supportExpirationQueueCache);
     bool updateName(const std::string& name, CClaimTrieNode* updatedNode);
     bool updateHash(const std::string& name, uint256& hash);
+    bool updateHashCompact(const std::string& name, uint256& hash);
     bool updateTakeoverHeight(const std::string& name, int nTakeoverHeight);
     bool recursiveNullify(CClaimTrieNode* node, std::string& name);
 
     bool recursiveCheckConsistency(const CClaimTrieNode* node) const;
+    void checkConsistencyShard(const std::vector<const CClaimTrieNode*>* subtrees,
+                               size_t nShard, size_t nShards, std::vector<char>* results) const;
 
     bool InsertFromDisk(const std::string& name, CClaimTrieNode* node);
 
+    uint64_t countSnapshotRecordsRecursive(const CClaimTrieNode* current, bool fRoot) const;
+    void recursiveNodeStats(const CClaimTrieNode* current, uint32_t nDepth, uint64_t& nNodes,
+                            uint64_t& nNodesWithClaims, uint32_t& nMaxDepth) const;
+    void recursiveWriteSnapshot(CAutoFile& fileout, const std::string& name,
+                                const CClaimTrieNode* current) const;
+
     unsigned int getTotalNamesRecursive(const CClaimTrieNode* current) const;
     unsigned int getTotalClaimsRecursive(const CClaimTrieNode* current) const;
     CAmount getTotalValueOfClaimsRecursive(const CClaimTrieNode* current,
                                            bool fControllingOnly) const;
+
+    void statsAddNodeClaims(const std::vector<CClaimValue>& claims);
+    void statsRemoveNodeClaims(const std::vector<CClaimValue>& claims);
+    void statsDropShedClaims(CClaimTrieNode* node);
+    void recomputeClaimsStats();
+    void shedClaimPayloads();
+    void recursiveShedClaimPayloads(CClaimTrieNode* current,
+                                    uint64_t& nNodesShed, uint64_t& nClaimsShed);
     bool recursiveFlattenTrie(const std::string& name,
                               const CClaimTrieNode* current,
                               std::vector<namedNodeType>& nodes) const;
+    void recursiveCollectClaimedNames(const std::string& name,
+                                      const CClaimTrieNode* current,
+                                      const std::string& sStart,
+                                      size_t nMaxNames,
+                                      std::vector<namedNodeType>& nodes) const;
+    void recursiveCollectNamesByPrefix(const std::string& name,
+                                       const CClaimTrieNode* current,
+                                       const std::string& sStart,
+                                       size_t nMaxNames,
+                                       std::vector<std::string>& names) const;
 
     void markNodeDirty(const std::string& name, CClaimTrieNode* node);
     void updateQueueRow(int nHeight, claimQueueRowType& row);
@@ -406,7 +730,7 @@ private:
     void BatchWriteNode(CDBBatch& batch, const std::string& name,
                         const CClaimTrieNode* pNode) const;
     void BatchEraseNode(CDBBatch& batch, const std::string& nome) const;
-    void BatchWriteClaimIndex(CDBBatch& batch) const;
+    void BatchWriteClaimIndex(CDBBatch& batch);
     void BatchWriteQueueRows(CDBBatch& batch);
     void BatchWriteQueueNameRows(CDBBatch& batch);
     void BatchWriteExpirationQueueRows(CDBBatch& batch);
@@ -429,6 +753,59 @@ private:
 
     nodeCacheType dirtyNodes;
     supportMapType dirtySupportNodes;
+
+    // first characters of names updated since the last consistency check;
+    // an incremental check only re-verifies these root subtrees
+    mutable std::set<unsigned char> subtreesDirtiedSinceCheck;
+
+    std::map<uint160, CClaimIndexElement> dirtyClaimIndexAdds;
+    std::set<uint160> dirtyClaimIndexErases;
+
+    claimIndexType claimIndex;
+
+    void loadClaimIndex();
+
+    // recently resolved names, so hot lookups skip the trie descent;
+    // cleared whenever a block updates the trie
+    static const size_t MAX_RESOLVE_CACHE_SIZE = 4096;
+    mutable boost::unordered_map<std::string, CClaimValue> resolveCache;
+
+    // rows captured by an in-flight asynchronous flush; consulted by the
+    // getters between the dirty maps and the database so reads stay
+    // coherent while the background write is still landing
+    mutable CCriticalSection cs_flushingState;
+    claimQueueType flushingQueueRows;
+    queueNameType flushingQueueNameRows;
+    expirationQueueType flushingExpirationQueueRows;
+    supportQueueType flushingSupportQueueRows;
+    queueNameType flushingSupportQueueNameRows;
+    expirationQueueType flushingSupportExpirationQueueRows;
+    supportMapType flushingSupportNodes;
+
+    mutable boost::thread flushThread;
+    bool fPendingFlushOk;
+
+    void commitFlushBatch(CDBBatch* batch);
+
+    // read-ahead window over the height-keyed queue keyspaces, refilled
+    // with one sequential scan per keyspace so steady-state sync does not
+    // issue several point reads per block; updates are mirrored into the
+    // window to keep it coherent with the database
+    static const int QUEUE_READ_AHEAD_HEIGHTS = 64;
+    void readAheadQueues(int nHeight) const;
+    mutable int nReadAheadStart;
+    mutable int nReadAheadEnd;
+    mutable claimQueueType readAheadClaimRows;
+    mutable expirationQueueType readAheadExpirationRows;
+    mutable supportQueueType readAheadSupportRows;
+    mutable expirationQueueType readAheadSupportExpirationRows;
+
+    // aggregates over the whole trie, kept current by updateName and
+    // recursiveNullify so gettotalclaims and friends need not walk it
+    unsigned int nTotalNames;
+    unsigned int nTotalClaims;
+    CAmount nTotalClaimsValue;
+    CAmount nTotalControllingValue;
 };
 
 class CClaimTrieProofNode
@@ -442,6 +819,15 @@ public:
     std::vector<std::pair<unsigned char, uint256> > children;
     bool hasValue;
     uint256 valHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(children);
+        READWRITE(hasValue);
+        READWRITE(valHash);
+    }
 };
 
 class CClaimTrieProof
@@ -453,6 +839,61 @@ public:
     bool hasValue;
     COutPoint outPoint;
     int nHeightOfLastTakeover;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nodes);
+        READWRITE(hasValue);
+        READWRITE(outPoint);
+        READWRITE(nHeightOfLastTakeover);
+    }
+};
+
+/** One name's part of a CClaimTrieBatchProof. The first nSharedNodes proof
+ *  nodes are not repeated; they are the leading nodes of the previous
+ *  entry's reconstructed node path. */
+class CClaimTrieBatchProofEntry
+{
+public:
+    CClaimTrieBatchProofEntry() : nSharedNodes(0), hasValue(false), nHeightOfLastTakeover(0) {};
+    std::string name;
+    uint32_t nSharedNodes;
+    std::vector<CClaimTrieProofNode> nodes;
+    bool hasValue;
+    COutPoint outPoint;
+    int nHeightOfLastTakeover;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(name);
+        READWRITE(nSharedNodes);
+        READWRITE(nodes);
+        READWRITE(hasValue);
+        READWRITE(outPoint);
+        READWRITE(nHeightOfLastTakeover);
+    }
+};
+
+/** Proofs for a sorted set of names against one trie state. Path nodes
+ *  shared between consecutive names appear only in the first entry that
+ *  uses them, so proofs for a batch of related names (e.g. one channel)
+ *  do not repeat the nodes near the root. */
+class CClaimTrieBatchProof
+{
+public:
+    CClaimTrieBatchProof() {};
+    std::vector<CClaimTrieBatchProofEntry> entries;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(entries);
+    }
 };
 
 class CClaimTrieCache
@@ -467,6 +908,10 @@ public:
     }
 
     uint256 getMerkleHash() const;
+    uint256 getMerkleHashCompact() const;
+    //! True once the compact commitment is maintained alongside the legacy
+    //! hash during the incremental recompute (the transition window).
+    bool compactHashesActive() const;
 
     bool empty() const;
     bool flush();
@@ -516,6 +961,8 @@ public:
                              bool fCheckTakeover = false) const;
     CClaimTrieProof getProofForName(const std::string& name) const;
 
+    bool getInfoForName(const std::string& name, CClaimValue& claim) const;
+
     bool finalizeDecrement() const;
 
     void removeAndAddSupportToExpirationQueue(expirationQueueRowType &row, int height, bool increment) const;
@@ -531,8 +978,9 @@ protected:
 
     mutable nodeCacheType cache;
     mutable nodeCacheType block_originals;
-    mutable std::set<std::string> dirtyHashes;
+    mutable dirtyHashesType dirtyHashes;
     mutable hashMapType cacheHashes;
+    mutable hashMapType cacheCompactHashes;
     mutable claimQueueType claimQueueCache;
     mutable queueNameType claimQueueNameCache;
     mutable expirationQueueType expirationQueueCache;
@@ -550,8 +998,18 @@ protected:
     uint256 computeHash() const;
 
     bool reorderTrieNode(const std::string& name, bool fCheckTakeover) const;
-    bool recursiveComputeMerkleHash(CClaimTrieNode* tnCurrent,
-                                    std::string sPos) const;
+    void saveBlockOriginal(const std::string& name, const CClaimTrieNode* node) const;
+    CClaimTrieNode* nodeForPosition(const std::string& position) const;
+    bool computeMerkleHashForNode(CClaimTrieNode* tnCurrent,
+                                  const std::string& sPos,
+                                  hashMapType& results,
+                                  hashMapType& resultsCompact,
+                                  bool fCompact) const;
+    void hashDirtyLevelShard(const std::vector<std::pair<std::string, CClaimTrieNode*> >* level,
+                             size_t nShard, size_t nShards,
+                             hashMapType* results,
+                             hashMapType* resultsCompact,
+                             bool fCompact) const;
     bool recursivePruneName(CClaimTrieNode* tnCurrent, unsigned int nPos,
                             std::string sName,
                             bool* pfNullified = NULL) const;
@@ -37,11 +37,21 @@ bool CCoins::Spend(uint32_t nPos)
     if (nPos >= vout.size() || vout[nPos].IsNull())
         return false;
     vout[nPos].SetNull();
+    if (fSpendTracking)
+        setSpentSinceRead.insert(nPos);
     Cleanup();
     return true;
 }
 
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
+bool CCoinsView::PeekCoins(const uint256 &txid, CCoins &coins) const { return GetCoins(txid, coins); }
+void CCoinsView::PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const {
+    CCoins coins;
+    for (std::vector<uint256>::const_iterator it = vtxids.begin(); it != vtxids.end(); it++) {
+        if (PeekCoins(*it, coins))
+            mapCoins[*it] = coins;
+    }
+}
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
@@ -50,14 +60,14 @@ CCoinsViewCursor *CCoinsView::Cursor() const { return 0; }
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
+bool CCoinsViewBacked::PeekCoins(const uint256 &txid, CCoins &coins) const { return base->PeekCoins(txid, coins); }
+void CCoinsViewBacked::PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const { base->PeekCoinsBatch(vtxids, mapCoins); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 
-CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
-
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
@@ -66,7 +76,16 @@ CCoinsViewCache::~CCoinsViewCache()
 }
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    return cacheCoins.DynamicMemoryUsage() + cachedCoinsUsage;
+}
+
+size_t CCoinsViewCache::DirtyMemoryUsage() const {
+    size_t nUsage = 0;
+    for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            nUsage += it->second.coins.DynamicMemoryUsage();
+    }
+    return nUsage;
 }
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
@@ -150,6 +169,50 @@ bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
     return (it != cacheCoins.end() && !it->second.coins.vout.empty());
 }
 
+bool CCoinsViewCache::PeekCoins(const uint256 &txid, CCoins &coins) const {
+    CCoinsMap::const_iterator it = cacheCoins.find(txid);
+    if (it != cacheCoins.end()) {
+        coins = it->second.coins;
+        return true;
+    }
+    return base->PeekCoins(txid, coins);
+}
+
+void CCoinsViewCache::WarmCoinsBatch(const std::vector<uint256> &vtxids) {
+    std::vector<uint256> vMisses;
+    for (std::vector<uint256>::const_iterator it = vtxids.begin(); it != vtxids.end(); it++) {
+        if (cacheCoins.find(*it) == cacheCoins.end())
+            vMisses.push_back(*it);
+    }
+    if (vMisses.empty())
+        return;
+    std::map<uint256, CCoins> mapCoins;
+    base->PeekCoinsBatch(vMisses, mapCoins);
+    for (std::map<uint256, CCoins>::iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        CCoinsMap::iterator itCache = cacheCoins.insert(std::make_pair(it->first, CCoinsCacheEntry())).first;
+        itCache->second.coins.swap(it->second);
+        if (itCache->second.coins.IsPruned()) {
+            // The parent only has an empty entry for this txid; we can
+            // consider our version as fresh, same as FetchCoins does.
+            itCache->second.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += itCache->second.coins.DynamicMemoryUsage();
+    }
+}
+
+void CCoinsViewCache::PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const {
+    std::vector<uint256> vMisses;
+    for (std::vector<uint256>::const_iterator it = vtxids.begin(); it != vtxids.end(); it++) {
+        CCoinsMap::const_iterator itCache = cacheCoins.find(*it);
+        if (itCache != cacheCoins.end())
+            mapCoins[*it] = itCache->second.coins;
+        else
+            vMisses.push_back(*it);
+    }
+    if (!vMisses.empty())
+        base->PeekCoinsBatch(vMisses, mapCoins);
+}
+
 bool CCoinsViewCache::HaveCoinsInCache(const uint256 &txid) const {
     CCoinsMap::const_iterator it = cacheCoins.find(txid);
     return it != cacheCoins.end();
@@ -217,6 +280,35 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    assert(!hasModifier);
+    // BatchWrite consumes the map it is given, so hand it copies of the
+    // dirty subset and keep the entries cached for further reads.
+    CCoinsMap mapDirty;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapDirty[it->first];
+            entry.coins = it->second.coins;
+            entry.flags = it->second.flags;
+            if (it->second.coins.IsPruned()) {
+                // The spent output is deleted from the base below; there is
+                // no point keeping it cached.
+                cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+                CCoinsMap::iterator itOld = it++;
+                cacheCoins.erase(itOld);
+                continue;
+            }
+            // Once written, the entry exists in the base, so it is neither
+            // dirty nor fresh from our point of view anymore.
+            it->second.flags = 0;
+        }
+        ++it;
+    }
+    if (mapDirty.empty())
+        return true;
+    return base->BatchWrite(mapDirty, hashBlock);
+}
+
 void CCoinsViewCache::Uncache(const uint256& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
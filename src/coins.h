@@ -8,6 +8,7 @@
 
 #include "compressor.h"
 #include "core_memusage.h"
+#include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -15,6 +16,8 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <set>
+
 #include <boost/foreach.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -86,11 +89,37 @@ public:
     //! as new tx version will probably only be introduced at certain heights
     int nVersion;
 
+    //! Memory only: bookkeeping for the per-txout database layout. The disk
+    //! view records where the record came from and which outputs have been
+    //! spent since the read, so flushing a partial spend can erase just the
+    //! consumed rows instead of rewriting the whole record. The tracking is
+    //! dropped as soon as the record is mutated through anything other than
+    //! Spend(), which forces the full rewrite path.
+    bool fStoredPerTxout;              //!< the on-disk copy uses per-output rows
+    bool fSpendTracking;               //!< setSpentSinceRead covers every change since the read
+    uint32_t nDiskVoutSize;            //!< vout.size() of the on-disk copy
+    std::set<uint32_t> setSpentSinceRead;
+
+    //! record that the current contents match the on-disk copy
+    void SetDiskOrigin(bool fPerTxout) {
+        fStoredPerTxout = fPerTxout;
+        fSpendTracking = true;
+        nDiskVoutSize = vout.size();
+        setSpentSinceRead.clear();
+    }
+
+    //! the contents no longer differ from disk by spends alone
+    void InvalidateSpendTracking() {
+        fSpendTracking = false;
+        setSpentSinceRead.clear();
+    }
+
     void FromTx(const CTransaction &tx, int nHeightIn) {
         fCoinBase = tx.IsCoinBase();
         vout = tx.vout;
         nHeight = nHeightIn;
         nVersion = tx.nVersion;
+        InvalidateSpendTracking();
         ClearUnspendable();
     }
 
@@ -104,10 +133,11 @@ public:
         std::vector<CTxOut>().swap(vout);
         nHeight = 0;
         nVersion = 0;
+        InvalidateSpendTracking();
     }
 
     //! empty constructor
-    CCoins() : fCoinBase(false), vout(0), nHeight(0), nVersion(0) { }
+    CCoins() : fCoinBase(false), vout(0), nHeight(0), nVersion(0), fStoredPerTxout(false), fSpendTracking(false), nDiskVoutSize(0) { }
 
     //!remove spent outputs at the end of vout
     void Cleanup() {
@@ -118,6 +148,7 @@ public:
     }
 
     void ClearUnspendable() {
+        InvalidateSpendTracking();
         BOOST_FOREACH(CTxOut &txout, vout) {
             if (txout.scriptPubKey.IsUnspendable())
                 txout.SetNull();
@@ -130,6 +161,10 @@ public:
         to.vout.swap(vout);
         std::swap(to.nHeight, nHeight);
         std::swap(to.nVersion, nVersion);
+        std::swap(to.fStoredPerTxout, fStoredPerTxout);
+        std::swap(to.fSpendTracking, fSpendTracking);
+        std::swap(to.nDiskVoutSize, nDiskVoutSize);
+        to.setSpentSinceRead.swap(setSpentSinceRead);
     }
 
     //! equality test
@@ -264,24 +299,6 @@ public:
     }
 };
 
-class CCoinsKeyHasher
-{
-private:
-    uint256 salt;
-
-public:
-    CCoinsKeyHasher();
-
-    /**
-     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
-     * unordered_map will behave unpredictably if the custom hasher returns a
-     * uint64_t, resulting in failures when syncing the chain (#4634).
-     */
-    size_t operator()(const uint256& key) const {
-        return key.GetHash(salt);
-    }
-};
-
 struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
@@ -295,7 +312,226 @@ struct CCoinsCacheEntry
     CCoinsCacheEntry() : coins(), flags(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+/** Open-addressing hash map from txid to CCoinsCacheEntry.
+ *
+ *  The probe array is flat (salted hash plus node pointer per slot, linear
+ *  probing), so a lookup costs one pass over adjacent slots followed by a
+ *  single dereference of the matching node, instead of the bucket-list walk
+ *  a node-based unordered_map does. Entries themselves stay heap allocated
+ *  because AccessCoins documents that returned pointers survive
+ *  modifications to other entries, which a fully inline table could not
+ *  honor across growth.
+ *
+ *  Iterators stay valid across rehashes (they hold the node pointer and
+ *  re-locate their slot by key on increment), and the usual
+ *  "itOld = it++; erase(itOld)" loop works: erasure leaves a tombstone.
+ */
+class CCoinsMap
+{
+public:
+    typedef std::pair<const uint256, CCoinsCacheEntry> value_type;
+    typedef size_t size_type;
+
+private:
+    struct Slot {
+        size_t hash;       //!< salted hash of the key, 0 = empty, 1 = tombstone
+        value_type* pnode;
+        Slot() : hash(0), pnode(NULL) {}
+    };
+
+    std::vector<Slot> vSlots;
+    size_t nEntries;
+    size_t nTombstones;
+    CSaltedTxidHasher hasher;
+
+    size_t HashKey(const uint256& key) const
+    {
+        size_t h = hasher(key);
+        return h < 2 ? h + 2 : h; // reserve 0 and 1 for slot states
+    }
+
+    //! Find the slot holding key, or the first insertable slot if absent.
+    size_t Probe(const uint256& key, size_t hash, bool& fFound) const
+    {
+        size_t mask = vSlots.size() - 1;
+        size_t pos = hash & mask;
+        size_t posInsert = (size_t)-1;
+        while (true) {
+            const Slot& slot = vSlots[pos];
+            if (slot.hash == 0) {
+                fFound = false;
+                return posInsert != (size_t)-1 ? posInsert : pos;
+            }
+            if (slot.hash == 1) {
+                if (posInsert == (size_t)-1)
+                    posInsert = pos;
+            } else if (slot.hash == hash && slot.pnode->first == key) {
+                fFound = true;
+                return pos;
+            }
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    void Rehash(size_t nNewSize)
+    {
+        std::vector<Slot> vOld;
+        vOld.swap(vSlots);
+        vSlots.resize(nNewSize);
+        nTombstones = 0;
+        size_t mask = nNewSize - 1;
+        for (std::vector<Slot>::iterator it = vOld.begin(); it != vOld.end(); it++) {
+            if (it->hash < 2)
+                continue;
+            size_t pos = it->hash & mask;
+            while (vSlots[pos].hash != 0)
+                pos = (pos + 1) & mask;
+            vSlots[pos] = *it;
+        }
+    }
+
+    void GrowIfNeeded()
+    {
+        if (vSlots.empty()) {
+            vSlots.resize(16);
+        } else if ((nEntries + nTombstones + 1) * 10 >= vSlots.size() * 7) {
+            // grow when the live load justifies it, otherwise just clear tombstones
+            Rehash(nEntries * 10 >= vSlots.size() * 5 ? vSlots.size() * 2 : vSlots.size());
+        }
+    }
+
+    //! Index of the next occupied slot at or after pos, or size() if none.
+    size_t ScanOccupied(size_t pos) const
+    {
+        while (pos < vSlots.size() && vSlots[pos].hash < 2)
+            pos++;
+        return pos;
+    }
+
+public:
+    class iterator
+    {
+        friend class CCoinsMap;
+        const CCoinsMap* pmap;
+        value_type* pnode;
+        iterator(const CCoinsMap* pmapIn, value_type* pnodeIn) : pmap(pmapIn), pnode(pnodeIn) {}
+
+    public:
+        iterator() : pmap(NULL), pnode(NULL) {}
+        value_type& operator*() const { return *pnode; }
+        value_type* operator->() const { return pnode; }
+        bool operator==(const iterator& rhs) const { return pnode == rhs.pnode; }
+        bool operator!=(const iterator& rhs) const { return pnode != rhs.pnode; }
+        iterator& operator++()
+        {
+            bool fFound = false;
+            size_t pos = pmap->Probe(pnode->first, pmap->HashKey(pnode->first), fFound);
+            assert(fFound);
+            pos = pmap->ScanOccupied(pos + 1);
+            pnode = pos < pmap->vSlots.size() ? pmap->vSlots[pos].pnode : NULL;
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator ret = *this;
+            ++(*this);
+            return ret;
+        }
+    };
+    typedef iterator const_iterator;
+
+    CCoinsMap() : nEntries(0), nTombstones(0) {}
+    CCoinsMap(const CCoinsMap& rhs) : nEntries(0), nTombstones(0)
+    {
+        for (const_iterator it = rhs.begin(); it != rhs.end(); it++)
+            insert(*it);
+    }
+    CCoinsMap& operator=(const CCoinsMap& rhs)
+    {
+        if (this != &rhs) {
+            clear();
+            for (const_iterator it = rhs.begin(); it != rhs.end(); it++)
+                insert(*it);
+        }
+        return *this;
+    }
+    ~CCoinsMap() { clear(); }
+
+    iterator begin() const
+    {
+        size_t pos = ScanOccupied(0);
+        return iterator(this, pos < vSlots.size() ? vSlots[pos].pnode : NULL);
+    }
+    iterator end() const { return iterator(this, NULL); }
+
+    iterator find(const uint256& key) const
+    {
+        if (vSlots.empty())
+            return end();
+        bool fFound = false;
+        size_t pos = Probe(key, HashKey(key), fFound);
+        return fFound ? iterator(this, vSlots[pos].pnode) : end();
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        GrowIfNeeded();
+        size_t hash = HashKey(value.first);
+        bool fFound = false;
+        size_t pos = Probe(value.first, hash, fFound);
+        if (fFound)
+            return std::make_pair(iterator(this, vSlots[pos].pnode), false);
+        if (vSlots[pos].hash == 1)
+            nTombstones--;
+        vSlots[pos].hash = hash;
+        vSlots[pos].pnode = new value_type(value);
+        nEntries++;
+        return std::make_pair(iterator(this, vSlots[pos].pnode), true);
+    }
+
+    CCoinsCacheEntry& operator[](const uint256& key)
+    {
+        return insert(std::make_pair(key, CCoinsCacheEntry())).first->second;
+    }
+
+    size_type erase(const uint256& key)
+    {
+        if (vSlots.empty())
+            return 0;
+        bool fFound = false;
+        size_t pos = Probe(key, HashKey(key), fFound);
+        if (!fFound)
+            return 0;
+        delete vSlots[pos].pnode;
+        vSlots[pos].hash = 1;
+        vSlots[pos].pnode = NULL;
+        nEntries--;
+        nTombstones++;
+        return 1;
+    }
+
+    void erase(iterator it) { erase(it.pnode->first); }
+
+    void clear()
+    {
+        for (std::vector<Slot>::iterator it = vSlots.begin(); it != vSlots.end(); it++) {
+            if (it->hash >= 2)
+                delete it->pnode;
+        }
+        std::vector<Slot>().swap(vSlots);
+        nEntries = 0;
+        nTombstones = 0;
+    }
+
+    size_type size() const { return nEntries; }
+    bool empty() const { return nEntries == 0; }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(vSlots.capacity() * sizeof(Slot)) +
+               nEntries * memusage::MallocUsage(sizeof(value_type));
+    }
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -329,6 +565,14 @@ public:
     //! This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256 &txid) const;
 
+    //! Like GetCoins, but guaranteed not to modify any cache along the view
+    //! chain, so concurrent lookups are safe while no writer is active
+    virtual bool PeekCoins(const uint256 &txid, CCoins &coins) const;
+
+    //! As PeekCoins, for several txids at once; missing entries are left out
+    //! of mapCoins. Backends can service the whole batch in one pass.
+    virtual void PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const;
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -354,6 +598,8 @@ public:
     CCoinsViewBacked(CCoinsView *viewIn);
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
+    bool PeekCoins(const uint256 &txid, CCoins &coins) const;
+    void PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
@@ -408,6 +654,16 @@ public:
     // Standard CCoinsView methods
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
+    bool PeekCoins(const uint256 &txid, CCoins &coins) const;
+    void PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const;
+
+    //! Batch-fetch the given txids from the base view into this cache in one
+    //! sorted pass, so the point lookups that follow are all cache hits.
+    //! Already-cached entries are left untouched and absent txids stay
+    //! uncached. Unlike PeekCoinsBatch this mutates the cache, so it must not
+    //! run concurrently with other users of the view.
+    void WarmCoinsBatch(const std::vector<uint256> &vtxids);
+
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
@@ -451,6 +707,15 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base without
+     * emptying it: dirty entries are written down and kept (now clean) for
+     * further reads, spent ones are deleted. Frequent Sync() calls keep the
+     * dirty set small so the eventual Flush() has little left to write.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
     /**
      * Removes the transaction with the given hash from the cache, if it is
      * not modified.
@@ -463,7 +728,14 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
-    /** 
+    /**
+     * Byte size of the coins held by not-yet-written (DIRTY) entries.
+     * This walks the whole cache, so call it at background cadence, not
+     * once per block.
+     */
+    size_t DirtyMemoryUsage() const;
+
+    /**
      * Amount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
      * so may not be able to calculate this.
@@ -93,8 +93,17 @@ typedef u_int SOCKET;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// The socket event loop is backed by epoll on Linux and by poll() on other
+// Unix systems, so descriptors above FD_SETSIZE are only a problem for the
+// select()-based Windows path.
+#if defined(__linux__) && !defined(WIN32)
+#define USE_EPOLL 1
+#elif !defined(WIN32)
+#define USE_POLL 1
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(USE_EPOLL) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
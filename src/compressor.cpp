@@ -183,3 +183,134 @@ uint64_t CTxOutCompressor::DecompressAmount(uint64_t x)
     }
     return n;
 }
+
+namespace {
+
+const size_t LZ4_MINMATCH = 4;      //!< minimum encodable match length
+const size_t LZ4_LASTLITERALS = 5;  //!< the format requires the block to end in literals
+const size_t LZ4_MFLIMIT = 12;      //!< no matches may start within this distance of the end
+const size_t LZ4_MAXDISTANCE = 65535;
+
+uint32_t LZ4HashPosition(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761U) >> 16;
+}
+
+void LZ4WriteLength(std::vector<unsigned char>& vchOut, size_t nLen)
+{
+    while (nLen >= 255) {
+        vchOut.push_back(255);
+        nLen -= 255;
+    }
+    vchOut.push_back((unsigned char)nLen);
+}
+
+} // anon namespace
+
+size_t LZ4Compress(const unsigned char* pIn, size_t nInLen, std::vector<unsigned char>& vchOut)
+{
+    vchOut.clear();
+    vchOut.reserve(nInLen + nInLen / 255 + 16);
+    const unsigned char* const pBase = pIn;
+    const unsigned char* const pEnd = pIn + nInLen;
+    const unsigned char* ip = pIn;
+    const unsigned char* pAnchor = pIn;
+    if (nInLen > LZ4_MFLIMIT) {
+        // Empty table slots point at position 0; a stale candidate is harmless
+        // because the byte comparison below verifies every match.
+        std::vector<uint32_t> vHashTable(65536, 0);
+        const unsigned char* const pMatchStartLimit = pEnd - LZ4_MFLIMIT;
+        const unsigned char* const pMatchEndLimit = pEnd - LZ4_LASTLITERALS;
+        while (ip < pMatchStartLimit) {
+            uint32_t nHash = LZ4HashPosition(ip);
+            const unsigned char* pMatch = pBase + vHashTable[nHash];
+            vHashTable[nHash] = (uint32_t)(ip - pBase);
+            if (pMatch < ip && (size_t)(ip - pMatch) <= LZ4_MAXDISTANCE && memcmp(pMatch, ip, LZ4_MINMATCH) == 0) {
+                const unsigned char* ipMatchEnd = ip + LZ4_MINMATCH;
+                const unsigned char* pMatchScan = pMatch + LZ4_MINMATCH;
+                while (ipMatchEnd < pMatchEndLimit && *ipMatchEnd == *pMatchScan) {
+                    ipMatchEnd++;
+                    pMatchScan++;
+                }
+                size_t nLitLen = ip - pAnchor;
+                size_t nMatchCode = (ipMatchEnd - ip) - LZ4_MINMATCH;
+                size_t nTokenPos = vchOut.size();
+                vchOut.push_back(0);
+                if (nLitLen >= 15)
+                    LZ4WriteLength(vchOut, nLitLen - 15);
+                vchOut.insert(vchOut.end(), pAnchor, ip);
+                size_t nOffset = ip - pMatch;
+                vchOut.push_back((unsigned char)(nOffset & 0xff));
+                vchOut.push_back((unsigned char)(nOffset >> 8));
+                if (nMatchCode >= 15)
+                    LZ4WriteLength(vchOut, nMatchCode - 15);
+                vchOut[nTokenPos] = (unsigned char)((std::min(nLitLen, (size_t)15) << 4) | std::min(nMatchCode, (size_t)15));
+                ip = ipMatchEnd;
+                pAnchor = ip;
+            } else {
+                ip++;
+            }
+        }
+    }
+    // trailing literals
+    size_t nLitLen = pEnd - pAnchor;
+    vchOut.push_back((unsigned char)(std::min(nLitLen, (size_t)15) << 4));
+    if (nLitLen >= 15)
+        LZ4WriteLength(vchOut, nLitLen - 15);
+    vchOut.insert(vchOut.end(), pAnchor, pEnd);
+    return vchOut.size();
+}
+
+bool LZ4Decompress(const unsigned char* pIn, size_t nInLen, unsigned char* pOut, size_t nOutLen)
+{
+    const unsigned char* ip = pIn;
+    const unsigned char* const pInEnd = pIn + nInLen;
+    unsigned char* op = pOut;
+    unsigned char* const pOutEnd = pOut + nOutLen;
+    while (ip < pInEnd) {
+        unsigned char chToken = *ip++;
+        size_t nLitLen = chToken >> 4;
+        if (nLitLen == 15) {
+            unsigned char b;
+            do {
+                if (ip >= pInEnd)
+                    return false;
+                b = *ip++;
+                nLitLen += b;
+            } while (b == 255);
+        }
+        if (nLitLen > (size_t)(pInEnd - ip) || nLitLen > (size_t)(pOutEnd - op))
+            return false;
+        memcpy(op, ip, nLitLen);
+        op += nLitLen;
+        ip += nLitLen;
+        if (ip == pInEnd)
+            break; // the last sequence carries no match
+        if (pInEnd - ip < 2)
+            return false;
+        size_t nOffset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (nOffset == 0 || nOffset > (size_t)(op - pOut))
+            return false;
+        size_t nMatchLen = chToken & 15;
+        if (nMatchLen == 15) {
+            unsigned char b;
+            do {
+                if (ip >= pInEnd)
+                    return false;
+                b = *ip++;
+                nMatchLen += b;
+            } while (b == 255);
+        }
+        nMatchLen += LZ4_MINMATCH;
+        if (nMatchLen > (size_t)(pOutEnd - op))
+            return false;
+        // byte-wise so overlapping matches self-replicate
+        const unsigned char* pMatch = op - nOffset;
+        while (nMatchLen--)
+            *op++ = *pMatch++;
+    }
+    return op == pOutEnd && ip == pInEnd;
+}
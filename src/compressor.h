@@ -120,4 +120,18 @@ public:
     }
 };
 
+/** Compress a buffer using the LZ4 block format (greedy parser, 64 KiB
+ *  window). The implementation is self-contained so no external codec
+ *  library is needed; the output is standard LZ4 block data. Returns the
+ *  compressed size, which may exceed the input size for incompressible
+ *  data -- callers should compare and store such records uncompressed.
+ */
+size_t LZ4Compress(const unsigned char* pIn, size_t nInLen, std::vector<unsigned char>& vchOut);
+
+/** Decompress an LZ4 block into a buffer of exactly nOutLen bytes.
+ *  Returns false if the input is malformed or does not decode to the
+ *  expected size; all reads and writes are bounds checked.
+ */
+bool LZ4Decompress(const unsigned char* pIn, size_t nInLen, unsigned char* pOut, size_t nOutLen);
+
 #endif // BITCOIN_COMPRESSOR_H
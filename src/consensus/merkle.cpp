@@ -3,9 +3,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "merkle.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "utilstrencodings.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 /*     WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
        that the following merkle tree algorithm has a serious flaw related to
@@ -42,6 +46,15 @@
        root.
 */
 
+/* Combine two 32-byte hashes into one with double-SHA256, using the batched
+   64-byte primitive to avoid the CSHA256 streaming overhead. */
+static inline void MerkleCombine(const uint256& left, uint256& h) {
+    unsigned char buf[64];
+    memcpy(buf, left.begin(), 32);
+    memcpy(buf + 32, h.begin(), 32);
+    SHA256D64(h.begin(), buf, 1);
+}
+
 /* This implements a constant-space merkle root/path calculator, limited to 2^32 leaves. */
 static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot, bool* pmutated, uint32_t branchpos, std::vector<uint256>* pbranch) {
     if (pbranch) pbranch->clear();
@@ -80,7 +93,7 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
                 }
             }
             mutated |= (inner[level] == h);
-            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+            MerkleCombine(inner[level], h);
         }
         // Store the resulting hash at inner position level.
         inner[level] = h;
@@ -106,7 +119,7 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
         if (pbranch && matchh) {
             pbranch->push_back(h);
         }
-        CHash256().Write(h.begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+        MerkleCombine(h, h);
         // Increment count to the value it would have if two entries at this
         // level had existed.
         count += (((uint32_t)1) << level);
@@ -121,7 +134,7 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
                     matchh = true;
                 }
             }
-            CHash256().Write(inner[level].begin(), 32).Write(h.begin(), 32).Finalize(h.begin());
+            MerkleCombine(inner[level], h);
             level++;
         }
     }
@@ -130,10 +143,51 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+/** Worker for the parallel levels of ComputeMerkleRoot: double-SHA256 a
+ *  contiguous range of pairs from one level into the next. */
+static void MerkleLevelWorker(unsigned char* out, const unsigned char* in, size_t blocks) {
+    SHA256D64(out, in, blocks);
+}
+
+/** Minimum number of pairs in a level before it is worth fanning the
+ *  hashing out to multiple threads. */
+static const size_t MIN_PARALLEL_MERKLE_PAIRS = 256;
+
+uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* pmutated) {
+    // Hash whole levels at a time through the batched 64-byte primitive
+    // instead of streaming pair by pair, spreading large levels across
+    // threads. MerkleComputation above remains for branch/proof callers.
+    std::vector<uint256> hashes(leaves);
+    std::vector<uint256> next;
+    bool mutated = false;
+    size_t nThreads = boost::thread::hardware_concurrency();
+    while (hashes.size() > 1) {
+        for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2)
+            mutated |= (hashes[pos] == hashes[pos + 1]);
+        if (hashes.size() & 1)
+            hashes.push_back(hashes.back());
+        size_t pairs = hashes.size() / 2;
+        if (nThreads >= 2 && pairs >= MIN_PARALLEL_MERKLE_PAIRS) {
+            // Workers on disjoint in-place ranges would race (one range's
+            // output overlaps another's input), so write to a second buffer.
+            next.resize(pairs);
+            boost::thread_group group;
+            size_t nChunk = (pairs + nThreads - 1) / nThreads;
+            for (size_t start = 0; start < pairs; start += nChunk) {
+                size_t n = std::min(nChunk, pairs - start);
+                group.create_thread(boost::bind(&MerkleLevelWorker, next[start].begin(), hashes[2 * start].begin(), n));
+            }
+            group.join_all();
+            hashes.swap(next);
+        } else {
+            // In place is fine single-threaded: SHA256D64 writes behind its reads.
+            SHA256D64(hashes[0].begin(), hashes[0].begin(), pairs);
+            hashes.resize(pairs);
+        }
+    }
+    if (pmutated) *pmutated = mutated;
+    if (hashes.empty()) return uint256();
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
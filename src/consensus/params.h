@@ -61,6 +61,11 @@ struct Params {
     int64_t nOriginalClaimExpirationTime;
     int64_t nExtendedClaimExpirationTime;
     int64_t nExtendedClaimExpirationForkHeight;
+    /** Height from which the compact (single-SHA256, fixed-layout) claim
+     *  trie commitment is computed alongside the legacy hash. The legacy
+     *  root stays the consensus commitment; this only opens the dual
+     *  computation window for the planned hash upgrade fork. */
+    int64_t nClaimTrieCompactHashForkHeight;
     int64_t GetExpirationTime(int64_t nHeight) const {
         return nHeight < nExtendedClaimExpirationForkHeight ?
             nOriginalClaimExpirationTime :
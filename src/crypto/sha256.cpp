@@ -128,8 +128,90 @@ void Transform(uint32_t* s, const unsigned char* chunk)
 }
 
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*);
+
+/** The transform used by CSHA256 and SHA256D64. Defaults to the portable
+ *  implementation; SHA256AutoDetect() may switch it to a specialized one.
+ *  Only written before other threads start hashing. */
+TransformType Transform = &sha256::Transform;
+
 } // namespace
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__))
+#include <cpuid.h>
+/** SHA-NI transform, defined in sha256_shani.cpp. */
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk);
+}
+#endif
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__))
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29))) {
+        // Self-test against the portable implementation before switching.
+        unsigned char chunk[64];
+        for (int i = 0; i < 64; i++)
+            chunk[i] = (unsigned char)i;
+        uint32_t stateA[8], stateB[8];
+        sha256::Initialize(stateA);
+        sha256::Initialize(stateB);
+        sha256::Transform(stateA, chunk);
+        sha256_shani::Transform(stateB, chunk);
+        if (memcmp(stateA, stateB, sizeof(stateA)) == 0) {
+            Transform = &sha256_shani::Transform;
+            ret = "shani(1way)";
+        }
+    }
+#endif
+    return ret;
+}
+
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks)
+{
+    // Padding blocks for a 64-byte message (first hash) and a 32-byte
+    // message (second hash); the lengths are 512 and 256 bits.
+    unsigned char pad64[64];
+    unsigned char buffer[64];
+    memset(pad64, 0, 64);
+    pad64[0] = 0x80;
+    pad64[62] = 0x02;
+    memset(buffer + 32, 0, 32);
+    buffer[32] = 0x80;
+    buffer[62] = 0x01;
+
+    uint32_t s[8];
+    while (blocks--) {
+        sha256::Initialize(s);
+        Transform(s, input);
+        Transform(s, pad64);
+        WriteBE32(buffer, s[0]);
+        WriteBE32(buffer + 4, s[1]);
+        WriteBE32(buffer + 8, s[2]);
+        WriteBE32(buffer + 12, s[3]);
+        WriteBE32(buffer + 16, s[4]);
+        WriteBE32(buffer + 20, s[5]);
+        WriteBE32(buffer + 24, s[6]);
+        WriteBE32(buffer + 28, s[7]);
+        sha256::Initialize(s);
+        Transform(s, buffer);
+        WriteBE32(output, s[0]);
+        WriteBE32(output + 4, s[1]);
+        WriteBE32(output + 8, s[2]);
+        WriteBE32(output + 12, s[3]);
+        WriteBE32(output + 16, s[4]);
+        WriteBE32(output + 20, s[5]);
+        WriteBE32(output + 24, s[6]);
+        WriteBE32(output + 28, s[7]);
+        input += 64;
+        output += 32;
+    }
+}
+
 
 ////// SHA-256
 
@@ -147,12 +229,12 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf);
         bufsize = 0;
     }
     while (end >= data + 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
+        Transform(s, data);
         bytes += 64;
         data += 64;
     }
@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <string>
+
 /** A hasher class for SHA-256. */
 class CSHA256
 {
@@ -25,4 +27,15 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA-256 implementation for the running CPU
+ *  (e.g. SHA-NI) and switch to it. Safe to call at most once, before any
+ *  other threads hash; returns the name of the implementation selected. */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte inputs.
+ *  output: pointer to a blocks*32 byte output buffer
+ *  input:  pointer to a blocks*64 byte input buffer
+ *  blocks: the number of hashes to compute. */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
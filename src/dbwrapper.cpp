@@ -4,17 +4,29 @@
 
 #include "dbwrapper.h"
 
+#include "perf.h"
+#include "sync.h"
 #include "util.h"
 #include "random.h"
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
+#include <set>
 #include <stdint.h>
 
+//! Batch writes slower than this (in milliseconds) are logged together with
+//! the level-0 file count, to correlate latency spikes with compaction.
+static const int64_t DEFAULT_DB_STALL_THRESHOLD_MS = 250;
+
+//! All open databases, so the stats RPC can walk them.
+static CCriticalSection cs_dbRegistry;
+static std::set<CDBWrapper*> setDBInstances;
+
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
 {
     if (status.ok())
@@ -29,14 +41,28 @@ void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
     throw dbwrapper_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+
+CDBOptions::CDBOptions()
+{
+    nBloomBitsPerKey = GetArg("-dbbloombits", DEFAULT_DB_BLOOM_BITS);
+    nBlockSize = GetArg("-dbblocksize", 0);
+    nMaxOpenFiles = GetArg("-dbmaxopenfiles", DEFAULT_DB_MAX_OPEN_FILES);
+    fCompression = GetBoolArg("-dbcompression", false);
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dbopts)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    if (dbopts.nBloomBitsPerKey > 0)
+        options.filter_policy = leveldb::NewBloomFilterPolicy(dbopts.nBloomBitsPerKey);
+    if (dbopts.nBlockSize > 0)
+        options.block_size = dbopts.nBlockSize;
+    options.compression = dbopts.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbopts.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -45,14 +71,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBOptions& dbopts)
 {
     penv = NULL;
+    strName = fMemory ? "memory" : path.filename().string();
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbopts);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -87,11 +114,20 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         LogPrintf("Wrote new obfuscate key for %s: %s\n", path.string(), GetObfuscateKeyHex());
     }
 
+    fObfuscateKeyNull = ObfuscateKeyIsNull(obfuscate_key);
+
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), GetObfuscateKeyHex());
+
+    LOCK(cs_dbRegistry);
+    setDBInstances.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(cs_dbRegistry);
+        setDBInstances.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -104,11 +140,46 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync) throw(dbwrapper_error)
 {
+    CPerfTimer timer("leveldb.write");
+    static const int64_t nStallThreshold = GetArg("-dbstallthreshold", DEFAULT_DB_STALL_THRESHOLD_MS) * 1000;
+    int64_t nStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    if (nStallThreshold > 0 && nElapsed > nStallThreshold) {
+        // leveldb throttles or blocks writers while level 0 is backlogged,
+        // so report that count alongside the slow write
+        std::string strLevel0 = "?";
+        pdb->GetProperty("leveldb.num-files-at-level0", &strLevel0);
+        LogPrintf("LevelDB batch write to %s took %.2fms (%s files at level 0, likely compaction stall)\n",
+                  strName, nElapsed * 0.001, strLevel0);
+    }
     HandleError(status);
     return true;
 }
 
+void CDBWrapper::GetStats(CDBStats& stats) const
+{
+    stats.name = strName;
+    stats.vFilesPerLevel.clear();
+    for (int nLevel = 0; ; nLevel++) {
+        std::string strValue;
+        if (!pdb->GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), &strValue))
+            break;
+        stats.vFilesPerLevel.push_back(atoi(strValue.c_str()));
+    }
+    pdb->GetProperty("leveldb.stats", &stats.strStats);
+}
+
+void GetDBWrapperStats(std::vector<CDBStats>& vStats)
+{
+    vStats.clear();
+    LOCK(cs_dbRegistry);
+    BOOST_FOREACH(const CDBWrapper* pdbw, setDBInstances) {
+        vStats.push_back(CDBStats());
+        pdbw->GetStats(vStats.back());
+    }
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -25,6 +25,30 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error);
 
+/** Point-in-time snapshot of one open database's leveldb internals. */
+struct CDBStats
+{
+    //! database directory leaf name ("chainstate", "claimtrie", ...)
+    std::string name;
+    //! table file count per level; a level-0 backlog signals compaction pressure
+    std::vector<int> vFilesPerLevel;
+    //! leveldb's own per-level size and compaction table ("leveldb.stats")
+    std::string strStats;
+};
+
+/** Collect internal statistics for every open CDBWrapper instance. */
+void GetDBWrapperStats(std::vector<CDBStats>& vStats);
+
+/** True if the obfuscation key is the all-zero noop key, in which case
+ *  values can be parsed straight out of leveldb's buffers. */
+inline bool ObfuscateKeyIsNull(const std::vector<unsigned char>& key)
+{
+    for (size_t i = 0; i < key.size(); i++)
+        if (key[i] != 0)
+            return false;
+    return true;
+}
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -40,6 +64,8 @@ public:
      */
     CDBBatch(const std::vector<unsigned char> *obfuscate_key) : obfuscate_key(obfuscate_key) { };
 
+    void Clear() { batch.Clear(); }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -67,6 +93,19 @@ public:
 
         batch.Delete(slKey);
     }
+
+    /** Write a record whose key and value are already serialized, re-applying
+     *  value obfuscation. Used to restore whole-database dumps taken with
+     *  CDBIterator::GetKeyRaw/GetValueRaw. */
+    void WriteRaw(const std::vector<unsigned char>& vchKey, const std::vector<unsigned char>& vchValue)
+    {
+        leveldb::Slice slKey(vchKey.empty() ? NULL : (const char*)&vchKey[0], vchKey.size());
+        std::vector<unsigned char> vchObfuscated(vchValue);
+        if (!vchObfuscated.empty() && !ObfuscateKeyIsNull(*obfuscate_key))
+            XorData(&vchObfuscated[0], vchObfuscated.size(), *obfuscate_key);
+        leveldb::Slice slValue(vchObfuscated.empty() ? NULL : (const char*)&vchObfuscated[0], vchObfuscated.size());
+        batch.Put(slKey, slValue);
+    }
 };
 
 class CDBIterator
@@ -74,6 +113,7 @@ class CDBIterator
 private:
     leveldb::Iterator *piter;
     const std::vector<unsigned char> *obfuscate_key;
+    bool fObfuscateKeyNull;
 
 public:
 
@@ -82,7 +122,8 @@ public:
      * @param[in] obfuscate_key    If passed, XOR data with this key.
      */
     CDBIterator(leveldb::Iterator *piterIn, const std::vector<unsigned char>* obfuscate_key) :
-        piter(piterIn), obfuscate_key(obfuscate_key) { };
+        piter(piterIn), obfuscate_key(obfuscate_key),
+        fObfuscateKeyNull(ObfuscateKeyIsNull(*obfuscate_key)) { };
     ~CDBIterator();
 
     bool Valid();
@@ -100,9 +141,10 @@ public:
     void Next();
 
     template<typename K> bool GetKey(K& key) {
+        // keys are never obfuscated, so they can always be parsed in place
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CSpanReader ssKey(slKey.data(), slKey.size(), SER_DISK, CLIENT_VERSION);
             ssKey >> key;
         } catch (const std::exception&) {
             return false;
@@ -114,12 +156,32 @@ public:
         return piter->key().size();
     }
 
+    //! Copy out the raw serialized key bytes, for whole-database dumps.
+    void GetKeyRaw(std::vector<unsigned char>& vchKey) {
+        leveldb::Slice slKey = piter->key();
+        vchKey.assign(slKey.data(), slKey.data() + slKey.size());
+    }
+
+    //! Copy out the raw value bytes with obfuscation removed.
+    void GetValueRaw(std::vector<unsigned char>& vchValue) {
+        leveldb::Slice slValue = piter->value();
+        vchValue.assign(slValue.data(), slValue.data() + slValue.size());
+        if (!vchValue.empty() && !fObfuscateKeyNull)
+            XorData(&vchValue[0], vchValue.size(), *obfuscate_key);
+    }
+
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(*obfuscate_key);
-            ssValue >> value;
+            if (fObfuscateKeyNull) {
+                // common case: parse leveldb's buffer in place, no copy
+                CSpanReader ssValue(slValue.data(), slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+            } else {
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue.Xor(*obfuscate_key);
+                ssValue >> value;
+            }
         } catch (const std::exception&) {
             return false;
         }
@@ -132,6 +194,26 @@ public:
 
 };
 
+/** Per-instance leveldb tuning knobs.
+ *
+ * The default constructor picks up the -dbbloombits, -dbblocksize,
+ * -dbmaxopenfiles and -dbcompression arguments, so every database honors
+ * them unless a caller overrides individual fields before construction.
+ */
+struct CDBOptions
+{
+    //! bloom filter bits per key (0 disables the filter policy)
+    int nBloomBitsPerKey;
+    //! approximate uncompressed block size in bytes (0 = leveldb default)
+    size_t nBlockSize;
+    //! maximum number of open table files
+    int nMaxOpenFiles;
+    //! whether table blocks are snappy-compressed on disk
+    bool fCompression;
+
+    CDBOptions();
+};
+
 class CDBWrapper
 {
 private:
@@ -159,12 +241,18 @@ private:
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
+    //! whether obfuscate_key is the all-zero noop key
+    bool fObfuscateKeyNull;
+
     //! the key under which the obfuscation key is stored
     static const std::string OBFUSCATE_KEY_KEY;
 
     //! the length of the obfuscate key in number of bytes
     static const unsigned int OBFUSCATE_KEY_NUM_BYTES;
 
+    //! database directory leaf name, for stats and stall log lines
+    std::string strName;
+
     std::vector<unsigned char> CreateObfuscateKey() const;
 
 public:
@@ -175,8 +263,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbopts      Per-instance leveldb tuning; defaults follow the -db* arguments.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBOptions& dbopts = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -196,8 +285,11 @@ public:
             HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
+            // Deserialize straight out of the result buffer; the string is
+            // de-obfuscated in place instead of being copied into a stream.
+            if (!strValue.empty() && !fObfuscateKeyNull)
+                XorData((unsigned char*)&strValue[0], strValue.size(), obfuscate_key);
+            CSpanReader ssValue(strValue.data(), strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -205,6 +297,54 @@ public:
         return true;
     }
 
+    /**
+     * Read several keys in one pass. The keys are serialized, sorted, and
+     * serviced by a single iterator over one consistent snapshot, so
+     * neighbouring keys share table and block reads instead of paying a
+     * random point read apiece. Keys that are absent from the database are
+     * simply left out of mapValues; the return value is false only if a
+     * present value failed to deserialize.
+     */
+    template <typename K, typename V>
+    bool ReadBatch(const std::vector<K>& vKeys, std::map<K, V>& mapValues) const throw(dbwrapper_error)
+    {
+        if (vKeys.empty())
+            return true;
+        std::vector<std::pair<std::string, size_t> > vSorted;
+        vSorted.reserve(vKeys.size());
+        for (size_t i = 0; i < vKeys.size(); i++) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(ssKey.GetSerializeSize(vKeys[i]));
+            ssKey << vKeys[i];
+            vSorted.push_back(std::make_pair(std::string(&ssKey[0], ssKey.size()), i));
+        }
+        std::sort(vSorted.begin(), vSorted.end());
+        boost::scoped_ptr<leveldb::Iterator> piter(pdb->NewIterator(readoptions));
+        const bool fKeyNull = ObfuscateKeyIsNull(obfuscate_key);
+        bool fOk = true;
+        for (std::vector<std::pair<std::string, size_t> >::const_iterator it = vSorted.begin(); it != vSorted.end(); it++) {
+            leveldb::Slice slKey(it->first.data(), it->first.size());
+            piter->Seek(slKey);
+            if (!piter->Valid() || piter->key().compare(slKey) != 0)
+                continue;
+            try {
+                leveldb::Slice slValue = piter->value();
+                if (fKeyNull) {
+                    CSpanReader ssValue(slValue.data(), slValue.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> mapValues[vKeys[it->second]];
+                } else {
+                    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue.Xor(obfuscate_key);
+                    ssValue >> mapValues[vKeys[it->second]];
+                }
+            } catch (const std::exception&) {
+                mapValues.erase(vKeys[it->second]);
+                fOk = false;
+            }
+        }
+        return fOk;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false) throw(dbwrapper_error)
     {
@@ -274,6 +414,12 @@ public:
      */
     std::string GetObfuscateKeyHex() const;
 
+    /**
+     * Snapshot this database's leveldb internals (per-level file counts and
+     * the compaction statistics table).
+     */
+    void GetStats(CDBStats& stats) const;
+
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -8,6 +8,9 @@
 #include "crypto/hmac_sha512.h"
 #include "crypto/sha512.h"
 #include "pubkey.h"
+#include "random.h"
+
+#include <limits>
 
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
@@ -15,43 +18,29 @@ inline uint32_t ROTL32(uint32_t x, int8_t r)
     return (x << r) | (x >> (32 - r));
 }
 
-uint256 PoWHash(const std::vector<unsigned char>& input)
+uint256 PoWHash(const unsigned char* data, size_t len)
 {
-    CHash256 h256;
-    CSHA512 h512;
-    CRIPEMD160 h160;
-    
-    std::vector<unsigned char> out;
-    out.resize(h512.OUTPUT_SIZE);
-    
-    std::vector<unsigned char> out_small;
-    out_small.resize(h160.OUTPUT_SIZE);
-    
-    h256.Write(input.data(), input.size());
-    h256.Finalize(&out[0]);
-    h256.Reset();
-    
-    h512.Write(out.data(), h256.OUTPUT_SIZE);
-    h512.Finalize(&out[0]);
-
-
-    h160.Write(out.data(), h512.OUTPUT_SIZE / 2);
-    h160.Finalize(&out_small[0]);
-    h160.Reset();
-
-    h256.Write(out_small.data(), h160.OUTPUT_SIZE);
-
-    h160.Write(out.data() + h512.OUTPUT_SIZE / 2, h512.OUTPUT_SIZE / 2);
-    h160.Finalize(&out_small[0]);
-
-    out.resize(h256.OUTPUT_SIZE);
-    h256.Write(out_small.data(), h160.OUTPUT_SIZE);
-    h256.Finalize(&out[0]);
-
-    uint256 result(out);
+    // The whole chain runs on stack buffers; this is evaluated once per
+    // header during sync and millions of times by the miner, so avoid
+    // the allocations the obvious vector-based version would make.
+    unsigned char out[CSHA512::OUTPUT_SIZE];
+    unsigned char out_small[2 * CRIPEMD160::OUTPUT_SIZE];
+
+    CHash256().Write(data, len).Finalize(out);
+    CSHA512().Write(out, CHash256::OUTPUT_SIZE).Finalize(out);
+    CRIPEMD160().Write(out, CSHA512::OUTPUT_SIZE / 2).Finalize(out_small);
+    CRIPEMD160().Write(out + CSHA512::OUTPUT_SIZE / 2, CSHA512::OUTPUT_SIZE / 2).Finalize(out_small + CRIPEMD160::OUTPUT_SIZE);
+
+    uint256 result;
+    CHash256().Write(out_small, sizeof(out_small)).Finalize(result.begin());
     return result;
 }
 
+uint256 PoWHash(const std::vector<unsigned char>& input)
+{
+    return PoWHash(input.data(), input.size());
+}
+
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
 {
     // The following is MurmurHash3 (x86_32), see http://code.google.com/p/smhasher/source/browse/trunk/MurmurHash3.cpp
@@ -120,3 +109,139 @@ void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char he
     num[3] = (nChild >>  0) & 0xFF;
     CHMAC_SHA512(chainCode.begin(), chainCode.size()).Write(&header, 1).Write(data, 32).Write(num, 4).Finalize(output);
 }
+
+#define SIPROUND do { \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; \
+    v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; \
+    v2 = ROTL64(v2, 32); \
+} while (0)
+
+static inline uint64_t ROTL64(uint64_t x, int8_t b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+CSipHasher::CSipHasher(uint64_t k0, uint64_t k1)
+{
+    v[0] = 0x736f6d6570736575ULL ^ k0;
+    v[1] = 0x646f72616e646f6dULL ^ k1;
+    v[2] = 0x6c7967656e657261ULL ^ k0;
+    v[3] = 0x7465646279746573ULL ^ k1;
+    count = 0;
+    tmp = 0;
+}
+
+CSipHasher& CSipHasher::Write(uint64_t data)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+    assert(count % 8 == 0);
+
+    v3 ^= data;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= data;
+
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+
+    count += 8;
+    return *this;
+}
+
+CSipHasher& CSipHasher::Write(const unsigned char* data, size_t size)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    uint64_t t = tmp;
+    int c = count;
+
+    while (size--) {
+        t |= ((uint64_t)(*(data++))) << (8 * (c % 8));
+        c++;
+        if ((c & 7) == 0) {
+            v3 ^= t;
+            SIPROUND;
+            SIPROUND;
+            v0 ^= t;
+            t = 0;
+        }
+    }
+
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    v[3] = v3;
+    count = c;
+    tmp = t;
+
+    return *this;
+}
+
+uint64_t CSipHasher::Finalize() const
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+
+    uint64_t t = tmp | (((uint64_t)count) << 56);
+
+    v3 ^= t;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= t;
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val)
+{
+    /* Specialized implementation for efficiency */
+    uint64_t d = val.GetUint64(0);
+
+    uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64_t v3 = 0x7465646279746573ULL ^ k1 ^ d;
+
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(1);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(2);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    d = val.GetUint64(3);
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+    v3 ^= ((uint64_t)4) << 59;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= ((uint64_t)4) << 59;
+    v2 ^= 0xFF;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+CSaltedTxidHasher::CSaltedTxidHasher() :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
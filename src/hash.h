@@ -167,10 +167,69 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
     return ss.GetHash();
 }
 
+/** Compute the LBRY proof-of-work hash chain (sha256d -> sha512 ->
+ *  ripemd160 over each half -> sha256d) without heap allocations. */
+uint256 PoWHash(const unsigned char* data, size_t len);
 uint256 PoWHash(const std::vector<unsigned char>& input);
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/** SipHash-2-4 */
+class CSipHasher
+{
+private:
+    uint64_t v[4];
+    uint64_t tmp;
+    int count;
+
+public:
+    /** Construct a SipHash calculator initialized with 128-bit key (k0, k1) */
+    CSipHasher(uint64_t k0, uint64_t k1);
+    /** Hash a 64-bit integer worth of data
+     *  It is treated as if this was the little-endian interpretation of 8 bytes.
+     *  This function can only be used when a multiple of 8 bytes have been written so far.
+     */
+    CSipHasher& Write(uint64_t data);
+    /** Hash arbitrary bytes. */
+    CSipHasher& Write(const unsigned char* data, size_t size);
+    /** Compute the 64-bit SipHash-2-4 of the data written so far. The object remains untouched. */
+    uint64_t Finalize() const;
+};
+
+/** Optimized SipHash-2-4 implementation for uint256.
+ *
+ *  It is identical to:
+ *    SipHasher(k0, k1)
+ *      .Write(val.GetUint64(0))
+ *      .Write(val.GetUint64(1))
+ *      .Write(val.GetUint64(2))
+ *      .Write(val.GetUint64(3))
+ *      .Finalize()
+ */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+
+/** SipHash-keyed hasher for unordered containers keyed by txids or other
+ *  attacker-influenced uint256 values. Each instance draws its own random
+ *  128-bit key, so bucket placement cannot be predicted or ground offline
+ *  into degenerate chains.
+ *
+ *  operator() must return size_t: with Boost 1.46 on 32-bit systems the
+ *  unordered_map behaves unpredictably if the custom hasher returns a
+ *  uint64_t (#4634).
+ */
+class CSaltedTxidHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    CSaltedTxidHasher();
+
+    size_t operator()(const uint256& txid) const {
+        return SipHashUint256(k0, k1, txid);
+    }
+};
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 #endif // BITCOIN_HASH_H
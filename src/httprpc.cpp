@@ -174,9 +174,12 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
     JSONRequest jreq;
     try {
-        // Parse request
+        // Parse the request straight out of its input buffer; the view is
+        // valid until the reply is written, and nothing is copied in between.
+        size_t nBodySize = 0;
+        const char* pBody = req->ReadBodyView(nBodySize);
         UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
+        if (pBody == NULL || !valRequest.read(pBody))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         std::string strReply;
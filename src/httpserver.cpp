@@ -8,7 +8,9 @@
 #include "compat.h"
 #include "util.h"
 #include "netbase.h"
+#include "perf.h"
 #include "rpc/protocol.h" // For HTTP status codes
+#include "utilstrencodings.h"
 #include "sync.h"
 #include "ui_interface.h"
 
@@ -46,11 +48,13 @@ class HTTPWorkItem : public HTTPClosure
 {
 public:
     HTTPWorkItem(HTTPRequest* req, const std::string &path, const HTTPRequestHandler& func):
-        req(req), path(path), func(func)
+        req(req), path(path), func(func), nQueuedAtMicros(GetTimeMicros())
     {
     }
     void operator()()
     {
+        // time spent waiting for a worker, before any handler work
+        PerfSample("rpc.queuetime", GetTimeMicros() - nQueuedAtMicros);
         func(req.get(), path);
     }
 
@@ -59,6 +63,7 @@ public:
 private:
     std::string path;
     HTTPRequestHandler func;
+    int64_t nQueuedAtMicros;
 };
 
 /** Simple work queue for distributing work over multiple threads.
@@ -186,11 +191,54 @@ struct evhttp* eventHTTP = 0;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Separate queue for methods that routinely run for seconds, so they
+//! cannot occupy every worker and stall cheap calls behind them
+static WorkQueue<HTTPClosure>* workQueueSlow = 0;
+//! Request lifecycle counters, reported by the gethttpinfo RPC
+static CCriticalSection cs_httpstats;
+static uint64_t nHTTPRequestsTotal = 0;
+static uint64_t nHTTPRequestsSlow = 0;
+static uint64_t nHTTPRequestsShed = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
 
+/** Methods whose handlers walk the whole claim trie or UTXO set and can
+ *  run for seconds. Requests naming them are routed to their own queue. */
+static const char* const ppszSlowMethods[] = {
+    "getclaimsintrie",
+    "getclaimtrie",
+    "getclaimsforname",
+    "gettotalvalueofclaims",
+    "getblocktemplate",
+    "gettxoutsetinfo",
+    "verifychain",
+};
+
+/** Peek at the request body (without draining it) to see whether it names
+ *  one of the known-slow methods. The method name appears in the first few
+ *  hundred bytes of a JSON-RPC request; a false positive merely routes a
+ *  request to the smaller worker pool. */
+static bool RequestLikelySlow(struct evhttp_request* req)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return false;
+    size_t size = evbuffer_get_length(buf);
+    if (size > 4096)
+        size = 4096;
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (!data)
+        return false;
+    std::string prefix(data, size);
+    for (size_t i = 0; i < ARRAYLEN(ppszSlowMethods); i++) {
+        if (prefix.find(ppszSlowMethods[i]) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
 {
@@ -288,12 +336,28 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        bool fSlow = workQueueSlow && RequestLikelySlow(req);
+        {
+            LOCK(cs_httpstats);
+            nHTTPRequestsTotal++;
+            if (fSlow)
+                nHTTPRequestsSlow++;
+        }
         std::auto_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        WorkQueue<HTTPClosure>* queue = fSlow ? workQueueSlow : workQueue;
+        assert(queue);
+        if (queue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
-        else
-            item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
+        else {
+            LogPrint("http", "Shedding request: %s work queue full (fast depth %d, slow depth %d)\n",
+                     fSlow ? "slow" : "fast", workQueue->Depth(), workQueueSlow ? workQueueSlow->Depth() : 0);
+            {
+                LOCK(cs_httpstats);
+                nHTTPRequestsShed++;
+            }
+            item->req->WriteHeader("Retry-After", "5");
+            item->req->WriteReply(HTTP_SERVUNAVAIL, "Work queue depth exceeded");
+        }
     } else {
         hreq->WriteReply(HTTP_NOTFOUND);
     }
@@ -421,7 +485,7 @@ bool InitHTTPServer()
     }
 
     evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+    evhttp_set_max_headers_size(http, GetArg("-rpcmaxheaderssize", MAX_HEADERS_SIZE));
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, NULL);
 
@@ -437,6 +501,7 @@ bool InitHTTPServer()
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueueSlow = new WorkQueue<HTTPClosure>(workQueueDepth);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -448,11 +513,17 @@ bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    // reserve a minority of the workers for the slow-method queue so trie
+    // and UTXO scans can never occupy the whole pool
+    int slowThreads = std::max(rpcThreads / 4, 1);
+    LogPrintf("HTTP: starting %d worker threads (%d reserved for slow methods)\n", rpcThreads + slowThreads, slowThreads);
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
 
     for (int i = 0; i < rpcThreads; i++)
         boost::thread(boost::bind(&HTTPWorkQueueRun, workQueue));
+    for (int i = 0; i < slowThreads; i++)
+        boost::thread(boost::bind(&HTTPWorkQueueRun, workQueueSlow));
+    RegisterThreadPool("httpworker", "-rpcthreads", rpcThreads + slowThreads);
     return true;
 }
 
@@ -469,6 +540,8 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    if (workQueueSlow)
+        workQueueSlow->Interrupt();
 }
 
 void StopHTTPServer()
@@ -478,6 +551,12 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
+        workQueue = 0;
+    }
+    if (workQueueSlow) {
+        workQueueSlow->WaitExit();
+        delete workQueueSlow;
+        workQueueSlow = 0;
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -508,6 +587,19 @@ void StopHTTPServer()
     LogPrint("http", "Stopped HTTP server\n");
 }
 
+void GetHTTPServerStats(uint64_t& nTotal, uint64_t& nSlow, uint64_t& nShed,
+                        size_t& nFastDepth, size_t& nSlowDepth)
+{
+    {
+        LOCK(cs_httpstats);
+        nTotal = nHTTPRequestsTotal;
+        nSlow = nHTTPRequestsSlow;
+        nShed = nHTTPRequestsShed;
+    }
+    nFastDepth = workQueue ? workQueue->Depth() : 0;
+    nSlowDepth = workQueueSlow ? workQueueSlow->Depth() : 0;
+}
+
 struct event_base* EventBase()
 {
     return eventBase;
@@ -584,6 +676,25 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+const char* HTTPRequest::ReadBodyView(size_t& size)
+{
+    size = 0;
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return NULL;
+    size = evbuffer_get_length(buf);
+    if (size == 0)
+        return NULL;
+    /** Append a terminator so parsers can treat the body as a C string,
+     * then linearize. Both operations stay inside the evbuffer, which owns
+     * the bytes for the lifetime of the request, so unlike ReadBody the
+     * body itself is never copied out.
+     */
+    if (evbuffer_add(buf, "", 1) != 0)
+        return NULL;
+    return (const char*)evbuffer_pullup(buf, size + 1);
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
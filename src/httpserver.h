@@ -49,6 +49,10 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Request lifecycle counters and current queue depths, for gethttpinfo */
+void GetHTTPServerStats(uint64_t& nTotal, uint64_t& nSlow, uint64_t& nShed,
+                        size_t& nFastDepth, size_t& nSlowDepth);
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -96,6 +100,16 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Get a NUL-terminated view of the request body without copying it out.
+     *
+     * The returned pointer aliases the request's input buffer and stays
+     * valid until the reply is written; the buffer is not drained. Returns
+     * NULL for an empty body. Use either this or ReadBody, not both: this
+     * appends the terminator to the underlying buffer.
+     */
+    const char* ReadBodyView(size_t& size);
+
     /**
      * Write output header.
      *
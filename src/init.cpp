@@ -16,12 +16,14 @@
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
 #include "main.h"
 #include "miner.h"
 #include "net.h"
+#include "perf.h"
 #include "policy/policy.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
@@ -94,8 +96,21 @@ enum BindFlags {
 };
 
 static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
+/** How often the fee estimator is flushed to disk (seconds); it also flushes
+ *  on shutdown, the periodic write just limits what a crash can lose. */
+static const int64_t FEE_ESTIMATES_FLUSH_INTERVAL = 60 * 60;
 CClientUIInterface uiInterface; // Declared but not defined in ui_interface.h
 
+static void FlushFeeEstimates()
+{
+    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+    CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (!est_fileout.IsNull())
+        mempool.WriteFeeEstimates(est_fileout);
+    else
+        LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Shutdown
@@ -157,7 +172,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -184,6 +198,9 @@ void Shutdown()
     /// Be sure that anything that writes files or flushes caches only does this if the respective
     /// module was initialized.
     RenameThread("bitcoin-shutoff");
+    // Drain the async log queue and write the rest of the shutdown sequence
+    // synchronously, so it survives if teardown goes wrong.
+    StopAsyncLogging();
     mempool.AddTransactionsUpdated(1);
 
     StopHTTPRPC();
@@ -195,18 +212,18 @@ void Shutdown()
         pwalletMain->Flush(false);
 #endif
     GenerateBitcoins(false, 0, Params());
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        DumpMempool();
+        DumpRecentRejects();
+        DumpOrphans();
+    }
     StopNode();
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
 
     if (fFeeEstimatesInitialized)
     {
-        boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            mempool.WriteFeeEstimates(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+        FlushFeeEstimates();
         fFeeEstimatesInitialized = false;
     }
 
@@ -215,6 +232,12 @@ void Shutdown()
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
         }
+        if (pclaimTrie != NULL) {
+            // write the snapshot that lets the next startup skip the
+            // node-by-node load from leveldb
+            if (!pclaimTrie->WriteSnapshot())
+                LogPrintf("%s: Failed to write the claim trie snapshot\n", __func__);
+        }
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -318,6 +341,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", _("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all)"));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -332,24 +356,44 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-flushceiling=<n>", _("Dirty chainstate tolerated (in megabytes) before idle-time background flushing kicks in (default: a quarter of -dbcache)"));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-dbbloombits=<n>", "Bloom filter bits per key for the databases, 0 to disable (default: 10)");
+        strUsage += HelpMessageOpt("-dbblocksize=<n>", "Database table block size in bytes, 0 for the leveldb default (default: 0)");
+        strUsage += HelpMessageOpt("-dbmaxopenfiles=<n>", "Maximum number of open table files per database (default: 64)");
+        strUsage += HelpMessageOpt("-dbcompression", "Compress database table blocks with snappy (default: false)");
+        strUsage += HelpMessageOpt("-dbstallthreshold=<n>", "Log database batch writes slower than <n> milliseconds, 0 to disable (default: 250)");
+    }
+    strUsage += HelpMessageOpt("-claimaddressindex", _("Maintain an index from address to the claims paying it, used by the getclaimsbyaddress rpc call (default: 0)"));
+    strUsage += HelpMessageOpt("-claimhistoryindex", _("Maintain a per-name index of claim trie operations, used by the getclaimhistory rpc call (default: 0)"));
+    strUsage += HelpMessageOpt("-claimjournal", _("Maintain a per-block journal of claim trie operations, used by the getclaimchangesbyheight rpc call and the /rest/claimchanges/ endpoint (default: 0)"));
+    strUsage += HelpMessageOpt("-claimtriecoldshed", strprintf(_("Keep only the winning claim of each name resident in the claim trie and reload the rest from disk on demand (default: %u)"), DEFAULT_CLAIMTRIE_COLD_SHED));
     strUsage += HelpMessageOpt("-feefilter", strprintf(_("Tell other nodes to filter invs to us by our mempool min fee (default: %u)"), DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadblockbuffer=<n>", strprintf(_("Read-ahead buffer size in megabytes when importing block files (default: %u)"), DEFAULT_LOADBLOCK_BUFFER_MB));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-numanode=<n>", _("Bind the node to the CPUs of the given NUMA node; worker threads and first-touch allocations follow (Linux only, default: unbound)"));
+    strUsage += HelpMessageOpt("-claimtriehashthreads=<n>", strprintf(_("Set the number of claim trie hashing threads (up to %d, 0 = auto, default: %d)"),
+        MAX_CLAIMTRIE_HASH_THREADS, DEFAULT_CLAIMTRIE_HASH_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
-    strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files on startup"));
+    strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state (UTXO set and claim trie) from the currently indexed blocks"));
+    strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-blockstatsindex", strprintf(_("Maintain per-block statistics, used by the getblockstats rpc call (default: %u)"), DEFAULT_BLOCKSTATSINDEX));
+    strUsage += HelpMessageOpt("-compressundo", strprintf(_("Compress newly written block undo data; previously written undo files remain readable (default: %u)"), DEFAULT_COMPRESS_UNDO));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -368,6 +412,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Number of peer message handling threads (default: %d)"), DEFAULT_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -392,6 +437,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(_("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-maxhistoricalsendrate=<n>", strprintf(_("Limit serving of historical blocks (more than a week below the tip) to <n> KiB/s so syncing peers cannot starve tip relay, 0 = no limit (default: %d)"), DEFAULT_HISTORICAL_SEND_RATE));
+    strUsage += HelpMessageOpt("-maxhistoricalsendratepeer=<n>", strprintf(_("Per-peer limit for serving historical blocks in KiB/s, 0 = no limit (default: %d)"), DEFAULT_HISTORICAL_SEND_RATE_PEER));
 
 #ifdef ENABLE_WALLET
     strUsage += CWallet::GetWalletHelpString(showDebug);
@@ -403,6 +450,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubclaim=<address>", _("Enable publish claim trie events in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -436,7 +484,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-logasync", strprintf("Write debug.log from a background thread so logging does not stall the logging caller; the last moments before a hard crash may be lost (default: %u)", DEFAULT_LOGASYNC));
+        strUsage += HelpMessageOpt("-logasyncbuffer=<n>", "Bytes of log lines to buffer for the background writer before dropping (default: 1048576)");
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
+        strUsage += HelpMessageOpt("-logtimenanos", strprintf("Add nanosecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMENANOS));
+        strUsage += HelpMessageOpt("-lockstats", "Profile lock acquisition counts and wait/hold times, reported by the getlockstats RPC (default: 0)");
+        strUsage += HelpMessageOpt("-rpcslowms=<n>", "Trace RPC calls slower than <n> milliseconds, including their lock-wait time, reported by the getrpcinfo RPC (default: 0 = off)");
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
@@ -467,7 +520,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Block creation options:"));
     strUsage += HelpMessageOpt("-blockminsize=<n>", strprintf(_("Set minimum block size in bytes (default: %u)"), DEFAULT_BLOCK_MIN_SIZE));
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", strprintf(_("Set maximum block size in bytes (default: %d)"), DEFAULT_BLOCK_MAX_SIZE));
-    strUsage += HelpMessageOpt("-blockprioritysize=<n>", strprintf(_("Set maximum size of high-priority/low-fee transactions in bytes (default: %d)"), DEFAULT_BLOCK_PRIORITY_SIZE));
+    strUsage += HelpMessageOpt("-blockprioritysize=<n>", _("DEPRECATED: this option is ignored. The block assembler selects transactions by ancestor package feerate and no longer reserves space for high-priority/low-fee transactions"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
@@ -485,6 +538,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+        strUsage += HelpMessageOpt("-rpcmaxheaderssize=<n>", "Maximum size of HTTP request line and headers in bytes (default: 8192)");
     }
 
     return strUsage;
@@ -627,6 +681,14 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL) && !ShutdownRequested()) {
+        int64_t nPhaseStart = GetTimeMillis();
+        LoadMempool();
+        LoadOrphans();
+        LoadRecentRejects();
+        RecordStartupPhase("mempool-load", GetTimeMillis() - nPhaseStart);
+    }
 }
 
 /** Sanity checks
@@ -645,10 +707,58 @@ bool InitSanityCheck(void)
     return true;
 }
 
+// Gauges evaluated when the perf counters are scraped (getperfstats RPC and
+// the /metrics endpoint). None of these take cs_main.
+static int64_t GaugeMempoolSize() { return (int64_t)mempool.size(); }
+static int64_t GaugeMempoolBytes() { return (int64_t)mempool.GetTotalTxSize(); }
+static int64_t GaugeMempoolUsage() { return (int64_t)mempool.DynamicMemoryUsage(); }
+static int64_t GaugeNetBytesRecv() { return (int64_t)CNode::GetTotalBytesRecv(); }
+static int64_t GaugeNetBytesSent() { return (int64_t)CNode::GetTotalBytesSent(); }
+static int64_t GaugeClaimTrieUsage() { return pclaimTrie ? (int64_t)pclaimTrie->DynamicMemoryUsage() : 0; }
+static int64_t GaugeFlushDirtyBytes() { return GetFlushDebtBytes(); }
+static int64_t GaugeFlushCeilingBytes() { return GetFlushCeilingBytes(); }
+static int64_t GaugeFlushAgeSeconds() { return GetSecondsSinceFullFlush(); }
+static int64_t GaugeTipHeight()
+{
+    CChainTipSnapshot snapshot;
+    return GetChainTipSnapshot(snapshot) ? snapshot.nHeight : -1;
+}
+static int64_t GaugeHTTPQueueDepth()
+{
+    uint64_t nTotal, nSlow, nShed;
+    size_t nFastDepth, nSlowDepth;
+    GetHTTPServerStats(nTotal, nSlow, nShed, nFastDepth, nSlowDepth);
+    return (int64_t)(nFastDepth + nSlowDepth);
+}
+static int64_t GaugeHTTPRequests()
+{
+    uint64_t nTotal, nSlow, nShed;
+    size_t nFastDepth, nSlowDepth;
+    GetHTTPServerStats(nTotal, nSlow, nShed, nFastDepth, nSlowDepth);
+    return (int64_t)nTotal;
+}
+
+static void RegisterPerfGauges()
+{
+    StatRegisterGauge("mempool.size", &GaugeMempoolSize);
+    StatRegisterGauge("mempool.bytes", &GaugeMempoolBytes);
+    StatRegisterGauge("mempool.usage", &GaugeMempoolUsage);
+    StatRegisterGauge("net.bytes.recv", &GaugeNetBytesRecv);
+    StatRegisterGauge("net.bytes.sent", &GaugeNetBytesSent);
+    StatRegisterGauge("claimtrie.usage", &GaugeClaimTrieUsage);
+    StatRegisterGauge("flush.dirty_bytes", &GaugeFlushDirtyBytes);
+    StatRegisterGauge("flush.ceiling_bytes", &GaugeFlushCeilingBytes);
+    StatRegisterGauge("flush.age_seconds", &GaugeFlushAgeSeconds);
+    StatRegisterGauge("chain.height", &GaugeTipHeight);
+    StatRegisterGauge("http.queue.depth", &GaugeHTTPQueueDepth);
+    StatRegisterGauge("http.requests", &GaugeHTTPRequests);
+}
+
 bool AppInitServers(boost::thread_group& threadGroup)
 {
     RPCServer::OnStopped(&OnRPCStopped);
     RPCServer::OnPreCommand(&OnRPCPreCommand);
+    RegisterPerfGauges();
     if (!InitHTTPServer())
         return false;
     if (!StartRPC())
@@ -757,12 +867,57 @@ void InitLogging()
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fLogTimestamps = GetBoolArg("-logtimestamps", DEFAULT_LOGTIMESTAMPS);
     fLogTimeMicros = GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
+    fLogTimeNanos = GetBoolArg("-logtimenanos", DEFAULT_LOGTIMENANOS);
     fLogIPs = GetBoolArg("-logips", DEFAULT_LOGIPS);
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Bitcoin version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
 }
 
+/** Load the claim trie on its own thread. It lives in a separate database
+ *  from the block index, so the two loads have no shared state until
+ *  InitBlockIndex may connect the genesis block. */
+static void ThreadLoadClaimTrie(bool* pfLoaded)
+{
+    RenameThread("bitcoin-trieload");
+    int64_t nStart = GetTimeMillis();
+    try {
+        *pfLoaded = pclaimTrie->ReadFromDisk(true);
+    } catch (const std::exception& e) {
+        LogPrintf("Error loading claim trie: %s\n", e.what());
+        *pfLoaded = false;
+    }
+    RecordStartupPhase("claim-trie", GetTimeMillis() - nStart);
+}
+
+/** Read the fee estimates file while the databases load; it only touches the
+ *  mempool's estimator, which nothing else uses this early. */
+static void ThreadLoadFeeEstimates()
+{
+    RenameThread("bitcoin-feeload");
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+    CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    // Allowed to fail as this file IS missing on first startup.
+    if (!est_filein.IsNull())
+        mempool.ReadFeeEstimates(est_filein);
+    fFeeEstimatesInitialized = true;
+    RecordStartupPhase("fee-estimates", GetTimeMillis() - nStart);
+}
+
+/** Joins a load thread on scope exit, so the early-error returns inside the
+ *  load loop cannot leave it running against state being torn down. */
+struct CScopedThreadJoiner
+{
+    boost::thread& thread;
+    CScopedThreadJoiner(boost::thread& threadIn) : thread(threadIn) {}
+    ~CScopedThreadJoiner()
+    {
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
 /** Initialize bitcoin.
  *  @pre Parameters should be parsed and config file should be read.
  */
@@ -885,7 +1040,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    fCompressUndo = GetBoolArg("-compressundo", DEFAULT_COMPRESS_UNDO);
+    fClaimJournal = GetBoolArg("-claimjournal", false);
+    fClaimHistoryIndex = GetBoolArg("-claimhistoryindex", false);
+    fClaimAddressIndex = GetBoolArg("-claimaddressindex", false);
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fLockStats = GetBoolArg("-lockstats", false);
+    nRPCSlowThresholdMS = GetArg("-rpcslowms", 0);
+    // lock-wait attribution is only worth its TLS bookkeeping when slow
+    // calls are actually being traced
+    fLockWaitTrace = nRPCSlowThresholdMS > 0;
+
+    hashAssumeValid = uint256S(GetArg("-assumevalid", ""));
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures for all blocks.\n");
 
     // mempool limits
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
@@ -902,6 +1072,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -claimtriehashthreads=0 means autodetect, <= 1 means no concurrency
+    nClaimTrieHashThreads = GetArg("-claimtriehashthreads", DEFAULT_CLAIMTRIE_HASH_THREADS);
+    if (nClaimTrieHashThreads <= 0)
+        nClaimTrieHashThreads += GetNumCores();
+    if (nClaimTrieHashThreads <= 1)
+        nClaimTrieHashThreads = 0;
+    else if (nClaimTrieHashThreads > MAX_CLAIMTRIE_HASH_THREADS)
+        nClaimTrieHashThreads = MAX_CLAIMTRIE_HASH_THREADS;
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -981,6 +1160,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
+    // Pick the fastest SHA-256 implementation for this CPU before any
+    // threads start hashing.
+    LogPrintf("Using SHA256 implementation: %s\n", SHA256AutoDetect());
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(strprintf(_("Initialization sanity check failed. %s is shutting down."), _(PACKAGE_NAME)));
@@ -1008,6 +1191,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (fPrintToDebugLog)
         OpenDebugLog();
+    StartAsyncLogging();
 
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
@@ -1020,11 +1204,30 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    // Bind before any worker thread or cache exists: threads created from
+    // here on inherit the mask, and the caches they touch are first-touch
+    // allocated on the chosen node.
+    int nNumaNode = GetArg("-numanode", -1);
+    if (nNumaNode >= 0) {
+        if (nNumaNode >= GetNumaNodeCount())
+            return InitError(strprintf(_("Invalid -numanode: this system has %d NUMA node(s)"), GetNumaNodeCount()));
+        if (BindCurrentThreadToNumaNode(nNumaNode))
+            LogPrintf("Bound to NUMA node %d (cpus %s)\n", nNumaNode, GetNumaNodeCpuList(nNumaNode));
+        else
+            LogPrintf("Warning: failed to bind to NUMA node %d, running unbound\n", nNumaNode);
+    }
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // Pre-verifies downloaded blocks that are waiting for the ordered
+        // connect pipeline; one thread suffices since CheckBlock shards
+        // large blocks internally.
+        threadGroup.create_thread(&ThreadBlockPreVerify);
     }
+    RegisterThreadPool("scriptcheck", "-par", nScriptCheckThreads);
+    RegisterThreadPool("blockpreverify", "-par", nScriptCheckThreads ? 1 : 0);
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1047,8 +1250,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // ********************************************************* Step 5: verify wallet database integrity
 #ifdef ENABLE_WALLET
     if (!fDisableWallet) {
+        int64_t nPhaseStart = GetTimeMillis();
         if (!CWallet::Verify())
             return false;
+        RecordStartupPhase("wallet-verify", GetTimeMillis() - nPhaseStart);
     } // (!fDisableWallet)
 #endif // ENABLE_WALLET
     // ********************************************************* Step 6: network initialization
@@ -1182,9 +1387,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         CNode::SetMaxOutboundTarget(GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024);
     }
 
+    if (mapArgs.count("-maxhistoricalsendrate") || mapArgs.count("-maxhistoricalsendratepeer")) {
+        CNode::SetHistoricalSendRate(GetArg("-maxhistoricalsendrate", DEFAULT_HISTORICAL_SEND_RATE)*1024,
+                                     GetArg("-maxhistoricalsendratepeer", DEFAULT_HISTORICAL_SEND_RATE_PEER)*1024);
+    }
+
     // ********************************************************* Step 7: load block chain
 
     fReindex = GetBoolArg("-reindex", false);
+    // -reindex-chainstate keeps the block index and re-derives only the UTXO
+    // set and claim trie by reconnecting the already-indexed blocks in order.
+    bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
 
     // Upgrading to 0.8; hard-link the old blknnnn.dat files into /blocks/
     boost::filesystem::path blocksDir = GetDataDir() / "blocks";
@@ -1231,6 +1444,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
+    // Overlap the fee-estimate file read with the database loads below.
+    boost::thread threadFeeEstimates(&ThreadLoadFeeEstimates);
+    CScopedThreadJoiner feeEstimatesJoiner(threadFeeEstimates);
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1249,10 +1466,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pclaimTrie;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
-                pclaimTrie = new CClaimTrie(false, fReindex);
+                pclaimTrie = new CClaimTrie(false, fReindex || fReindexChainState);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1261,10 +1478,32 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                         CleanupBlockRevFiles();
                 }
 
-                if (!LoadBlockIndex()) {
+                // The claim trie and the block index live in separate
+                // databases, so their loads can run concurrently. The join
+                // must come before anything touches the trie or unwinds
+                // this iteration's databases, i.e. before any break/return.
+                bool fClaimTrieLoaded = false;
+                boost::thread threadClaimTrie(boost::bind(&ThreadLoadClaimTrie, &fClaimTrieLoaded));
+
+                int64_t nPhaseStart = GetTimeMillis();
+                bool fBlockIndexLoaded = false;
+                try {
+                    fBlockIndexLoaded = LoadBlockIndex();
+                } catch (const std::exception& e) {
+                    if (fDebug) LogPrintf("%s\n", e.what());
+                }
+                threadClaimTrie.join();
+                if (!fBlockIndexLoaded) {
                     strLoadError = _("Error loading block database");
                     break;
                 }
+                RecordStartupPhase("block-index", GetTimeMillis() - nPhaseStart);
+
+                if (!fClaimTrieLoaded)
+                {
+                    strLoadError = _("Error loading the claim trie from disk");
+                    break;
+                }
 
                 // If the loaded chain has a wrong genesis, bail out immediately
                 // (we're likely using a testnet datadir, or the other way around).
@@ -1282,13 +1521,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
                     break;
                 }
-                
-                if (!pclaimTrie->ReadFromDisk(true))
-                {
-                    strLoadError = _("Error loading the claim trie from disk");
+
+                // Check for changed -blockstatsindex state
+                if (fBlockStatsIndex != GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -blockstatsindex");
                     break;
                 }
-
+                
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1313,11 +1552,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                 }
 
+                nPhaseStart = GetTimeMillis();
                 if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                               GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
+                RecordStartupPhase("verify-chainstate", GetTimeMillis() - nPhaseStart);
             } catch (const std::exception& e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1356,12 +1597,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
-    boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-    CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
-    // Allowed to fail as this file IS missing on first startup.
-    if (!est_filein.IsNull())
-        mempool.ReadFeeEstimates(est_filein);
-    fFeeEstimatesInitialized = true;
+    if (threadFeeEstimates.joinable())
+        threadFeeEstimates.join();
 
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
@@ -1369,9 +1606,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         pwalletMain = NULL;
         LogPrintf("Wallet disabled!\n");
     } else {
+        int64_t nPhaseStart = GetTimeMillis();
         CWallet::InitLoadWallet();
         if (!pwalletMain)
             return false;
+        RecordStartupPhase("wallet-load", GetTimeMillis() - nPhaseStart);
     }
 #else // ENABLE_WALLET
     LogPrintf("No wallet support compiled in!\n");
@@ -1397,9 +1636,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     uiInterface.InitMessage(_("Activating best chain..."));
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
+    int64_t nPhaseStart = GetTimeMillis();
     CValidationState state;
     if (!ActivateBestChain(state, chainparams))
         strErrors << "Failed to connect best block";
+    RecordStartupPhase("activate-chain", GetTimeMillis() - nPhaseStart);
 
     std::vector<boost::filesystem::path> vImportFiles;
     if (mapArgs.count("-loadblock"))
@@ -1438,7 +1679,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    nPhaseStart = GetTimeMillis();
     StartNode(threadGroup, scheduler);
+    RecordStartupPhase("net-start", GetTimeMillis() - nPhaseStart);
 
     // Monitor the chain, and alert if we get blocks much quicker or slower than expected
     int64_t nPowTargetSpacing = consensusParams.nPowTargetSpacing;
@@ -1446,6 +1689,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                                          boost::ref(cs_main), boost::cref(pindexBestHeader), nPowTargetSpacing);
     scheduler.scheduleEvery(f, nPowTargetSpacing);
 
+    // Trickle dirty chainstate to disk while the node is idle, so flushes
+    // stay small and do not land in the middle of block bursts.
+    scheduler.scheduleEvery(&AttemptBackgroundFlush, BACKGROUND_FLUSH_INTERVAL);
+
+    // Fee estimates previously only survived a clean shutdown; an hourly
+    // write bounds what a crash can lose, on the same coalesced timer
+    // grid as the rest of the periodic housekeeping.
+    scheduler.scheduleEvery(&FlushFeeEstimates, FEE_ESTIMATES_FLUSH_INTERVAL);
+
     // Generate coins in the background
     GenerateBitcoins(GetBoolArg("-gen", false), GetArg("-genproclimit", 1), Params());
 
@@ -1454,6 +1706,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
 
+    // The mempool load runs in the import thread and reports itself when it
+    // completes; getperfstats serves the full list either way.
+    {
+        std::vector<std::pair<std::string, int64_t> > vPhases;
+        GetStartupPhases(vPhases);
+        int64_t nTotalPhaseMs = 0;
+        LogPrintf("Startup phase timings:\n");
+        for (size_t i = 0; i < vPhases.size(); i++) {
+            LogPrintf(" - %-17s %7dms\n", vPhases[i].first, vPhases[i].second);
+            nTotalPhaseMs += vPhases[i].second;
+        }
+        LogPrintf(" - total measured  %7dms\n", nTotalPhaseMs);
+    }
+
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
         // Add wallet transactions that aren't already in a block to mapTransactions
@@ -1461,6 +1727,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
+
+        // Run a thread to keep the key pool topped up
+        threadGroup.create_thread(&ThreadKeyPoolRefill);
     }
 #endif
 
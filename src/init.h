@@ -6,7 +6,10 @@
 #ifndef BITCOIN_INIT_H
 #define BITCOIN_INIT_H
 
+#include <stdint.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 class CScheduler;
 class CWallet;
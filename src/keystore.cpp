@@ -7,6 +7,7 @@
 
 #include "key.h"
 #include "pubkey.h"
+#include "script/script.h"
 #include "util.h"
 
 #include <boost/foreach.hpp>
@@ -30,10 +31,18 @@ bool CBasicKeyStore::GetPubKey(const CKeyID &address, CPubKey &vchPubKeyOut) con
     return true;
 }
 
+void CBasicKeyStore::AddOwnedScriptsForKey(const CPubKey &pubkey)
+{
+    LOCK(cs_KeyStore);
+    setOwnedScripts.insert(GetScriptForDestination(pubkey.GetID()));
+    setOwnedScripts.insert(GetScriptForRawPubKey(pubkey));
+}
+
 bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    AddOwnedScriptsForKey(pubkey);
     return true;
 }
 
@@ -44,6 +53,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    setOwnedScripts.insert(GetScriptForDestination(CScriptID(redeemScript)));
     return true;
 }
 
@@ -85,6 +95,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    setOwnedScripts.insert(dest);
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys[pubKey.GetID()] = pubKey;
@@ -112,3 +123,21 @@ bool CBasicKeyStore::HaveWatchOnly() const
     LOCK(cs_KeyStore);
     return (!setWatchOnly.empty());
 }
+
+bool CBasicKeyStore::PossiblyMine(const CScript &scriptPubKey) const
+{
+    // Only the canonical single-entity shapes are fully enumerated in
+    // setOwnedScripts; everything else (bare multisig, nonstandard, claim
+    // scripts) must take the full IsMine path.
+    bool fCanonical =
+        (scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 &&
+         scriptPubKey[2] == 20 && scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG) ||
+        scriptPubKey.IsPayToScriptHash() ||
+        (scriptPubKey.size() >= 35 && (scriptPubKey[0] == 33 || scriptPubKey[0] == 65) &&
+         scriptPubKey.size() == (size_t)scriptPubKey[0] + 2 && scriptPubKey.back() == OP_CHECKSIG);
+    if (!fCanonical)
+        return true;
+
+    LOCK(cs_KeyStore);
+    return setOwnedScripts.count(scriptPubKey) > 0;
+}
@@ -12,7 +12,9 @@
 #include "script/standard.h"
 #include "sync.h"
 
+#include <boost/functional/hash.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/variant.hpp>
 
 /** A virtual base class for key stores */
@@ -44,12 +46,26 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest) =0;
     virtual bool HaveWatchOnly(const CScript &dest) const =0;
     virtual bool HaveWatchOnly() const =0;
+
+    //! Cheap negative membership test for IsMine: may return true for
+    //! scripts the store does not own, but never false for one it does.
+    virtual bool PossiblyMine(const CScript &scriptPubKey) const { return true; }
+};
+
+/** Hasher for the owned-script prefilter set */
+struct ScriptBytesHasher
+{
+    std::size_t operator()(const CScript &script) const
+    {
+        return boost::hash_range(script.begin(), script.end());
+    }
 };
 
 typedef std::map<CKeyID, CKey> KeyMap;
 typedef std::map<CKeyID, CPubKey> WatchKeyMap;
 typedef std::map<CScriptID, CScript > ScriptMap;
 typedef std::set<CScript> WatchOnlySet;
+typedef boost::unordered_set<CScript, ScriptBytesHasher> OwnedScriptSet;
 
 /** Basic key store, that keeps keys in an address->secret map */
 class CBasicKeyStore : public CKeyStore
@@ -60,6 +76,16 @@ protected:
     ScriptMap mapScripts;
     WatchOnlySet setWatchOnly;
 
+    //! Every canonical scriptPubKey this store can claim: the P2PKH and P2PK
+    //! forms of each key, the P2SH form of each redeem script, and watched
+    //! scripts verbatim. Entries are never removed (a stale entry only sends
+    //! IsMine down the full path), so RemoveWatchOnly needs no bookkeeping.
+    OwnedScriptSet setOwnedScripts;
+
+    //! Register the spendable script forms of pubkey in setOwnedScripts.
+    //! Also called by the encrypted store, whose keys bypass AddKeyPubKey.
+    void AddOwnedScriptsForKey(const CPubKey &pubkey);
+
 public:
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
     bool GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const;
@@ -106,6 +132,8 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest);
     virtual bool HaveWatchOnly(const CScript &dest) const;
     virtual bool HaveWatchOnly() const;
+
+    bool PossiblyMine(const CScript &scriptPubKey) const;
 };
 
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CKeyingMaterial;
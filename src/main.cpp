@@ -7,17 +7,20 @@
 
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
 #include "hash.h"
 #include "init.h"
 #include "merkleblock.h"
 #include "nameclaim.h"
 #include "net.h"
+#include "perf.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -28,6 +31,7 @@
 #include "script/sigcache.h"
 #include "script/standard.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -40,10 +44,17 @@
 
 #include <sstream>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/math/distributions/poisson.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -68,6 +79,12 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
+bool fBlockStatsIndex = false;
+bool fClaimJournal = false;
+bool fClaimHistoryIndex = false;
+bool fClaimAddressIndex = false;
+bool fCompressUndo = DEFAULT_COMPRESS_UNDO;
+CUtxoSetStats utxoSetStats;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -75,6 +92,7 @@ bool fRequireStandard = true;
 unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+uint256 hashAssumeValid;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -87,12 +105,10 @@ CAmount minFeePerNameClaimChar = MIN_FEE_PER_NAMECLAIM_CHAR;
 CTxMemPool mempool(::minRelayTxFee);
 FeeFilterRounder filterRounder(::minRelayTxFee);
 
-struct COrphanTx {
-    CTransaction tx;
-    NodeId fromPeer;
-};
-map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+boost::unordered_map<uint256, COrphanTx, CSaltedTxidHasher> mapOrphanTransactions GUARDED_BY(cs_main);
+boost::unordered_map<uint256, set<uint256>, CSaltedTxidHasher> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+map<NodeId, set<uint256> > mapOrphanTransactionsByPeer GUARDED_BY(cs_main);
+list<uint256> listOrphanLru GUARDED_BY(cs_main);
 void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
@@ -267,6 +283,13 @@ struct CNodeState {
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
+    //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer can give us cmpctblocks.
+    bool fProvidesHeaderAndIDs;
+    //! Compact block reconstruction in progress with this peer, if any.
+    uint256 hashPendingCmpctBlock;
+    boost::shared_ptr<PartiallyDownloadedBlock> pendingCmpctBlock;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -283,6 +306,9 @@ struct CNodeState {
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        hashPendingCmpctBlock.SetNull();
     }
 };
 
@@ -434,6 +460,35 @@ bool CanDirectFetch(const Consensus::Params &consensusParams)
     return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20;
 }
 
+// As per BIP152, at most 3 peers are asked to announce blocks using compact
+// encodings; when a fourth earns the slot, the oldest is told to stop.
+static std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+// Requires cs_main
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(const CNodeState* nodestate, CNode* pfrom)
+{
+    if (!nodestate->fProvidesHeaderAndIDs)
+        return;
+    BOOST_FOREACH(const NodeId nodeid, lNodesAnnouncingHeaderAndIDs)
+        if (nodeid == pfrom->GetId())
+            return;
+    bool fAnnounceUsingCMPCTBLOCK = false;
+    uint64_t nCMPCTBLOCKVersion = 1;
+    if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == lNodesAnnouncingHeaderAndIDs.front()) {
+                pnode->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+                break;
+            }
+        }
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    fAnnounceUsingCMPCTBLOCK = true;
+    pfrom->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
 // Requires cs_main
 bool PeerHasHeader(CNodeState *state, CBlockIndex *pindex)
 {
@@ -597,6 +652,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CClaimTrie *pclaimTrie = NULL;
 CBlockTreeDB *pblocktree = NULL;
@@ -606,6 +662,32 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions
 //
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// validated transaction cache
+//
+
+/** Transactions whose input scripts have already been fully verified, keyed
+ *  by txid with the verification flags used. A txid commits to its scriptSigs
+ *  and to the prevouts (and therefore their scriptPubKeys), so (txid, flags)
+ *  fully determines the script verification outcome and the entries stay
+ *  valid across reorgs. Guarded by cs_main like the mempool itself. */
+static map<uint256, unsigned int> mapValidatedTx GUARDED_BY(cs_main);
+static const size_t MAX_VALIDATED_TX_CACHE = 100000;
+
+static void MarkTxScriptsValidated(const uint256& txid, unsigned int flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (mapValidatedTx.size() >= MAX_VALIDATED_TX_CACHE)
+        mapValidatedTx.clear();
+    mapValidatedTx[txid] = flags;
+}
+
+static bool AreTxScriptsValidated(const uint256& txid, unsigned int flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    map<uint256, unsigned int>::const_iterator it = mapValidatedTx.find(txid);
+    return it != mapValidatedTx.end() && (it->second & flags) == flags;
+}
+
 bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     uint256 hash = tx.GetHash();
@@ -626,10 +708,13 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
-    mapOrphanTransactions[hash].fromPeer = peer;
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.lruIter = listOrphanLru.insert(listOrphanLru.end(), hash);
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+    mapOrphanTransactionsByPeer[peer].insert(hash);
 
     LogPrint("mempool", "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
              mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
@@ -638,33 +723,41 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
 
 void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    boost::unordered_map<uint256, COrphanTx, CSaltedTxidHasher>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
     BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
     {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
+        boost::unordered_map<uint256, set<uint256>, CSaltedTxidHasher>::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
         itPrev->second.erase(hash);
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    map<NodeId, set<uint256> >::iterator itPeer = mapOrphanTransactionsByPeer.find(it->second.fromPeer);
+    if (itPeer != mapOrphanTransactionsByPeer.end())
+    {
+        itPeer->second.erase(hash);
+        if (itPeer->second.empty())
+            mapOrphanTransactionsByPeer.erase(itPeer);
+    }
+    listOrphanLru.erase(it->second.lruIter);
     mapOrphanTransactions.erase(it);
 }
 
 void EraseOrphansFor(NodeId peer)
 {
+    // The per-peer index makes this proportional to the number of orphans
+    // actually erased, rather than a scan of the whole pool under cs_main.
     int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
+    map<NodeId, set<uint256> >::iterator itPeer = mapOrphanTransactionsByPeer.find(peer);
+    while (itPeer != mapOrphanTransactionsByPeer.end() && !itPeer->second.empty())
     {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
-            ++nErased;
-        }
+        EraseOrphanTx(*itPeer->second.begin());
+        ++nErased;
+        // EraseOrphanTx drops the peer entry once its set drains
+        itPeer = mapOrphanTransactionsByPeer.find(peer);
     }
     if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
 }
@@ -675,17 +768,32 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
     unsigned int nEvicted = 0;
     while (mapOrphanTransactions.size() > nMaxOrphans)
     {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        // Evict the oldest orphan. An attacker gains nothing over the old
+        // random eviction by this: flooding orphans flushes the pool either
+        // way, and expiring stale entries first keeps recently announced
+        // chains intact while their parents are still in flight.
+        EraseOrphanTx(listOrphanLru.front());
         ++nEvicted;
     }
     return nEvicted;
 }
 
+size_t GetOrphanPoolMemoryUsage()
+{
+    LOCK(cs_main);
+    size_t nUsage = memusage::DynamicUsage(mapOrphanTransactions) +
+                    memusage::DynamicUsage(mapOrphanTransactionsByPrev) +
+                    memusage::DynamicUsage(mapOrphanTransactionsByPeer) +
+                    memusage::MallocUsage(sizeof(uint256) + 2 * sizeof(void*)) * listOrphanLru.size();
+    for (boost::unordered_map<uint256, COrphanTx, CSaltedTxidHasher>::const_iterator it = mapOrphanTransactions.begin(); it != mapOrphanTransactions.end(); ++it)
+        nUsage += RecursiveDynamicUsage(it->second.tx);
+    for (boost::unordered_map<uint256, set<uint256>, CSaltedTxidHasher>::const_iterator it = mapOrphanTransactionsByPrev.begin(); it != mapOrphanTransactionsByPrev.end(); ++it)
+        nUsage += memusage::DynamicUsage(it->second);
+    for (map<NodeId, set<uint256> >::const_iterator it = mapOrphanTransactionsByPeer.begin(); it != mapOrphanTransactionsByPeer.end(); ++it)
+        nUsage += memusage::DynamicUsage(it->second);
+    return nUsage;
+}
+
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
     if (tx.nLockTime == 0)
@@ -1018,24 +1126,16 @@ std::string FormatStateMessage(const CValidationState &state)
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                               bool* pfMissingInputs, CFeeRate* txFeeRate, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+                              int64_t nAcceptTime, std::vector<uint256>& vHashTxnToUncache)
 {
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
 
-    if (!CheckTransaction(tx, state))
-        return false; // state filled in by CheckTransaction
-
-    // Coinbase is only valid in a block, not as a loose transaction
-    if (tx.IsCoinBase())
-        return state.DoS(100, false, REJECT_INVALID, "coinbase");
-
-    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
-    string reason;
-    if (fRequireStandard && !IsStandardTx(tx, reason))
-        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
+    // The stateless checks (CheckTransaction, coinbase rejection,
+    // standardness) have already run in AcceptToMemoryPool, before any
+    // lock was involved.
 
     // Don't relay version 2 transactions until CSV is active, and we can be
     // sure that such transactions will be mined (unless we're on
@@ -1180,7 +1280,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
+        // Decode the claim scripts once here; the entry carries the fee
+        // obligation for the admission check below, miner selection and the
+        // mempool RPC reports.
+        CAmount minClaimTrieFee = CalcMinClaimTrieFee(tx, minFeePerNameClaimChar);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime ? nAcceptTime : GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, minClaimTrieFee, lp);
         unsigned int nSize = entry.GetTxSize();
         if (txFeeRate) {
             *txFeeRate = CFeeRate(nFees, nSize);
@@ -1197,7 +1301,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
         // If a ClaimTrie transaction, it must meet the minimum fee requirement due to
         // it consuming extra system resources, compared to an ordinary transaction
-        CAmount minClaimTrieFee = CalcMinClaimTrieFee(tx, minFeePerNameClaimChar);
         if (nModifiedFees < minClaimTrieFee) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "minimum claim trie fee not met", false,
                              strprintf("%d < %d", nFees, minClaimTrieFee));
@@ -1273,9 +1376,12 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         uint64_t nConflictingCount = 0;
         CTxMemPool::setEntries allConflicting;
 
-        // If we don't hold the lock allConflicting might be incomplete; the
-        // subsequent RemoveStaged() and addUnchecked() calls don't guarantee
-        // mempool consistency for us.
+        // Every mempool mutator runs under cs_main, which our caller holds
+        // for the whole admission, so the pool cannot change while pool.cs
+        // is dropped between this evaluation and the commit section below.
+        // Scoping pool.cs to the two short sections keeps mempool readers
+        // (RPC, relay lookups) running while the scripts are verified.
+        {
         LOCK(pool.cs);
         if (setConflicts.size())
         {
@@ -1391,10 +1497,12 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                               FormatMoney(::minRelayTxFee.GetFee(nSize))));
             }
         }
+        }
 
-        // Check against previous transactions
+        // Check against previous transactions, with no pool lock held.
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true))
+        PrecomputedTransactionData txdata(tx);
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata))
             return false; // state filled in by CheckInputs
 
         // Check again against just the consensus-critical mandatory script
@@ -1406,12 +1514,20 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, NULL, &txdata))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
 
+        // Remember the outcome so ConnectBlock can skip re-executing the
+        // scripts when this transaction is mined.
+        MarkTxScriptsValidated(hash, STANDARD_SCRIPT_VERIFY_FLAGS | MANDATORY_SCRIPT_VERIFY_FLAGS);
+
+        // Final commit section: held only long enough to swap the
+        // replaced transactions for the new one.
+        {
+        LOCK(pool.cs);
         // Remove conflicting transactions from the mempool
         BOOST_FOREACH(const CTxMemPool::txiter it, allConflicting)
         {
@@ -1425,6 +1541,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
+        }
 
         // trim mempool and check if tx was trimmed
         if (!fOverrideMempoolLimit) {
@@ -1439,16 +1556,338 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
     return true;
 }
 
+/** Tally the outcome of a mempool admission attempt and pass it through. */
+static bool CountMempoolResult(bool res)
+{
+    static CStatCounter& counterAccepted = StatCounter("mempool.accepted");
+    static CStatCounter& counterRejected = StatCounter("mempool.rejected");
+    (res ? counterAccepted : counterRejected).Increment();
+    return res;
+}
+
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, CFeeRate* txFeeRate, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool* pfMissingInputs, CFeeRate* txFeeRate, bool fOverrideMempoolLimit, const CAmount nAbsurdFee,
+                        int64_t nAcceptTime)
 {
+    if (pfMissingInputs)
+        *pfMissingInputs = false;
+
+    // Stage 1: checks that depend only on the transaction itself, including
+    // decoding any claim scripts for the standardness rules. These need no
+    // locks at all, so a malformed transaction never touches the pool.
+    if (!CheckTransaction(tx, state))
+        return CountMempoolResult(false); // state filled in by CheckTransaction
+
+    // Coinbase is only valid in a block, not as a loose transaction
+    if (tx.IsCoinBase())
+        return CountMempoolResult(state.DoS(100, false, REJECT_INVALID, "coinbase"));
+
+    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
+    string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason))
+        return CountMempoolResult(state.DoS(0, false, REJECT_NONSTANDARD, reason));
+
+    // Stage 2: the stateful checks; coin lookups and the pool commit take
+    // pool.cs only for short sections, and the script checks run between
+    // them with no pool lock held.
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, txFeeRate, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, txFeeRate, fOverrideMempoolLimit, nAbsurdFee, nAcceptTime, vHashTxToUncache);
     if (!res) {
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
             pcoinsTip->Uncache(hashTx);
     }
-    return res;
+    TRACE2(mempool, tx_validated, tx.GetHash().begin(), res);
+    return CountMempoolResult(res);
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    }
+};
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            return false;
+        }
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransaction tx;
+            int64_t nTime;
+            int64_t nFeeDelta;
+            file >> tx;
+            file >> nTime;
+            file >> nFeeDelta;
+
+            CAmount amountdelta = nFeeDelta;
+            if (amountdelta) {
+                mempool.PrioritiseTransaction(tx.GetHash(), tx.GetHash().ToString(), 0, amountdelta);
+            }
+            CValidationState state;
+            if (nTime + nExpiryTimeout > nNow) {
+                LOCK(cs_main);
+                AcceptToMemoryPool(mempool, state, tx, true, NULL, NULL, false, 0, nTime);
+                if (state.IsValid()) {
+                    ++count;
+                } else {
+                    ++failed;
+                }
+            } else {
+                ++skipped;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        std::map<uint256, CAmount> mapDeltas;
+        file >> mapDeltas;
+
+        for (std::map<uint256, CAmount>::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++) {
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), 0, it->second);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t start = GetTimeMicros();
+
+    std::map<uint256, CAmount> mapDeltas;
+    std::vector<CTxMemPool::txiter> vEntries;
+
+    {
+        LOCK(mempool.cs);
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mempool.mapDeltas.begin(); it != mempool.mapDeltas.end(); it++) {
+            mapDeltas[it->first] = it->second.second;
+        }
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); mi++) {
+            vEntries.push_back(mi);
+        }
+    }
+    // Write parents before children, so that replaying through
+    // AcceptToMemoryPool never sees a missing in-mempool input. Ancestor
+    // count is a valid topological order: a child always counts strictly
+    // more ancestors than any of its parents.
+    std::sort(vEntries.begin(), vEntries.end(), CompareTxIterByAncestorCount());
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vEntries.size();
+        BOOST_FOREACH(const CTxMemPool::txiter& it, vEntries) {
+            file << it->GetTx();
+            file << (int64_t)it->GetTime();
+            file << (int64_t)(it->GetModifiedFee() - it->GetFee());
+            mapDeltas.erase(it->GetTx().GetHash());
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid - start) * 0.000001, (last - mid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+static const uint64_t REJECTS_DUMP_VERSION = 1;
+static const uint64_t ORPHANS_DUMP_VERSION = 1;
+
+bool LoadRecentRejects()
+{
+    FILE* filestr = fopen((GetDataDir() / "rejects.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != REJECTS_DUMP_VERSION)
+            return false;
+        uint256 hashChainTip;
+        file >> hashChainTip;
+        // The filter was never constructed before the randomizer is up, so
+        // deserialize over a fresh instance rather than default-constructing.
+        CRollingBloomFilter filter(120000, 0.000001);
+        file >> filter;
+
+        LOCK(cs_main);
+        // Entries were judged against the tip the filter was saved at; a
+        // different tip on load may have changed their validity, so start
+        // over exactly as the in-memory reset on tip change would.
+        if (!recentRejects || chainActive.Tip() == NULL ||
+            chainActive.Tip()->GetBlockHash() != hashChainTip) {
+            LogPrintf("Discarding saved reject filter for a different chain tip\n");
+            return false;
+        }
+        *recentRejects = filter;
+        hashRecentRejectsChainTip = hashChainTip;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize reject filter on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported recent reject filter from disk\n");
+    return true;
+}
+
+bool DumpRecentRejects()
+{
+    uint256 hashChainTip;
+    CRollingBloomFilter filter(120000, 0.000001);
+    {
+        LOCK(cs_main);
+        if (!recentRejects || chainActive.Tip() == NULL)
+            return false;
+        // Only worth saving if the filter still matches the tip it was
+        // populated against; otherwise it would be discarded on load anyway.
+        if (hashRecentRejectsChainTip != chainActive.Tip()->GetBlockHash())
+            return false;
+        hashChainTip = hashRecentRejectsChainTip;
+        filter = *recentRejects;
+    }
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "rejects.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return false;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << REJECTS_DUMP_VERSION;
+        file << hashChainTip;
+        file << filter;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "rejects.dat.new", GetDataDir() / "rejects.dat");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump reject filter: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadOrphans()
+{
+    FILE* filestr = fopen((GetDataDir() / "orphans.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return false;
+
+    int64_t count = 0;
+    int64_t resolved = 0;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != ORPHANS_DUMP_VERSION)
+            return false;
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            CTransaction tx;
+            file >> tx;
+
+            LOCK(cs_main);
+            // The mempool reload may have brought the missing parents back;
+            // anything that now connects goes straight in, the rest returns
+            // to the orphan pool without a source peer to punish.
+            bool fMissingInputs = false;
+            CValidationState state;
+            AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, NULL);
+            if (state.IsValid()) {
+                ++resolved;
+            } else if (fMissingInputs && AddOrphanTx(tx, -1)) {
+                ++count;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        LOCK(cs_main);
+        LimitOrphanTxSize(GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize orphan data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported orphan transactions from disk: %i restored, %i resolved\n", count, resolved);
+    return true;
+}
+
+bool DumpOrphans()
+{
+    std::vector<CTransaction> vOrphans;
+    {
+        LOCK(cs_main);
+        vOrphans.reserve(mapOrphanTransactions.size());
+        // LRU order, oldest first, so a size-capped reload keeps the same
+        // survivors the in-memory eviction would have kept.
+        BOOST_FOREACH(const uint256& hash, listOrphanLru) {
+            boost::unordered_map<uint256, COrphanTx, CSaltedTxidHasher>::const_iterator it = mapOrphanTransactions.find(hash);
+            if (it != mapOrphanTransactions.end())
+                vOrphans.push_back(it->second.tx);
+        }
+    }
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "orphans.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return false;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << ORPHANS_DUMP_VERSION;
+        file << (uint64_t)vOrphans.size();
+        BOOST_FOREACH(const CTransaction& tx, vOrphans) {
+            file << tx;
+        }
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "orphans.dat.new", GetDataDir() / "orphans.dat");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump orphans: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
 }
 
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
@@ -1512,6 +1951,84 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     return false;
 }
 
+static bool CompareTxDiskOffset(const std::pair<CDiskTxPos, size_t>& a, const std::pair<CDiskTxPos, size_t>& b)
+{
+    return a.first.nPos < b.first.nPos;
+}
+
+void GetTransactionsBatch(const std::vector<uint256> &vHashes, std::vector<CTransaction> &vTx, std::vector<uint256> &vHashBlock, std::vector<bool> &vFound)
+{
+    vTx.assign(vHashes.size(), CTransaction());
+    vHashBlock.assign(vHashes.size(), uint256());
+    vFound.assign(vHashes.size(), false);
+
+    LOCK(cs_main);
+
+    // Serve what we can from the mempool, and collect the rest for one
+    // sorted pass over the txindex.
+    std::vector<uint256> vMissing;
+    std::vector<size_t> vMissingIndex;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        if (mempool.lookup(vHashes[i], vTx[i])) {
+            vFound[i] = true;
+            continue;
+        }
+        vMissing.push_back(vHashes[i]);
+        vMissingIndex.push_back(i);
+    }
+    if (vMissing.empty() || !fTxIndex)
+        return;
+
+    std::map<uint256, CDiskTxPos> mapPos;
+    if (!pblocktree->ReadTxIndexBatch(vMissing, mapPos)) {
+        error("%s: txindex batch read failed", __func__);
+        return;
+    }
+
+    // Group the hits by block file so each file is opened once and read in
+    // offset order instead of seeking back and forth per transaction.
+    std::map<int, std::vector<std::pair<CDiskTxPos, size_t> > > mapByFile;
+    for (size_t j = 0; j < vMissing.size(); j++) {
+        std::map<uint256, CDiskTxPos>::const_iterator itPos = mapPos.find(vMissing[j]);
+        if (itPos == mapPos.end())
+            continue;
+        mapByFile[itPos->second.nFile].push_back(std::make_pair(itPos->second, vMissingIndex[j]));
+    }
+
+    for (std::map<int, std::vector<std::pair<CDiskTxPos, size_t> > >::iterator itFile = mapByFile.begin(); itFile != mapByFile.end(); itFile++) {
+        std::vector<std::pair<CDiskTxPos, size_t> >& vEntries = itFile->second;
+        std::sort(vEntries.begin(), vEntries.end(), CompareTxDiskOffset);
+
+        CAutoFile file(OpenBlockFile(vEntries[0].first, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            error("%s: OpenBlockFile failed for file %d", __func__, itFile->first);
+            continue;
+        }
+        for (size_t k = 0; k < vEntries.size(); k++) {
+            const CDiskTxPos& postx = vEntries[k].first;
+            const size_t nIndex = vEntries[k].second;
+            CBlockHeader header;
+            try {
+                if (fseek(file.Get(), postx.nPos, SEEK_SET) != 0)
+                    throw std::runtime_error("fseek failed");
+                file >> header;
+                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                file >> vTx[nIndex];
+            } catch (const std::exception& e) {
+                error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                continue;
+            }
+            if (vTx[nIndex].GetHash() != vHashes[nIndex]) {
+                error("%s: txid mismatch", __func__);
+                vTx[nIndex] = CTransaction();
+                continue;
+            }
+            vHashBlock[nIndex] = header.GetHash();
+            vFound[nIndex] = true;
+        }
+    }
+}
+
 
 
 
@@ -1543,10 +2060,165 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+#ifndef WIN32
+/** A read-only mapping of one blk*.dat file. Mappings are shared between
+ *  readers and refcounted; a mapping that became too small (the file grew)
+ *  or was evicted is released once its last reader drops it. */
+struct CBlockFileView
+{
+    const unsigned char* pchData;
+    size_t nSize;
+    int nRefCount;
+    //! unmap when the last reference is released
+    bool fObsolete;
+    //! identity of the mapped file, so a replaced file is never served
+    dev_t nDevice;
+    ino_t nInode;
+
+    CBlockFileView() : pchData(NULL), nSize(0), nRefCount(0), fObsolete(false), nDevice(0), nInode(0) {}
+};
+
+static CCriticalSection cs_blockFileViews;
+static std::map<int, CBlockFileView*> mapBlockFileViews;
+//! number of simultaneously mapped block files before idle ones are evicted
+static const size_t MAX_BLOCK_FILE_VIEWS = 64;
+
+static void UnmapBlockFileView(CBlockFileView* pview)
+{
+    munmap((void*)pview->pchData, pview->nSize);
+    delete pview;
+}
+
+static void ReleaseBlockFileView(CBlockFileView* pview)
+{
+    LOCK(cs_blockFileViews);
+    if (--pview->nRefCount == 0 && pview->fObsolete)
+        UnmapBlockFileView(pview);
+}
+
+//! Retire any cached mapping of the given block file. Called when the file
+//! is finalized (truncated to its final size), pruned, or otherwise
+//! replaced on disk; current readers finish on the old mapping.
+static void InvalidateBlockFileView(int nFile)
+{
+    LOCK(cs_blockFileViews);
+    std::map<int, CBlockFileView*>::iterator it = mapBlockFileViews.find(nFile);
+    if (it != mapBlockFileViews.end()) {
+        it->second->fObsolete = true;
+        if (it->second->nRefCount == 0)
+            UnmapBlockFileView(it->second);
+        mapBlockFileViews.erase(it);
+    }
+}
+
+//! Map (or reuse a mapping of) the given block file, covering at least
+//! nMinSize bytes. Returns NULL when the file cannot be mapped that far,
+//! in which case the caller falls back to stdio.
+static CBlockFileView* AcquireBlockFileView(int nFile, size_t nMinSize)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    struct stat st;
+    if (stat(path.string().c_str(), &st) != 0) {
+        // the file is gone (pruned, or the datadir changed); any cached
+        // mapping of it is stale
+        InvalidateBlockFileView(nFile);
+        return NULL;
+    }
+
+    LOCK(cs_blockFileViews);
+    std::map<int, CBlockFileView*>::iterator it = mapBlockFileViews.find(nFile);
+    if (it != mapBlockFileViews.end()) {
+        // Only serve a cached mapping of the very file now on disk: blk
+        // file numbers restart with each datadir and a finalized file gets
+        // truncated, so check identity and that the file has not shrunk.
+        if (it->second->nDevice == st.st_dev && it->second->nInode == st.st_ino &&
+            (size_t)st.st_size >= it->second->nSize && it->second->nSize >= nMinSize) {
+            it->second->nRefCount++;
+            return it->second;
+        }
+        // grown past this mapping, truncated, or replaced; map afresh
+        it->second->fObsolete = true;
+        if (it->second->nRefCount == 0)
+            UnmapBlockFileView(it->second);
+        mapBlockFileViews.erase(it);
+    }
+    if (mapBlockFileViews.size() >= MAX_BLOCK_FILE_VIEWS) {
+        for (it = mapBlockFileViews.begin(); it != mapBlockFileViews.end();) {
+            std::map<int, CBlockFileView*>::iterator itOld = it++;
+            itOld->second->fObsolete = true;
+            if (itOld->second->nRefCount == 0)
+                UnmapBlockFileView(itOld->second);
+            mapBlockFileViews.erase(itOld);
+        }
+    }
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < nMinSize) {
+        close(fd);
+        return NULL;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+    CBlockFileView* pview = new CBlockFileView();
+    pview->pchData = (const unsigned char*)addr;
+    pview->nSize = st.st_size;
+    pview->nRefCount = 1;
+    pview->nDevice = st.st_dev;
+    pview->nInode = st.st_ino;
+    mapBlockFileViews[nFile] = pview;
+    return pview;
+}
+//! Ask the kernel to start paging in a block's on-disk bytes ahead of the
+//! synchronous read that will follow, so a run of requests for adjacent
+//! blocks turns into one sequential fetch instead of a seek per block.
+static void PrefetchBlockPos(const CDiskBlockPos& pos)
+{
+    if (pos.nPos < 8)
+        return;
+    CBlockFileView* pview = AcquireBlockFileView(pos.nFile, (size_t)pos.nPos);
+    if (!pview)
+        return;
+    size_t nStart = (size_t)pos.nPos - 8;
+    size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+    size_t nAligned = nStart - (nStart % nPage);
+    size_t nLength = std::min((size_t)MAX_BLOCK_SIZE + 8 + (nStart - nAligned), pview->nSize - nAligned);
+    madvise((void*)(pview->pchData + nAligned), nLength, MADV_WILLNEED);
+    ReleaseBlockFileView(pview);
+}
+#endif // !WIN32
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
+#ifndef WIN32
+    // Serve the read from a persistent mapping of the block file when we
+    // can: historical blocks then come straight out of the page cache with
+    // no fopen/fseek/memcpy per request. A block at the growing tail of
+    // the current file may extend past the mapped size, in which case the
+    // deserializer throws and we retry through stdio below.
+    CBlockFileView* pview = AcquireBlockFileView(pos.nFile, (size_t)pos.nPos + 80);
+    if (pview) {
+        bool fOk = false;
+        try {
+            CSpanReader ss((const char*)pview->pchData + pos.nPos, pview->nSize - pos.nPos, SER_DISK, CLIENT_VERSION);
+            ss >> block;
+            fOk = true;
+        } catch (const std::exception&) {
+            block.SetNull();
+        }
+        ReleaseBlockFileView(pview);
+        if (fOk) {
+            if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+                return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
+            return true;
+        }
+    }
+#endif
+
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -1567,6 +2239,61 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The on-disk record is the serialized block framed by the message start
+    // and a length field, so the bytes can be handed out as one contiguous
+    // buffer without materializing a CBlock. Only the framing is verified
+    // here; callers that need a validated block use ReadBlockFromDisk.
+    if (pos.nPos < 8)
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+
+#ifndef WIN32
+    CBlockFileView* pview = AcquireBlockFileView(pos.nFile, (size_t)pos.nPos);
+    if (pview) {
+        const unsigned char* pchFrame = pview->pchData + pos.nPos - 8;
+        if (memcmp(pchFrame, messageStart, MESSAGE_START_SIZE) != 0) {
+            ReleaseBlockFileView(pview);
+            return error("%s: bad block framing at %s", __func__, pos.ToString());
+        }
+        uint32_t nSize = ReadLE32(pchFrame + 4);
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE) {
+            ReleaseBlockFileView(pview);
+            return error("%s: bad block length %u at %s", __func__, nSize, pos.ToString());
+        }
+        if ((size_t)pos.nPos + nSize <= pview->nSize) {
+            ssBlock.write((const char*)(pview->pchData + pos.nPos), nSize);
+            ReleaseBlockFileView(pview);
+            return true;
+        }
+        // a block at the growing tail of the current file may extend past
+        // the mapped size; retry through stdio below
+        ReleaseBlockFileView(pview);
+    }
+#endif
+
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 8), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    try {
+        unsigned char pchFrame[MESSAGE_START_SIZE];
+        uint32_t nSize = 0;
+        filein.read((char*)pchFrame, sizeof(pchFrame));
+        filein >> nSize;
+        if (memcmp(pchFrame, messageStart, MESSAGE_START_SIZE) != 0)
+            return error("%s: bad block framing at %s", __func__, pos.ToString());
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+            return error("%s: bad block length %u at %s", __func__, nSize, pos.ToString());
+        size_t nOffset = ssBlock.size();
+        ssBlock.resize(nOffset + nSize);
+        filein.read(&ssBlock[nOffset], nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
@@ -1577,15 +2304,21 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
-bool withinLevelBounds(int nReduction, int nLevel)
+/** The subsidy reduction level r applies while r*(r+1)/2 <= nLevel <
+ *  (r+1)*(r+2)/2, i.e. the level boundaries are the triangular numbers.
+ *  The subsidy reaches zero once r hits 500 (the starting subsidy in
+ *  whole coins), so only the boundaries up to that point matter. The
+ *  table is built once at startup; GetBlockSubsidy runs on every block
+ *  of IBD, so it should not iterate towards the boundary per call. */
+static const int MAX_SUBSIDY_REDUCTION = 500;
+static std::vector<int> buildSubsidyLevelBounds()
 {
-    if (((nReduction * nReduction + nReduction) >> 1) > nLevel)
-        return false;
-    nReduction += 1;
-    if (((nReduction * nReduction + nReduction) >> 1) <= nLevel)
-        return false;
-    return true;
+    std::vector<int> vBounds(MAX_SUBSIDY_REDUCTION + 1);
+    for (int nReduction = 0; nReduction <= MAX_SUBSIDY_REDUCTION; nReduction++)
+        vBounds[nReduction] = (nReduction * nReduction + nReduction) >> 1;
+    return vBounds;
 }
+static const std::vector<int> vSubsidyLevelBounds = buildSubsidyLevelBounds();
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
@@ -1599,32 +2332,15 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
     }
     else if (nHeight <= 55000)
     {
-        int l = nHeight - 5000;
-        int nLevel = 0;
-        for (int i = 0; i < l; i+=100)
-        {
-            nLevel++;
-        }
-        return nLevel * COIN;
+        // one level per started 100-block band above height 5000
+        return ((nHeight - 5000 + 99) / 100) * COIN;
     }
     CAmount nStartingSubsidy = 500 * COIN;
     int nLevel = (nHeight - 55001) / consensusParams.nSubsidyLevelInterval;
-    int nReduction = ((-1 + (int)sqrt((8 * nLevel) + 1)) / 2);
-    while (!(withinLevelBounds(nReduction, nLevel)))
-    {
-        if (((nReduction * nReduction + nReduction) >> 1) > nLevel)
-        {
-            nReduction--;
-        }
-        else
-        {
-            nReduction++;
-        }
-    }
-    CAmount nSubsidyReduction = nReduction * COIN;
-    if (nSubsidyReduction >= nStartingSubsidy)
+    if (nLevel >= vSubsidyLevelBounds[MAX_SUBSIDY_REDUCTION])
         return 0;
-    return nStartingSubsidy - nSubsidyReduction;
+    int nReduction = int(std::upper_bound(vSubsidyLevelBounds.begin(), vSubsidyLevelBounds.end(), nLevel) - vSubsidyLevelBounds.begin()) - 1;
+    return nStartingSubsidy - nReduction * COIN;
 }
 
 bool IsInitialBlockDownload()
@@ -1835,7 +2551,7 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, ptxdata), &error)) {
         return false;
     }
     return true;
@@ -1894,7 +2610,7 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks, const PrecomputedTransactionData *ptxdata)
 {
     if (!tx.IsCoinBase())
     {
@@ -1921,7 +2637,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, ptxdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1934,7 +2650,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, ptxdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1956,6 +2672,14 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
+/** Marker byte for framed compressed undo records. A legacy record starts
+ *  with the compact size of vtxundo, which only begins with 0xff for counts
+ *  of 2^32 or more transactions, so the two formats cannot collide. */
+static const unsigned char UNDO_COMPRESSED_MARKER = 0xff;
+static const unsigned char UNDO_COMPRESS_LZ4 = 1;
+/** Sanity bound on a single undo record (compressed or raw). */
+static const uint64_t MAX_UNDO_RECORD_SIZE = 64 * 1024 * 1024;
+
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
@@ -1963,8 +2687,25 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
+    // Serialize the undo data up front so it can optionally be compressed.
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    ssUndo << blockundo;
+    CDataStream ssFramed(SER_DISK, CLIENT_VERSION);
+    if (fCompressUndo) {
+        std::vector<unsigned char> vchCompressed;
+        LZ4Compress((const unsigned char*)&ssUndo[0], ssUndo.size(), vchCompressed);
+        uint64_t nRawSize = ssUndo.size();
+        uint64_t nCompSize = vchCompressed.size();
+        // Only keep the compressed form when it wins including the framing.
+        if (nCompSize + 16 < nRawSize) {
+            ssFramed << UNDO_COMPRESSED_MARKER << UNDO_COMPRESS_LZ4 << VARINT(nRawSize) << VARINT(nCompSize);
+            ssFramed.write((const char*)&vchCompressed[0], vchCompressed.size());
+        }
+    }
+    const CDataStream& ssPayload = ssFramed.empty() ? ssUndo : ssFramed;
+
     // Write index header
-    unsigned int nSize = fileout.GetSerializeSize(blockundo);
+    unsigned int nSize = ssPayload.size();
     fileout << FLATDATA(messageStart) << nSize;
 
     // Write undo data
@@ -1972,9 +2713,9 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     if (fileOutPos < 0)
         return error("%s: ftell failed", __func__);
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout.write(&ssPayload[0], ssPayload.size());
 
-    // calculate & write checksum
+    // calculate & write checksum (always over the uncompressed contents)
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
@@ -1990,10 +2731,42 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     if (filein.IsNull())
         return error("%s: OpenBlockFile failed", __func__);
 
+    // Undo records are read in bursts during reorgs and -verifyblocks; start
+    // the fetch of the record (we don't know its exact size, so over-ask by a
+    // block's worth) before the small stdio reads below stall on it.
+    AdviseWillNeed(filein.Get(), pos.nPos, MAX_BLOCK_SIZE);
+
     // Read block
     uint256 hashChecksum;
     try {
-        filein >> blockundo;
+        // Peek at the first byte to tell a framed compressed record from a
+        // legacy one; see UNDO_COMPRESSED_MARKER above.
+        int chPeek = fgetc(filein.Get());
+        if (chPeek == EOF)
+            return error("%s: short read", __func__);
+        if ((unsigned char)chPeek == UNDO_COMPRESSED_MARKER) {
+            unsigned char chMethod = 0;
+            filein >> chMethod;
+            if (chMethod != UNDO_COMPRESS_LZ4)
+                return error("%s: unknown undo compression method %u", __func__, chMethod);
+            uint64_t nRawSize = 0;
+            uint64_t nCompSize = 0;
+            filein >> VARINT(nRawSize) >> VARINT(nCompSize);
+            if (nRawSize > MAX_UNDO_RECORD_SIZE || nCompSize > MAX_UNDO_RECORD_SIZE)
+                return error("%s: oversized undo record", __func__);
+            std::vector<unsigned char> vchCompressed(nCompSize);
+            if (nCompSize > 0)
+                filein.read((char*)&vchCompressed[0], nCompSize);
+            CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+            ssUndo.resize(nRawSize);
+            if (nRawSize > 0 && !LZ4Decompress(&vchCompressed[0], nCompSize, (unsigned char*)&ssUndo[0], nRawSize))
+                return error("%s: undo decompression failed", __func__);
+            ssUndo >> blockundo;
+        } else {
+            if (fseek(filein.Get(), pos.nPos, SEEK_SET) != 0)
+                return error("%s: fseek failed", __func__);
+            filein >> blockundo;
+        }
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
@@ -2030,14 +2803,56 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 
 } // anon namespace
 
+/** Pre-decoded claim script for one block output or restored prevout.
+ *  Decoding is stateless, so it can be prepared away from the serialized
+ *  apply path: DisconnectBlock shards these tables across threads for large
+ *  blocks, and the block pre-verification pool fills them for downloaded
+ *  blocks waiting on the ordered connect pipeline. */
+class CClaimScriptPrep
+{
+public:
+    bool fHasClaim;
+    int op;
+    std::vector<std::vector<unsigned char> > vvchParams;
+
+    CClaimScriptPrep() : fHasClaim(false), op(0) {}
+};
+
+static const size_t MIN_PARALLEL_UNDO_TXS = 64;
+
+static void PrepareClaimUndoShard(const CBlock* pblock, const CBlockUndo* pblockUndo, size_t nShard, size_t nShards,
+                                  std::vector<std::vector<CClaimScriptPrep> >* pvOutPrep,
+                                  std::vector<std::vector<CClaimScriptPrep> >* pvInPrep)
+{
+    for (size_t i = nShard; i < pblock->vtx.size(); i += nShards) {
+        const CTransaction& tx = pblock->vtx[i];
+        std::vector<CClaimScriptPrep>& vOut = (*pvOutPrep)[i];
+        vOut.resize(tx.vout.size());
+        for (unsigned int n = 0; n < tx.vout.size(); n++)
+            vOut[n].fHasClaim = DecodeClaimScript(tx.vout[n].scriptPubKey, vOut[n].op, vOut[n].vvchParams);
+        if (i == 0)
+            continue;
+        const CTxUndo& txundo = pblockUndo->vtxundo[i-1];
+        std::vector<CClaimScriptPrep>& vIn = (*pvInPrep)[i-1];
+        vIn.resize(txundo.vprevout.size());
+        for (unsigned int j = 0; j < txundo.vprevout.size(); j++) {
+            const CTxInUndo& undo = txundo.vprevout[j];
+            if (undo.fIsClaim)
+                vIn[j].fHasClaim = DecodeClaimScript(undo.txout.scriptPubKey, vIn[j].op, vIn[j].vvchParams);
+        }
+    }
+}
+
 /**
  * Apply the undo operation of a CTxInUndo to the given chain state.
  * @param undo The undo object.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
+ * @param pPrep Pre-decoded claim script for this undo entry, or NULL to
+ *              decode on the spot.
  * @return True on success.
  */
-static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, CClaimTrieCache& trieCache, const COutPoint& out)
+static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, CClaimTrieCache& trieCache, const COutPoint& out, const CClaimScriptPrep* pPrep)
 {
     bool fClean = true;
 
@@ -2058,12 +2873,21 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, CClaimTr
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
     if (coins->vout.size() < out.n+1)
         coins->vout.resize(out.n+1);
+    // restoring an output is not a spend, so the record must take the full
+    // rewrite path at the next flush
+    coins->InvalidateSpendTracking();
 
     // restore claim if applicable
-    int op;
-    std::vector<std::vector<unsigned char> > vvchParams;
-    if (undo.fIsClaim && DecodeClaimScript(undo.txout.scriptPubKey, op, vvchParams))
+    CClaimScriptPrep prepLocal;
+    if (undo.fIsClaim && pPrep == NULL)
+    {
+        prepLocal.fHasClaim = DecodeClaimScript(undo.txout.scriptPubKey, prepLocal.op, prepLocal.vvchParams);
+        pPrep = &prepLocal;
+    }
+    if (undo.fIsClaim && pPrep->fHasClaim)
     {
+        const int op = pPrep->op;
+        const std::vector<std::vector<unsigned char> >& vvchParams = pPrep->vvchParams;
         if (op == OP_CLAIM_NAME || op == OP_UPDATE_CLAIM)
         {
             uint160 claimId;
@@ -2114,6 +2938,15 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, CClaimTr
     return fClean;
 }
 
+arith_uint256 UtxoElementHash(const uint256& txid, uint32_t n, const CTxOut& out)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << txid;
+    ss << VARINT(n);
+    ss << out;
+    return UintToArith256(ss.GetHash());
+}
+
 bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, CClaimTrieCache& trieCache, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -2134,6 +2967,58 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
+    // reverse -claimaddressindex mutations: outputs created in this block
+    // come out of the index, restored prevouts go back in (pfClean is only
+    // set by verification callers, which must not touch the index)
+    bool fScriptIndex = fClaimAddressIndex && pfClean == NULL;
+    std::vector<CClaimScriptIndexOp> vScriptIndexOps;
+
+    // rolling UTXO set statistics: deltas accumulate locally and commit only
+    // once the whole disconnect has gone through (pfClean is only set by
+    // verification callers, which work on a throwaway view)
+    bool fUtxoStats = utxoSetStats.fValid && pfClean == NULL;
+    int64_t nUtxoOutsDelta = 0;
+    CAmount nUtxoAmountDelta = 0;
+    arith_uint256 hashUtxoAdd;
+    arith_uint256 hashUtxoSub;
+    std::map<uint256, bool> mapUtxoHad;
+
+    // Pull everything this disconnect will touch -- the block's own txids
+    // (whose outputs get cleared) and every prevout being restored -- into
+    // the cache with one sorted batch read, instead of a scattered point
+    // read per ModifyCoins/ApplyTxInUndo call below.
+    {
+        std::vector<uint256> vPrefetch;
+        vPrefetch.reserve(block.vtx.size() * 2);
+        for (unsigned int i = 0; i < block.vtx.size(); i++) {
+            vPrefetch.push_back(block.vtx[i].GetHash());
+            if (i > 0) {
+                BOOST_FOREACH(const CTxIn& txin, block.vtx[i].vin)
+                    vPrefetch.push_back(txin.prevout.hash);
+            }
+        }
+        view.WarmCoinsBatch(vPrefetch);
+    }
+
+    // Pre-decode every claim script this disconnect will consult -- the
+    // block's own outputs and the restored prevouts carried in the undo
+    // data. Large blocks shard the decoding across threads the same way
+    // CheckBlock shards its transaction checks; the reverse apply loop
+    // below then only does coin and trie mutations.
+    std::vector<std::vector<CClaimScriptPrep> > vOutPrep(block.vtx.size());
+    std::vector<std::vector<CClaimScriptPrep> > vInPrep(blockUndo.vtxundo.size());
+    {
+        size_t nShards = std::min(static_cast<size_t>(GetValidationThreadBudget()), block.vtx.size() / (MIN_PARALLEL_UNDO_TXS / 2));
+        if (nShards > 1 && block.vtx.size() >= MIN_PARALLEL_UNDO_TXS) {
+            boost::thread_group threads;
+            for (size_t nShard = 0; nShard < nShards; ++nShard)
+                threads.create_thread(boost::bind(&PrepareClaimUndoShard, &block, &blockUndo, nShard, nShards, &vOutPrep, &vInPrep));
+            threads.join_all();
+        } else {
+            PrepareClaimUndoShard(&block, &blockUndo, 0, 1, &vOutPrep, &vInPrep);
+        }
+    }
+
     assert(trieCache.decrementBlock(blockUndo.insertUndo, blockUndo.expireUndo, blockUndo.insertSupportUndo, blockUndo.expireSupportUndo, blockUndo.takeoverHeightUndo));
 
     // undo transactions in reverse order
@@ -2141,6 +3026,21 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
+        if (fUtxoStats)
+        {
+            // record the pre-disconnect existence of every record this tx
+            // touches the first time it is seen; all modifications happen
+            // after this point, so first sight is always pre-modification
+            if (mapUtxoHad.find(hash) == mapUtxoHad.end())
+                mapUtxoHad[hash] = view.HaveCoins(hash);
+            if (i > 0)
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    if (mapUtxoHad.find(txin.prevout.hash) == mapUtxoHad.end())
+                        mapUtxoHad[txin.prevout.hash] = view.HaveCoins(txin.prevout.hash);
+            }
+        }
+
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
@@ -2157,14 +3057,16 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
 
         // remove any claims
+        const std::vector<CClaimScriptPrep>& vTxOutPrep = vOutPrep[i];
         for (unsigned int i = 0; i < tx.vout.size(); ++i)
         {
             const CTxOut& txout = tx.vout[i];
 
-            int op;
-            std::vector<std::vector<unsigned char> > vvchParams;
-            if (DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+            const CClaimScriptPrep& prep = vTxOutPrep[i];
+            if (prep.fHasClaim)
             {
+                const int op = prep.op;
+                const std::vector<std::vector<unsigned char> >& vvchParams = prep.vvchParams;
                 if (op == OP_CLAIM_NAME || op == OP_UPDATE_CLAIM)
                 {
                     uint160 claimId;
@@ -2189,6 +3091,8 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                                   claimId.GetHex(), hash.ToString(), i);
                     }
                     std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                    if (fScriptIndex)
+                        vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(txout.scriptPubKey)), claimId, false));
                     LogPrintf("%s: (txid: %s, nOut: %d) Trying to remove %s from the claim trie due to its block being disconnected\n", __func__, hash.ToString(), i, name.c_str());
                     if (!trieCache.undoAddClaim(name, COutPoint(hash, i), pindex->nHeight))
                     {
@@ -2209,6 +3113,19 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             }
         }
 
+        if (fUtxoStats)
+        {
+            for (unsigned int n = 0; n < outs->vout.size(); n++)
+            {
+                if (!outs->vout[n].IsNull())
+                {
+                    hashUtxoSub += UtxoElementHash(hash, n, outs->vout[n]);
+                    nUtxoOutsDelta--;
+                    nUtxoAmountDelta -= outs->vout[n].nValue;
+                }
+            }
+        }
+
         // remove outputs
         outs->Clear();
         }
@@ -2221,7 +3138,21 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
                 const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, trieCache, out))
+                const CClaimScriptPrep& prepIn = vInPrep[i-1][j];
+                if (fScriptIndex && undo.fIsClaim && prepIn.fHasClaim)
+                {
+                    if (prepIn.op == OP_CLAIM_NAME)
+                        vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(undo.txout.scriptPubKey)), ClaimIdHash(out.hash, out.n), true));
+                    else if (prepIn.op == OP_UPDATE_CLAIM)
+                        vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(undo.txout.scriptPubKey)), uint160(prepIn.vvchParams[1]), true));
+                }
+                if (fUtxoStats && !undo.txout.IsNull())
+                {
+                    hashUtxoAdd += UtxoElementHash(out.hash, out.n, undo.txout);
+                    nUtxoOutsDelta++;
+                    nUtxoAmountDelta += undo.txout.nValue;
+                }
+                if (!ApplyTxInUndo(undo, view, trieCache, out, &prepIn))
                     fClean = false;
             }
         }
@@ -2240,11 +3171,73 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     }
 
 
-    if (pfClean) {
-        *pfClean = fClean;
-        return true;
+    if (pfClean) {
+        *pfClean = fClean;
+        return true;
+    }
+
+    if (fUtxoStats)
+    {
+        for (std::map<uint256, bool>::const_iterator it = mapUtxoHad.begin(); it != mapUtxoHad.end(); ++it)
+        {
+            bool fHaveNow = view.HaveCoins(it->first);
+            if (fHaveNow && !it->second)
+                utxoSetStats.nTransactions++;
+            else if (!fHaveNow && it->second)
+                utxoSetStats.nTransactions--;
+        }
+        utxoSetStats.nTransactionOutputs += nUtxoOutsDelta;
+        utxoSetStats.nTotalAmount += nUtxoAmountDelta;
+        utxoSetStats.hashRolling += hashUtxoAdd;
+        utxoSetStats.hashRolling -= hashUtxoSub;
+        utxoSetStats.hashBlock = pindex->pprev->GetBlockHash();
+    }
+
+    // drop the journal row for the disconnected block (pfClean is only set
+    // by verification callers, which must not touch the journal)
+    if (fClaimJournal)
+        pclaimTrie->eraseClaimOpJournal(pindex->nHeight);
+
+    if (fClaimHistoryIndex)
+    {
+        // every name this disconnect touched appears either in a claim
+        // script of the block (outputs, or restored prevouts in the undo
+        // data) or in one of the block's queue undo lists
+        std::set<std::string> namesTouched;
+        int op;
+        std::vector<std::vector<unsigned char> > vvchParams;
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+        {
+            BOOST_FOREACH(const CTxOut& txout, block.vtx[i].vout)
+            {
+                if (DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+                    namesTouched.insert(std::string(vvchParams[0].begin(), vvchParams[0].end()));
+            }
+        }
+        BOOST_FOREACH(const CTxUndo& txundo, blockUndo.vtxundo)
+        {
+            BOOST_FOREACH(const CTxInUndo& inundo, txundo.vprevout)
+            {
+                if (inundo.fIsClaim && DecodeClaimScript(inundo.txout.scriptPubKey, op, vvchParams))
+                    namesTouched.insert(std::string(vvchParams[0].begin(), vvchParams[0].end()));
+            }
+        }
+        for (insertUndoType::const_iterator it = blockUndo.insertUndo.begin(); it != blockUndo.insertUndo.end(); ++it)
+            namesTouched.insert(it->name);
+        for (claimQueueRowType::const_iterator it = blockUndo.expireUndo.begin(); it != blockUndo.expireUndo.end(); ++it)
+            namesTouched.insert(it->first);
+        for (insertUndoType::const_iterator it = blockUndo.insertSupportUndo.begin(); it != blockUndo.insertSupportUndo.end(); ++it)
+            namesTouched.insert(it->name);
+        for (supportQueueRowType::const_iterator it = blockUndo.expireSupportUndo.begin(); it != blockUndo.expireSupportUndo.end(); ++it)
+            namesTouched.insert(it->first);
+        for (std::vector<std::pair<std::string, int> >::const_iterator it = blockUndo.takeoverHeightUndo.begin(); it != blockUndo.takeoverHeightUndo.end(); ++it)
+            namesTouched.insert(it->first);
+        pclaimTrie->trimClaimHistory(pindex->nHeight, namesTouched);
     }
 
+    if (fScriptIndex)
+        pclaimTrie->applyClaimScriptIndexOps(vScriptIndexOps);
+
     return fClean;
 }
 
@@ -2256,8 +3249,13 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+#ifndef WIN32
+            // a cached mapping may extend past the new end of file
+            InvalidateBlockFileView(nLastBlockFile);
+#endif
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2280,6 +3278,133 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+//! Runtime cap on validation parallelism; 0 means "use all of -par". Shard
+//! helpers and the script check queue consult it, so the validation budget
+//! can be rebalanced (e.g. toward RPC once at tip) without a restart.
+static boost::atomic<int> nValidationThreadBudget(0);
+
+int GetValidationThreadBudget()
+{
+    int nBudget = nValidationThreadBudget.load(boost::memory_order_relaxed);
+    if (nBudget <= 0 || nBudget > nScriptCheckThreads)
+        return nScriptCheckThreads;
+    return nBudget;
+}
+
+void SetValidationThreadBudget(int nBudget)
+{
+    if (nBudget >= nScriptCheckThreads)
+        nBudget = 0; // full -par allotment
+    nValidationThreadBudget.store(nBudget, boost::memory_order_relaxed);
+    // The queue's workers exclude the master, which always participates.
+    scriptcheckqueue.SetMaxActiveWorkers(nBudget > 0 ? nBudget - 1 : -1);
+}
+
+/** A downloaded block pre-verified out of order while it waits for the
+ *  ordered connect pipeline to reach it: the stateless CheckBlock run
+ *  (which sets CBlock::fChecked on success), the blanked sighash bodies
+ *  normally built per transaction inside ConnectBlock, and the decoded
+ *  claim output scripts. The worker owns the entry until fDone is set;
+ *  consumers only take entries whose processing has finished. */
+class CPreVerifiedBlock
+{
+public:
+    CBlock block;
+    int nHeight;
+    std::vector<PrecomputedTransactionData> vTxData;
+    std::vector<std::vector<CClaimScriptPrep> > vOutPrep;
+    boost::atomic<bool> fDone;
+
+    CPreVerifiedBlock(const CBlock& blockIn, int nHeightIn) : block(blockIn), nHeight(nHeightIn), fDone(false) {}
+};
+
+/** Bound on blocks held by the pre-verification cache; entries are erased as
+ *  the chain connects past them, so this only limits the download lead. */
+static const size_t PREVERIFY_MAX_BLOCKS = 32;
+static boost::mutex mutexPreVerify;
+static boost::condition_variable condPreVerify;
+static std::map<uint256, boost::shared_ptr<CPreVerifiedBlock> > mapPreVerified; // guarded by mutexPreVerify
+static std::deque<boost::shared_ptr<CPreVerifiedBlock> > queuePreVerifyJobs;    // guarded by mutexPreVerify
+//! only set once the worker thread is running, so nothing is queued for a
+//! pool that is not there to drain it (tests, -par=0)
+static bool fPreVerifyActive = false;
+
+static void PreVerifyBlock(CPreVerifiedBlock& entry)
+{
+    // A failed check just leaves fChecked unset; the in-order connect
+    // re-runs CheckBlock and reports the failure with full context.
+    CValidationState state;
+    CheckBlock(entry.block, state);
+
+    entry.vTxData.resize(entry.block.vtx.size());
+    entry.vOutPrep.resize(entry.block.vtx.size());
+    for (size_t i = 0; i < entry.block.vtx.size(); i++) {
+        const CTransaction& tx = entry.block.vtx[i];
+        if (i > 0)
+            entry.vTxData[i].Init(tx);
+        std::vector<CClaimScriptPrep>& vOut = entry.vOutPrep[i];
+        vOut.resize(tx.vout.size());
+        for (size_t n = 0; n < tx.vout.size(); n++)
+            vOut[n].fHasClaim = DecodeClaimScript(tx.vout[n].scriptPubKey, vOut[n].op, vOut[n].vvchParams);
+    }
+}
+
+void ThreadBlockPreVerify()
+{
+    RenameThread("bitcoin-preverify");
+    boost::unique_lock<boost::mutex> lock(mutexPreVerify);
+    fPreVerifyActive = true;
+    while (true) {
+        while (queuePreVerifyJobs.empty())
+            condPreVerify.wait(lock);
+        boost::shared_ptr<CPreVerifiedBlock> pentry = queuePreVerifyJobs.front();
+        queuePreVerifyJobs.pop_front();
+        lock.unlock();
+        PreVerifyBlock(*pentry);
+        pentry->fDone.store(true, boost::memory_order_release);
+        lock.lock();
+    }
+}
+
+/** Queue an out-of-order block for background pre-verification. The caller
+ *  passes the active tip height so entries the chain has moved past can be
+ *  dropped without taking cs_main here. */
+static void EnqueuePreVerifyBlock(const CBlock& block, int nHeight, int nTipHeight)
+{
+    boost::unique_lock<boost::mutex> lock(mutexPreVerify);
+    if (!fPreVerifyActive)
+        return;
+    const uint256 hash = block.GetHash();
+    if (mapPreVerified.count(hash))
+        return;
+    std::map<uint256, boost::shared_ptr<CPreVerifiedBlock> >::iterator it = mapPreVerified.begin();
+    while (it != mapPreVerified.end()) {
+        std::map<uint256, boost::shared_ptr<CPreVerifiedBlock> >::iterator itErase = it++;
+        if (itErase->second->nHeight <= nTipHeight)
+            mapPreVerified.erase(itErase);
+    }
+    if (mapPreVerified.size() >= PREVERIFY_MAX_BLOCKS)
+        return;
+    boost::shared_ptr<CPreVerifiedBlock> pentry(new CPreVerifiedBlock(block, nHeight));
+    mapPreVerified[hash] = pentry;
+    queuePreVerifyJobs.push_back(pentry);
+    condPreVerify.notify_one();
+}
+
+/** Detach the finished pre-verification entry for a block, if there is one.
+ *  Entries still being processed are left alone; the caller falls back to
+ *  the usual read-and-check path. */
+static boost::shared_ptr<CPreVerifiedBlock> TakePreVerifiedBlock(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(mutexPreVerify);
+    std::map<uint256, boost::shared_ptr<CPreVerifiedBlock> >::iterator it = mapPreVerified.find(hash);
+    if (it == mapPreVerified.end() || !it->second->fDone.load(boost::memory_order_acquire))
+        return boost::shared_ptr<CPreVerifiedBlock>();
+    boost::shared_ptr<CPreVerifiedBlock> pentry = it->second;
+    mapPreVerified.erase(it);
+    return pentry;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2395,7 +3520,17 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, CClaimTrieCache& trieCache, bool fJustCheck)
+static void PrefetchCoinsShard(const CCoinsViewCache* view, const std::vector<uint256>* vHashes, size_t nShard, size_t nShards)
+{
+    std::vector<uint256> vShard;
+    vShard.reserve((vHashes->size() + nShards - 1) / nShards);
+    for (size_t i = nShard; i < vHashes->size(); i += nShards)
+        vShard.push_back((*vHashes)[i]);
+    std::map<uint256, CCoins> mapCoins;
+    view->PeekCoinsBatch(vShard, mapCoins);
+}
+
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, CClaimTrieCache& trieCache, bool fJustCheck, const CPreVerifiedBlock* pPreVer)
 {
     const CChainParams& chainparams = Params();
     AssertLockHeld(cs_main);
@@ -2432,6 +3567,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             fScriptChecks = false;
         }
     }
+    if (fScriptChecks && !hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // A suitable default value is included with the software and updated from time to time.  Because validity
+        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+        // This setting doesn't apply to the block itself, and it only applies if the block is an ancestor of
+        //  our best header: otherwise an attacker could feed us a chain of headers built on the assumed-valid
+        //  block and have us connect its blocks without ever checking a signature.
+        // Script verification is skipped when this check passes; PoW, block structure, and all UTXO and
+        //  claimtrie updates are still performed in full.
+        BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end()) {
+            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader != NULL &&
+                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex) {
+                fScriptChecks = false;
+            }
+        }
+    }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
@@ -2510,16 +3663,86 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    PerfSample("connectblock.forks", nTime2 - nTime1);
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
 
+    // collected per-block claim ops for the -claimjournal and
+    // -claimhistoryindex keyspaces
+    bool fJournal = (fClaimJournal || fClaimHistoryIndex) && !fJustCheck;
+    claimOpJournalRowType vClaimJournal;
+
+    // pending -claimaddressindex mutations; the index tracks unspent claim
+    // outputs, so entries are keyed off output creation and spend only
+    bool fScriptIndex = fClaimAddressIndex && !fJustCheck;
+    std::vector<CClaimScriptIndexOp> vScriptIndexOps;
+
+    // rolling UTXO set statistics: deltas accumulate locally and commit only
+    // once the whole block has connected
+    bool fUtxoStats = utxoSetStats.fValid && !fJustCheck;
+    int64_t nUtxoOutsDelta = 0;
+    CAmount nUtxoAmountDelta = 0;
+    arith_uint256 hashUtxoAdd;
+    arith_uint256 hashUtxoSub;
+    std::map<uint256, bool> mapUtxoHad;
+
+    // During initial block download the dominant stall is the serial leveldb
+    // point read behind each AccessCoins miss, so the whole block's input set
+    // is issued as a parallel batch of non-mutating lookups first; the misses
+    // land in leveldb's block cache and the serial fetches below stop waiting
+    // on disk. PeekCoins never modifies a cache in the view chain, so the
+    // worker threads are safe while connection has not started writing.
+    if (GetValidationThreadBudget() > 1 && IsInitialBlockDownload())
+    {
+        std::vector<uint256> vPrefetch;
+        for (unsigned int i = 1; i < block.vtx.size(); i++)
+        {
+            const CTransaction& tx = block.vtx[i];
+            for (unsigned int j = 0; j < tx.vin.size(); j++)
+                vPrefetch.push_back(tx.vin[j].prevout.hash);
+        }
+        std::sort(vPrefetch.begin(), vPrefetch.end());
+        vPrefetch.erase(std::unique(vPrefetch.begin(), vPrefetch.end()), vPrefetch.end());
+        if (vPrefetch.size() >= 16)
+        {
+            size_t nShards = std::min(static_cast<size_t>(GetValidationThreadBudget()), vPrefetch.size());
+            boost::thread_group prefetchThreads;
+            for (size_t nShard = 0; nShard < nShards; ++nShard)
+                prefetchThreads.create_thread(boost::bind(&PrefetchCoinsShard, &view, &vPrefetch, nShard, nShards));
+            prefetchThreads.join_all();
+        }
+    }
+
+    // Reserved up front: the deferred script checks hold pointers into this
+    // vector, so it must never reallocate. Declared before the queue control
+    // so it outlives the workers even when ConnectBlock returns early with
+    // checks still queued (the control's destructor waits for them).
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
+
+    // raw material for the optional per-block stats record; everything here
+    // is a byproduct of work this loop already does
+    std::vector<unsigned int> vStatTxSizes;
+    std::vector<CAmount> vStatFeeRates;
+    CAmount nStatTotalOut = 0;
+    unsigned int nStatOutputs = 0;
+    unsigned int nStatClaimNames = 0;
+    unsigned int nStatClaimUpdates = 0;
+    unsigned int nStatClaimSupports = 0;
+    unsigned int nStatClaimSpends = 0;
+    if (fBlockStatsIndex) {
+        vStatTxSizes.reserve(block.vtx.size());
+        vStatFeeRates.reserve(block.vtx.size());
+    }
+
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
@@ -2566,13 +3789,32 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                      REJECT_INVALID, "bad-blk-sigops");
             }
 
-            nFees += view.GetValueIn(tx)-tx.GetValueOut();
+            CAmount nTxFee = view.GetValueIn(tx)-tx.GetValueOut();
+            nFees += nTxFee;
+            if (fBlockStatsIndex) {
+                size_t nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                vStatFeeRates.push_back(nTxSize > 0 ? nTxFee * 1000 / (CAmount)nTxSize : 0);
+                nStatTotalOut += tx.GetValueOut();
+            }
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
+            // Skip script execution entirely for transactions already fully
+            // verified at mempool admission with a superset of the flags
+            // required here; the amount and availability checks still run.
+            bool fRunScripts = fScriptChecks && !AreTxScriptsValidated(tx.GetHash(), flags);
+            // txdata lives as long as the block's deferred script checks do
+            txdata.push_back(PrecomputedTransactionData());
+            if (fRunScripts) {
+                if (pPreVer != NULL && pPreVer->vTxData[i].fReady)
+                    txdata.back() = pPreVer->vTxData[i];
+                else
+                    txdata.back().Init(tx);
+            }
+            if (!CheckInputs(tx, state, view, fRunScripts, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL, &txdata.back()))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
+            TRACE2(validation, checkqueue_dispatch, tx.GetHash().begin(), (uint64_t)vChecks.size());
             control.Add(vChecks);
 
             // To handle claim updates, stick all claims found in the inputs into a map of
@@ -2595,6 +3837,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 std::vector<std::vector<unsigned char> > vvchParams;
                 if (DecodeClaimScript(coins->vout[txin.prevout.n].scriptPubKey, op, vvchParams))
                 {
+                    nStatClaimSpends++;
                     if (op == OP_CLAIM_NAME || op == OP_UPDATE_CLAIM)
                     {
                         uint160 claimId;
@@ -2604,7 +3847,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             std::string name(vvchParams[0].begin(), vvchParams[0].end());
                             std::string value(vvchParams[1].begin(), vvchParams[1].end());
                             claimId = ClaimIdHash(txin.prevout.hash, txin.prevout.n);
-                            LogPrintf("+++ %s[%lu]: OP_CLAIM_NAME \"%s\" = \"%s\" with claimId %s and tx prevout %s at index %d\n",
+                            LogPrint("claims", "+++ %s[%lu]: OP_CLAIM_NAME \"%s\" = \"%s\" with claimId %s and tx prevout %s at index %d\n",
                                       __func__, pindex->nHeight, name, SanitizeString(value),
                                       claimId.GetHex(), txin.prevout.hash.GetHex(), txin.prevout.n);
                         }
@@ -2614,18 +3857,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             std::string name(vvchParams[0].begin(), vvchParams[0].end());
                             std::string value(vvchParams[1].begin(), vvchParams[1].end());
                             claimId = uint160(vvchParams[1]);
-                            LogPrintf("+++ %s[%lu]: OP_UPDATE_CLAIM \"%s\" = \"%s\" with claimId %s and tx prevout %s at index %d\n",
+                            LogPrint("claims", "+++ %s[%lu]: OP_UPDATE_CLAIM \"%s\" = \"%s\" with claimId %s and tx prevout %s at index %d\n",
                                       __func__, pindex->nHeight, name, SanitizeString(value),
                                       claimId.GetHex(), txin.prevout.hash.GetHex(), txin.prevout.n);
                         }
                         std::string name(vvchParams[0].begin(), vvchParams[0].end());
                         int nValidAtHeight;
-                        LogPrintf("%s: Removing %s from the claim trie. Tx: %s, nOut: %d\n", __func__, name, txin.prevout.hash.GetHex(), txin.prevout.n);
+                        LogPrint("claims", "%s: Removing %s from the claim trie. Tx: %s, nOut: %d\n", __func__, name, txin.prevout.hash.GetHex(), txin.prevout.n);
+                        if (fScriptIndex)
+                            vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(coins->vout[txin.prevout.n].scriptPubKey)), claimId, false));
                         if (trieCache.spendClaim(name, COutPoint(txin.prevout.hash, txin.prevout.n), coins->nHeight, nValidAtHeight))
                         {
                             mClaimUndoHeights[i] = nValidAtHeight;
                             std::pair<std::string, uint160> entry(name, claimId);
                             spentClaims.push_back(entry);
+                            if (!fJustCheck)
+                                GetMainSignals().ClaimEvent("claimspent", name, claimId, pindex->nHeight);
+                            if (fJournal)
+                                vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::CLAIM_SPENT, name, COutPoint(txin.prevout.hash, txin.prevout.n), claimId, coins->vout[txin.prevout.n].nValue, nValidAtHeight));
                         }
                     }
                     else if (op == OP_SUPPORT_CLAIM)
@@ -2633,43 +3882,69 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         assert(vvchParams.size() == 2);
                         std::string name(vvchParams[0].begin(), vvchParams[0].end());
                         uint160 supportedClaimId(vvchParams[1]);
-                        LogPrintf("+++ %s[%lu]: OP_SUPPORT_CLAIM \"%s\" with claimId %s and tx prevout %s at index %d\n",
+                        LogPrint("claims", "+++ %s[%lu]: OP_SUPPORT_CLAIM \"%s\" with claimId %s and tx prevout %s at index %d\n",
                                   __func__, pindex->nHeight, name,
                                   supportedClaimId.GetHex(), txin.prevout.hash.GetHex(), txin.prevout.n);
                         int nValidAtHeight;
-                        LogPrintf("%s: Removing support for %s in %s. Tx: %s, nOut: %d, removed txid: %s\n", __func__, supportedClaimId.ToString(), name, txin.prevout.hash.ToString(), txin.prevout.n,tx.GetHash().ToString());
+                        LogPrint("claims", "%s: Removing support for %s in %s. Tx: %s, nOut: %d, removed txid: %s\n", __func__, supportedClaimId.ToString(), name, txin.prevout.hash.ToString(), txin.prevout.n,tx.GetHash().ToString());
                         if (trieCache.spendSupport(name, COutPoint(txin.prevout.hash, txin.prevout.n), coins->nHeight, nValidAtHeight))
                         {
                             mClaimUndoHeights[i] = nValidAtHeight;
+                            if (!fJustCheck)
+                                GetMainSignals().ClaimEvent("supportspent", name, supportedClaimId, pindex->nHeight);
+                            if (fJournal)
+                                vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::SUPPORT_SPENT, name, COutPoint(txin.prevout.hash, txin.prevout.n), supportedClaimId, coins->vout[txin.prevout.n].nValue, nValidAtHeight));
                         }
                     }
                 }
             }
             
+            const std::vector<CClaimScriptPrep>* pvTxOutPrep = pPreVer != NULL ? &pPreVer->vOutPrep[i] : NULL;
             for (unsigned int i = 0; i < tx.vout.size(); ++i)
             {
                 const CTxOut& txout = tx.vout[i];
 
-                int op;
-                std::vector<std::vector<unsigned char> > vvchParams;
-                if (DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+                CClaimScriptPrep prepLocal;
+                const CClaimScriptPrep* pprep = pvTxOutPrep != NULL ? &(*pvTxOutPrep)[i] : NULL;
+                if (pprep == NULL) {
+                    prepLocal.fHasClaim = DecodeClaimScript(txout.scriptPubKey, prepLocal.op, prepLocal.vvchParams);
+                    pprep = &prepLocal;
+                }
+                if (pprep->fHasClaim)
                 {
+                    const int op = pprep->op;
+                    const std::vector<std::vector<unsigned char> >& vvchParams = pprep->vvchParams;
+                    if (op == OP_CLAIM_NAME)
+                        nStatClaimNames++;
+                    else if (op == OP_UPDATE_CLAIM)
+                        nStatClaimUpdates++;
+                    else if (op == OP_SUPPORT_CLAIM)
+                        nStatClaimSupports++;
                     if (op == OP_CLAIM_NAME)
                     {
                         assert(vvchParams.size() == 2);
                         std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        LogPrintf("%s: Inserting %s into the claim trie. Tx: %s, nOut: %d\n", __func__, name, tx.GetHash().GetHex(), i);
+                        LogPrint("claims", "%s: Inserting %s into the claim trie. Tx: %s, nOut: %d\n", __func__, name, tx.GetHash().GetHex(), i);
                         if (!trieCache.addClaim(name, COutPoint(tx.GetHash(), i), ClaimIdHash(tx.GetHash(), i), txout.nValue, pindex->nHeight))
                         {
                             LogPrintf("%s: Something went wrong inserting the claim\n", __func__);
                         }
+                        else
+                        {
+                            if (!fJustCheck)
+                                GetMainSignals().ClaimEvent("claimadded", name, ClaimIdHash(tx.GetHash(), i), pindex->nHeight);
+                            if (fJournal)
+                                vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::CLAIM_ADDED, name, COutPoint(tx.GetHash(), i), ClaimIdHash(tx.GetHash(), i), txout.nValue, 0));
+                            if (fScriptIndex)
+                                vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(txout.scriptPubKey)), ClaimIdHash(tx.GetHash(), i), true));
+                        }
                     }
                     else if (op == OP_UPDATE_CLAIM)
                     {
                         assert(vvchParams.size() == 3);
                         std::string name(vvchParams[0].begin(), vvchParams[0].end());
                         uint160 claimId(vvchParams[1]);
-                        LogPrintf("%s: Got a claim update. Name: %s, claimId: %s, new txid: %s, nOut: %d\n", __func__, name, claimId.GetHex(), tx.GetHash().GetHex(), i);
+                        LogPrint("claims", "%s: Got a claim update. Name: %s, claimId: %s, new txid: %s, nOut: %d\n", __func__, name, claimId.GetHex(), tx.GetHash().GetHex(), i);
                         spentClaimsType::iterator itSpent;
                         for (itSpent = spentClaims.begin(); itSpent != spentClaims.end(); ++itSpent)
                         {
@@ -2685,6 +3960,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                             {
                                 LogPrintf("%s: Something went wrong updating the claim\n", __func__);
                             }
+                            else
+                            {
+                                if (!fJustCheck)
+                                    GetMainSignals().ClaimEvent("claimupdated", name, claimId, pindex->nHeight);
+                                if (fJournal)
+                                    vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::CLAIM_UPDATED, name, COutPoint(tx.GetHash(), i), claimId, txout.nValue, 0));
+                                if (fScriptIndex)
+                                    vScriptIndexOps.push_back(CClaimScriptIndexOp(Hash160(StripClaimScriptPrefix(txout.scriptPubKey)), claimId, true));
+                            }
                         }
                     }
                     else if (op == OP_SUPPORT_CLAIM)
@@ -2696,11 +3980,50 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                         {
                             LogPrintf("%s: Something went wrong inserting the support\n", __func__);
                         }
+                        else
+                        {
+                            if (!fJustCheck)
+                                GetMainSignals().ClaimEvent("supportadded", name, supportedClaimId, pindex->nHeight);
+                            if (fJournal)
+                                vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::SUPPORT_ADDED, name, COutPoint(tx.GetHash(), i), supportedClaimId, txout.nValue, 0));
+                        }
                     }
                 }
             }
         }
 
+        if (fUtxoStats)
+        {
+            // record the pre-block existence of every record this tx touches
+            // the first time it is seen; all coin modifications come through
+            // UpdateCoins below, so first sight is always pre-modification
+            if (mapUtxoHad.find(tx.GetHash()) == mapUtxoHad.end())
+                mapUtxoHad[tx.GetHash()] = view.HaveCoins(tx.GetHash());
+            if (!tx.IsCoinBase())
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                {
+                    if (mapUtxoHad.find(txin.prevout.hash) == mapUtxoHad.end())
+                        mapUtxoHad[txin.prevout.hash] = view.HaveCoins(txin.prevout.hash);
+                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                    const CTxOut& txout = coins->vout[txin.prevout.n];
+                    hashUtxoSub += UtxoElementHash(txin.prevout.hash, txin.prevout.n, txout);
+                    nUtxoOutsDelta--;
+                    nUtxoAmountDelta -= txout.nValue;
+                }
+            }
+            for (unsigned int j = 0; j < tx.vout.size(); j++)
+            {
+                // unspendable outputs never enter the coins database
+                if (!tx.vout[j].scriptPubKey.IsUnspendable())
+                {
+                    hashUtxoAdd += UtxoElementHash(tx.GetHash(), j, tx.vout[j]);
+                    nUtxoOutsDelta++;
+                    nUtxoAmountDelta += tx.vout[j].nValue;
+                }
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0)
         {
@@ -2728,18 +4051,59 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         // inserted into the trie in the first place.
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        unsigned int nTxDiskSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        pos.nTxOffset += nTxDiskSize;
+        if (fBlockStatsIndex) {
+            vStatTxSizes.push_back(nTxDiskSize);
+            nStatOutputs += tx.vout.size();
+        }
     }
 
     assert(trieCache.incrementBlock(blockundo.insertUndo, blockundo.expireUndo, blockundo.insertSupportUndo, blockundo.expireSupportUndo, blockundo.takeoverHeightUndo));
 
-    if (trieCache.getMerkleHash() != block.hashClaimTrie)
-        return state.DoS(100,
-                         error("ConnectBlock() : the merkle root of the claim trie does not match "
-                               "(actual=%s vs block=%s)", trieCache.getMerkleHash().GetHex(),
-                               block.hashClaimTrie.GetHex()), REJECT_INVALID, "bad-claim-merkle-hash");
+    // Each entry in takeoverHeightUndo is a name whose winning claim changed in
+    // this block; report the new winner so indexers need not poll for takeovers
+    if (!fJustCheck)
+    {
+        for (std::vector<std::pair<std::string, int> >::const_iterator itTakeover = blockundo.takeoverHeightUndo.begin(); itTakeover != blockundo.takeoverHeightUndo.end(); ++itTakeover)
+        {
+            CClaimValue claimInTrie;
+            if (trieCache.getInfoForName(itTakeover->first, claimInTrie))
+            {
+                GetMainSignals().ClaimEvent("takeover", itTakeover->first, claimInTrie.claimId, pindex->nHeight);
+                if (fJournal)
+                    vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::NAME_TAKEOVER, itTakeover->first, claimInTrie.outPoint, claimInTrie.claimId, claimInTrie.nAmount, pindex->nHeight));
+            }
+        }
+    }
+
+    if (fJournal)
+    {
+        for (insertUndoType::const_iterator it = blockundo.insertUndo.begin(); it != blockundo.insertUndo.end(); ++it)
+            vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::CLAIM_ACTIVATED, it->name, it->outPoint, uint160(), 0, pindex->nHeight));
+        for (claimQueueRowType::const_iterator it = blockundo.expireUndo.begin(); it != blockundo.expireUndo.end(); ++it)
+            vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::CLAIM_EXPIRED, it->first, it->second.outPoint, it->second.claimId, it->second.nAmount, it->second.nValidAtHeight));
+        for (insertUndoType::const_iterator it = blockundo.insertSupportUndo.begin(); it != blockundo.insertSupportUndo.end(); ++it)
+            vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::SUPPORT_ACTIVATED, it->name, it->outPoint, uint160(), 0, pindex->nHeight));
+        for (supportQueueRowType::const_iterator it = blockundo.expireSupportUndo.begin(); it != blockundo.expireSupportUndo.end(); ++it)
+            vClaimJournal.push_back(CClaimOpJournalEntry(CClaimOpJournalEntry::SUPPORT_EXPIRED, it->first, it->second.outPoint, it->second.supportedClaimId, it->second.nAmount, it->second.nValidAtHeight));
+    }
+
+    // Like the script checks above, recomputing the claim trie merkle root is
+    // skipped for ancestors of a checkpoint. During reindex this lets the
+    // dirty node set accumulate across many blocks, so each node is hashed
+    // once at the next flush instead of once per block that touched it.
+    if (fScriptChecks) {
+        CPerfTimer timer("connectblock.claimtriehash");
+        if (trieCache.getMerkleHash() != block.hashClaimTrie)
+            return state.DoS(100,
+                             error("ConnectBlock() : the merkle root of the claim trie does not match "
+                                   "(actual=%s vs block=%s)", trieCache.getMerkleHash().GetHex(),
+                                   block.hashClaimTrie.GetHex()), REJECT_INVALID, "bad-claim-merkle-hash");
+    }
 
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    PerfSample("connectblock.connect", nTime3 - nTime2);
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
@@ -2751,9 +4115,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                REJECT_INVALID, "bad-cb-amount");
     }
 
-    if (!control.Wait())
-        return state.DoS(100, false);
+    {
+        CPerfTimer timer("connectblock.scriptwait");
+        if (!control.Wait())
+            return state.DoS(100, false);
+    }
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
+    PerfSample("connectblock.verify", nTime4 - nTime2);
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
     if (fJustCheck)
@@ -2782,11 +4150,75 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fBlockStatsIndex)
+    {
+        CBlockStats stats;
+        stats.nHeight = pindex->nHeight;
+        stats.nTxCount = block.vtx.size();
+        stats.nTotalSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+        stats.nInputs = nInputs;
+        stats.nOutputs = nStatOutputs;
+        stats.nTotalOut = nStatTotalOut;
+        stats.nTotalFee = nFees;
+        stats.nClaimNames = nStatClaimNames;
+        stats.nClaimUpdates = nStatClaimUpdates;
+        stats.nClaimSupports = nStatClaimSupports;
+        stats.nClaimSpends = nStatClaimSpends;
+        if (!vStatTxSizes.empty())
+        {
+            std::sort(vStatTxSizes.begin(), vStatTxSizes.end());
+            stats.nMinTxSize = vStatTxSizes.front();
+            stats.nMaxTxSize = vStatTxSizes.back();
+            stats.nMedianTxSize = vStatTxSizes[(vStatTxSizes.size() - 1) / 2];
+        }
+        if (!vStatFeeRates.empty())
+        {
+            std::sort(vStatFeeRates.begin(), vStatFeeRates.end());
+            const size_t n = vStatFeeRates.size();
+            stats.nMinFeeRate = vStatFeeRates.front();
+            stats.nMaxFeeRate = vStatFeeRates.back();
+            stats.nFeeRatePct10 = vStatFeeRates[(n - 1) * 10 / 100];
+            stats.nFeeRatePct25 = vStatFeeRates[(n - 1) * 25 / 100];
+            stats.nFeeRatePct50 = vStatFeeRates[(n - 1) * 50 / 100];
+            stats.nFeeRatePct75 = vStatFeeRates[(n - 1) * 75 / 100];
+            stats.nFeeRatePct90 = vStatFeeRates[(n - 1) * 90 / 100];
+        }
+        if (!pblocktree->WriteBlockStats(pindex->GetBlockHash(), stats))
+            return AbortNode(state, "Failed to write block stats");
+    }
+
+    if (fUtxoStats)
+    {
+        for (std::map<uint256, bool>::const_iterator it = mapUtxoHad.begin(); it != mapUtxoHad.end(); ++it)
+        {
+            bool fHaveNow = view.HaveCoins(it->first);
+            if (fHaveNow && !it->second)
+                utxoSetStats.nTransactions++;
+            else if (!fHaveNow && it->second)
+                utxoSetStats.nTransactions--;
+        }
+        utxoSetStats.nTransactionOutputs += nUtxoOutsDelta;
+        utxoSetStats.nTotalAmount += nUtxoAmountDelta;
+        utxoSetStats.hashRolling += hashUtxoAdd;
+        utxoSetStats.hashRolling -= hashUtxoSub;
+        utxoSetStats.hashBlock = pindex->GetBlockHash();
+    }
+
+    if (fClaimJournal)
+        pclaimTrie->writeClaimOpJournal(pindex->nHeight, vClaimJournal);
+
+    if (fClaimHistoryIndex)
+        pclaimTrie->appendClaimHistory(pindex->nHeight, vClaimJournal);
+
+    if (fClaimAddressIndex)
+        pclaimTrie->applyClaimScriptIndexOps(vScriptIndexOps);
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
     trieCache.setBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    PerfSample("connectblock.index", nTime5 - nTime4);
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
 
     // Watch for changes to the previous coinbase transaction.
@@ -2803,10 +4235,22 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 enum FlushStateMode {
     FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
+    FLUSH_STATE_TRICKLE,
     FLUSH_STATE_PERIODIC,
     FLUSH_STATE_ALWAYS
 };
 
+static int64_t nLastWrite = 0;
+static int64_t nLastFlush = 0;
+static int64_t nLastSetChain = 0;
+//! When ConnectTip last finished (microseconds); the background flusher
+//! treats recent block activity as a busy signal and defers.
+static boost::atomic<int64_t> nTimeLastBlockConnected(0);
+//! Flush debt figures published for the stats gauges, which must not take
+//! cs_main: updated by the flush paths and the background flusher.
+static boost::atomic<int64_t> nFlushDebtBytes(0);
+static boost::atomic<int64_t> nTimeLastFullFlush(0);
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2816,9 +4260,6 @@ enum FlushStateMode {
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     const CChainParams& chainparams = Params();
     LOCK2(cs_main, cs_LastBlockFile);
-    static int64_t nLastWrite = 0;
-    static int64_t nLastFlush = 0;
-    static int64_t nLastSetChain = 0;
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
@@ -2844,13 +4285,17 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     if (nLastSetChain == 0) {
         nLastSetChain = nNow;
     }
-    size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+    // The claim trie shares the -dbcache budget: counting its residency here
+    // makes the coins cache give way as the trie grows, bounding the total.
+    size_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pclaimTrie->DynamicMemoryUsage();
     // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
     // The cache is over the limit, we have to write now.
     bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
-    bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
+    // The background flusher forces this path when the node is idle and over its dirty ceiling.
+    bool fPeriodicWrite = (mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) ||
+                          mode == FLUSH_STATE_TRICKLE;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
@@ -2885,8 +4330,23 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             UnlinkPrunedFiles(setFilesToPrune);
         nLastWrite = nNow;
     }
+    // Trickle the dirty coins out between full flushes. The block index
+    // write above has already run, so the chainstate may safely reference
+    // it; each sync is a single atomic batch including the best block, so
+    // it is as crash safe as a full flush but keeps the cache warm. By the
+    // time a full flush is due there is little left to write.
+    if (fPeriodicWrite && !fDoFullFlush) {
+        CPerfTimer timer("flush.trickle");
+        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            return state.Error("out of disk space");
+        if (!pcoinsTip->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        nFlushDebtBytes.store(0, boost::memory_order_relaxed);
+    }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
+        CPerfTimer timer("flush.full");
+        TRACE3(validation, flush_start, (int64_t)mode, (uint64_t)pcoinsTip->GetCacheSize(), (uint64_t)cacheSize);
         // Typical CCoins structures on disk are around 128 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
@@ -2895,11 +4355,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
-        if (!pclaimTrie->WriteToDisk())
+        if (!pclaimTrie->WriteToDisk(mode != FLUSH_STATE_ALWAYS))
             return AbortNode("Failed to write to claim trie database");
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
+        nFlushDebtBytes.store(0, boost::memory_order_relaxed);
+        nTimeLastFullFlush.store(nNow, boost::memory_order_relaxed);
+        TRACE2(validation, flush_end, (int64_t)mode, (uint64_t)(GetTimeMicros() - nNow));
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2923,11 +4386,81 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+int64_t GetFlushDebtBytes() {
+    return nFlushDebtBytes.load(boost::memory_order_relaxed);
+}
+
+int64_t GetFlushCeilingBytes() {
+    int64_t nMB = GetArg("-flushceiling", DEFAULT_FLUSH_CEILING);
+    if (nMB > 0)
+        return nMB << 20;
+    return (int64_t)(nCoinCacheUsage / 4);
+}
+
+int64_t GetSecondsSinceFullFlush() {
+    int64_t nLast = nTimeLastFullFlush.load(boost::memory_order_relaxed);
+    if (nLast == 0)
+        return -1;
+    return (GetTimeMicros() - nLast) / 1000000;
+}
+
+void AttemptBackgroundFlush()
+{
+    // Runs on the scheduler thread. Never contend with validation: if
+    // cs_main is busy, skip this round and try again next tick.
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return;
+    if (fImporting || fReindex || pcoinsTip == NULL || IsInitialBlockDownload())
+        return;
+    int64_t nNow = GetTimeMicros();
+    int64_t nSinceBlock = nNow - nTimeLastBlockConnected.load(boost::memory_order_relaxed);
+    if (nSinceBlock < (int64_t)BACKGROUND_FLUSH_IDLE_DELAY * 1000000)
+        return;
+    int64_t nDirty = (int64_t)pcoinsTip->DirtyMemoryUsage();
+    nFlushDebtBytes.store(nDirty, boost::memory_order_relaxed);
+    if (nDirty <= GetFlushCeilingBytes())
+        return;
+    // Idle and over the dirty ceiling: trickle the dirty set out now so the
+    // next periodic or critical flush has little left to write.
+    CPerfTimer timer("flush.background");
+    CValidationState state;
+    FlushStateToDisk(state, FLUSH_STATE_TRICKLE);
+}
+
 /** Update chainActive and related internal data structures. */
+static CCriticalSection cs_tipSnapshot;
+static CChainTipSnapshot tipSnapshot;
+static bool fTipSnapshotValid = false;
+
+bool GetChainTipSnapshot(CChainTipSnapshot& snapshot)
+{
+    LOCK(cs_tipSnapshot);
+    if (!fTipSnapshotValid)
+        return false;
+    snapshot = tipSnapshot;
+    return true;
+}
+
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
 
+    {
+        // Publish a copy of the new tip state for monitoring RPCs, so they
+        // need not take cs_main just to report the current height
+        LOCK(cs_tipSnapshot);
+        tipSnapshot.nHeight = pindexNew->nHeight;
+        tipSnapshot.nHeaderHeight = pindexBestHeader ? pindexBestHeader->nHeight : pindexNew->nHeight;
+        tipSnapshot.hashTip = pindexNew->GetBlockHash();
+        tipSnapshot.hashClaimTrie = pindexNew->hashClaimTrie;
+        tipSnapshot.nChainWork = ArithToUint256(pindexNew->nChainWork);
+        tipSnapshot.nBits = pindexNew->nBits;
+        tipSnapshot.nMedianTime = pindexNew->GetMedianTimePast();
+        tipSnapshot.dVerificationProgress = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexNew);
+        fTipSnapshotValid = true;
+    }
+
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
@@ -3044,17 +4577,32 @@ static int64_t nTimePostConnect = 0;
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
+/** Data gathered while connecting a tip so that wallet and external
+ *  notifications can be dispatched after cs_main has been released and
+ *  the new tip announced to peers. */
+struct ConnectedBlock {
+    CBlockIndex* pindex;
+    CBlock block;
+    std::list<CTransaction> txConflicted;
+};
+
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock, ConnectedBlock& connected)
 {
     assert(pindexNew->pprev == chainActive.Tip());
-    // Read block from disk.
+    connected.pindex = pindexNew;
+    // Read block from disk, unless the pre-verification pool already holds
+    // it deserialized with its stateless checks and precomputations done.
     int64_t nTime1 = GetTimeMicros();
-    CBlock block;
-    if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew, chainparams.GetConsensus()))
+    boost::shared_ptr<CPreVerifiedBlock> pPreVer = TakePreVerifiedBlock(pindexNew->GetBlockHash());
+    if (pPreVer) {
+        connected.block = pPreVer->block;
+    } else if (!pblock) {
+        if (!ReadBlockFromDisk(connected.block, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
-        pblock = &block;
+    } else {
+        connected.block = *pblock;
     }
+    pblock = &connected.block;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
@@ -3062,7 +4610,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     {
         CCoinsViewCache view(pcoinsTip);
         CClaimTrieCache trieCache(pclaimTrie);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, trieCache);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, trieCache, false, pPreVer.get());
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3083,23 +4631,22 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.
-    list<CTransaction> txConflicted;
-    mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
+    mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, connected.txConflicted, !IsInitialBlockDownload());
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
-    // Tell wallet about transactions that went from mempool
-    // to conflicted:
-    BOOST_FOREACH(const CTransaction &tx, txConflicted) {
-        SyncWithWallets(tx, pindexNew, NULL);
-    }
-    // ... and about transactions that got confirmed:
-    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
-        SyncWithWallets(tx, pindexNew, pblock);
-    }
+    // Wallet notifications for conflicted and confirmed transactions are
+    // dispatched by ActivateBestChain once cs_main is released, so peers
+    // hear about the new tip before the wallet grinds through the block.
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    TRACE4(validation, block_connected,
+           pindexNew->nHeight,
+           pindexNew->GetBlockHash().begin(),
+           (uint64_t)pblock->vtx.size(),
+           (uint64_t)(nTime6 - nTime1));
+    nTimeLastBlockConnected.store(nTime6, boost::memory_order_relaxed);
     return true;
 }
 
@@ -3173,11 +4720,29 @@ static void PruneBlockIndexCandidates() {
     assert(!setBlockIndexCandidates.empty());
 }
 
+/** One slot of the block read-ahead used by ActivateBestChainStep: while a
+ *  block is being applied, the next one is read from disk and deserialized
+ *  into the other slot by a background worker, so connecting long stretches
+ *  (reindex-chainstate, startup activation) overlaps disk and parse time
+ *  with validation. The apply order itself is unchanged. */
+struct CBlockReadAhead {
+    const CBlockIndex* pindex;
+    CBlock block;
+    bool fOk;
+
+    CBlockReadAhead() : pindex(NULL), fOk(false) {}
+};
+
+static void ThreadReadBlock(CBlockReadAhead* pread, const Consensus::Params* consensusParams)
+{
+    pread->fOk = ReadBlockFromDisk(pread->block, pread->pindex, *consensusParams);
+}
+
 /**
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
  */
-static bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const CBlock* pblock)
+static bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const CBlock* pblock, std::list<ConnectedBlock>& connectedBlocks)
 {
     AssertLockHeld(cs_main);
     bool fInvalidFound = false;
@@ -3209,9 +4774,35 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
-        // Connect new blocks.
-        BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
+        // Connect new blocks, in order. Two read-ahead slots alternate
+        // between "being applied" and "being filled by the worker", so the
+        // read and deserialization of block N+1 runs while block N connects.
+        CBlockReadAhead readAheadBuf[2];
+        CBlockReadAhead* preadCurrent = &readAheadBuf[0];
+        CBlockReadAhead* preadNext = &readAheadBuf[1];
+        boost::thread threadReadAhead;
+        for (size_t i = vpindexToConnect.size(); i-- > 0; ) {
+            CBlockIndex *pindexConnect = vpindexToConnect[i];
+            // Collect the block prefetched for this iteration, if any; a
+            // failed read just falls back to the synchronous path inside
+            // ConnectTip, which reports the error.
+            if (threadReadAhead.joinable())
+                threadReadAhead.join();
+            std::swap(preadCurrent, preadNext);
+            const CBlock* pblockConnect = NULL;
+            if (pindexConnect == pindexMostWork && pblock)
+                pblockConnect = pblock;
+            else if (preadCurrent->pindex == pindexConnect && preadCurrent->fOk)
+                pblockConnect = &preadCurrent->block;
+            // Start reading the next block while this one is applied.
+            if (i > 0) {
+                preadNext->pindex = vpindexToConnect[i - 1];
+                preadNext->fOk = false;
+                threadReadAhead = boost::thread(boost::bind(&ThreadReadBlock, preadNext, &chainparams.GetConsensus()));
+            }
+            connectedBlocks.push_back(ConnectedBlock());
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect, connectedBlocks.back())) {
+                connectedBlocks.pop_back();
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -3222,6 +4813,8 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
                     break;
                 } else {
                     // A system error occurred (disk space, database error, ...).
+                    if (threadReadAhead.joinable())
+                        threadReadAhead.join();
                     return false;
                 }
             } else {
@@ -3233,6 +4826,8 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
                 }
             }
         }
+        if (threadReadAhead.joinable())
+            threadReadAhead.join();
     }
 
     if (fBlocksDisconnected) {
@@ -3265,6 +4860,7 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
         CBlockIndex *pindexNewTip = NULL;
         const CBlockIndex *pindexFork;
         bool fInitialDownload;
+        std::list<ConnectedBlock> connectedBlocks;
         {
             LOCK(cs_main);
             CBlockIndex *pindexOldTip = chainActive.Tip();
@@ -3274,7 +4870,7 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
             if (pindexMostWork == NULL || pindexMostWork == chainActive.Tip())
                 return true;
 
-            if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : NULL))
+            if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : NULL, connectedBlocks))
                 return false;
 
             pindexNewTip = chainActive.Tip();
@@ -3321,6 +4917,12 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
                 }
             }
         }
+        // Tell the wallet about the blocks that were connected, now that
+        // peers have already been told about the new tip. Each block goes
+        // out as one call so listeners can batch their per-block work.
+        BOOST_FOREACH(ConnectedBlock& connected, connectedBlocks) {
+            SyncWithWallets(connected.txConflicted, connected.pindex, &connected.block);
+        }
     } while(pindexMostWork != chainActive.Tip());
     CheckBlockIndex(chainparams.GetConsensus());
 
@@ -3413,7 +5015,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = CBlockIndexPool::New(block);
     assert(pindexNew);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
@@ -3428,6 +5030,7 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
     }
+    pindexNew->BuildVersionTally();
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -3585,6 +5188,27 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
+/** Minimum number of transactions in a block before CheckBlock fans the
+ *  per-transaction checks out to threads */
+static const size_t MIN_PARALLEL_CHECK_TXS = 64;
+
+static void CheckBlockTxShard(const CBlock* pblock, size_t nShard, size_t nShards,
+                              CValidationState* pstate, unsigned int* pnSigOps, size_t* pnFailedTx)
+{
+    unsigned int nSigOps = 0;
+    for (size_t i = nShard; i < pblock->vtx.size(); i += nShards)
+    {
+        const CTransaction& tx = pblock->vtx[i];
+        if (!CheckTransaction(tx, *pstate))
+        {
+            *pnFailedTx = i;
+            return;
+        }
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+    *pnSigOps = nSigOps;
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3626,16 +5250,51 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         if (block.vtx[i].IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
-    // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
-
+    // Check transactions. The per-transaction checks and sigop counting are
+    // stateless, so large blocks are sharded across threads the same way
+    // VerifyDB shards block verification; on failure the lowest-index
+    // failing transaction is reported, matching the serial order.
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    size_t nShards = std::min(static_cast<size_t>(GetValidationThreadBudget()), block.vtx.size() / (MIN_PARALLEL_CHECK_TXS / 2));
+    if (nShards > 1 && block.vtx.size() >= MIN_PARALLEL_CHECK_TXS)
     {
-        nSigOps += GetLegacySigOpCount(tx);
+        std::vector<CValidationState> vShardState(nShards);
+        std::vector<unsigned int> vShardSigOps(nShards, 0);
+        std::vector<size_t> vShardFailedTx(nShards, block.vtx.size());
+        boost::thread_group threads;
+        for (size_t nShard = 0; nShard < nShards; ++nShard)
+            threads.create_thread(boost::bind(&CheckBlockTxShard, &block, nShard, nShards,
+                                              &vShardState[nShard], &vShardSigOps[nShard], &vShardFailedTx[nShard]));
+        threads.join_all();
+        size_t nFirstFailed = block.vtx.size();
+        size_t nFailedShard = 0;
+        for (size_t nShard = 0; nShard < nShards; ++nShard)
+        {
+            if (vShardFailedTx[nShard] < nFirstFailed)
+            {
+                nFirstFailed = vShardFailedTx[nShard];
+                nFailedShard = nShard;
+            }
+            nSigOps += vShardSigOps[nShard];
+        }
+        if (nFirstFailed < block.vtx.size())
+        {
+            state = vShardState[nFailedShard];
+            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                 strprintf("Transaction check failed (tx hash %s) %s", block.vtx[nFirstFailed].GetHash().ToString(), state.GetDebugMessage()));
+        }
+    }
+    else
+    {
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            if (!CheckTransaction(tx, state))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            nSigOps += GetLegacySigOpCount(tx);
+        }
     }
     if (nSigOps > MAX_BLOCK_SIGOPS)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
@@ -3716,7 +5375,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, bool fCheckPOW=true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3735,7 +5394,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3829,6 +5488,18 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
 
 static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned nRequired, const Consensus::Params& consensusParams)
 {
+    if (pstart == NULL)
+        return (nRequired == 0);
+    if (minVersion >= 2 && minVersion <= 4)
+    {
+        // The cumulative tallies turn the window count into a subtraction:
+        // blocks in (nHeight - window, nHeight] with nVersion >= minVersion.
+        const CBlockIndex* pbelow = pstart->GetAncestor(pstart->nHeight - consensusParams.nMajorityWindow);
+        unsigned int nFound = pstart->nVersionTally[minVersion - 2] -
+                              (pbelow ? pbelow->nVersionTally[minVersion - 2] : 0);
+        return (nFound >= nRequired);
+    }
+    // Fallback for versions without a precomputed tally.
     unsigned int nFound = 0;
     for (int i = 0; i < consensusParams.nMajorityWindow && nFound < nRequired && pstart != NULL; i++)
     {
@@ -3853,6 +5524,12 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
         if (pindex && pfrom) {
             mapBlockSource[pindex->GetBlockHash()] = pfrom->GetId();
         }
+        // Blocks fetched ahead of the connect point otherwise sit raw until
+        // the ordered pipeline reaches them; hand them to the background
+        // pool so their stateless work is done by the time they connect.
+        if (ret && pindex && (pindex->nStatus & BLOCK_HAVE_DATA) &&
+            pindex->nHeight > chainActive.Height() + 1 && IsInitialBlockDownload())
+            EnqueuePreVerifyBlock(*pblock, pindex->nHeight, chainActive.Height());
         CheckBlockIndex(chainparams.GetConsensus());
         if (!ret)
             return error("%s: AcceptBlock FAILED", __func__);
@@ -3942,6 +5619,10 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+#ifndef WIN32
+        // drop any mapping of the file so its disk space is really freed
+        InvalidateBlockFileView(*it);
+#endif
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4020,6 +5701,11 @@ FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly)
         LogPrintf("Unable to open file %s\n", path.string());
         return NULL;
     }
+    if (fReadOnly) {
+        // Readers deserialize field by field; a bigger stdio buffer turns
+        // those many small fread()s into a few large ones.
+        setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    }
     if (pos.nPos) {
         if (fseek(file, pos.nPos, SEEK_SET)) {
             LogPrintf("Unable to seek to position %u of %s\n", pos.nPos, path.string());
@@ -4054,7 +5740,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = CBlockIndexPool::New();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
@@ -4066,7 +5752,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
+    if (!pblocktree->LoadBlockIndexGuts(nScriptCheckThreads > 1 ? nScriptCheckThreads : 1))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4104,6 +5790,9 @@ bool static LoadBlockIndexDB()
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
+        // The height-sorted walk guarantees the parent's tally is already
+        // built, so this pass precomputes the whole historical schedule.
+        pindex->BuildVersionTally();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -4157,6 +5846,10 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have a block stats index
+    pblocktree->ReadFlag("blockstatsindex", fBlockStatsIndex);
+    LogPrintf("%s: block stats index %s\n", __func__, fBlockStatsIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -4173,6 +5866,31 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
+/** Worker for the parallel phase of VerifyDB: read, deserialize and check
+ *  a stride of blocks (levels 0-2), which are independent per block. */
+static void VerifyBlocksShard(const CChainParams* chainparams, const std::vector<CBlockIndex*>* vpindex, size_t nShard, size_t nShards, int nCheckLevel, std::vector<char>* vOk)
+{
+    for (size_t i = nShard; i < vpindex->size(); i += nShards) {
+        CBlockIndex* pindex = (*vpindex)[i];
+        CBlock block;
+        CValidationState state;
+        if (!ReadBlockFromDisk(block, pindex, chainparams->GetConsensus())) {
+            (*vOk)[i] = 0;
+            continue;
+        }
+        if (nCheckLevel >= 1 && !CheckBlock(block, state)) {
+            (*vOk)[i] = 0;
+            continue;
+        }
+        if (nCheckLevel >= 2 && pindex->pprev) {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!pos.IsNull() && !UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                (*vOk)[i] = 0;
+        }
+    }
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -4202,8 +5920,36 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
+    // Run the per-block checks (read, deserialize, CheckBlock, undo data)
+    // across the script-check thread count first; they are independent per
+    // block and dominate the verification time. The level 3 disconnect walk
+    // below is inherently sequential and reuses the warmed page cache.
+    bool fParallelChecked = false;
+    if (GetValidationThreadBudget() > 1) {
+        std::vector<CBlockIndex*> vpindexCheck;
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+            if (pindex->nHeight < chainActive.Height() - nCheckDepth)
+                break;
+            vpindexCheck.push_back(pindex);
+        }
+        size_t nShards = std::min(static_cast<size_t>(GetValidationThreadBudget()), vpindexCheck.size());
+        if (nShards > 1) {
+            std::vector<char> vOk(vpindexCheck.size(), 1);
+            boost::thread_group threads;
+            for (size_t nShard = 0; nShard < nShards; ++nShard)
+                threads.create_thread(boost::bind(&VerifyBlocksShard, &chainparams, &vpindexCheck, nShard, nShards, nCheckLevel, &vOk));
+            threads.join_all();
+            for (size_t i = 0; i < vOk.size(); ++i) {
+                if (!vOk[i])
+                    return error("VerifyDB(): *** found bad block or undo data at %d, hash=%s", vpindexCheck[i]->nHeight, vpindexCheck[i]->GetBlockHash().ToString());
+            }
+            fParallelChecked = true;
+        }
+    }
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
+        if (fParallelChecked && nCheckLevel < 3)
+            break;
         boost::this_thread::interruption_point();
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
@@ -4213,11 +5959,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
+        if (!fParallelChecked && nCheckLevel >= 1 && !CheckBlock(block, state))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__, 
                          pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
+        if (!fParallelChecked && nCheckLevel >= 2 && pindex) {
             CBlockUndo undo;
             CDiskBlockPos pos = pindex->GetUndoPos();
             if (!pos.IsNull()) {
@@ -4257,19 +6003,87 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
     }
-
-    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
-
+
+    LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
+
+    return true;
+}
+
+/** Cache of generated claim trie proofs, keyed by (block hash, name).
+ *  Generating a proof for a non-tip block disconnects up to
+ *  MAX_RPC_BLOCK_DECREMENTS blocks, so repeated getnameproof calls for
+ *  the same name and block are worth remembering. Guarded by cs_main. */
+static std::map<std::pair<uint256, std::string>, CClaimTrieProof> mapProofCache;
+static const size_t MAX_PROOF_CACHE_SIZE = 1000;
+
+bool GetProofForName(const CBlockIndex* pindexProof, const std::string& name, CClaimTrieProof& proof)
+{
+    AssertLockHeld(cs_main);
+    if (!chainActive.Contains(pindexProof))
+    {
+        return false;
+    }
+    const std::pair<uint256, std::string> cacheKey = std::make_pair(pindexProof->GetBlockHash(), name);
+    std::map<std::pair<uint256, std::string>, CClaimTrieProof>::iterator itCached = mapProofCache.find(cacheKey);
+    if (itCached != mapProofCache.end())
+    {
+        proof = itCached->second;
+        return true;
+    }
+    CCoinsViewCache coins(pcoinsTip);
+    CClaimTrieCache trieCache(pclaimTrie);
+    CBlockIndex* pindexState = chainActive.Tip();
+    CValidationState state;
+    for (CBlockIndex *pindex = chainActive.Tip(); pindex && pindex->pprev && pindexState != pindexProof; pindex=pindex->pprev)
+    {
+        boost::this_thread::interruption_point();
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        {
+            return false;
+        }
+        if (pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage)
+        {
+            bool fClean = true;
+            if (!DisconnectBlock(block, state, pindex, coins, trieCache, &fClean))
+            {
+                return false;
+            }
+            pindexState = pindex->pprev;
+        }
+        if (ShutdownRequested())
+            return false;
+    }
+    assert(pindexState == pindexProof);
+    proof = trieCache.getProofForName(name);
+    if (mapProofCache.size() >= MAX_PROOF_CACHE_SIZE)
+        mapProofCache.clear();
+    mapProofCache[cacheKey] = proof;
     return true;
 }
 
-bool GetProofForName(const CBlockIndex* pindexProof, const std::string& name, CClaimTrieProof& proof)
+bool GetProofsForNames(const CBlockIndex* pindexProof, const std::vector<std::string>& names, std::vector<CClaimTrieProof>& proofs)
 {
     AssertLockHeld(cs_main);
     if (!chainActive.Contains(pindexProof))
     {
         return false;
     }
+    // serve what we can from the proof cache and rewind at most once for
+    // the rest, instead of once per name as repeated GetProofForName
+    // calls would
+    proofs.resize(names.size());
+    std::vector<size_t> vMissing;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        std::map<std::pair<uint256, std::string>, CClaimTrieProof>::iterator itCached = mapProofCache.find(std::make_pair(pindexProof->GetBlockHash(), names[i]));
+        if (itCached != mapProofCache.end())
+            proofs[i] = itCached->second;
+        else
+            vMissing.push_back(i);
+    }
+    if (vMissing.empty())
+        return true;
     CCoinsViewCache coins(pcoinsTip);
     CClaimTrieCache trieCache(pclaimTrie);
     CBlockIndex* pindexState = chainActive.Tip();
@@ -4295,7 +6109,13 @@ bool GetProofForName(const CBlockIndex* pindexProof, const std::string& name, CC
             return false;
     }
     assert(pindexState == pindexProof);
-    proof = trieCache.getProofForName(name);
+    for (std::vector<size_t>::const_iterator it = vMissing.begin(); it != vMissing.end(); ++it)
+    {
+        proofs[*it] = trieCache.getProofForName(names[*it]);
+        if (mapProofCache.size() >= MAX_PROOF_CACHE_SIZE)
+            mapProofCache.clear();
+        mapProofCache[std::make_pair(pindexProof->GetBlockHash(), names[*it])] = proofs[*it];
+    }
     return true;
 }
 
@@ -4309,6 +6129,8 @@ void UnloadBlockIndex()
     mempool.clear();
     mapOrphanTransactions.clear();
     mapOrphanTransactionsByPrev.clear();
+    mapOrphanTransactionsByPeer.clear();
+    listOrphanLru.clear();
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -4326,10 +6148,9 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    CBlockIndexPool::FreeAll();
+    utxoSetStats = CUtxoSetStats();
     fHavePruned = false;
 }
 
@@ -4355,6 +6176,9 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    fBlockStatsIndex = GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
+    pblocktree->WriteFlag("blockstatsindex", fBlockStatsIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4384,18 +6208,201 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+/** One framed payload moving through the block import pipeline: the raw
+ *  bytes are filled by the reader, the block and its hash by a worker. */
+struct CBlockImportItem
+{
+    uint64_t nSequence;
+    CDiskBlockPos pos;
+    std::vector<unsigned char> vchBlock;
+    CBlock block;
+    uint256 hash;
+    bool fDeserOk;
+
+    CBlockImportItem() : nSequence(0), fDeserOk(false) {}
+};
+
+/** Work/result queue between the import reader, the deserialization
+ *  workers and the in-order consumer. */
+class CBlockImportQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    std::deque<CBlockImportItem*> queueWork;
+    std::map<uint64_t, CBlockImportItem*> mapDone;
+    bool fQuit;
+
+public:
+    CBlockImportQueue() : fQuit(false) {}
+
+    void PushWork(CBlockImportItem* pitem)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queueWork.push_back(pitem);
+        condWork.notify_one();
+    }
+
+    //! Blocks until work is available; returns NULL once quitting.
+    CBlockImportItem* PopWork()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queueWork.empty() && !fQuit)
+            condWork.wait(lock);
+        if (queueWork.empty())
+            return NULL;
+        CBlockImportItem* pitem = queueWork.front();
+        queueWork.pop_front();
+        return pitem;
+    }
+
+    void PushDone(CBlockImportItem* pitem)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        mapDone[pitem->nSequence] = pitem;
+        condDone.notify_one();
+    }
+
+    //! Fetch the result with the given sequence number, optionally waiting
+    //! for it; results are consumed strictly in order.
+    CBlockImportItem* TakeDone(uint64_t nSequence, bool fWait)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            std::map<uint64_t, CBlockImportItem*>::iterator it = mapDone.find(nSequence);
+            if (it != mapDone.end()) {
+                CBlockImportItem* pitem = it->second;
+                mapDone.erase(it);
+                return pitem;
+            }
+            if (!fWait || fQuit)
+                return NULL;
+            condDone.wait(lock);
+        }
+    }
+
+    void Quit()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+        condWork.notify_all();
+        condDone.notify_all();
+    }
+
+    //! Delete anything still queued; only valid once the workers are gone.
+    void Clear()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (std::deque<CBlockImportItem*>::iterator it = queueWork.begin(); it != queueWork.end(); it++)
+            delete *it;
+        queueWork.clear();
+        for (std::map<uint64_t, CBlockImportItem*>::iterator it = mapDone.begin(); it != mapDone.end(); it++)
+            delete it->second;
+        mapDone.clear();
+    }
+};
+
+static void BlockImportWorker(CBlockImportQueue* pqueue)
+{
+    while (CBlockImportItem* pitem = pqueue->PopWork()) {
+        try {
+            CSpanReader ss((const char*)&pitem->vchBlock[0], pitem->vchBlock.size(), SER_DISK, CLIENT_VERSION);
+            ss >> pitem->block;
+            pitem->hash = pitem->block.GetHash();
+            pitem->fDeserOk = true;
+        } catch (const std::exception&) {
+            pitem->fDeserOk = false;
+        }
+        pqueue->PushDone(pitem);
+    }
+}
+
+//! Hand a deserialized block to validation; returns false when a state
+//! error means the import should stop.
+static bool ProcessImportedBlock(const CChainParams& chainparams, CBlock& block, const uint256& hash, CDiskBlockPos* dbp,
+                                 std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)) {
+        CValidationState state;
+        if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            CBlock blockChild;
+            if (ReadBlockFromDisk(blockChild, it->second, chainparams.GetConsensus()))
+            {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                        head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, chainparams, NULL, &blockChild, true, &it->second))
+                {
+                    nLoaded++;
+                    queue.push_back(blockChild.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    //! raw payloads in flight between the reader and the consumer
+    static const uint64_t MAX_BLOCK_IMPORT_QUEUE = 32;
+
     int nLoaded = 0;
+    // Three overlapping stages: this thread scans the file and copies out
+    // raw payloads (keeping the disk busy), the workers deserialize and
+    // hash them in parallel, and completed blocks are consumed strictly
+    // in sequence order so validation sees the file order unchanged.
+    CBlockImportQueue importQueue;
+    boost::thread_group threadGroup;
+    int nWorkers = GetValidationThreadBudget() > 1 ? GetValidationThreadBudget() : 1;
+    for (int i = 0; i < nWorkers; i++)
+        threadGroup.create_thread(boost::bind(&BlockImportWorker, &importQueue));
+    uint64_t nNextSeq = 0;
+    uint64_t nNextProcess = 0;
     try {
+        // We read the file front to back exactly once; widen the kernel
+        // read-ahead window accordingly.
+        AdviseSequentialAccess(fileIn);
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nBufSize = std::max((uint64_t)(2 * MAX_BLOCK_SIZE),
+                                     (uint64_t)GetArg("-loadblockbuffer", DEFAULT_LOADBLOCK_BUFFER_MB) * 1024 * 1024);
+        CBufferedFile blkdat(fileIn, nBufSize, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fStop = false;
+        while (!blkdat.eof() && !fStop) {
             boost::this_thread::interruption_point();
 
             blkdat.SetPos(nRewind);
@@ -4419,67 +6426,66 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 break;
             }
             try {
-                // read block
+                // read the raw block and hand it to the workers
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0)) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, chainparams, NULL, &block, true, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
+                CBlockImportItem* pitem = new CBlockImportItem();
+                pitem->nSequence = nNextSeq++;
+                if (dbp) {
+                    pitem->pos = *dbp;
+                    pitem->pos.nPos = nBlockPos;
                 }
+                pitem->vchBlock.resize(nSize);
+                blkdat.read((char*)&pitem->vchBlock[0], nSize);
+                nRewind = blkdat.GetPos();
+                importQueue.PushWork(pitem);
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                nNextSeq--; // the item was never queued
+                continue;
+            }
+
+            // consume whatever has completed, waiting only when the
+            // pipeline is full
+            while (nNextProcess < nNextSeq) {
+                bool fWait = nNextSeq - nNextProcess >= MAX_BLOCK_IMPORT_QUEUE;
+                CBlockImportItem* pdone = importQueue.TakeDone(nNextProcess, fWait);
+                if (pdone == NULL)
+                    break;
+                nNextProcess++;
+                if (pdone->fDeserOk && !ProcessImportedBlock(chainparams, pdone->block, pdone->hash, dbp ? &pdone->pos : NULL, mapBlocksUnknownParent, nLoaded))
+                    fStop = true;
+                else if (!pdone->fDeserOk)
+                    LogPrintf("%s: Deserialize or I/O error in block at position %u\n", __func__, pdone->pos.nPos);
+                delete pdone;
             }
         }
+        // drain the pipeline
+        while (nNextProcess < nNextSeq && !fStop) {
+            CBlockImportItem* pdone = importQueue.TakeDone(nNextProcess, true);
+            if (pdone == NULL)
+                break;
+            nNextProcess++;
+            if (pdone->fDeserOk && !ProcessImportedBlock(chainparams, pdone->block, pdone->hash, dbp ? &pdone->pos : NULL, mapBlocksUnknownParent, nLoaded))
+                fStop = true;
+            else if (!pdone->fDeserOk)
+                LogPrintf("%s: Deserialize or I/O error in block at position %u\n", __func__, pdone->pos.nPos);
+            delete pdone;
+        }
+        importQueue.Quit();
+        threadGroup.join_all();
+        importQueue.Clear();
     } catch (const std::runtime_error& e) {
+        importQueue.Quit();
+        threadGroup.join_all();
+        importQueue.Clear();
         AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        importQueue.Quit();
+        threadGroup.join_all();
+        importQueue.Clear();
+        throw;
     }
     if (nLoaded > 0)
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
@@ -4755,6 +6761,62 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+// Worker for the parallel per-batch header PoW check: validates the headers
+// in [nStart, nEnd) against their claimed nBits and raises *pfFailed on the
+// first failure. Whether each nBits itself is correct is checked later,
+// contextually, under cs_main.
+static void CheckHeadersPoW(const std::vector<CBlockHeader>* pheaders, size_t nStart, size_t nEnd, const Consensus::Params* pparams, char* pfFailed)
+{
+    for (size_t i = nStart; i < nEnd; i++) {
+        if (!CheckProofOfWork((*pheaders)[i].GetPoWHash(), (*pheaders)[i].nBits, *pparams)) {
+            *pfFailed = 1;
+            return;
+        }
+    }
+}
+
+/** Number of blocks served per ProcessGetData pass before yielding back to
+ *  the message loop; the rest of the queue keeps the handler thread awake
+ *  and is picked up on the next pass. */
+static const unsigned int MAX_GETDATA_BLOCKS_PER_PASS = 16;
+
+/** Cache of per-block merkle tree layers for filtered-block serving. The
+ *  layer hashes depend only on the block, so when several SPV peers sync
+ *  through the same range each block's tree is computed once and every
+ *  peer's merkleblock costs just its own filter matching and bit
+ *  extraction. A handful of entries suffices: peers in sync ask for the
+ *  same recent window of blocks.
+ */
+static const size_t MAX_MERKLE_LAYERS_CACHE = 16;
+static std::map<uint256, boost::shared_ptr<CMerkleTreeLayers> > mapMerkleLayers;
+static std::list<uint256> listMerkleLayersLru;
+static CCriticalSection cs_merkleLayers;
+
+static boost::shared_ptr<CMerkleTreeLayers> GetMerkleTreeLayers(const uint256& hashBlock, const CBlock& block)
+{
+    LOCK(cs_merkleLayers);
+    std::map<uint256, boost::shared_ptr<CMerkleTreeLayers> >::iterator it = mapMerkleLayers.find(hashBlock);
+    if (it != mapMerkleLayers.end())
+    {
+        listMerkleLayersLru.remove(hashBlock);
+        listMerkleLayersLru.push_back(hashBlock);
+        return it->second;
+    }
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        vTxid.push_back(block.vtx[i].GetHash());
+    boost::shared_ptr<CMerkleTreeLayers> pLayers(new CMerkleTreeLayers(vTxid));
+    mapMerkleLayers[hashBlock] = pLayers;
+    listMerkleLayersLru.push_back(hashBlock);
+    while (mapMerkleLayers.size() > MAX_MERKLE_LAYERS_CACHE)
+    {
+        mapMerkleLayers.erase(listMerkleLayersLru.front());
+        listMerkleLayersLru.pop_front();
+    }
+    return pLayers;
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -4763,6 +6825,25 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
     LOCK(cs_main);
 
+#ifndef WIN32
+    // Hint the kernel about every block this pass will read before the
+    // first synchronous read starts; a syncing peer's getdata lists
+    // consecutive blocks, so the hints coalesce into sequential I/O.
+    {
+        unsigned int nLookahead = 0;
+        for (std::deque<CInv>::iterator itHint = it; itHint != pfrom->vRecvGetData.end() && nLookahead < MAX_GETDATA_BLOCKS_PER_PASS; ++itHint)
+        {
+            if (itHint->type != MSG_BLOCK && itHint->type != MSG_FILTERED_BLOCK && itHint->type != MSG_CMPCT_BLOCK)
+                continue;
+            nLookahead++;
+            BlockMap::iterator mi = mapBlockIndex.find(itHint->hash);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                PrefetchBlockPos(mi->second->GetBlockPos());
+        }
+    }
+#endif
+
+    unsigned int nBlocksServed = 0;
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -4771,9 +6852,14 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
         const CInv &inv = *it;
         {
             boost::this_thread::interruption_point();
+            // Yield back to the message loop after a batch of blocks so one
+            // syncing peer cannot monopolize it for a disk-bound interval.
+            if ((inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) &&
+                nBlocksServed >= MAX_GETDATA_BLOCKS_PER_PASS)
+                break;
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -4797,7 +6883,8 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // disconnect node in case we have reached the outbound limit for serving historical blocks
                 // never disconnect whitelisted nodes
                 static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && CNode::OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+                bool fHistorical = send && (pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek);
+                if (send && CNode::OutboundTargetReached(true) && (fHistorical || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
                 {
                     LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
@@ -4805,37 +6892,83 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     pfrom->fDisconnect = true;
                     send = false;
                 }
+                // Historical serving competes with tip relay for upload
+                // bandwidth; when the token buckets are empty, leave the
+                // request queued and retry it once they refill. Tip blocks
+                // are never throttled.
+                if (send && fHistorical && !pfrom->fWhitelisted && !pfrom->HasHistoricalBudget())
+                {
+                    pfrom->nHistoricalThrottled++;
+                    LogPrint("net", "historical block serving throttled, deferring getdata peer=%d\n", pfrom->GetId());
+                    it--;
+                    break;
+                }
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
+                    nBlocksServed++;
+                    unsigned int nBlockBytes = 0;
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
-                    else // MSG_FILTERED_BLOCK)
                     {
-                        LOCK(pfrom->cs_filter);
-                        if (pfrom->pfilter)
+                        // Relay the serialized bytes straight from disk: one
+                        // contiguous buffer per block, rather than exploding
+                        // a block into thousands of per-transaction
+                        // allocations only to reserialize it unchanged.
+                        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+                        if (!ReadRawBlockFromDisk(ssBlock, mi->second->GetBlockPos(), Params().MessageStart()))
+                            assert(!"cannot load block from disk");
+                        nBlockBytes = ssBlock.size();
+                        pfrom->PushSerializedMessage(NetMsgType::BLOCK, CreateNetMessage(NetMsgType::BLOCK, ssBlock));
+                    }
+                    else
+                    {
+                        // The compact and filtered forms need the
+                        // deserialized transactions, so read the block proper.
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
+                        nBlockBytes = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+                        if (inv.type == MSG_CMPCT_BLOCK)
+                        {
+                            // If a peer is asking for old blocks, we're almost guaranteed
+                            // they won't have a useful mempool to match against a compact block,
+                            // and we don't feel like constructing the object for them, so
+                            // instead we respond with the full, non-compact block.
+                            if (mi->second->nHeight >= chainActive.Height() - 10) {
+                                CBlockHeaderAndShortTxIDs cmpctblock(block);
+                                pfrom->PushMessage(NetMsgType::CMPCTBLOCK, cmpctblock);
+                            } else
+                                pfrom->PushMessage(NetMsgType::BLOCK, block);
+                        }
+                        else // MSG_FILTERED_BLOCK)
                         {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                            pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
+                            LOCK(pfrom->cs_filter);
+                            if (pfrom->pfilter)
+                            {
+                                // the tree layers are peer independent; share
+                                // them across every peer syncing this block
+                                boost::shared_ptr<CMerkleTreeLayers> pLayers = GetMerkleTreeLayers(inv.hash, block);
+                                CMerkleBlock merkleBlock(block, *pfrom->pfilter, pLayers.get());
+                                pfrom->PushMessage(NetMsgType::MERKLEBLOCK, merkleBlock);
+                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                                // This avoids hurting performance by pointlessly requiring a round-trip
+                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                                // they must either disconnect and retry or request the full block.
+                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                                // however we MUST always provide at least what the remote peer needs
+                                typedef std::pair<unsigned int, uint256> PairType;
+                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                    pfrom->PushMessage(NetMsgType::TX, block.vtx[pair.first]);
+                            }
+                            // else
+                                // no response
                         }
-                        // else
-                            // no response
                     }
 
+                    if (fHistorical && !pfrom->fWhitelisted)
+                        pfrom->AccountHistoricalBytes(nBlockBytes);
+
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
                     {
@@ -4855,9 +6988,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<uint256, CTransaction>::iterator mi = mapRelay.find(inv.hash);
+                    boost::unordered_map<uint256, CSerializeDataRef, CSaltedTxidHasher>::iterator mi = mapRelay.find(inv.hash);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        // Already serialized with its header at relay time;
+                        // shared across every peer that asks for it.
+                        pfrom->PushSerializedMessage(inv.GetCommand(), (*mi).second);
                         pushed = true;
                     }
                 }
@@ -4876,7 +7011,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -4895,7 +7030,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams)
+bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, const boost::shared_ptr<CNetMsgDecodeJob>& pDecodeJob)
 {
     RandAddSeedPerfmon();
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -5062,6 +7197,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             // nodes)
             pfrom->PushMessage(NetMsgType::SENDHEADERS);
         }
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide version-1 cmpctblocks.
+            // However, we do not request new block announcements using
+            // cmpctblock messages.
+            // We send this to non-NODE NETWORK peers as well, because
+            // they may wish to request compact blocks from us.
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            pfrom->PushMessage(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
     }
 
 
@@ -5137,6 +7282,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
 
     else if (strCommand == NetMsgType::INV)
     {
@@ -5339,8 +7496,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
-        vRecv >> tx;
+        // use the decode pool's pre-parsed transaction when there is one
+        CTransaction txDeserialized;
+        if (!(pDecodeJob && pDecodeJob->ptx))
+            vRecv >> txDeserialized;
+        const CTransaction& tx = (pDecodeJob && pDecodeJob->ptx) ? *pDecodeJob->ptx : txDeserialized;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -5368,7 +7528,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             set<NodeId> setMisbehaving;
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
+                boost::unordered_map<uint256, set<uint256>, CSaltedTxidHasher>::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
                 if (itByPrev == mapOrphanTransactionsByPrev.end())
                     continue;
                 for (set<uint256>::iterator mi = itByPrev->second.begin();
@@ -5481,13 +7641,46 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
 
+        if (nCount == MAX_HEADERS_RESULTS) {
+            // Headers message had its maximum size; the peer may have more
+            // headers. Pipeline the next request right away, so the next
+            // batch is already in flight while this one is validated below.
+            LogPrint("net", "pipelining more getheaders to peer=%d (startheight:%d)\n", pfrom->id, pfrom->nStartingHeight);
+            std::vector<uint256> vHave;
+            vHave.push_back(headers.back().GetHash());
+            pfrom->PushMessage(NetMsgType::GETHEADERS, CBlockLocator(vHave), uint256());
+        }
+
+        // Validate the per-header PoW hashes across all cores before taking
+        // cs_main; they dominate header sync cost on this chain. The
+        // contextual pass below still verifies each claimed nBits.
+        {
+            char fPoWFailed = 0;
+            const Consensus::Params& params = chainparams.GetConsensus();
+            size_t nThreads = boost::thread::hardware_concurrency();
+            if (nThreads < 2 || nCount < 64) {
+                CheckHeadersPoW(&headers, 0, headers.size(), &params, &fPoWFailed);
+            } else {
+                boost::thread_group powThreads;
+                size_t nPerThread = (headers.size() + nThreads - 1) / nThreads;
+                for (size_t i = 0; i < headers.size(); i += nPerThread)
+                    powThreads.create_thread(boost::bind(&CheckHeadersPoW, &headers, i, std::min(i + nPerThread, headers.size()), &params, &fPoWFailed));
+                powThreads.join_all();
+            }
+            if (fPoWFailed) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 50);
+                return error("invalid proof of work in headers message");
+            }
+        }
+
+        LOCK(cs_main);
+
         CBlockIndex *pindexLast = NULL;
         BOOST_FOREACH(const CBlockHeader& header, headers) {
             CValidationState state;
@@ -5495,7 +7688,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
+            // The batch PoW check above already verified the header hashes.
+            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, false)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -5508,14 +7702,6 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
-            // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexLast), uint256());
-        }
-
         bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus());
         CNodeState *nodestate = State(pfrom->GetId());
         // If this set of headers is valid and ends in a block with at least as
@@ -5558,6 +7744,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                             pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
                 }
                 if (vGetData.size() > 0) {
+                    if (nodestate->fProvidesHeaderAndIDs && vToFetch.size() == 1 && mapBlocksInFlight.size() == 1 && pindexLast->pprev->IsValid(BLOCK_VALID_CHAIN)) {
+                        // We seem to be rather well-synced, so it appears pfrom was the first to provide us
+                        // with this block! Let's get them to announce using compact blocks in the future.
+                        MaybeSetPeerAsAnnouncingHeaderAndIDs(nodestate, pfrom);
+                        // In any case, we want to download using a compact block, not a regular one
+                        vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                    }
                     pfrom->PushMessage(NetMsgType::GETDATA, vGetData);
                 }
             }
@@ -5566,10 +7759,186 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CheckBlockIndex(chainparams.GetConsensus());
     }
 
-    else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        LOCK(cs_main);
+
+        if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+            // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
+            if (!IsInitialBlockDownload())
+                pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+            return true;
+        }
+
+        CBlockIndex *pindex = NULL;
+        CValidationState state;
+        if (!AcceptBlockHeader(cmpctblock.header, state, chainparams, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header via cmpctblock");
+            }
+        }
+
+        assert(pindex);
+        UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+        if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+            return true;
+
+        if (!CanDirectFetch(chainparams.GetConsensus()) || pindex->pprev != chainActive.Tip()) {
+            // We're not caught up enough for the mempool to be useful, or
+            // this block doesn't extend our tip; let the usual headers-based
+            // fetching handle it.
+            return true;
+        }
+
+        // If the block is already being fetched from another peer, let that
+        // download finish rather than racing it.
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator inFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
+        if (inFlightIt != mapBlocksInFlight.end() && inFlightIt->second.first != pfrom->GetId())
+            return true;
+
+        CNodeState *nodestate = State(pfrom->GetId());
+        nodestate->pendingCmpctBlock.reset(new PartiallyDownloadedBlock(&mempool));
+        ReadStatus status = nodestate->pendingCmpctBlock->InitData(cmpctblock);
+        if (status == READ_STATUS_INVALID) {
+            nodestate->pendingCmpctBlock.reset();
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us invalid compact block", pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Duplicate short ids; just request the full block.
+            nodestate->pendingCmpctBlock.reset();
+            vector<CInv> vInv(1);
+            vInv[0] = CInv(MSG_BLOCK, pindex->GetBlockHash());
+            pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+            return true;
+        }
+
+        BlockTransactionsRequest req;
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!nodestate->pendingCmpctBlock->IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        if (req.indexes.empty()) {
+            // Everything was in our mempool; reconstruct and process now.
+            CBlock block;
+            ReadStatus fillStatus = nodestate->pendingCmpctBlock->FillBlock(block, std::vector<CTransaction>());
+            nodestate->pendingCmpctBlock.reset();
+            if (fillStatus != READ_STATUS_OK) {
+                // A short id collision slotted in the wrong transaction;
+                // fall back to the full block.
+                vector<CInv> vInv(1);
+                vInv[0] = CInv(MSG_BLOCK, pindex->GetBlockHash());
+                pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+                return true;
+            }
+            CValidationState procState;
+            ProcessNewBlock(procState, chainparams, pfrom, &block, true, NULL);
+            int nDoS2;
+            if (procState.IsInvalid(nDoS2)) {
+                assert (procState.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+                pfrom->PushMessage(NetMsgType::REJECT, strCommand, (unsigned char)procState.GetRejectCode(),
+                                   procState.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+                if (nDoS2 > 0)
+                    Misbehaving(pfrom->GetId(), nDoS2);
+            } else
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(nodestate, pfrom);
+        } else {
+            // Ask the announcing peer for the transactions we're missing.
+            nodestate->hashPendingCmpctBlock = pindex->GetBlockHash();
+            req.blockhash = pindex->GetBlockHash();
+            if (inFlightIt == mapBlocksInFlight.end())
+                MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
+            pfrom->PushMessage(NetMsgType::GETBLOCKTXN, req);
+        }
+    }
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        LOCK(cs_main);
+
+        CNodeState *nodestate = State(pfrom->GetId());
+        if (!nodestate->pendingCmpctBlock || nodestate->hashPendingCmpctBlock != resp.blockhash) {
+            LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+            return true;
+        }
+
+        CBlock block;
+        ReadStatus status = nodestate->pendingCmpctBlock->FillBlock(block, resp.txn);
+        nodestate->pendingCmpctBlock.reset();
+        nodestate->hashPendingCmpctBlock.SetNull();
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us invalid compact block/non-matching block transactions", pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Might have collided, fall back to getdata, now resolving the full block
+            vector<CInv> vInv(1);
+            vInv[0] = CInv(MSG_BLOCK, resp.blockhash);
+            pfrom->PushMessage(NetMsgType::GETDATA, vInv);
+        } else {
+            CValidationState state;
+            ProcessNewBlock(state, chainparams, pfrom, &block, true, NULL);
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+                pfrom->PushMessage(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
+                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+            } else
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(nodestate, pfrom);
+        }
+    }
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
     {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - 15) {
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block > 15 deep\n", pfrom->id);
+            return true;
+        }
+
         CBlock block;
-        vRecv >> block;
+        if (!ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                return error("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage(NetMsgType::BLOCKTXN, resp);
+    }
+
+    else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        // use the decode pool's pre-parsed block when there is one
+        CBlock blockDeserialized;
+        if (!(pDecodeJob && pDecodeJob->pblock))
+            vRecv >> blockDeserialized;
+        const CBlock& block = (pDecodeJob && pDecodeJob->pblock) ? *pDecodeJob->pblock : blockDeserialized;
 
         CInv inv(MSG_BLOCK, block.GetHash());
         LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
@@ -5877,6 +8246,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // the decode pool still owns the payload; revisit once it is done
+        if (msg.pDecodeJob && !msg.pDecodeJob->fDone.load(boost::memory_order_acquire))
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -5901,8 +8274,16 @@ bool ProcessMessages(CNode* pfrom)
 
         // Checksum
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = ReadLE32((unsigned char*)&hash);
+        unsigned int nChecksum;
+        if (msg.pDecodeJob) {
+            // Take the payload (or what remains of it) back from the decode
+            // pool; it already hashed the full message, so reuse its result.
+            msg.vRecv.swap(msg.pDecodeJob->vRecv);
+            nChecksum = msg.pDecodeJob->nChecksumComputed;
+        } else {
+            uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+            nChecksum = ReadLE32((unsigned char*)&hash);
+        }
         if (nChecksum != hdr.nChecksum)
         {
             LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n", __func__,
@@ -5914,7 +8295,7 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, msg.pDecodeJob);
             boost::this_thread::interruption_point();
         }
         catch (const std::ios_base::failure& e)
@@ -5958,6 +8339,30 @@ bool ProcessMessages(CNode* pfrom)
 }
 
 
+/** Orders pending invs for relay under backlog: block invs stay ahead of
+ *  everything, then transactions by descending mempool fee rate. */
+struct CompareInvFeeRate
+{
+    const std::map<uint256, double>* pmapFeeRate;
+
+    CompareInvFeeRate(const std::map<uint256, double>* pmapFeeRateIn) : pmapFeeRate(pmapFeeRateIn) {}
+
+    bool operator()(const CInv& a, const CInv& b) const
+    {
+        bool fTxA = (a.type == MSG_TX);
+        bool fTxB = (b.type == MSG_TX);
+        if (fTxA != fTxB)
+            return !fTxA;
+        if (!fTxA)
+            return false;
+        std::map<uint256, double>::const_iterator itA = pmapFeeRate->find(a.hash);
+        std::map<uint256, double>::const_iterator itB = pmapFeeRate->find(b.hash);
+        double dRateA = itA != pmapFeeRate->end() ? itA->second : 0.0;
+        double dRateB = itB != pmapFeeRate->end() ? itB->second : 0.0;
+        return dRateA > dRateB;
+    }
+};
+
 bool SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -6097,7 +8502,9 @@ bool SendMessages(CNode* pto)
             // add all to the inv queue.
             LOCK(pto->cs_inventory);
             vector<CBlock> vHeaders;
-            bool fRevertToInv = (!state.fPreferHeaders || pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+            bool fRevertToInv = ((!state.fPreferHeaders &&
+                                 (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
+                                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
             CBlockIndex *pBestIndex = NULL; // last header queued for delivery
             ProcessBlockAvailability(pto->id); // ensure pindexBestKnownBlock is up-to-date
 
@@ -6135,6 +8542,35 @@ bool SendMessages(CNode* pto)
                     }
                 }
             }
+            if (!fRevertToInv && !vHeaders.empty()) {
+                if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs) {
+                    // We only send up to 1 block as header-and-ids, as
+                    // otherwise probably means we're doing an initial-ish-sync
+                    // or they're slow.
+                    LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", __func__,
+                            vHeaders.front().GetHash().ToString(), pto->id);
+                    //TODO: Shouldn't need to reload block from disk, but requires refactor
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, pBestIndex, consensusParams))
+                        assert(!"cannot load block from disk");
+                    CBlockHeaderAndShortTxIDs cmpctblock(block);
+                    pto->PushMessage(NetMsgType::CMPCTBLOCK, cmpctblock);
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else if (state.fPreferHeaders) {
+                    if (vHeaders.size() > 1) {
+                        LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
+                                vHeaders.size(),
+                                vHeaders.front().GetHash().ToString(),
+                                vHeaders.back().GetHash().ToString(), pto->id);
+                    } else {
+                        LogPrint("net", "%s: sending header %s to peer=%d\n", __func__,
+                                vHeaders.front().GetHash().ToString(), pto->id);
+                    }
+                    pto->PushMessage(NetMsgType::HEADERS, vHeaders);
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else
+                    fRevertToInv = true;
+            }
             if (fRevertToInv) {
                 // If falling back to using an inv, just try to inv the tip.
                 // The last entry in vBlockHashesToAnnounce was our tip at some point
@@ -6162,18 +8598,6 @@ bool SendMessages(CNode* pto)
                             pto->id, hashToAnnounce.ToString());
                     }
                 }
-            } else if (!vHeaders.empty()) {
-                if (vHeaders.size() > 1) {
-                    LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
-                            vHeaders.size(),
-                            vHeaders.front().GetHash().ToString(),
-                            vHeaders.back().GetHash().ToString(), pto->id);
-                } else {
-                    LogPrint("net", "%s: sending header %s to peer=%d\n", __func__,
-                            vHeaders.front().GetHash().ToString(), pto->id);
-                }
-                pto->PushMessage(NetMsgType::HEADERS, vHeaders);
-                state.pindexBestHeaderSent = pBestIndex;
             }
             pto->vBlockHashesToAnnounce.clear();
         }
@@ -6190,6 +8614,31 @@ bool SendMessages(CNode* pto)
                 pto->nNextInvSend = PoissonNextSend(nNow, AVG_INVENTORY_BROADCAST_INTERVAL);
             }
             LOCK(pto->cs_inventory);
+            // Flush ahead of the trickle timer once the queue has built up;
+            // waiting out the full interval only adds queueing delay when
+            // the batch is already big enough to amortize a packet.
+            if (!fSendTrickle && pto->vInventoryToSend.size() >= INVENTORY_FLUSH_BACKLOG)
+                fSendTrickle = true;
+            // Under backlog announce the highest fee rate transactions
+            // first, so the valuable traffic propagates ahead of the
+            // deferred tail.
+            if (fSendTrickle && pto->vInventoryToSend.size() > INVENTORY_BROADCAST_MAX)
+            {
+                std::map<uint256, double> mapFeeRate;
+                {
+                    LOCK(mempool.cs);
+                    BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
+                    {
+                        if (inv.type != MSG_TX)
+                            continue;
+                        CTxMemPool::txiter mit = mempool.mapTx.find(inv.hash);
+                        if (mit != mempool.mapTx.end() && mit->GetTxSize() > 0)
+                            mapFeeRate[inv.hash] = (double)mit->GetModifiedFee() / mit->GetTxSize();
+                    }
+                }
+                std::stable_sort(pto->vInventoryToSend.begin(), pto->vInventoryToSend.end(), CompareInvFeeRate(&mapFeeRate));
+            }
+            unsigned int nTxInvSent = 0;
             vInv.reserve(std::min<size_t>(1000, pto->vInventoryToSend.size()));
             vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
@@ -6197,6 +8646,13 @@ bool SendMessages(CNode* pto)
                 if (inv.type == MSG_TX && pto->filterInventoryKnown.contains(inv.hash))
                     continue;
 
+                // cap the tx invs per flush; the sorted tail waits its turn
+                if (inv.type == MSG_TX && nTxInvSent >= INVENTORY_BROADCAST_MAX)
+                {
+                    vInvWait.push_back(inv);
+                    continue;
+                }
+
                 // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
@@ -6217,6 +8673,8 @@ bool SendMessages(CNode* pto)
 
                 pto->filterInventoryKnown.insert(inv.hash);
 
+                if (inv.type == MSG_TX)
+                    nTxInvSent++;
                 vInv.push_back(inv);
                 if (vInv.size() >= 1000)
                 {
@@ -6350,5 +8808,7 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        mapOrphanTransactionsByPeer.clear();
+        listOrphanLru.clear();
     }
 } instance_of_cmaincleanup;
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <list>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -35,8 +36,10 @@ class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
+class CPreVerifiedBlock;
 class CScriptCheck;
 class CTxMemPool;
+class PrecomputedTransactionData;
 class CValidationInterface;
 class CValidationState;
 
@@ -67,6 +70,10 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool, whether the mempool survives restarts via mempool.dat */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -loadblockbuffer, ring buffer size in MiB for reading block files during reindex/import */
+static const unsigned int DEFAULT_LOADBLOCK_BUFFER_MB = 16;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -94,6 +101,17 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Cadence (in seconds) at which the background flush service wakes up. */
+static const unsigned int BACKGROUND_FLUSH_INTERVAL = 5;
+/** Seconds without a connected block before the node counts as idle enough
+ *  for a background flush; during block bursts the disk belongs to
+ *  validation. */
+static const unsigned int BACKGROUND_FLUSH_IDLE_DELAY = 10;
+/** Default for -flushceiling (MB of dirty chainstate tolerated before an
+ *  idle-time trickle write); 0 means a quarter of the -dbcache budget. */
+static const int64_t DEFAULT_FLUSH_CEILING = 0;
+/** Default for -compressundo: write block undo data LZ4 compressed. */
+static const bool DEFAULT_COMPRESS_UNDO = false;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -103,6 +121,10 @@ static const unsigned int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
 /** Average delay between trickled inventory broadcasts in seconds.
  *  Blocks, whitelisted receivers, and a random 25% of transactions bypass this. */
 static const unsigned int AVG_INVENTORY_BROADCAST_INTERVAL = 5;
+/** Pending inventory backlog at which tx invs flush ahead of the trickle timer */
+static const unsigned int INVENTORY_FLUSH_BACKLOG = 4000;
+/** Maximum tx invs sent per flush; under backlog the rest wait, highest fee rate first */
+static const unsigned int INVENTORY_BROADCAST_MAX = 1000;
 /** Average delay between feefilter broadcasts in seconds. */
 static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -121,6 +143,7 @@ static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const unsigned int DEFAULT_BYTES_PER_SIGOP = 20;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -136,6 +159,8 @@ static const bool DEFAULT_PEERBLOOMFILTERS = true;
 
 struct BlockHasher
 {
+    // A salted hash is not needed here: block hashes carry proof of work,
+    // so grinding keys into one bucket is costlier than the damage done.
     size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
 };
 
@@ -152,12 +177,47 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+/** Current validation thread budget; between 1 and nScriptCheckThreads. */
+int GetValidationThreadBudget();
+/** Cap how many of the -par threads validation may use; <= 0 or >= -par
+ *  restores the full allotment. Takes effect without a restart. */
+void SetValidationThreadBudget(int nBudget);
 extern bool fTxIndex;
+extern bool fBlockStatsIndex;
+extern bool fClaimJournal;
+extern bool fClaimHistoryIndex;
+extern bool fClaimAddressIndex;
+extern bool fCompressUndo;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
+
+/** Rolling statistics over the UTXO set, maintained incrementally by
+ *  ConnectBlock/DisconnectBlock once seeded by a full scan (the first
+ *  gettxoutsetinfo call). hashRolling is an order-independent set hash:
+ *  the sum mod 2^256 of a hash per unspent output, so connecting a block
+ *  adds the hashes of its created outputs and subtracts those of its
+ *  spent ones. Guarded by cs_main. */
+struct CUtxoSetStats
+{
+    bool fValid;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+    arith_uint256 hashRolling;
+
+    CUtxoSetStats() : fValid(false), nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+};
+extern CUtxoSetStats utxoSetStats;
+
+/** Hash of one unspent output for the rolling UTXO set hash */
+arith_uint256 UtxoElementHash(const uint256& txid, uint32_t n, const CTxOut& out);
 extern bool fCheckpointsEnabled;
+/** Block hash whose ancestors we assume to have valid scripts (zero if disabled).
+ *  PoW, block structure and UTXO/claimtrie updates are still fully verified. */
+extern uint256 hashAssumeValid;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -227,6 +287,7 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Get a cryptographic proof that a name maps to a value **/
 bool GetProofForName(const CBlockIndex* pindexProof, const std::string& name, CClaimTrieProof& proof);
+bool GetProofsForNames(const CBlockIndex* pindexProof, const std::vector<std::string>& names, std::vector<CClaimTrieProof>& proofs);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -245,10 +306,40 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run the block pre-verification worker, which performs stateless checks on
+ *  downloaded blocks waiting for the ordered connect pipeline */
+void ThreadBlockPreVerify();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
+/** Immutable copy of chain tip state, refreshed at each UpdateTip. Lets
+ *  monitoring RPCs report tip data without contending on cs_main. */
+struct CChainTipSnapshot
+{
+    int nHeight;
+    int nHeaderHeight;
+    uint256 hashTip;
+    uint256 hashClaimTrie;
+    uint256 nChainWork;
+    uint32_t nBits;
+    int64_t nMedianTime;
+    double dVerificationProgress;
+
+    CChainTipSnapshot() : nHeight(-1), nHeaderHeight(-1), nBits(0), nMedianTime(0), dVerificationProgress(0.0) {}
+};
+/** Copy the latest tip snapshot. Returns false until the first UpdateTip. */
+bool GetChainTipSnapshot(CChainTipSnapshot& snapshot);
+/** An orphan transaction waiting for its missing parents to arrive. */
+struct COrphanTx {
+    CTransaction tx;
+    NodeId fromPeer;
+    std::list<uint256>::iterator lruIter; //! position in listOrphanLru (front = oldest)
+};
+extern boost::unordered_map<uint256, COrphanTx, CSaltedTxidHasher> mapOrphanTransactions;
+extern boost::unordered_map<uint256, std::set<uint256>, CSaltedTxidHasher> mapOrphanTransactionsByPrev;
+/** Total dynamic memory used by the orphan transaction pool and its indexes. */
+size_t GetOrphanPoolMemoryUsage();
 /** Format a string that describes several potential problems detected by the core.
  * strFor can have three values:
  * - "rpc": get critical warnings, which should put the client in safe mode if non-empty
@@ -259,6 +350,12 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
+/** Batched GetTransaction for explorer-style fetches. Resolves the whole set
+ *  of txindex positions in one sorted pass, then groups the hits by block file
+ *  and reads each file once in offset order. Results are parallel to vHashes;
+ *  mempool transactions are returned with a null block hash. Only -txindex
+ *  lookups are attempted for confirmed transactions (no slow coins fallback). */
+void GetTransactionsBatch(const std::vector<uint256> &vHashes, std::vector<CTransaction> &vTx, std::vector<uint256> &vHashBlock, std::vector<bool> &vFound);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, const CBlock* pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -293,12 +390,47 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Background flush service, run from the scheduler thread every
+ *  BACKGROUND_FLUSH_INTERVAL seconds. Trickles dirty chainstate to disk
+ *  when the node is idle and the dirty set exceeds the -flushceiling
+ *  budget; skips the round entirely if validation holds cs_main. */
+void AttemptBackgroundFlush();
+/** Flush debt figures published for the stats gauges; these take no locks. */
+int64_t GetFlushDebtBytes();
+int64_t GetFlushCeilingBytes();
+int64_t GetSecondsSinceFullFlush();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 
-/** (try to) add transaction to memory pool **/
+/** (try to) add transaction to memory pool; nAcceptTime overrides the entry
+ *  timestamp (0 means "now"), used when replaying a saved mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, CFeeRate* txFeeRate, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+                        bool* pfMissingInputs, CFeeRate* txFeeRate, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0,
+                        int64_t nAcceptTime=0);
+
+/** Load the mempool saved by DumpMempool, replaying each transaction through
+ *  AcceptToMemoryPool. Meant to run off the init path (see ThreadImport). */
+bool LoadMempool();
+
+/** Atomically write the current mempool to $DATADIR/mempool.dat. */
+bool DumpMempool();
+
+/** Load the recent-rejects filter saved by DumpRecentRejects; the saved
+ *  filter is only adopted if the chain tip still matches the one it was
+ *  populated against. */
+bool LoadRecentRejects();
+
+/** Atomically write the recent-rejects filter (with its salt and rotation
+ *  state) and the chain tip it was judged against to $DATADIR/rejects.dat. */
+bool DumpRecentRejects();
+
+/** Load orphan transactions saved by DumpOrphans, replaying each through
+ *  AcceptToMemoryPool and returning the still-unconnected ones to the
+ *  orphan pool. */
+bool LoadOrphans();
+
+/** Atomically write the orphan pool to $DATADIR/orphans.dat. */
+bool DumpOrphans();
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -338,6 +470,72 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Compact per-block statistics, computed during ConnectBlock where every
+ *  transaction is already deserialized and every claim script already
+ *  decoded, and stored by the optional -blockstatsindex for the
+ *  getblockstats RPC. Feerates are in satoshis per kB over the
+ *  non-coinbase transactions; percentiles are nearest-rank. */
+class CBlockStats
+{
+public:
+    int32_t nHeight;
+    uint32_t nTxCount;
+    uint32_t nTotalSize;
+    uint32_t nMinTxSize;
+    uint32_t nMaxTxSize;
+    uint32_t nMedianTxSize;
+    uint32_t nInputs;
+    uint32_t nOutputs;
+    CAmount nTotalOut;   // sum of non-coinbase output values
+    CAmount nTotalFee;
+    CAmount nMinFeeRate;
+    CAmount nMaxFeeRate;
+    CAmount nFeeRatePct10;
+    CAmount nFeeRatePct25;
+    CAmount nFeeRatePct50;
+    CAmount nFeeRatePct75;
+    CAmount nFeeRatePct90;
+    uint32_t nClaimNames;    // OP_CLAIM_NAME outputs
+    uint32_t nClaimUpdates;  // OP_UPDATE_CLAIM outputs
+    uint32_t nClaimSupports; // OP_SUPPORT_CLAIM outputs
+    uint32_t nClaimSpends;   // claim-bearing prevouts spent
+
+    CBlockStats()
+        : nHeight(0), nTxCount(0), nTotalSize(0), nMinTxSize(0), nMaxTxSize(0)
+        , nMedianTxSize(0), nInputs(0), nOutputs(0), nTotalOut(0), nTotalFee(0)
+        , nMinFeeRate(0), nMaxFeeRate(0), nFeeRatePct10(0), nFeeRatePct25(0)
+        , nFeeRatePct50(0), nFeeRatePct75(0), nFeeRatePct90(0), nClaimNames(0)
+        , nClaimUpdates(0), nClaimSupports(0), nClaimSpends(0)
+    {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(VARINT(nTxCount));
+        READWRITE(VARINT(nTotalSize));
+        READWRITE(VARINT(nMinTxSize));
+        READWRITE(VARINT(nMaxTxSize));
+        READWRITE(VARINT(nMedianTxSize));
+        READWRITE(VARINT(nInputs));
+        READWRITE(VARINT(nOutputs));
+        READWRITE(nTotalOut);
+        READWRITE(nTotalFee);
+        READWRITE(nMinFeeRate);
+        READWRITE(nMaxFeeRate);
+        READWRITE(nFeeRatePct10);
+        READWRITE(nFeeRatePct25);
+        READWRITE(nFeeRatePct50);
+        READWRITE(nFeeRatePct75);
+        READWRITE(nFeeRatePct90);
+        READWRITE(VARINT(nClaimNames));
+        READWRITE(VARINT(nClaimUpdates));
+        READWRITE(VARINT(nClaimSupports));
+        READWRITE(VARINT(nClaimSpends));
+    }
+};
+
 
 /** 
  * Count ECDSA signature operations the old-fashioned (pre-0.6) way
@@ -362,7 +560,8 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * instead of being performed inline.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL,
+                 const PrecomputedTransactionData *ptxdata = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
@@ -422,12 +621,13 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData *ptxdata;
 
 public:
-    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), ptxdata(NULL) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = NULL) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), ptxdata(txdataIn) { }
 
     bool operator()();
 
@@ -438,6 +638,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(ptxdata, check.ptxdata);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -448,6 +649,9 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read a block's serialized bytes without deserializing it. Only the on-disk
+ *  framing is checked, so this is for paths that relay the bytes as-is. */
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -464,7 +668,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, CClaimTrieCache& trieCache, bool fJustCheck = false);
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, CClaimTrieCache& trieCache, bool fJustCheck = false, const CPreVerifiedBlock* pPreVer = NULL);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
@@ -553,6 +757,10 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coin database underneath pcoinsTip (protected by cs_main) */
+class CCoinsViewDB;
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active CClaimTrie (protected by cs_main) */
 extern CClaimTrie *pclaimTrie;
 
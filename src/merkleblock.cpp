@@ -11,7 +11,29 @@
 
 using namespace std;
 
-CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
+void CMerkleTreeLayers::Build(const std::vector<uint256>& vTxid)
+{
+    vvLayer.clear();
+    if (vTxid.empty())
+        return;
+    vvLayer.push_back(vTxid);
+    while (vvLayer.back().size() > 1)
+    {
+        const std::vector<uint256>& vPrev = vvLayer.back();
+        std::vector<uint256> vNext;
+        vNext.reserve((vPrev.size() + 1) / 2);
+        for (unsigned int pos = 0; pos < vPrev.size(); pos += 2)
+        {
+            // an odd node at the end is paired with itself, matching CalcHash
+            const uint256& left = vPrev[pos];
+            const uint256& right = pos + 1 < vPrev.size() ? vPrev[pos + 1] : left;
+            vNext.push_back(Hash(BEGIN(left), END(left), BEGIN(right), END(right)));
+        }
+        vvLayer.push_back(vNext);
+    }
+}
+
+CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter, const CMerkleTreeLayers* pLayers)
 {
     header = block.GetBlockHeader();
 
@@ -34,7 +56,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
         vHashes.push_back(hash);
     }
 
-    txn = CPartialMerkleTree(vHashes, vMatch);
+    txn = CPartialMerkleTree(vHashes, vMatch, pLayers);
 }
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
@@ -77,7 +99,7 @@ uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::ve
     }
 }
 
-void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const CMerkleTreeLayers* pLayers) {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
     for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
@@ -86,12 +108,12 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     vBits.push_back(fParentOfMatch);
     if (height==0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(pLayers ? pLayers->GetHash(height, pos) : CalcHash(height, pos, vTxid));
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height-1, pos*2, vTxid, vMatch);
+        TraverseAndBuild(height-1, pos*2, vTxid, vMatch, pLayers);
         if (pos*2+1 < CalcTreeWidth(height-1))
-            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch);
+            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch, pLayers);
     }
 }
 
@@ -133,18 +155,22 @@ uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, uns
     }
 }
 
-CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) : nTransactions(vTxid.size()), fBad(false) {
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const CMerkleTreeLayers* pLayers) : nTransactions(vTxid.size()), fBad(false) {
     // reset state
     vBits.clear();
     vHash.clear();
 
+    // only trust precomputed layers built over the same leaves
+    if (pLayers && pLayers->GetNumTransactions() != vTxid.size())
+        pLayers = NULL;
+
     // calculate height of tree
     int nHeight = 0;
     while (CalcTreeWidth(nHeight) > 1)
         nHeight++;
 
     // traverse the partial tree
-    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+    TraverseAndBuild(nHeight, 0, vTxid, vMatch, pLayers);
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
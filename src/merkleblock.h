@@ -13,6 +13,29 @@
 
 #include <vector>
 
+/** Fully computed merkle tree over a block's txids, one vector of hashes
+ *  per level with level 0 holding the txids themselves. The contents depend
+ *  only on the block, never on the requesting peer, so one instance can be
+ *  shared by every filtered-block request for the same block: building a
+ *  CPartialMerkleTree against it reduces to the per-peer match-bit
+ *  traversal, with no hashing for unmatched subtrees.
+ */
+class CMerkleTreeLayers
+{
+public:
+    CMerkleTreeLayers() {}
+    explicit CMerkleTreeLayers(const std::vector<uint256>& vTxid) { Build(vTxid); }
+
+    void Build(const std::vector<uint256>& vTxid);
+
+    bool empty() const { return vvLayer.empty(); }
+    size_t GetNumTransactions() const { return vvLayer.empty() ? 0 : vvLayer[0].size(); }
+    const uint256& GetHash(int height, unsigned int pos) const { return vvLayer[height][pos]; }
+
+private:
+    std::vector<std::vector<uint256> > vvLayer;
+};
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -70,8 +93,9 @@ protected:
     /** calculate the hash of a node in the merkle tree (at leaf level: the txid's themselves) */
     uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
 
-    /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /** recursive function that traverses tree nodes, storing the data as bits and hashes;
+     *  when pLayers is given, node hashes are taken from it instead of being recomputed */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const CMerkleTreeLayers* pLayers);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -104,8 +128,9 @@ public:
         }
     }
 
-    /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
-    CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them;
+     *  pLayers optionally supplies the precomputed node hashes for the whole tree */
+    CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch, const CMerkleTreeLayers* pLayers = NULL);
 
     CPartialMerkleTree();
 
@@ -137,8 +162,9 @@ public:
      * Create from a CBlock, filtering transactions according to filter
      * Note that this will call IsRelevantAndUpdate on the filter for each transaction,
      * thus the filter will likely be modified.
+     * pLayers optionally supplies the block's precomputed merkle tree layers.
      */
-    CMerkleBlock(const CBlock& block, CBloomFilter& filter);
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter, const CMerkleTreeLayers* pLayers = NULL);
 
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
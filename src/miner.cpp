@@ -12,6 +12,7 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "main.h"
 #include "nameclaim.h"
@@ -21,6 +22,7 @@
 #include "pow.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -47,14 +49,15 @@ using namespace std;
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-class ScoreCompare
+/** Sort a package so parents always precede children: a child counts
+ *  strictly more in-mempool ancestors than any of its parents. */
+struct CompareIterByAncestorCount
 {
-public:
-    ScoreCompare() {}
-
-    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b)
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
     {
-        return CompareTxMemPoolEntryByScore()(*b,*a); // Convert to less than
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
     }
 };
 
@@ -98,11 +101,6 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
     // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
     nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE-1000), nBlockMaxSize));
 
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
     // Minimum block size you want to create; block will be filled with free transactions
     // until there are no more or the block reaches this size:
     unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
@@ -110,21 +108,11 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
 
     // Collect memory pool transactions into the block
     CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
 
-    // This vector will be sorted into a priority queue:
-    vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
     bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     uint64_t nBlockSize = 1000;
     uint64_t nBlockTx = 0;
     unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
     CAmount nFees = 0;
 
     {
@@ -150,276 +138,250 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
                                 ? nMedianTimePast
                                 : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock) {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                 mi != mempool.mapTx.end(); ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        }
-
-        CTxMemPool::indexed_transaction_set::index<mining_score>::type::iterator mi = mempool.mapTx.get<mining_score>().begin();
-        CTxMemPool::txiter iter;
+        // Walk the ancestor-feerate index, which the pool maintains
+        // incrementally, and include each candidate together with its
+        // not-yet-included ancestors as one package. No per-call priority
+        // recomputation over the whole pool is needed any more.
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        int lastFewPackages = 0;
+        CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
 
-        while (mi != mempool.mapTx.get<mining_score>().end() || !clearedTxs.empty())
+        for (; mi != mempool.mapTx.get<ancestor_score>().end(); ++mi)
         {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty()) { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else {  // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
+            CTxMemPool::txiter candidateIt = mempool.mapTx.project<0>(mi);
+            if (inBlock.count(candidateIt))
+                continue;
 
-            if (inBlock.count(iter))
-            {
-                continue; // could have been added to the priorityBlock
+            // The index orders by package feerate, so once the raw package
+            // rate falls below the relay floor nothing later can qualify.
+            if (candidateIt->GetModFeesWithAncestors() < ::minRelayTxFee.GetFee(candidateIt->GetSizeWithAncestors()) &&
+                nBlockSize >= nBlockMinSize) {
+                break;
             }
 
-            const CTransaction& tx = iter->GetTx();
-
-            bool fOrphan = false;
-            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+            // Assemble the package: the candidate plus any of its ancestors
+            // that are not already in the block.
+            CTxMemPool::setEntries setAncestors;
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*candidateIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            setAncestors.insert(candidateIt);
+
+            std::vector<CTxMemPool::txiter> package;
+            package.reserve(setAncestors.size());
+            uint64_t nPackageSize = 0;
+            unsigned int nPackageSigOps = 0;
+            bool fSkipPackage = false;
+            BOOST_FOREACH(CTxMemPool::txiter ancestorIt, setAncestors)
             {
-                if (!inBlock.count(parent)) {
-                    fOrphan = true;
+                if (inBlock.count(ancestorIt))
+                    continue;
+                if (!IsFinalTx(ancestorIt->GetTx(), nHeight, nLockTimeCutoff)) {
+                    fSkipPackage = true;
+                    break;
+                }
+                // A fee delta may have dropped a claim transaction below the
+                // per-name-character minimum it met at admission; the cached
+                // obligation makes this check free.
+                if (ancestorIt->GetModifiedFee() < ancestorIt->GetMinClaimTrieFee()) {
+                    fSkipPackage = true;
                     break;
                 }
+                package.push_back(ancestorIt);
+                nPackageSize += ancestorIt->GetTxSize();
+                nPackageSigOps += ancestorIt->GetSigOpCount();
             }
-            if (fOrphan) {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter,actualPriority));
-                else
-                    waitSet.insert(iter);
+            if (fSkipPackage || package.empty())
                 continue;
-            }
 
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock &&
-                (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
-            if (!priorityTx &&
-                (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize)) {
-                break;
-            }
-            if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
+            if (nBlockSize + nPackageSize >= nBlockMaxSize) {
+                if (nBlockSize >  nBlockMaxSize - 100 || lastFewPackages > 50) {
                     break;
                 }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
+                // Once we're within 1000 bytes of a full block, only look at
+                // 50 more packages to try to fill the remaining space.
                 if (nBlockSize > nBlockMaxSize - 1000) {
-                    lastFewTxs++;
+                    lastFewPackages++;
                 }
                 continue;
             }
-
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
+            if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS) {
+                if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2) {
+                    break;
+                }
                 continue;
+            }
 
-            typedef std::vector<std::pair<std::string, uint160> > spentClaimsType;
-            spentClaimsType spentClaims;
+            // Parents before children, so the claim trie and the in-block
+            // coin lookups below always see a transaction's inputs first.
+            std::sort(package.begin(), package.end(), CompareIterByAncestorCount());
 
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            BOOST_FOREACH(CTxMemPool::txiter iter, package)
             {
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                int nTxinHeight = 0;
-                CScript scriptPubKey;
-                bool fGotCoins = false;
-                if (coins)
+                const CTransaction& tx = iter->GetTx();
+                unsigned int nTxSize = iter->GetTxSize();
+
+                typedef std::vector<std::pair<std::string, uint160> > spentClaimsType;
+                spentClaimsType spentClaims;
+
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 {
-                    if (txin.prevout.n < coins->vout.size())
+                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                    int nTxinHeight = 0;
+                    CScript scriptPubKey;
+                    bool fGotCoins = false;
+                    if (coins)
                     {
-                        nTxinHeight = coins->nHeight;
-                        scriptPubKey = coins->vout[txin.prevout.n].scriptPubKey;
-                        fGotCoins = true;
+                        if (txin.prevout.n < coins->vout.size())
+                        {
+                            nTxinHeight = coins->nHeight;
+                            scriptPubKey = coins->vout[txin.prevout.n].scriptPubKey;
+                            fGotCoins = true;
+                        }
                     }
-                }
-                else // must be in block or else
-                {
-                    BOOST_FOREACH(CTxMemPool::txiter inBlockEntry, inBlock)
+                    else // must be in block or else
                     {
-                        CTransaction inBlockTx = inBlockEntry->GetTx();
-                        if (inBlockTx.GetHash() == txin.prevout.hash)
+                        BOOST_FOREACH(CTxMemPool::txiter inBlockEntry, inBlock)
                         {
-                            if (inBlockTx.vout.size() >= txin.prevout.n)
+                            CTransaction inBlockTx = inBlockEntry->GetTx();
+                            if (inBlockTx.GetHash() == txin.prevout.hash)
                             {
-                                nTxinHeight = nHeight;
-                                scriptPubKey = inBlockTx.vout[txin.prevout.n].scriptPubKey;
-                                fGotCoins = true;
+                                if (inBlockTx.vout.size() >= txin.prevout.n)
+                                {
+                                    nTxinHeight = nHeight;
+                                    scriptPubKey = inBlockTx.vout[txin.prevout.n].scriptPubKey;
+                                    fGotCoins = true;
+                                }
                             }
                         }
                     }
-                }
-                if (!fGotCoins)
-                {
-                    LogPrintf("Tried to include a transaction but could not find the txout it was spending. This is bad. Please send this log file to the maintainers of this program.\n");
-                    throw std::runtime_error("Tried to include a transaction but could not find the txout it was spending.");
-                }
+                    if (!fGotCoins)
+                    {
+                        LogPrintf("Tried to include a transaction but could not find the txout it was spending. This is bad. Please send this log file to the maintainers of this program.\n");
+                        throw std::runtime_error("Tried to include a transaction but could not find the txout it was spending.");
+                    }
 
-                std::vector<std::vector<unsigned char> > vvchParams;
-                int op;
+                    std::vector<std::vector<unsigned char> > vvchParams;
+                    int op;
 
-                if (DecodeClaimScript(scriptPubKey, op, vvchParams))
-                {
-                    if (op == OP_CLAIM_NAME || op == OP_UPDATE_CLAIM)
+                    if (DecodeClaimScript(scriptPubKey, op, vvchParams))
                     {
-                        uint160 claimId;
-                        if (op == OP_CLAIM_NAME)
+                        if (op == OP_CLAIM_NAME || op == OP_UPDATE_CLAIM)
                         {
-                            assert(vvchParams.size() == 2);
-                            claimId = ClaimIdHash(txin.prevout.hash, txin.prevout.n);
-                        }
-                        else if (op == OP_UPDATE_CLAIM)
-                        {
-                            assert(vvchParams.size() == 3);
-                            claimId = uint160(vvchParams[1]);
-                        }
-                        std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        int throwaway;
-                        if (trieCache.spendClaim(name, COutPoint(txin.prevout.hash, txin.prevout.n), nTxinHeight, throwaway))
-                        {
-                            std::pair<std::string, uint160> entry(name, claimId);
-                            spentClaims.push_back(entry);
-                        }
-                        else
-                        {
-                            LogPrintf("%s(): The claim was not found in the trie or queue and therefore can't be updated\n", __func__);
+                            uint160 claimId;
+                            if (op == OP_CLAIM_NAME)
+                            {
+                                assert(vvchParams.size() == 2);
+                                claimId = ClaimIdHash(txin.prevout.hash, txin.prevout.n);
+                            }
+                            else if (op == OP_UPDATE_CLAIM)
+                            {
+                                assert(vvchParams.size() == 3);
+                                claimId = uint160(vvchParams[1]);
+                            }
+                            std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                            int throwaway;
+                            if (trieCache.spendClaim(name, COutPoint(txin.prevout.hash, txin.prevout.n), nTxinHeight, throwaway))
+                            {
+                                std::pair<std::string, uint160> entry(name, claimId);
+                                spentClaims.push_back(entry);
+                            }
+                            else
+                            {
+                                LogPrintf("%s(): The claim was not found in the trie or queue and therefore can't be updated\n", __func__);
+                            }
                         }
-                    }
-                    else if (op == OP_SUPPORT_CLAIM)
-                    {
-                        assert(vvchParams.size() == 2);
-                        std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        int throwaway;
-                        if (!trieCache.spendSupport(name, COutPoint(txin.prevout.hash, txin.prevout.n), nTxinHeight, throwaway))
+                        else if (op == OP_SUPPORT_CLAIM)
                         {
-                            LogPrintf("%s(): The support was not found in the trie or queue\n", __func__);
+                            assert(vvchParams.size() == 2);
+                            std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                            int throwaway;
+                            if (!trieCache.spendSupport(name, COutPoint(txin.prevout.hash, txin.prevout.n), nTxinHeight, throwaway))
+                            {
+                                LogPrintf("%s(): The support was not found in the trie or queue\n", __func__);
+                            }
                         }
                     }
                 }
-            }
-            
-            for (unsigned int i = 0; i < tx.vout.size(); ++i)
-            {
-                const CTxOut& txout = tx.vout[i];
             
-                std::vector<std::vector<unsigned char> > vvchParams;
-                int op;
-                if (DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+                for (unsigned int i = 0; i < tx.vout.size(); ++i)
                 {
-                    if (op == OP_CLAIM_NAME)
-                    {
-                        assert(vvchParams.size() == 2);
-                        std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        if (!trieCache.addClaim(name, COutPoint(tx.GetHash(), i), ClaimIdHash(tx.GetHash(), i), txout.nValue, nHeight))
-                        {
-                            LogPrintf("%s: Something went wrong inserting the name\n", __func__);
-                        }
-                    }
-                    else if (op == OP_UPDATE_CLAIM)
+                    const CTxOut& txout = tx.vout[i];
+            
+                    std::vector<std::vector<unsigned char> > vvchParams;
+                    int op;
+                    if (DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
                     {
-                        assert(vvchParams.size() == 3);
-                        std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        uint160 claimId(vvchParams[1]);
-                        spentClaimsType::iterator itSpent;
-                        for (itSpent = spentClaims.begin(); itSpent != spentClaims.end(); ++itSpent)
+                        if (op == OP_CLAIM_NAME)
                         {
-                            if (itSpent->first == name && itSpent->second == claimId)
+                            assert(vvchParams.size() == 2);
+                            std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                            if (!trieCache.addClaim(name, COutPoint(tx.GetHash(), i), ClaimIdHash(tx.GetHash(), i), txout.nValue, nHeight))
                             {
-                                break;
+                                LogPrintf("%s: Something went wrong inserting the name\n", __func__);
                             }
                         }
-                        if (itSpent != spentClaims.end())
+                        else if (op == OP_UPDATE_CLAIM)
                         {
-                            spentClaims.erase(itSpent);
-                            if (!trieCache.addClaim(name, COutPoint(tx.GetHash(), i), claimId, txout.nValue, nHeight))
+                            assert(vvchParams.size() == 3);
+                            std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                            uint160 claimId(vvchParams[1]);
+                            spentClaimsType::iterator itSpent;
+                            for (itSpent = spentClaims.begin(); itSpent != spentClaims.end(); ++itSpent)
                             {
-                                LogPrintf("%s: Something went wrong updating a claim\n", __func__);
+                                if (itSpent->first == name && itSpent->second == claimId)
+                                {
+                                    break;
+                                }
+                            }
+                            if (itSpent != spentClaims.end())
+                            {
+                                spentClaims.erase(itSpent);
+                                if (!trieCache.addClaim(name, COutPoint(tx.GetHash(), i), claimId, txout.nValue, nHeight))
+                                {
+                                    LogPrintf("%s: Something went wrong updating a claim\n", __func__);
+                                }
+                            }
+                            else
+                            {
+                                LogPrintf("%s(): This update refers to a claim that was not found in the trie or queue, and therefore cannot be updated. The claim may have expired or it may have never existed.\n", __func__);
                             }
                         }
-                        else
-                        {
-                            LogPrintf("%s(): This update refers to a claim that was not found in the trie or queue, and therefore cannot be updated. The claim may have expired or it may have never existed.\n", __func__);
-                        }
-                    }
-                    else if (op == OP_SUPPORT_CLAIM)
-                    {
-                        assert(vvchParams.size() == 2);
-                        std::string name(vvchParams[0].begin(), vvchParams[0].end());
-                        uint160 supportedClaimId(vvchParams[1]);
-                        if (!trieCache.addSupport(name, COutPoint(tx.GetHash(), i), txout.nValue, supportedClaimId, nHeight))
+                        else if (op == OP_SUPPORT_CLAIM)
                         {
-                            LogPrintf("%s: Something went wrong inserting the claim support\n", __func__);
+                            assert(vvchParams.size() == 2);
+                            std::string name(vvchParams[0].begin(), vvchParams[0].end());
+                            uint160 supportedClaimId(vvchParams[1]);
+                            if (!trieCache.addSupport(name, COutPoint(tx.GetHash(), i), txout.nValue, supportedClaimId, nHeight))
+                            {
+                                LogPrintf("%s: Something went wrong inserting the claim support\n", __func__);
+                            }
                         }
                     }
                 }
-            }
-            CValidationState state;
+                CValidationState state;
 
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS) {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2) {
-                    break;
-                }
-                continue;
-            }
+                unsigned int nTxSigOps = iter->GetSigOpCount();
 
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority)
-            {
-                double dPriority = iter->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-            }
-
-            inBlock.insert(iter);
+                CAmount nTxFees = iter->GetFee();
+                // Added
+                pblock->vtx.push_back(tx);
+                pblocktemplate->vTxFees.push_back(nTxFees);
+                pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+                nBlockSize += nTxSize;
+                ++nBlockTx;
+                nBlockSigOps += nTxSigOps;
+                nFees += nTxFees;
 
-            // Add transactions that depend on this one to the priority queue
-            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock) {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end()) {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
-                    }
-                }
-                else {
-                    if (waitSet.count(child)) {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
-                    }
+                if (fPrintPriority)
+                {
+                    double dPriority = iter->GetPriority(nHeight);
+                    CAmount dummy;
+                    mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
+                    LogPrintf("priority %.1f fee %s txid %s\n",
+                              dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
                 }
+
+                inBlock.insert(iter);
             }
         }
         nLastBlockTx = nBlockTx;
@@ -505,13 +467,16 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-void static BitcoinMiner(const CChainParams& chainparams)
+void static BitcoinMiner(const CChainParams& chainparams, unsigned int nThreadIndex)
 {
-    LogPrintf("LBRYcrdMiner started\n");
+    LogPrintf("LBRYcrdMiner thread %u started\n", nThreadIndex);
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("bitcoin-miner");
 
-    unsigned int nExtraNonce = 0;
+    // Each thread gets a disjoint extranonce range, so the coinbases (and
+    // therefore the merkle roots) of concurrent threads never collide and
+    // no two threads scan the same hash space.
+    unsigned int nExtraNonce = nThreadIndex << 24;
 
     boost::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript);
@@ -568,11 +533,20 @@ void static BitcoinMiner(const CChainParams& chainparams)
             while (true)
             {
                 unsigned int nHashesDone = 0;
-                
+
+                // Serialize the header once per batch and hash the nonce
+                // range by patching the nonce bytes in place, instead of
+                // re-serializing the whole header for every attempt.
+                CDataStream ssHeader(SER_GETHASH, PROTOCOL_VERSION);
+                ssHeader << *((CBlockHeader*)pblock);
+                unsigned char* pHeader = (unsigned char*)&ssHeader[0];
+                const size_t nNonceOffset = ssHeader.size() - 4;
+
                 // Check if something found
                 while (true)
                 {
-                    hash = pblock->GetPoWHash();
+                    WriteLE32(pHeader + nNonceOffset, pblock->nNonce);
+                    hash = PoWHash(pHeader, ssHeader.size());
                     if (((uint16_t*)&hash)[15] == 0 && UintToArith256(hash) <= hashTarget)
                     {
                         found = true;
@@ -684,5 +658,5 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
 
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), (unsigned int)i));
 }
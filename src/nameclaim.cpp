@@ -52,6 +52,10 @@ CScript UpdateClaimScript(std::string name, uint160 claimId, std::string value)
 
 bool DecodeClaimScript(const CScript& scriptIn, int& op, std::vector<std::vector<unsigned char> >& vvchParams)
 {
+    if (!HasClaimScriptPrefix(scriptIn))
+    {
+        return false;
+    }
     CScript::const_iterator pc = scriptIn.begin();
     return DecodeClaimScript(scriptIn, op, vvchParams, pc);
 }
@@ -71,33 +75,36 @@ bool DecodeClaimScript(const CScript& scriptIn, int& op, std::vector<std::vector
 
     op = opcode;
 
-    std::vector<unsigned char> vchParam1;
-    std::vector<unsigned char> vchParam2;
-    std::vector<unsigned char> vchParam3;
+    // Read the parameters as views into the script so that nothing is
+    // copied until the whole shape has been validated; claim values can be
+    // tens of kilobytes, and malformed scripts bail out copy-free.
+    CScript::const_iterator vchParam1Begin = pc, vchParam1End = pc;
+    CScript::const_iterator vchParam2Begin = pc, vchParam2End = pc;
+    CScript::const_iterator vchParam3Begin = pc, vchParam3End = pc;
     // Valid formats:
     // OP_CLAIM_NAME vchName vchValue OP_2DROP OP_DROP pubkeyscript
     // OP_UPDATE_CLAIM vchName vchClaimId vchValue OP_2DROP OP_2DROP pubkeyscript
     // OP_SUPPORT_CLAIM vchName vchClaimId OP_2DROP OP_DROP pubkeyscript
     // All others are invalid.
 
-    if (!scriptIn.GetOp(pc, opcode, vchParam1) || opcode < 0 || opcode > OP_PUSHDATA4)
+    if (!scriptIn.GetOpView(pc, opcode, vchParam1Begin, vchParam1End) || opcode < 0 || opcode > OP_PUSHDATA4)
     {
         return false;
     }
-    if (!scriptIn.GetOp(pc, opcode, vchParam2) || opcode < 0 || opcode > OP_PUSHDATA4)
+    if (!scriptIn.GetOpView(pc, opcode, vchParam2Begin, vchParam2End) || opcode < 0 || opcode > OP_PUSHDATA4)
     {
         return false;
     }
     if (op == OP_UPDATE_CLAIM || op == OP_SUPPORT_CLAIM)
     {
-        if (vchParam2.size() != 160/8)
+        if (vchParam2End - vchParam2Begin != 160/8)
         {
             return false;
         }
     }
     if (op == OP_UPDATE_CLAIM)
     {
-        if (!scriptIn.GetOp(pc, opcode, vchParam3) || opcode < 0 || opcode > OP_PUSHDATA4)
+        if (!scriptIn.GetOpView(pc, opcode, vchParam3Begin, vchParam3End) || opcode < 0 || opcode > OP_PUSHDATA4)
         {
             return false;
         }
@@ -119,11 +126,11 @@ bool DecodeClaimScript(const CScript& scriptIn, int& op, std::vector<std::vector
         return false;
     }
 
-    vvchParams.push_back(vchParam1);
-    vvchParams.push_back(vchParam2);
+    vvchParams.push_back(std::vector<unsigned char>(vchParam1Begin, vchParam1End));
+    vvchParams.push_back(std::vector<unsigned char>(vchParam2Begin, vchParam2End));
     if (op == OP_UPDATE_CLAIM)
     {
-        vvchParams.push_back(vchParam3);
+        vvchParams.push_back(std::vector<unsigned char>(vchParam3Begin, vchParam3End));
     }
     return true;
 }
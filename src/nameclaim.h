@@ -25,6 +25,22 @@
 // Scripts exceeding this size are rejected in CheckTransaction in main.cpp
 #define MAX_CLAIM_NAME_SIZE 255
 
+/**
+ * Cheap classifier: does scriptIn begin with one of the claim opcodes?
+ * If not, DecodeClaimScript is guaranteed to fail, so per-output loops
+ * (mempool acceptance, ConnectBlock, the wallet) get out with a single
+ * byte compare instead of a full parse.
+ */
+inline bool HasClaimScriptPrefix(const CScript& scriptIn)
+{
+    if (scriptIn.empty())
+    {
+        return false;
+    }
+    unsigned char b = scriptIn[0];
+    return b == OP_CLAIM_NAME || b == OP_SUPPORT_CLAIM || b == OP_UPDATE_CLAIM;
+}
+
 CScript ClaimNameScript(std::string name, std::string value);
 CScript SupportClaimScript(std::string name, uint160 claimId);
 CScript UpdateClaimScript(std::string name, uint160 claimId, std::string value);
@@ -15,8 +15,11 @@
 #include "consensus/consensus.h"
 #include "crypto/common.h"
 #include "hash.h"
+#include "perf.h"
+#include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
@@ -24,6 +27,13 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#elif defined(USE_POLL)
+#include <poll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -90,7 +100,7 @@ std::string strSubVersion;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<uint256, CTransaction> mapRelay;
+boost::unordered_map<uint256, CSerializeDataRef, CSaltedTxidHasher> mapRelay;
 deque<pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<uint256, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -110,6 +120,18 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore *semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
 
+/** Workers in the decode pool, which pre-parses expensive payloads (see
+ *  CNetMsgDecodeJob) as they complete on the socket side. */
+static const unsigned int DECODE_POOL_THREADS = 2;
+/** Transactions smaller than this are cheap enough to parse inline. */
+static const unsigned int DECODE_POOL_MIN_TX_SIZE = 4096;
+static boost::mutex mutexDecodePool;
+static boost::condition_variable condDecodePool;
+static std::deque<boost::shared_ptr<CNetMsgDecodeJob> > queueDecodeJobs; // guarded by mutexDecodePool
+//! only set during StartNode, so completed messages are never queued for a
+//! pool that is not running (tests, shutdown)
+static bool fDecodePoolActive = false;
+
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
@@ -335,6 +357,12 @@ uint64_t CNode::nMaxOutboundTotalBytesSentInCycle = 0;
 uint64_t CNode::nMaxOutboundTimeframe = 60*60*24; //1 day
 uint64_t CNode::nMaxOutboundCycleStartTime = 0;
 
+CCriticalSection CNode::cs_historicalRate;
+uint64_t CNode::nHistoricalSendRate = 0;
+uint64_t CNode::nHistoricalSendRatePeer = 0;
+int64_t CNode::nHistoricalTokensClass = 0;
+int64_t CNode::nHistoricalLastRefillClass = 0;
+
 CNode* FindNode(const CNetAddr& ip)
 {
     LOCK(cs_vNodes);
@@ -426,12 +454,15 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
     return NULL;
 }
 
+static void SocketEventsForget(SOCKET hSocket);
+
 void CNode::CloseSocketDisconnect()
 {
     fDisconnect = true;
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        SocketEventsForget(hSocket);
         CloseSocket(hSocket);
     }
 
@@ -627,6 +658,8 @@ void CNode::copyStats(CNodeStats &stats)
     X(nRecvBytes);
     X(mapRecvBytesPerMsgCmd);
     X(fWhitelisted);
+    X(nHistoricalBytesServed);
+    X(nHistoricalThrottled);
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -679,22 +712,61 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         pch += handled;
         nBytes -= handled;
 
-        if (msg.complete()) {
+        if (msg.complete())
+            MessageCompleted(msg);
+    }
 
-            //store received bytes per message command
-            //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
-            if (i == mapRecvBytesPerMsgCmd.end())
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+    return true;
+}
 
-            msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+// requires LOCK(cs_vRecvMsg)
+bool CNode::ReceiveDirectBytes(unsigned int nBytes)
+{
+    CNetMessage& msg = vRecvMsg.back();
+    msg.nDataPos += nBytes;
+    if (msg.complete())
+        MessageCompleted(msg);
+    return true;
+}
+
+// requires LOCK(cs_vRecvMsg)
+void CNode::MessageCompleted(CNetMessage& msg)
+{
+    //store received bytes per message command
+    //to prevent a memory DOS, only allow valid commands
+    mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapRecvBytesPerMsgCmd.end())
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    static CStatCounter& counter = StatCounter("net.msgs.recv");
+    counter.Increment();
+
+    TRACE3(net, message_received, id, msg.hdr.GetCommand().c_str(), msg.hdr.nMessageSize);
+
+    msg.nTime = GetTimeMicros();
+
+    if (fDecodePoolActive) {
+        std::string strCommand = msg.hdr.GetCommand();
+        if (strCommand == NetMsgType::BLOCK ||
+            (strCommand == NetMsgType::TX && msg.hdr.nMessageSize >= DECODE_POOL_MIN_TX_SIZE)) {
+            // Hand the payload to the decode pool; the handler swaps it
+            // back once the job is done.
+            boost::shared_ptr<CNetMsgDecodeJob> pjob(new CNetMsgDecodeJob(msg.vRecv.nType, msg.vRecv.nVersion));
+            pjob->strCommand = strCommand;
+            pjob->nChecksumExpected = msg.hdr.nChecksum;
+            pjob->vRecv.swap(msg.vRecv);
+            msg.pDecodeJob = pjob;
+            {
+                boost::mutex::scoped_lock lock(mutexDecodePool);
+                queueDecodeJobs.push_back(pjob);
+            }
+            condDecodePool.notify_one();
         }
     }
 
-    return true;
+    messageHandlerCondition.notify_one();
 }
 
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
@@ -755,10 +827,73 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSerializeDataRef>::iterator it = pnode->vSendMsg.begin();
 
+#ifndef WIN32
+    // Gather as many queued buffers as possible into a single scatter/gather
+    // write, so draining a backlog of small messages costs one syscall
+    // instead of one per message.
+    static const size_t MAX_SEND_IOVS = 64;
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        struct iovec iov[MAX_SEND_IOVS];
+        size_t nIovs = 0;
+        size_t nQueued = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (std::deque<CSerializeDataRef>::iterator jt = it; jt != pnode->vSendMsg.end() && nIovs < MAX_SEND_IOVS; jt++) {
+            const CSerializeData &data = **jt;
+            assert(data.size() > nOffset);
+            iov[nIovs].iov_base = (void*)&data[nOffset];
+            iov[nIovs].iov_len = data.size() - nOffset;
+            nQueued += iov[nIovs].iov_len;
+            nIovs++;
+            nOffset = 0;
+        }
+        struct msghdr msgh;
+        memset(&msgh, 0, sizeof(msgh));
+        msgh.msg_iov = iov;
+        msgh.msg_iovlen = nIovs;
+        ssize_t nBytes = sendmsg(pnode->hSocket, &msgh, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (nBytes > 0) {
+            pnode->nLastSend = GetTime();
+            pnode->nSendBytes += nBytes;
+            pnode->RecordBytesSent(nBytes);
+            // Advance past every buffer that was fully written and record the
+            // partial progress, if any, on the first unfinished one.
+            size_t nConsumed = nBytes;
+            while (it != pnode->vSendMsg.end() && nConsumed > 0) {
+                const CSerializeData &data = **it;
+                size_t nLeft = data.size() - pnode->nSendOffset;
+                if (nConsumed >= nLeft) {
+                    nConsumed -= nLeft;
+                    pnode->nSendOffset = 0;
+                    pnode->nSendSize -= data.size();
+                    it++;
+                } else {
+                    pnode->nSendOffset += nConsumed;
+                    nConsumed = 0;
+                }
+            }
+            if ((size_t)nBytes < nQueued) {
+                // could not send everything gathered; stop sending more
+                break;
+            }
+        } else {
+            if (nBytes < 0) {
+                // error
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                {
+                    LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
+                    pnode->CloseSocketDisconnect();
+                }
+            }
+            // couldn't send anything at all
+            break;
+        }
+    }
+#else
+    while (it != pnode->vSendMsg.end()) {
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -788,6 +923,7 @@ void SocketSendData(CNode *pnode)
             break;
         }
     }
+#endif
 
     if (it == pnode->vSendMsg.end()) {
         assert(pnode->nSendOffset == 0);
@@ -1025,6 +1161,194 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+/** Readiness events used by the socket handler's poller. Error conditions are
+ *  always reported, so only receive and send interest need to be declared. */
+static const unsigned char SOCKET_EVENT_RECV = 1;
+static const unsigned char SOCKET_EVENT_SEND = 2;
+static const unsigned char SOCKET_EVENT_ERROR = 4;
+
+#ifdef USE_EPOLL
+/** The kernel drops a descriptor from the epoll set when it is closed; the
+ *  shadow registry has to follow suit, or a reused descriptor number could be
+ *  mistaken for a still-current registration and never re-added. */
+static CCriticalSection cs_socketEvents;
+static int nEpollFd = -1;
+static std::map<SOCKET, unsigned char> mapEpollRegistered;
+
+static void SocketEventsForget(SOCKET hSocket)
+{
+    LOCK(cs_socketEvents);
+    mapEpollRegistered.erase(hSocket);
+}
+#else
+static void SocketEventsForget(SOCKET hSocket)
+{
+}
+#endif
+
+/** Wait up to nTimeoutMs for readiness on the given sockets.
+ *
+ *  mapInterest maps each descriptor to the SOCKET_EVENT_* events the caller
+ *  cares about; descriptors that become ready are reported in mapEvents. On
+ *  Linux a persistent epoll instance is kept and registrations are only
+ *  touched when a descriptor's interest changes, so per-iteration kernel work
+ *  scales with the number of active sockets rather than with the number of
+ *  connections. Other Unix systems use a poll() sweep, which still removes
+ *  the FD_SETSIZE ceiling; Windows keeps select().
+ *
+ *  Returns false if waiting failed and the caller should sleep instead.
+ */
+static bool SocketEvents(const std::map<SOCKET, unsigned char>& mapInterest,
+                         std::map<SOCKET, unsigned char>& mapEvents, int nTimeoutMs)
+{
+#ifdef USE_EPOLL
+    LOCK(cs_socketEvents);
+    if (nEpollFd == -1) {
+        nEpollFd = epoll_create1(0);
+        if (nEpollFd == -1) {
+            LogPrintf("socket event error: epoll_create1 failed: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+    }
+
+    // Drop registrations whose socket went away, refresh those whose interest
+    // changed, and add the newcomers.
+    for (std::map<SOCKET, unsigned char>::iterator it = mapEpollRegistered.begin(); it != mapEpollRegistered.end();) {
+        std::map<SOCKET, unsigned char>::const_iterator want = mapInterest.find(it->first);
+        if (want == mapInterest.end()) {
+            epoll_ctl(nEpollFd, EPOLL_CTL_DEL, it->first, NULL);
+            mapEpollRegistered.erase(it++);
+            continue;
+        }
+        if (want->second != it->second) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = ((want->second & SOCKET_EVENT_RECV) ? EPOLLIN : 0) |
+                        ((want->second & SOCKET_EVENT_SEND) ? EPOLLOUT : 0);
+            ev.data.fd = it->first;
+            if (epoll_ctl(nEpollFd, EPOLL_CTL_MOD, it->first, &ev) == 0 ||
+                (errno == ENOENT && epoll_ctl(nEpollFd, EPOLL_CTL_ADD, it->first, &ev) == 0))
+                it->second = want->second;
+        }
+        ++it;
+    }
+    for (std::map<SOCKET, unsigned char>::const_iterator it = mapInterest.begin(); it != mapInterest.end(); ++it) {
+        if (mapEpollRegistered.count(it->first))
+            continue;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((it->second & SOCKET_EVENT_RECV) ? EPOLLIN : 0) |
+                    ((it->second & SOCKET_EVENT_SEND) ? EPOLLOUT : 0);
+        ev.data.fd = it->first;
+        if (epoll_ctl(nEpollFd, EPOLL_CTL_ADD, it->first, &ev) == 0)
+            mapEpollRegistered[it->first] = it->second;
+    }
+
+    std::vector<struct epoll_event> events(mapInterest.empty() ? 1 : mapInterest.size());
+    int nReady = epoll_wait(nEpollFd, &events[0], events.size(), nTimeoutMs);
+    if (nReady < 0) {
+        if (errno != EINTR)
+            LogPrintf("socket event error: epoll_wait failed: %s\n", NetworkErrorString(errno));
+        return errno == EINTR;
+    }
+    for (int i = 0; i < nReady; i++) {
+        unsigned char nMask = 0;
+        if (events[i].events & EPOLLIN)
+            nMask |= SOCKET_EVENT_RECV;
+        if (events[i].events & EPOLLOUT)
+            nMask |= SOCKET_EVENT_SEND;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            nMask |= SOCKET_EVENT_ERROR;
+        if (nMask)
+            mapEvents[events[i].data.fd] = nMask;
+    }
+    return true;
+#elif defined(USE_POLL)
+    std::vector<struct pollfd> pollfds;
+    pollfds.reserve(mapInterest.size());
+    for (std::map<SOCKET, unsigned char>::const_iterator it = mapInterest.begin(); it != mapInterest.end(); ++it) {
+        struct pollfd pfd;
+        memset(&pfd, 0, sizeof(pfd));
+        pfd.fd = it->first;
+        pfd.events = ((it->second & SOCKET_EVENT_RECV) ? POLLIN : 0) |
+                     ((it->second & SOCKET_EVENT_SEND) ? POLLOUT : 0);
+        pollfds.push_back(pfd);
+    }
+    if (pollfds.empty()) {
+        MilliSleep(nTimeoutMs);
+        return true;
+    }
+    int nReady = poll(&pollfds[0], pollfds.size(), nTimeoutMs);
+    if (nReady < 0) {
+        if (errno != EINTR)
+            LogPrintf("socket event error: poll failed: %s\n", NetworkErrorString(errno));
+        return errno == EINTR;
+    }
+    for (size_t i = 0; i < pollfds.size(); i++) {
+        unsigned char nMask = 0;
+        if (pollfds[i].revents & POLLIN)
+            nMask |= SOCKET_EVENT_RECV;
+        if (pollfds[i].revents & POLLOUT)
+            nMask |= SOCKET_EVENT_SEND;
+        if (pollfds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+            nMask |= SOCKET_EVENT_ERROR;
+        if (nMask)
+            mapEvents[pollfds[i].fd] = nMask;
+    }
+    return true;
+#else
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+    for (std::map<SOCKET, unsigned char>::const_iterator it = mapInterest.begin(); it != mapInterest.end(); ++it) {
+        if (it->second & SOCKET_EVENT_RECV)
+            FD_SET(it->first, &fdsetRecv);
+        if (it->second & SOCKET_EVENT_SEND)
+            FD_SET(it->first, &fdsetSend);
+        FD_SET(it->first, &fdsetError);
+        hSocketMax = max(hSocketMax, it->first);
+        have_fds = true;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = nTimeoutMs / 1000;
+    timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            // Treat everything as readable so the recv() calls below weed out
+            // the dead sockets.
+            for (std::map<SOCKET, unsigned char>::const_iterator it = mapInterest.begin(); it != mapInterest.end(); ++it)
+                mapEvents[it->first] = SOCKET_EVENT_RECV;
+        }
+        MilliSleep(nTimeoutMs);
+        return true;
+    }
+    for (std::map<SOCKET, unsigned char>::const_iterator it = mapInterest.begin(); it != mapInterest.end(); ++it) {
+        unsigned char nMask = 0;
+        if (FD_ISSET(it->first, &fdsetRecv))
+            nMask |= SOCKET_EVENT_RECV;
+        if (FD_ISSET(it->first, &fdsetSend))
+            nMask |= SOCKET_EVENT_SEND;
+        if (FD_ISSET(it->first, &fdsetError))
+            nMask |= SOCKET_EVENT_ERROR;
+        if (nMask)
+            mapEvents[it->first] = nMask;
+    }
+    return true;
+#endif
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1096,24 +1420,10 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        std::map<SOCKET, unsigned char> mapInterest;
 
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            mapInterest[hListenSocket.socket] = SOCKET_EVENT_RECV;
 
         {
             LOCK(cs_vNodes);
@@ -1121,18 +1431,16 @@ void ThreadSocketHandler()
             {
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
 
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
+                // * If there is data to send, wait for the socket to become
+                //   writable. As this only happens when optimistic write failed,
+                //   we choose to first drain the write buffer in this case before
+                //   receiving more. This avoids needlessly queueing received data,
+                //   if the remote peer is not themselves receiving data. This means
+                //   properly utilizing TCP flow control signalling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for received data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -1140,47 +1448,37 @@ void ThreadSocketHandler()
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                unsigned char nInterest = 0;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        nInterest = SOCKET_EVENT_SEND;
                 }
-                {
+                if (!nInterest) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                     if (lockRecv && (
                         pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
                         pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                        nInterest = SOCKET_EVENT_RECV;
                 }
+                // Error conditions are always reported, so register the socket
+                // even when neither sending nor receiving is wanted right now.
+                mapInterest[pnode->hSocket] = nInterest;
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::map<SOCKET, unsigned char> mapEvents;
+        if (!SocketEvents(mapInterest, mapEvents, 50)) // 50ms: frequency to poll pnode->vSend
+            MilliSleep(50);
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            std::map<SOCKET, unsigned char>::const_iterator mev = mapEvents.find(hListenSocket.socket);
+            if (hListenSocket.socket != INVALID_SOCKET && mev != mapEvents.end() && (mev->second & SOCKET_EVENT_RECV))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1205,7 +1503,13 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            unsigned char nEvents = 0;
+            {
+                std::map<SOCKET, unsigned char>::const_iterator mev = mapEvents.find(pnode->hSocket);
+                if (mev != mapEvents.end())
+                    nEvents = mev->second;
+            }
+            if (nEvents & (SOCKET_EVENT_RECV | SOCKET_EVENT_ERROR))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1213,10 +1517,33 @@ void ThreadSocketHandler()
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        char* pchDest = pchBuf;
+                        unsigned int nCap = sizeof(pchBuf);
+                        bool fDirect = false;
+                        // When the bulk of a message body is still outstanding,
+                        // receive straight into the message's own buffer rather
+                        // than staging through pchBuf and copying. Headers and
+                        // small remainders keep the bounce buffer, which lets
+                        // ReceiveMsgBytes split them across messages.
+                        if (!pnode->vRecvMsg.empty()) {
+                            CNetMessage& msg = pnode->vRecvMsg.back();
+                            if (msg.in_data && !msg.complete() &&
+                                msg.hdr.nMessageSize <= MAX_PROTOCOL_MESSAGE_LENGTH &&
+                                msg.hdr.nMessageSize - msg.nDataPos >= sizeof(pchBuf)) {
+                                if (msg.vRecv.size() < msg.nDataPos + sizeof(pchBuf))
+                                    msg.vRecv.resize(std::min(msg.hdr.nMessageSize, msg.nDataPos + 256 * 1024));
+                                pchDest = &msg.vRecv[msg.nDataPos];
+                                nCap = std::min((unsigned int)(msg.vRecv.size() - msg.nDataPos),
+                                                msg.hdr.nMessageSize - msg.nDataPos);
+                                fDirect = true;
+                            }
+                        }
+                        int nBytes = recv(pnode->hSocket, pchDest, nCap, MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            bool fOk = fDirect ? pnode->ReceiveDirectBytes(nBytes)
+                                               : pnode->ReceiveMsgBytes(pchBuf, nBytes);
+                            if (!fOk)
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
@@ -1249,7 +1576,7 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (nEvents & SOCKET_EVENT_SEND)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
@@ -1418,6 +1745,30 @@ void MapPort(bool)
 
 
 
+static CCriticalSection cs_nDNSSeedsFound;
+static int nDNSSeedsFound = 0;
+
+static void LookupDNSSeed(const CDNSSeedData& seed)
+{
+    vector<CNetAddr> vIPs;
+    vector<CAddress> vAdd;
+    int found = 0;
+    if (LookupHost(seed.host.c_str(), vIPs))
+    {
+        BOOST_FOREACH(const CNetAddr& ip, vIPs)
+        {
+            int nOneDay = 24*3600;
+            CAddress addr = CAddress(CService(ip, Params().GetDefaultPort()));
+            addr.nTime = GetTime() - 3*nOneDay - GetRand(4*nOneDay); // use a random age between 3 and 7 days old
+            vAdd.push_back(addr);
+            found++;
+        }
+    }
+    addrman.Add(vAdd, CNetAddr(seed.name, true));
+    LOCK(cs_nDNSSeedsFound);
+    nDNSSeedsFound += found;
+}
+
 void ThreadDNSAddressSeed()
 {
     // goal: only query DNS seeds if address need is acute
@@ -1433,32 +1784,23 @@ void ThreadDNSAddressSeed()
     }
 
     const vector<CDNSSeedData> &vSeeds = Params().DNSSeeds();
-    int found = 0;
 
     LogPrintf("Loading addresses from DNS seeds (could take a while)\n");
 
+    // Resolve all seeds in parallel so one slow or dead seed does not delay
+    // the rest; the address pool fills as fast as the quickest seeds answer.
+    boost::thread_group seedThreads;
     BOOST_FOREACH(const CDNSSeedData &seed, vSeeds) {
         if (HaveNameProxy()) {
             AddOneShot(seed.host);
         } else {
-            vector<CNetAddr> vIPs;
-            vector<CAddress> vAdd;
-            if (LookupHost(seed.host.c_str(), vIPs))
-            {
-                BOOST_FOREACH(const CNetAddr& ip, vIPs)
-                {
-                    int nOneDay = 24*3600;
-                    CAddress addr = CAddress(CService(ip, Params().GetDefaultPort()));
-                    addr.nTime = GetTime() - 3*nOneDay - GetRand(4*nOneDay); // use a random age between 3 and 7 days old
-                    vAdd.push_back(addr);
-                    found++;
-                }
-            }
-            addrman.Add(vAdd, CNetAddr(seed.name, true));
+            seedThreads.create_thread(boost::bind(&LookupDNSSeed, boost::cref(seed)));
         }
     }
+    seedThreads.join_all();
 
-    LogPrintf("%d addresses found from DNS seeds\n", found);
+    LOCK(cs_nDNSSeedsFound);
+    LogPrintf("%d addresses found from DNS seeds\n", nDNSSeedsFound);
 }
 
 
@@ -1474,11 +1816,24 @@ void ThreadDNSAddressSeed()
 
 void DumpAddresses()
 {
+    // Skip rewriting peers.dat when nothing changed since the last dump;
+    // the periodic flush would otherwise rewrite megabytes every interval.
+    static uint64_t nLastUpdateCount = 0;
+    static bool fDumped = false;
+    uint64_t nUpdateCount = addrman.GetUpdateCount();
+    if (fDumped && nUpdateCount == nLastUpdateCount) {
+        LogPrint("net", "Skipped flushing unchanged peers.dat\n");
+        return;
+    }
+
     int64_t nStart = GetTimeMillis();
 
     CAddrDB adb;
     adb.Write(addrman);
 
+    nLastUpdateCount = nUpdateCount;
+    fDumped = true;
+
     LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
 }
@@ -1507,6 +1862,70 @@ void static ProcessOneShot()
     }
 }
 
+// Race non-blocking connection attempts to several addrman candidates; the
+// first completed TCP handshake becomes the peer and the losers are closed,
+// so refilling an outbound slot is not serialized behind full connect
+// timeouts. Falls back to the single-candidate path behind a proxy.
+static bool OpenNetworkConnectionRace(const std::vector<CAddress>& vCandidates, CSemaphoreGrant *grantOutbound)
+{
+    boost::this_thread::interruption_point();
+
+    // Drop candidates that became unusable since they were selected.
+    std::vector<CAddress> vTry;
+    BOOST_FOREACH(const CAddress& addr, vCandidates) {
+        if (IsLocal(addr) || FindNode((CNetAddr)addr) || CNode::IsBanned(addr) ||
+            FindNode(addr.ToStringIPPort()))
+            continue;
+        vTry.push_back(addr);
+    }
+    if (vTry.empty())
+        return false;
+
+    proxyType proxy;
+    if (vTry.size() == 1 || GetProxy(vTry[0].GetNetwork(), proxy))
+        return OpenNetworkConnection(vTry[0], grantOutbound);
+
+    LogPrint("net", "racing %u connection candidates\n", vTry.size());
+
+    std::vector<CService> vServ(vTry.begin(), vTry.end());
+    SOCKET hSocket = INVALID_SOCKET;
+    CService addrWinner;
+    bool fConnected = ConnectSocketRace(vServ, hSocket, addrWinner, nConnectTimeout);
+
+    // Every raced candidate counts as attempted, winner included.
+    BOOST_FOREACH(const CAddress& addr, vTry)
+        addrman.Attempt(addr);
+
+    if (!fConnected)
+        return false;
+
+    boost::this_thread::interruption_point();
+
+    if (!IsSelectableSocket(hSocket)) {
+        LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
+        CloseSocket(hSocket);
+        return false;
+    }
+
+    CAddress addrConnect = vTry[0];
+    BOOST_FOREACH(const CAddress& addr, vTry)
+        if ((CService)addr == addrWinner)
+            addrConnect = addr;
+
+    CNode* pnode = new CNode(hSocket, addrConnect, "", false);
+    pnode->AddRef();
+    {
+        LOCK(cs_vNodes);
+        vNodes.push_back(pnode);
+    }
+    pnode->nTimeConnected = GetTime();
+    if (grantOutbound)
+        grantOutbound->MoveTo(pnode->grantOutbound);
+    pnode->fNetworkNode = true;
+
+    return true;
+}
+
 void ThreadOpenConnections()
 {
     // Connect to specific addresses
@@ -1534,8 +1953,6 @@ void ThreadOpenConnections()
     {
         ProcessOneShot();
 
-        MilliSleep(500);
-
         CSemaphoreGrant grant(*semOutbound);
         boost::this_thread::interruption_point();
 
@@ -1550,9 +1967,11 @@ void ThreadOpenConnections()
         }
 
         //
-        // Choose an address to connect to based on most recently seen
+        // Choose addresses to connect to based on most recently seen. Up to
+        // four candidates from distinct groups are raced in parallel for the
+        // free slot; the first completed handshake wins.
         //
-        CAddress addrConnect;
+        std::vector<CAddress> vCandidates;
 
         // Only connect out to one peer per network group (/16 for IPv4).
         // Do this here so we don't have to critsect vNodes inside mapAddresses critsect.
@@ -1571,7 +1990,7 @@ void ThreadOpenConnections()
         int64_t nANow = GetAdjustedTime();
 
         int nTries = 0;
-        while (true)
+        while (vCandidates.size() < 4)
         {
             CAddrInfo addr = addrman.Select();
 
@@ -1597,12 +2016,20 @@ void ThreadOpenConnections()
             if (addr.GetPort() != Params().GetDefaultPort() && nTries < 50)
                 continue;
 
-            addrConnect = addr;
-            break;
+            // never race two candidates from the same group
+            setConnected.insert(addr.GetGroup());
+            vCandidates.push_back(addr);
         }
 
-        if (addrConnect.IsValid())
-            OpenNetworkConnection(addrConnect, &grant);
+        bool fConnected = false;
+        if (!vCandidates.empty())
+            fConnected = OpenNetworkConnectionRace(vCandidates, &grant);
+
+        // Pace the loop only when nothing was established, so an empty or
+        // exhausted addrman does not busy-spin; after a restart the free
+        // slots are refilled back to back without artificial delays.
+        if (!fConnected)
+            MilliSleep(500);
     }
 }
 
@@ -1707,6 +2134,48 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
+static void DecodeNetMessage(CNetMsgDecodeJob& job)
+{
+    uint256 hash = Hash(job.vRecv.begin(), job.vRecv.end());
+    job.nChecksumComputed = ReadLE32((unsigned char*)&hash);
+    if (job.nChecksumComputed != job.nChecksumExpected)
+        return;
+    const unsigned int nSize = job.vRecv.size();
+    try {
+        if (job.strCommand == NetMsgType::BLOCK) {
+            boost::shared_ptr<CBlock> pblock(new CBlock());
+            job.vRecv >> *pblock;
+            job.pblock = pblock;
+        } else if (job.strCommand == NetMsgType::TX) {
+            boost::shared_ptr<CTransaction> ptx(new CTransaction());
+            job.vRecv >> *ptx;
+            job.ptx = ptx;
+        }
+    } catch (const std::exception&) {
+        // Malformed payload: rewind so the handler's own parse attempt
+        // reports the failure exactly as it would have without the pool.
+        job.vRecv.Rewind(nSize - job.vRecv.size());
+    }
+}
+
+void ThreadMessageDecoder()
+{
+    boost::unique_lock<boost::mutex> lock(mutexDecodePool);
+    while (true) {
+        while (queueDecodeJobs.empty())
+            condDecodePool.wait(lock);
+        boost::shared_ptr<CNetMsgDecodeJob> pjob = queueDecodeJobs.front();
+        queueDecodeJobs.pop_front();
+        lock.unlock();
+        DecodeNetMessage(*pjob);
+        pjob->fDone.store(true, boost::memory_order_release);
+        // The handler may be sitting out its 100ms tick waiting for this
+        // message; wake it so the finished payload is picked up promptly.
+        messageHandlerCondition.notify_one();
+        lock.lock();
+    }
+}
+
 void ThreadMessageHandler()
 {
     boost::mutex condition_mutex;
@@ -1731,6 +2200,13 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // Let at most one handler thread work on a peer at a time; the
+            // others move on to the next peer instead of queueing up behind a
+            // slow one.
+            TRY_LOCK(pnode->cs_msgProc, lockProc);
+            if (!lockProc)
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1991,11 +2467,26 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Initiate outbound connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
-    // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    // Process messages. Several handler threads share the peer list; each
+    // peer is claimed by one thread at a time, so a peer stuck behind
+    // cs_main-heavy work no longer delays ping/addr/inv handling for the
+    // others.
+    int nMsgThreads = GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    if (nMsgThreads < 1)
+        nMsgThreads = 1;
+    for (int i = 0; i < nMsgThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+
+    // Pre-parse expensive payloads off the handler threads
+    fDecodePoolActive = true;
+    for (unsigned int i = 0; i < DECODE_POOL_THREADS; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgdecode", &ThreadMessageDecoder));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
+
+    RegisterThreadPool("net", "", 4); // socket, addcon, opencon, msghand
+    RegisterThreadPool("msgdecode", "", DECODE_POOL_THREADS);
 }
 
 bool StopNode()
@@ -2053,6 +2544,22 @@ public:
 instance_of_cnetcleanup;
 
 
+CSerializeDataRef CreateNetMessage(const char* pszCommand, const CDataStream& ssPayload)
+{
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+
+    CSerializeData* pdata = new CSerializeData();
+    pdata->reserve(ssHeader.size() + ssPayload.size());
+    pdata->insert(pdata->end(), ssHeader.begin(), ssHeader.end());
+    pdata->insert(pdata->end(), ssPayload.begin(), ssPayload.end());
+    return CSerializeDataRef(pdata);
+}
+
 void RelayTransaction(const CTransaction& tx, CFeeRate feerate)
 {
     CInv inv(MSG_TX, tx.GetHash());
@@ -2065,9 +2572,17 @@ void RelayTransaction(const CTransaction& tx, CFeeRate feerate)
             vRelayExpiration.pop_front();
         }
 
-        mapRelay.insert(std::make_pair(inv.hash, tx));
+        // Serialize the complete wire message once; every peer that later
+        // requests this transaction is handed the same refcounted buffer.
+        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+        ssTx.reserve(10000);
+        ssTx << tx;
+        mapRelay.insert(std::make_pair(inv.hash, CreateNetMessage(NetMsgType::TX, ssTx)));
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv.hash));
     }
+    // Extract the filterable elements once; matching against each peer's
+    // filter then costs only the hash probes.
+    CTxFilterElements filterElements(tx);
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
     {
@@ -2081,13 +2596,62 @@ void RelayTransaction(const CTransaction& tx, CFeeRate feerate)
         LOCK(pnode->cs_filter);
         if (pnode->pfilter)
         {
-            if (pnode->pfilter->IsRelevantAndUpdate(tx))
+            if (pnode->pfilter->IsRelevantAndUpdate(filterElements))
                 pnode->PushInventory(inv);
         } else
             pnode->PushInventory(inv);
     }
 }
 
+void RelayTransactions(const std::vector<std::pair<CTransaction, CFeeRate> >& vtx)
+{
+    std::vector<CInv> vInv;
+    vInv.reserve(vtx.size());
+    {
+        LOCK(cs_mapRelay);
+        // Expire old relay messages
+        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
+        {
+            mapRelay.erase(vRelayExpiration.front().second);
+            vRelayExpiration.pop_front();
+        }
+
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            CInv inv(MSG_TX, vtx[i].first.GetHash());
+            CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+            ssTx.reserve(10000);
+            ssTx << vtx[i].first;
+            mapRelay.insert(std::make_pair(inv.hash, CreateNetMessage(NetMsgType::TX, ssTx)));
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv.hash));
+            vInv.push_back(inv);
+        }
+    }
+    // Extract the filterable elements of each transaction once for the whole
+    // peer list, instead of once per peer inside the loop below.
+    std::vector<CTxFilterElements> vElems;
+    vElems.reserve(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++)
+        vElems.push_back(CTxFilterElements(vtx[i].first));
+    // One pass over the peer list for the whole batch: the per-peer locks are
+    // taken once and the invs land in the same announcement trickle.
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        if(!pnode->fRelayTxes)
+            continue;
+        LOCK2(pnode->cs_feeFilter, pnode->cs_filter);
+        for (size_t i = 0; i < vtx.size(); i++)
+        {
+            if (vtx[i].second.GetFeePerK() < pnode->minFeeFilter)
+                continue;
+            if (pnode->pfilter && !pnode->pfilter->IsRelevantAndUpdate(vElems[i]))
+                continue;
+            pnode->PushInventory(vInv[i]);
+        }
+    }
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2188,6 +2752,57 @@ uint64_t CNode::GetOutboundTargetBytesLeft()
     return (nMaxOutboundTotalBytesSentInCycle >= nMaxOutboundLimit) ? 0 : nMaxOutboundLimit - nMaxOutboundTotalBytesSentInCycle;
 }
 
+void CNode::SetHistoricalSendRate(uint64_t nClassRate, uint64_t nPeerRate)
+{
+    LOCK(cs_historicalRate);
+    nHistoricalSendRate = nClassRate;
+    nHistoricalSendRatePeer = nPeerRate;
+    // start with one second worth of burst
+    nHistoricalTokensClass = nClassRate;
+    nHistoricalLastRefillClass = GetTimeMillis();
+}
+
+uint64_t CNode::GetHistoricalSendRate()
+{
+    LOCK(cs_historicalRate);
+    return nHistoricalSendRate;
+}
+
+bool CNode::HasHistoricalBudget()
+{
+    LOCK(cs_historicalRate);
+    int64_t now = GetTimeMillis();
+    if (nHistoricalSendRate > 0)
+    {
+        // refill the class bucket, capping the burst at two seconds of rate
+        nHistoricalTokensClass = std::min(nHistoricalTokensClass + (now - nHistoricalLastRefillClass) * (int64_t)nHistoricalSendRate / 1000, 2 * (int64_t)nHistoricalSendRate);
+        nHistoricalLastRefillClass = now;
+        if (nHistoricalTokensClass <= 0)
+            return false;
+    }
+    if (nHistoricalSendRatePeer > 0)
+    {
+        nHistoricalTokens = std::min(nHistoricalTokens + (now - nHistoricalLastRefill) * (int64_t)nHistoricalSendRatePeer / 1000, 2 * (int64_t)nHistoricalSendRatePeer);
+        nHistoricalLastRefill = now;
+        if (nHistoricalTokens <= 0)
+            return false;
+    }
+    return true;
+}
+
+void CNode::AccountHistoricalBytes(uint64_t bytes)
+{
+    LOCK(cs_historicalRate);
+    // the buckets may go negative; the deficit has to be paid off by refills
+    // before the next request is served, which keeps the average rate honest
+    // for messages larger than the burst allowance
+    if (nHistoricalSendRate > 0)
+        nHistoricalTokensClass -= bytes;
+    if (nHistoricalSendRatePeer > 0)
+        nHistoricalTokens -= bytes;
+    nHistoricalBytesServed += bytes;
+}
+
 uint64_t CNode::GetTotalBytesRecv()
 {
     LOCK(cs_totalBytesRecv);
@@ -2200,6 +2815,27 @@ uint64_t CNode::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+size_t GetNetMemoryUsage()
+{
+    // Bytes queued in per-peer send and receive buffers. This counts message
+    // payloads, not allocator overhead, but those buffers are what balloon
+    // when a peer stalls.
+    size_t nUsage = 0;
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        {
+            LOCK(pnode->cs_vSend);
+            nUsage += pnode->nSendSize;
+        }
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv) {
+            BOOST_FOREACH(const CNetMessage& msg, pnode->vRecvMsg)
+                nUsage += msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+        }
+    }
+    return nUsage;
+}
+
 void CNode::Fuzz(int nChance)
 {
     if (!fSuccessfullyConnected) return; // Don't fuzz initial handshake
@@ -2385,6 +3021,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     minFeeFilter = 0;
     lastSentFeeFilter = 0;
     nextSendTimeFeeFilter = 0;
+    nHistoricalBytesServed = 0;
+    nHistoricalThrottled = 0;
+    nHistoricalTokens = 0;
+    nHistoricalLastRefill = GetTimeMillis();
 
     BOOST_FOREACH(const std::string &msg, getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2494,6 +3134,11 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
     //log total amount of bytes per command
     mapSendBytesPerMsgCmd[std::string(pszCommand)] += nSize + CMessageHeader::HEADER_SIZE;
 
+    static CStatCounter& counter = StatCounter("net.msgs.sent");
+    counter.Increment();
+
+    TRACE3(net, message_sent, id, pszCommand, nSize);
+
     // Set the checksum
     uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
     unsigned int nChecksum = 0;
@@ -2503,17 +3148,35 @@ void CNode::EndMessage(const char* pszCommand) UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    CSerializeData* pdata = new CSerializeData();
+    ssSend.GetAndClear(*pdata);
+    vSendMsg.push_back(CSerializeDataRef(pdata));
+    nSendSize += pdata->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushSerializedMessage(const std::string& strCommand, const CSerializeDataRef& data)
+{
+    LOCK(cs_vSend);
+
+    //log total amount of bytes per command
+    mapSendBytesPerMsgCmd[strCommand] += data->size();
+
+    LogPrint("net", "(%d bytes) peer=%d\n", data->size() - CMessageHeader::HEADER_SIZE, id);
+
+    vSendMsg.push_back(data);
+    nSendSize += data->size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
 //
 // CBanDB
 //
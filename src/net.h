@@ -9,6 +9,7 @@
 #include "amount.h"
 #include "bloom.h"
 #include "compat.h"
+#include "hash.h"
 #include "limitedmap.h"
 #include "netbase.h"
 #include "protocol.h"
@@ -24,13 +25,18 @@
 #include <arpa/inet.h>
 #endif
 
+#include <boost/atomic.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/signals2/signal.hpp>
 
 class CAddrMan;
+class CBlock;
 class CScheduler;
 class CNode;
+class CTransaction;
 
 namespace boost {
     class thread_group;
@@ -64,10 +70,17 @@ static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
+/** The default for -maxhistoricalsendrate in KiB/s. 0 = Unlimited */
+static const uint64_t DEFAULT_HISTORICAL_SEND_RATE = 0;
+/** The default for -maxhistoricalsendratepeer in KiB/s. 0 = Unlimited */
+static const uint64_t DEFAULT_HISTORICAL_SEND_RATE_PEER = 0;
 /** Default for blocks only*/
 static const bool DEFAULT_BLOCKSONLY = false;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
+/** Number of message handler threads; a peer is only ever serviced by one of
+ *  them at a time, so per-peer message order is preserved. */
+static const int DEFAULT_MSGHANDLER_THREADS = 2;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
@@ -150,6 +163,16 @@ bool IsReachable(const CNetAddr &addr);
 CAddress GetLocalAddress(const CNetAddr *paddrPeer = NULL);
 
 
+/** Refcounted immutable wire message (header, checksum and payload). One
+ * serialized message can be queued to any number of peers without copying
+ * the bytes per peer. */
+typedef boost::shared_ptr<const CSerializeData> CSerializeDataRef;
+
+/** Build a complete wire message around an already-serialized payload. The
+ * returned buffer can be handed to CNode::PushSerializedMessage on as many
+ * peers as needed. */
+CSerializeDataRef CreateNetMessage(const char* pszCommand, const CDataStream& ssPayload);
+
 extern bool fDiscover;
 extern bool fListen;
 extern uint64_t nLocalServices;
@@ -161,7 +184,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<uint256, CTransaction> mapRelay;
+extern boost::unordered_map<uint256, CSerializeDataRef, CSaltedTxidHasher> mapRelay;
 extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<uint256, int64_t> mapAlreadyAskedFor;
@@ -204,6 +227,8 @@ public:
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
     bool fWhitelisted;
+    uint64_t nHistoricalBytesServed;
+    uint64_t nHistoricalThrottled;
     double dPingTime;
     double dPingWait;
     double dPingMin;
@@ -213,6 +238,29 @@ public:
 
 
 
+/** A completed network message handed to the decode pool (net.cpp), which
+ *  verifies the checksum and pre-parses expensive payloads off the message
+ *  handler thread.
+ *
+ *  The raw payload is swapped out of the owning CNetMessage when the job is
+ *  queued and swapped back by the handler once fDone is set, so the deque
+ *  entry can be discarded at any moment (peer disconnect) without
+ *  invalidating the job. Until fDone is set (with release ordering) the
+ *  worker owns every field; afterwards only the handler touches them.
+ */
+class CNetMsgDecodeJob {
+public:
+    CDataStream vRecv;                   // payload, swapped in from the message
+    std::string strCommand;
+    unsigned int nChecksumExpected;      // from the message header
+    unsigned int nChecksumComputed;      // set by the worker
+    boost::shared_ptr<CBlock> pblock;    // result for block messages
+    boost::shared_ptr<CTransaction> ptx; // result for tx messages
+    boost::atomic<bool> fDone;
+
+    CNetMsgDecodeJob(int nTypeIn, int nVersionIn) : vRecv(nTypeIn, nVersionIn), nChecksumExpected(0), nChecksumComputed(0), fDone(false) {}
+};
+
 class CNetMessage {
 public:
     bool in_data;                   // parsing header (false) or data (true)
@@ -226,6 +274,9 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
+    // set while the decode pool owns the payload (see CNetMsgDecodeJob)
+    boost::shared_ptr<CNetMsgDecodeJob> pDecodeJob;
+
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
@@ -324,12 +375,16 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializeDataRef> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Claimed (with TRY_LOCK) by whichever message handler thread is
+    // currently servicing this peer, so the handlers never interleave
+    // messages from one peer.
+    CCriticalSection cs_msgProc;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -423,6 +478,11 @@ public:
     CAmount lastSentFeeFilter;
     int64_t nextSendTimeFeeFilter;
 
+    // Bandwidth scheduler counters: bytes of historical blocks served to
+    // this peer, and how often its requests were deferred for lack of budget
+    uint64_t nHistoricalBytesServed;
+    uint64_t nHistoricalThrottled;
+
     CNode(SOCKET hSocketIn, const CAddress &addrIn, const std::string &addrNameIn = "", bool fInboundIn = false);
     ~CNode();
 
@@ -439,6 +499,17 @@ private:
     static uint64_t nMaxOutboundLimit;
     static uint64_t nMaxOutboundTimeframe;
 
+    // historical block serving rate limits (token buckets, bytes/second)
+    static CCriticalSection cs_historicalRate;
+    static uint64_t nHistoricalSendRate;
+    static uint64_t nHistoricalSendRatePeer;
+    static int64_t nHistoricalTokensClass;
+    static int64_t nHistoricalLastRefillClass;
+
+    // per-peer token bucket; guarded by cs_historicalRate
+    int64_t nHistoricalTokens;
+    int64_t nHistoricalLastRefill;
+
     CNode(const CNode&);
     void operator=(const CNode&);
 
@@ -466,6 +537,15 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
 
+    // Credit nBytes received straight into the current message's data buffer
+    // (see the direct-receive path in ThreadSocketHandler).
+    // requires LOCK(cs_vRecvMsg)
+    bool ReceiveDirectBytes(unsigned int nBytes);
+
+    // Bookkeeping shared by the two receive paths above.
+    // requires LOCK(cs_vRecvMsg)
+    void MessageCompleted(CNetMessage& msg);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -544,6 +624,9 @@ public:
 
     void PushVersion();
 
+    // Queue an already-built wire message (see CreateNetMessage) without
+    // serializing it again; strCommand is only used for byte accounting.
+    void PushSerializedMessage(const std::string& strCommand, const CSerializeDataRef& data);
 
     void PushMessage(const char* pszCommand)
     {
@@ -768,12 +851,29 @@ public:
     //!response the time in second left in the current max outbound cycle
     // in case of no limit, it will always response 0
     static uint64_t GetMaxOutboundTimeLeftInCycle();
+
+    //!set the historical block serving rates in bytes per second (0 = unlimited)
+    static void SetHistoricalSendRate(uint64_t nClassRate, uint64_t nPeerRate);
+    static uint64_t GetHistoricalSendRate();
+
+    //!check whether this peer may currently be served a historical block;
+    // refills the class-wide and per-peer token buckets as a side effect
+    bool HasHistoricalBudget();
+
+    //!charge served historical bytes against the class and per-peer buckets
+    void AccountHistoricalBytes(uint64_t bytes);
 };
 
 
 
 class CTransaction;
 void RelayTransaction(const CTransaction& tx, CFeeRate feerate);
+/** Relay a batch of transactions with a single relay-map update and a single
+ * pass over the peer list, instead of one per transaction. */
+void RelayTransactions(const std::vector<std::pair<CTransaction, CFeeRate> >& vtx);
+
+/** Total bytes queued in per-peer send and receive buffers. */
+size_t GetNetMemoryUsage();
 
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
@@ -516,6 +516,126 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
     return true;
 }
 
+bool ConnectSocketRace(const std::vector<CService>& vAddrs, SOCKET& hSocketRet, CService& addrConnected, int nTimeout)
+{
+    // Start a non-blocking connect to every candidate.
+    std::vector<std::pair<SOCKET, size_t> > vRacing;
+    for (size_t i = 0; i < vAddrs.size(); i++)
+    {
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!vAddrs[i].GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+            LogPrintf("Cannot connect to %s: unsupported network\n", vAddrs[i].ToString());
+            continue;
+        }
+
+        SOCKET hSocket = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+        if (hSocket == INVALID_SOCKET)
+            continue;
+
+        int set = 1;
+#ifdef SO_NOSIGPIPE
+        // Different way of disabling SIGPIPE on BSD
+        setsockopt(hSocket, SOL_SOCKET, SO_NOSIGPIPE, (void*)&set, sizeof(int));
+#endif
+
+        //Disable Nagle's algorithm
+#ifdef WIN32
+        setsockopt(hSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&set, sizeof(int));
+#else
+        setsockopt(hSocket, IPPROTO_TCP, TCP_NODELAY, (void*)&set, sizeof(int));
+#endif
+
+        if (!SetSocketNonBlocking(hSocket, true)) {
+            CloseSocket(hSocket);
+            continue;
+        }
+
+        if (connect(hSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR)
+        {
+            int nErr = WSAGetLastError();
+            // WSAEINVAL is here because some legacy version of winsock uses it
+            if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
+                vRacing.push_back(std::make_pair(hSocket, i));
+                continue;
+            }
+#ifdef WIN32
+            if (WSAGetLastError() != WSAEISCONN)
+#endif
+            {
+                CloseSocket(hSocket);
+                continue;
+            }
+        }
+
+        // Connected immediately (e.g. localhost); close the others and win.
+        for (size_t j = 0; j < vRacing.size(); j++)
+            CloseSocket(vRacing[j].first);
+        hSocketRet = hSocket;
+        addrConnected = vAddrs[i];
+        return true;
+    }
+
+    // Wait for the first candidate to finish its handshake, dropping the
+    // ones that fail along the way.
+    int64_t nDeadline = GetTimeMillis() + nTimeout;
+    while (!vRacing.empty())
+    {
+        int64_t nRemaining = nDeadline - GetTimeMillis();
+        if (nRemaining <= 0)
+            break;
+
+        struct timeval timeout = MillisToTimeval(nRemaining);
+        fd_set fdset;
+        FD_ZERO(&fdset);
+        SOCKET hSocketMax = 0;
+        for (size_t j = 0; j < vRacing.size(); j++) {
+            FD_SET(vRacing[j].first, &fdset);
+            hSocketMax = std::max(hSocketMax, vRacing[j].first);
+        }
+        int nRet = select(hSocketMax + 1, NULL, &fdset, NULL, &timeout);
+        if (nRet == 0)
+            break;
+        if (nRet == SOCKET_ERROR) {
+            LogPrintf("select() for racing connects failed: %s\n", NetworkErrorString(WSAGetLastError()));
+            break;
+        }
+
+        for (std::vector<std::pair<SOCKET, size_t> >::iterator it = vRacing.begin(); it != vRacing.end();)
+        {
+            if (!FD_ISSET(it->first, &fdset)) {
+                it++;
+                continue;
+            }
+            int nSockErr = 0;
+            socklen_t nRetSize = sizeof(nSockErr);
+#ifdef WIN32
+            if (getsockopt(it->first, SOL_SOCKET, SO_ERROR, (char*)(&nSockErr), &nRetSize) == SOCKET_ERROR)
+#else
+            if (getsockopt(it->first, SOL_SOCKET, SO_ERROR, &nSockErr, &nRetSize) == SOCKET_ERROR)
+#endif
+                nSockErr = WSAGetLastError();
+            if (nSockErr == 0)
+            {
+                // Winner: close the remaining candidates.
+                for (size_t j = 0; j < vRacing.size(); j++)
+                    if (vRacing[j].first != it->first)
+                        CloseSocket(vRacing[j].first);
+                hSocketRet = it->first;
+                addrConnected = vAddrs[it->second];
+                return true;
+            }
+            LogPrint("net", "connect() to %s failed after select(): %s\n", vAddrs[it->second].ToString(), NetworkErrorString(nSockErr));
+            CloseSocket(it->first);
+            it = vRacing.erase(it);
+        }
+    }
+
+    for (size_t j = 0; j < vRacing.size(); j++)
+        CloseSocket(vRacing[j].first);
+    return false;
+}
+
 bool SetProxy(enum Network net, const proxyType &addrProxy) {
     assert(net >= 0 && net < NET_MAX);
     if (!addrProxy.IsValid())
@@ -211,6 +211,10 @@ bool Lookup(const char *pszName, CService& addr, int portDefault = 0, bool fAllo
 bool Lookup(const char *pszName, std::vector<CService>& vAddr, int portDefault = 0, bool fAllowLookup = true, unsigned int nMaxSolutions = 0);
 bool LookupNumeric(const char *pszName, CService& addr, int portDefault = 0);
 bool ConnectSocket(const CService &addr, SOCKET& hSocketRet, int nTimeout, bool *outProxyConnectionFailed = 0);
+/** Start non-blocking connects to all candidates at once and return the first
+ * one to complete the TCP handshake; the losers are closed. Direct
+ * connections only, the caller must handle proxies itself. */
+bool ConnectSocketRace(const std::vector<CService>& vAddrs, SOCKET& hSocketRet, CService& addrConnected, int nTimeout);
 bool ConnectSocketByName(CService &addr, SOCKET& hSocketRet, const char *pszDest, int portDefault, int nTimeout, bool *outProxyConnectionFailed = 0);
 /** Return readable error string for a network error code */
 std::string NetworkErrorString(int err);
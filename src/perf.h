@@ -0,0 +1,256 @@
+// Copyright (c) 2016 The LBRY Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PERF_H
+#define BITCOIN_PERF_H
+
+#include "utiltime.h"
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+/**
+ * A named duration counter aggregating call count, total, min and max, plus
+ * a ring of recent samples from which percentiles are computed on demand.
+ * Samples are in microseconds; recording takes one uncontended mutex.
+ *
+ * Counters live in a process-wide registry (see PerfCounter) and are never
+ * destroyed, so references to them stay valid for the life of the process.
+ */
+class CPerfCounter
+{
+private:
+    mutable boost::mutex cs;
+    uint64_t nCount;
+    int64_t nTotal;
+    int64_t nMin;
+    int64_t nMax;
+    //! ring buffer of the most recent samples, for percentiles
+    std::vector<int64_t> vRecent;
+    size_t nRecentPos;
+
+    static const size_t RECENT_SAMPLES = 4096;
+
+public:
+    CPerfCounter() : nCount(0), nTotal(0), nMin(0), nMax(0), nRecentPos(0) {}
+
+    void Sample(int64_t nMicros)
+    {
+        boost::mutex::scoped_lock lock(cs);
+        if (nCount == 0 || nMicros < nMin)
+            nMin = nMicros;
+        if (nCount == 0 || nMicros > nMax)
+            nMax = nMicros;
+        nCount++;
+        nTotal += nMicros;
+        if (vRecent.size() < RECENT_SAMPLES) {
+            vRecent.push_back(nMicros);
+        } else {
+            vRecent[nRecentPos] = nMicros;
+            nRecentPos = (nRecentPos + 1) % RECENT_SAMPLES;
+        }
+    }
+
+    uint64_t GetCount() const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        return nCount;
+    }
+
+    int64_t GetTotal() const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        return nTotal;
+    }
+
+    int64_t GetMin() const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        return nMin;
+    }
+
+    int64_t GetMax() const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        return nMax;
+    }
+
+    int64_t GetAverage() const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        return nCount == 0 ? 0 : nTotal / (int64_t)nCount;
+    }
+
+    //! nPercentile in [0, 100], computed over the recent-sample window
+    int64_t GetPercentile(int nPercentile) const
+    {
+        boost::mutex::scoped_lock lock(cs);
+        if (vRecent.empty())
+            return 0;
+        std::vector<int64_t> vSorted(vRecent);
+        std::sort(vSorted.begin(), vSorted.end());
+        return vSorted[(vSorted.size() - 1) * nPercentile / 100];
+    }
+
+    void Reset()
+    {
+        boost::mutex::scoped_lock lock(cs);
+        nCount = 0;
+        nTotal = 0;
+        nMin = 0;
+        nMax = 0;
+        vRecent.clear();
+        nRecentPos = 0;
+    }
+};
+
+typedef std::map<std::string, CPerfCounter*> PerfCounterMap;
+
+inline boost::mutex& PerfRegistryMutex()
+{
+    static boost::mutex cs_registry;
+    return cs_registry;
+}
+
+inline PerfCounterMap& PerfRegistryMap()
+{
+    static PerfCounterMap mapCounters;
+    return mapCounters;
+}
+
+/** Look up (or create) the counter with the given name. */
+inline CPerfCounter& PerfCounter(const std::string& strName)
+{
+    boost::mutex::scoped_lock lock(PerfRegistryMutex());
+    PerfCounterMap& mapCounters = PerfRegistryMap();
+    PerfCounterMap::iterator it = mapCounters.find(strName);
+    if (it == mapCounters.end())
+        it = mapCounters.insert(std::make_pair(strName, new CPerfCounter())).first;
+    return *it->second;
+}
+
+/** Record a duration that was measured externally. */
+inline void PerfSample(const std::string& strName, int64_t nMicros)
+{
+    PerfCounter(strName).Sample(nMicros);
+}
+
+/** Snapshot the registry; the returned pointers stay valid forever. */
+inline void PerfGetCounters(std::vector<std::pair<std::string, CPerfCounter*> >& vCounters)
+{
+    boost::mutex::scoped_lock lock(PerfRegistryMutex());
+    PerfCounterMap& mapCounters = PerfRegistryMap();
+    for (PerfCounterMap::iterator it = mapCounters.begin(); it != mapCounters.end(); it++)
+        vCounters.push_back(std::make_pair(it->first, it->second));
+}
+
+/**
+ * A monotonically increasing event counter. Incrementing is a single relaxed
+ * atomic add, cheap enough for per-message and per-transaction paths; reads
+ * are lock-free as well. Hot paths should cache the reference returned by
+ * StatCounter() in a function-local static rather than looking it up per
+ * event.
+ */
+class CStatCounter
+{
+private:
+    boost::atomic<int64_t> nValue;
+
+    CStatCounter(const CStatCounter&);
+    void operator=(const CStatCounter&);
+
+public:
+    CStatCounter() : nValue(0) {}
+
+    void Add(int64_t n) { nValue.fetch_add(n, boost::memory_order_relaxed); }
+    void Increment() { Add(1); }
+    int64_t Get() const { return nValue.load(boost::memory_order_relaxed); }
+    void Reset() { nValue.store(0, boost::memory_order_relaxed); }
+};
+
+typedef std::map<std::string, CStatCounter*> StatCounterMap;
+
+/** Gauge callback: computes a current value (queue depth, cache size) at
+ * scrape time. Must be cheap and must never take cs_main. */
+typedef boost::function<int64_t()> StatGaugeFunc;
+typedef std::map<std::string, StatGaugeFunc> StatGaugeMap;
+
+inline StatCounterMap& StatRegistryMap()
+{
+    static StatCounterMap mapCounters;
+    return mapCounters;
+}
+
+inline StatGaugeMap& StatGaugeRegistryMap()
+{
+    static StatGaugeMap mapGauges;
+    return mapGauges;
+}
+
+/** Look up (or create) the event counter with the given name. */
+inline CStatCounter& StatCounter(const std::string& strName)
+{
+    boost::mutex::scoped_lock lock(PerfRegistryMutex());
+    StatCounterMap& mapCounters = StatRegistryMap();
+    StatCounterMap::iterator it = mapCounters.find(strName);
+    if (it == mapCounters.end())
+        it = mapCounters.insert(std::make_pair(strName, new CStatCounter())).first;
+    return *it->second;
+}
+
+/** Register a gauge; replaces any previous registration of the same name. */
+inline void StatRegisterGauge(const std::string& strName, StatGaugeFunc func)
+{
+    boost::mutex::scoped_lock lock(PerfRegistryMutex());
+    StatGaugeRegistryMap()[strName] = func;
+}
+
+/** Snapshot the event counters; the returned pointers stay valid forever. */
+inline void StatGetCounters(std::vector<std::pair<std::string, CStatCounter*> >& vCounters)
+{
+    boost::mutex::scoped_lock lock(PerfRegistryMutex());
+    StatCounterMap& mapCounters = StatRegistryMap();
+    for (StatCounterMap::iterator it = mapCounters.begin(); it != mapCounters.end(); it++)
+        vCounters.push_back(std::make_pair(it->first, it->second));
+}
+
+/** Evaluate all registered gauges. The callbacks run outside the registry
+ * mutex so a slow gauge cannot block counter updates. */
+inline void StatGetGauges(std::vector<std::pair<std::string, int64_t> >& vGauges)
+{
+    std::vector<std::pair<std::string, StatGaugeFunc> > vFuncs;
+    {
+        boost::mutex::scoped_lock lock(PerfRegistryMutex());
+        StatGaugeMap& mapGauges = StatGaugeRegistryMap();
+        for (StatGaugeMap::iterator it = mapGauges.begin(); it != mapGauges.end(); it++)
+            vFuncs.push_back(std::make_pair(it->first, it->second));
+    }
+    for (size_t i = 0; i < vFuncs.size(); i++)
+        vGauges.push_back(std::make_pair(vFuncs[i].first, vFuncs[i].second()));
+}
+
+/** Scoped timer: samples the enclosing scope's wall time into a counter. */
+class CPerfTimer
+{
+private:
+    CPerfCounter& counter;
+    int64_t nStart;
+
+    CPerfTimer(const CPerfTimer&);
+    void operator=(const CPerfTimer&);
+
+public:
+    CPerfTimer(const std::string& strName) : counter(PerfCounter(strName)), nStart(GetTimeMicros()) {}
+    ~CPerfTimer() { counter.Sample(GetTimeMicros() - nStart); }
+};
+
+#endif // BITCOIN_PERF_H
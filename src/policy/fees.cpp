@@ -7,12 +7,25 @@
 #include "policy/policy.h"
 
 #include "amount.h"
+#include "nameclaim.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "streams.h"
 #include "txmempool.h"
 #include "util.h"
 
+/** Whether any output of this transaction carries a claim script. */
+static bool TxHasClaimScript(const CTransaction& tx)
+{
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        int op;
+        std::vector<std::vector<unsigned char> > vvchParams;
+        if (DecodeClaimScript(tx.vout[i].scriptPubKey, op, vvchParams))
+            return true;
+    }
+    return false;
+}
+
 void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
                                 unsigned int maxConfirms, double _decay, std::string _dataTypeString)
 {
@@ -310,6 +323,7 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     }
     vfeelist.push_back(INF_FEERATE);
     feeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "FeeRate");
+    claimFeeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY, "ClaimFeeRate");
 
     minTrackedPriority = AllowFreeThreshold() < MIN_PRIORITY ? MIN_PRIORITY : AllowFreeThreshold();
     std::vector<double> vprilist;
@@ -386,10 +400,12 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
         mapMemPoolTxs[hash].stats = &priStats;
         mapMemPoolTxs[hash].bucketIndex =  priStats.NewTx(txHeight, curPri);
     }
-    // Record this as a fee estimate
+    // Record this as a fee estimate, in the claim class if any output
+    // carries a claim script
     else if (isFeeDataPoint(feeRate, curPri)) {
-        mapMemPoolTxs[hash].stats = &feeStats;
-        mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+        TxConfirmStats* feeClass = TxHasClaimScript(entry.GetTx()) ? &claimFeeStats : &feeStats;
+        mapMemPoolTxs[hash].stats = feeClass;
+        mapMemPoolTxs[hash].bucketIndex = feeClass->NewTx(txHeight, (double)feeRate.GetFeePerK());
     }
     else {
         LogPrint("estimatefee", "not adding");
@@ -428,9 +444,13 @@ void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     if (entry.GetFee() == 0 || isPriDataPoint(feeRate, curPri)) {
         priStats.Record(blocksToConfirm, curPri);
     }
-    // Record this as a fee estimate
+    // Record this as a fee estimate, in the claim class if any output
+    // carries a claim script
     else if (isFeeDataPoint(feeRate, curPri)) {
-        feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        if (TxHasClaimScript(entry.GetTx()))
+            claimFeeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        else
+            feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     }
 }
 
@@ -478,6 +498,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     // Clear the current block states
     feeStats.ClearCurrent(nBlockHeight);
+    claimFeeStats.ClearCurrent(nBlockHeight);
     priStats.ClearCurrent(nBlockHeight);
 
     // Repopulate the current block states
@@ -486,6 +507,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     // Update all exponential averages with the current block states
     feeStats.UpdateMovingAverages();
+    claimFeeStats.UpdateMovingAverages();
     priStats.UpdateMovingAverages();
 
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u confirmed entries, new mempool map size %u\n",
@@ -566,11 +588,26 @@ double CBlockPolicyEstimator::estimateSmartPriority(int confTarget, int *answerF
     return median;
 }
 
+CFeeRate CBlockPolicyEstimator::estimateClaimFee(int confTarget)
+{
+    // Return failure if trying to analyze a target we're not tracking
+    if (confTarget <= 0 || (unsigned int)confTarget > claimFeeStats.GetMaxConfirms())
+        return CFeeRate(0);
+
+    double median = claimFeeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+
+    if (median < 0)
+        return estimateFee(confTarget);
+
+    return CFeeRate(median);
+}
+
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
     fileout << nBestSeenHeight;
     feeStats.Write(fileout);
     priStats.Write(fileout);
+    claimFeeStats.Write(fileout);
 }
 
 void CBlockPolicyEstimator::Read(CAutoFile& filein)
@@ -580,6 +617,15 @@ void CBlockPolicyEstimator::Read(CAutoFile& filein)
     feeStats.Read(filein);
     priStats.Read(filein);
     nBestSeenHeight = nFileBestSeenHeight;
+    try {
+        claimFeeStats.Read(filein);
+    } catch (const std::exception&) {
+        // Estimate files written before the claim fee class existed end
+        // here; start that class from scratch. TxConfirmStats::Read only
+        // commits after a full successful parse, so claimFeeStats is
+        // still in its freshly initialized state.
+        LogPrint("estimatefee", "No claim fee section in estimates file, starting fresh\n");
+    }
 }
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
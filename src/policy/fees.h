@@ -243,6 +243,10 @@ public:
     /** Return a fee estimate */
     CFeeRate estimateFee(int confTarget);
 
+    /** Return a fee estimate for claim-bearing transactions. Falls back to
+     *  the general fee estimate while too little claim data has been seen. */
+    CFeeRate estimateClaimFee(int confTarget);
+
     /** Estimate fee rate needed to get be included in a block within
      *  confTarget blocks. If no answer can be given at confTarget, return an
      *  estimate at the lowest target where one can be given.
@@ -282,6 +286,11 @@ private:
     /** Classes to track historical data on transaction confirmations */
     TxConfirmStats feeStats, priStats;
 
+    /** Separate fee class for transactions carrying claim scripts; their fee
+     *  dynamics are dominated by the per-character name claim fee rather than
+     *  ordinary feerate competition, which skews the plain fee buckets. */
+    TxConfirmStats claimFeeStats;
+
     /** Breakpoints to help determine whether a transaction was confirmed by priority or Fee */
     CFeeRate feeLikely, feeUnlikely;
     double priLikely, priUnlikely;
@@ -19,9 +19,9 @@ uint256 CBlockHeader::GetHash() const
 uint256 CBlockHeader::GetPoWHash() const
 {
     CDataStream ds(SER_GETHASH, PROTOCOL_VERSION);
+    ds.reserve(112); // serialized header size
     ds << *this;
-    std::vector<unsigned char> input(ds.begin(), ds.end());
-    return PoWHash(input);
+    return PoWHash((const unsigned char*)&ds[0], ds.size());
 }
 
 std::string CBlock::ToString() const
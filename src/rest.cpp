@@ -5,10 +5,12 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "claimtrie.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "perf.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -59,11 +61,12 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false, const std::string& strFilter = "");
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern bool getValueForClaim(const COutPoint& out, std::string& sValue);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message)
 {
@@ -599,6 +602,267 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static const size_t MAX_CLAIMSBATCH_NAMES = 100; //allow a max of 100 names to be resolved at once
+
+static bool rest_claim(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    // Note: a name whose final characters happen to spell a known format
+    // suffix must be queried with an explicit suffix appended.
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "No name specified");
+
+    CClaimValue claim;
+    std::string sValue;
+    CAmount nEffectiveAmount;
+    {
+        LOCK(cs_main);
+        if (!pclaimTrie->getInfoForName(param, claim))
+            return RESTERR(req, HTTP_NOT_FOUND, param + " not found in claim trie");
+        if (!getValueForClaim(claim.outPoint, sValue))
+            return RESTERR(req, HTTP_NOT_FOUND, param + " has no accessible value");
+        nEffectiveAmount = pclaimTrie->getEffectiveAmountForClaim(param, claim.claimId);
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssClaim(SER_NETWORK, PROTOCOL_VERSION);
+        ssClaim << claim << sValue;
+        std::string binaryClaim = ssClaim.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryClaim);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssClaim(SER_NETWORK, PROTOCOL_VERSION);
+        ssClaim << claim << sValue;
+        std::string strHex = HexStr(ssClaim.begin(), ssClaim.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue ret(UniValue::VOBJ);
+        ret.push_back(Pair("value", sValue));
+        ret.push_back(Pair("claimId", claim.claimId.GetHex()));
+        ret.push_back(Pair("txid", claim.outPoint.hash.GetHex()));
+        ret.push_back(Pair("n", (int)claim.outPoint.n));
+        ret.push_back(Pair("amount", claim.nAmount));
+        ret.push_back(Pair("effective amount", nEffectiveAmount));
+        ret.push_back(Pair("height", claim.nHeight));
+        std::string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_claimproof(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "No name specified");
+
+    CClaimTrieProof proof;
+    {
+        LOCK(cs_main);
+        if (!GetProofForName(chainActive.Tip(), param, proof))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to generate proof");
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssProof(SER_NETWORK, PROTOCOL_VERSION);
+        ssProof << proof;
+        std::string binaryProof = ssProof.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryProof);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssProof(SER_NETWORK, PROTOCOL_VERSION);
+        ssProof << proof;
+        std::string strHex = HexStr(ssProof.begin(), ssProof.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: bin, hex)");
+    }
+    }
+}
+
+extern const char* ClaimOpName(unsigned char nOp);
+
+static bool rest_claimchanges(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "No height specified. Use /rest/claimchanges/<height>.<ext>.");
+    if (!fClaimJournal)
+        return RESTERR(req, HTTP_NOT_FOUND, "claim journal is not enabled (-claimjournal)");
+
+    long nHeight = strtol(param.c_str(), NULL, 10);
+    claimOpJournalRowType row;
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            return RESTERR(req, HTTP_BAD_REQUEST, "Height out of range: " + param);
+        pclaimTrie->getClaimOpJournal(nHeight, row);
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssJournal(SER_NETWORK, PROTOCOL_VERSION);
+        ssJournal << row;
+        std::string binaryJournal = ssJournal.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryJournal);
+        return true;
+    }
+    case RF_HEX: {
+        CDataStream ssJournal(SER_NETWORK, PROTOCOL_VERSION);
+        ssJournal << row;
+        std::string strHex = HexStr(ssJournal.begin(), ssJournal.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue ret(UniValue::VARR);
+        for (claimOpJournalRowType::const_iterator it = row.begin(); it != row.end(); ++it)
+        {
+            UniValue op(UniValue::VOBJ);
+            op.push_back(Pair("op", ClaimOpName(it->nOp)));
+            op.push_back(Pair("name", it->name));
+            op.push_back(Pair("txid", it->outPoint.hash.GetHex()));
+            op.push_back(Pair("n", (int)it->outPoint.n));
+            if (!it->claimId.IsNull())
+                op.push_back(Pair("claimId", it->claimId.GetHex()));
+            op.push_back(Pair("amount", it->nAmount));
+            if (it->nValidAtHeight != 0)
+                op.push_back(Pair("valid at height", it->nValidAtHeight));
+            ret.push_back(op);
+        }
+        std::string strJSON = ret.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_claimsbatch(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    if (req->GetRequestMethod() != HTTPRequest::POST)
+        return RESTERR(req, HTTP_BAD_REQUEST, "claimsbatch requires a POST of newline-separated names");
+
+    std::vector<std::string> vNames;
+    {
+        std::string strBody = req->ReadBody();
+        boost::split(vNames, strBody, boost::is_any_of("\n"));
+    }
+    // drop empty trailing entries
+    while (!vNames.empty() && vNames.back().empty())
+        vNames.pop_back();
+    if (vNames.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "No names specified");
+    if (vNames.size() > MAX_CLAIMSBATCH_NAMES)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Too many names (max %d)", (int)MAX_CLAIMSBATCH_NAMES));
+
+    // Reply is the native serialization of the found (name, claim) pairs;
+    // names with no winning claim are simply absent.
+    std::vector<std::pair<std::string, CClaimValue> > vClaims;
+    {
+        LOCK(cs_main);
+        for (std::vector<std::string>::const_iterator it = vNames.begin(); it != vNames.end(); ++it) {
+            CClaimValue claim;
+            if (pclaimTrie->getInfoForName(*it, claim))
+                vClaims.push_back(std::make_pair(*it, claim));
+        }
+    }
+    CDataStream ssClaims(SER_NETWORK, PROTOCOL_VERSION);
+    ssClaims << vClaims;
+    std::string binaryClaims = ssClaims.str();
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->WriteReply(HTTP_OK, binaryClaims);
+    return true;
+}
+
+//! Turn a dotted counter name into a Prometheus metric name
+static std::string MetricsName(const std::string& strName)
+{
+    std::string strMetric = "lbrycrd_" + strName;
+    for (size_t i = 0; i < strMetric.size(); i++)
+        if (strMetric[i] == '.' || strMetric[i] == '-')
+            strMetric[i] = '_';
+    return strMetric;
+}
+
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+
+    // Prometheus text exposition format. Everything here reads lock-free
+    // counters or cheap gauges; in particular cs_main is never taken, so
+    // scraping cannot stall (or be stalled by) validation.
+    std::string strReply;
+    strReply.reserve(4096);
+
+    std::vector<std::pair<std::string, CStatCounter*> > vCounters;
+    StatGetCounters(vCounters);
+    for (size_t i = 0; i < vCounters.size(); i++) {
+        std::string strMetric = MetricsName(vCounters[i].first) + "_total";
+        strReply += "# TYPE " + strMetric + " counter\n";
+        strReply += strMetric + " " + itostr(vCounters[i].second->Get()) + "\n";
+    }
+
+    std::vector<std::pair<std::string, int64_t> > vGauges;
+    StatGetGauges(vGauges);
+    for (size_t i = 0; i < vGauges.size(); i++) {
+        std::string strMetric = MetricsName(vGauges[i].first);
+        strReply += "# TYPE " + strMetric + " gauge\n";
+        strReply += strMetric + " " + itostr(vGauges[i].second) + "\n";
+    }
+
+    std::vector<std::pair<std::string, CPerfCounter*> > vTimers;
+    PerfGetCounters(vTimers);
+    for (size_t i = 0; i < vTimers.size(); i++) {
+        // Export each duration counter as a Prometheus summary in seconds
+        std::string strMetric = MetricsName(vTimers[i].first) + "_seconds";
+        CPerfCounter* pcounter = vTimers[i].second;
+        strReply += "# TYPE " + strMetric + " summary\n";
+        strReply += strprintf("%s{quantile=\"0.5\"} %.6f\n", strMetric, pcounter->GetPercentile(50) * 0.000001);
+        strReply += strprintf("%s{quantile=\"0.99\"} %.6f\n", strMetric, pcounter->GetPercentile(99) * 0.000001);
+        strReply += strprintf("%s_sum %.6f\n", strMetric, pcounter->GetTotal() * 0.000001);
+        strReply += strprintf("%s_count %d\n", strMetric, pcounter->GetCount());
+    }
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, strReply);
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -611,6 +875,11 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/claim/", rest_claim},
+      {"/rest/claimproof/", rest_claimproof},
+      {"/rest/claimchanges/", rest_claimchanges},
+      {"/rest/claimsbatch", rest_claimsbatch},
+      {"/metrics", rest_metrics},
 };
 
 bool StartREST()
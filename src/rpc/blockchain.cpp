@@ -10,15 +10,18 @@
 #include "coins.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "perf.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
+#include "nameclaim.h"
 
 #include <stdint.h>
 
@@ -31,22 +34,17 @@ using namespace std;
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
-double GetDifficulty(const CBlockIndex* blockindex)
+static double GetDifficultyFromBits(uint32_t nBits)
 {
     // Floating point number that is a multiple of the minimum difficulty,
     // minimum difficulty = 1.0.
-    if (blockindex == NULL)
-    {
-        if (chainActive.Tip() == NULL)
-            return 1.0;
-        else
-            blockindex = chainActive.Tip();
-    }
+    if (nBits == 0)
+        return 1.0;
 
-    int nShift = (blockindex->nBits >> 24) & 0xff;
+    int nShift = (nBits >> 24) & 0xff;
 
     double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
+        (double)0x0000ffff / (double)(nBits & 0x00ffffff);
 
     while (nShift < 29)
     {
@@ -62,6 +60,19 @@ double GetDifficulty(const CBlockIndex* blockindex)
     return dDiff;
 }
 
+double GetDifficulty(const CBlockIndex* blockindex)
+{
+    if (blockindex == NULL)
+    {
+        if (chainActive.Tip() == NULL)
+            return 1.0;
+        else
+            blockindex = chainActive.Tip();
+    }
+
+    return GetDifficultyFromBits(blockindex->nBits);
+}
+
 UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
@@ -91,7 +102,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false, const std::string& strFilter = "")
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
@@ -106,19 +117,47 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("nameclaimroot", block.hashClaimTrie.GetHex()));
-    UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    if (strFilter != "header")
     {
-        if(txDetails)
+        UniValue txs(UniValue::VARR);
+        BOOST_FOREACH(const CTransaction&tx, block.vtx)
         {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
+            if (strFilter == "claims")
+            {
+                // Project each transaction down to its claim operations so
+                // block summary queries stay small even for full blocks
+                for (unsigned int i = 0; i < tx.vout.size(); i++)
+                {
+                    const CTxOut& txout = tx.vout[i];
+                    int op;
+                    std::vector<std::vector<unsigned char> > vvchParams;
+                    if (!HasClaimScriptPrefix(txout.scriptPubKey) || !DecodeClaimScript(txout.scriptPubKey, op, vvchParams))
+                        continue;
+                    UniValue objClaim(UniValue::VOBJ);
+                    objClaim.push_back(Pair("txid", tx.GetHash().GetHex()));
+                    objClaim.push_back(Pair("n", (int)i));
+                    if (op == OP_CLAIM_NAME)
+                        objClaim.push_back(Pair("operation", "claim"));
+                    else if (op == OP_SUPPORT_CLAIM)
+                        objClaim.push_back(Pair("operation", "support"));
+                    else
+                        objClaim.push_back(Pair("operation", "update"));
+                    objClaim.push_back(Pair("name", std::string(vvchParams[0].begin(), vvchParams[0].end())));
+                    objClaim.push_back(Pair("amount", ValueFromAmount(txout.nValue)));
+                    txs.push_back(objClaim);
+                }
+            }
+            else if(txDetails)
+            {
+                UniValue objTx(UniValue::VOBJ);
+                TxToJSON(tx, uint256(), objTx);
+                txs.push_back(objTx);
+            }
+            else
+                txs.push_back(tx.GetHash().GetHex());
         }
-        else
-            txs.push_back(tx.GetHash().GetHex());
+        result.push_back(Pair("tx", txs));
     }
-    result.push_back(Pair("tx", txs));
     result.push_back(Pair("time", block.GetBlockTime()));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     result.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -152,6 +191,10 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
+    CChainTipSnapshot snapshot;
+    if (GetChainTipSnapshot(snapshot))
+        return snapshot.nHeight;
+
     LOCK(cs_main);
     return chainActive.Height();
 }
@@ -169,6 +212,10 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
+    CChainTipSnapshot snapshot;
+    if (GetChainTipSnapshot(snapshot))
+        return snapshot.hashTip.GetHex();
+
     LOCK(cs_main);
     return chainActive.Tip()->GetBlockHash().GetHex();
 }
@@ -186,6 +233,10 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getdifficulty", "")
         );
 
+    CChainTipSnapshot snapshot;
+    if (GetChainTipSnapshot(snapshot))
+        return GetDifficultyFromBits(snapshot.nBits);
+
     LOCK(cs_main);
     return GetDifficulty();
 }
@@ -194,45 +245,56 @@ UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
     {
+        unsigned int chainHeight = (unsigned int)chainActive.Height();
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
         BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            // In steady state most entries are untouched between polls, so
+            // the fragment built on the previous call can be reused. The
+            // cache is dropped whenever the entry's ancestry or fee delta
+            // changes (which also covers the depends list, since removing a
+            // parent updates our ancestor state) or the chain advances.
+            if (!e.IsInfoCached(chainHeight))
             {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
+                UniValue info(UniValue::VOBJ);
+                info.push_back(Pair("size", (int)e.GetTxSize()));
+                info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+                info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
+                info.push_back(Pair("minclaimtriefee", ValueFromAmount(e.GetMinClaimTrieFee())));
+                info.push_back(Pair("time", e.GetTime()));
+                info.push_back(Pair("height", (int)e.GetHeight()));
+                info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+                info.push_back(Pair("currentpriority", e.GetPriority(chainHeight)));
+                info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+                info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+                info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+                const CTransaction& tx = e.GetTx();
+                set<string> setDepends;
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                {
+                    if (mempool.exists(txin.prevout.hash))
+                        setDepends.insert(txin.prevout.hash.ToString());
+                }
 
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends)
-            {
-                depends.push_back(dep);
-            }
+                UniValue depends(UniValue::VARR);
+                BOOST_FOREACH(const string& dep, setDepends)
+                {
+                    depends.push_back(dep);
+                }
 
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+                info.push_back(Pair("depends", depends));
+                e.SetCachedInfo(info, chainHeight);
+            }
+            o.push_back(Pair(hash.ToString(), e.GetCachedInfo()));
         }
         return o;
     }
     else
     {
         vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+        mempool.queryHashesSnapshot(vtxid);
 
         UniValue a(UniValue::VARR);
         BOOST_FOREACH(const uint256& hash, vtxid)
@@ -261,6 +323,7 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"size\" : n,             (numeric) transaction size in bytes\n"
             "    \"fee\" : n,              (numeric) transaction fee in " + CURRENCY_UNIT + "\n"
             "    \"modifiedfee\" : n,      (numeric) transaction fee with fee deltas used for mining priority\n"
+            "    \"minclaimtriefee\" : n,  (numeric) minimum fee obligation from claim names, 0 for ordinary transactions\n"
             "    \"time\" : n,             (numeric) local time transaction entered pool in seconds since 1 Jan 1970 GMT\n"
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
@@ -373,14 +436,15 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue getblock(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() < 1 || params.size() > 2)
+    if (fHelp || params.size() < 1 || params.size() > 3)
         throw runtime_error(
-            "getblock \"hash\" ( verbose )\n"
+            "getblock \"hash\" ( verbose filter )\n"
             "\nIf verbose is false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
             "If verbose is true, returns an Object with information about block <hash>.\n"
             "\nArguments:\n"
             "1. \"hash\"          (string, required) The block hash\n"
             "2. verbose           (boolean, optional, default=true) true for a json object, false for the hex encoded data\n"
+            "3. \"filter\"        (string, optional, default=\"\") \"header\" to omit the tx array, \"claims\" to list only claim operations in place of txids\n"
             "\nResult (for verbose = true):\n"
             "{\n"
             "  \"hash\" : \"hash\",     (string) the block hash (same as provided)\n"
@@ -420,6 +484,14 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
+    std::string strFilter;
+    if (params.size() > 2)
+    {
+        strFilter = params[2].get_str();
+        if (strFilter != "" && strFilter != "header" && strFilter != "claims")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "filter must be \"header\" or \"claims\"");
+    }
+
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
@@ -440,7 +512,130 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    return blockToJSON(block, pblockindex, false, strFilter);
+}
+
+UniValue getblockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockstats hash_or_height ( stats )\n"
+            "\nReturns per-block statistics computed while the block was connected.\n"
+            "Requires the -blockstatsindex command line option; blocks connected\n"
+            "before the index was enabled have no record.\n"
+            "\nArguments:\n"
+            "1. hash_or_height    (string or numeric, required) The block hash or height\n"
+            "2. \"stats\"          (array, optional) JSON array of field names; only those fields are returned\n"
+            "    [\n"
+            "      \"fieldname\"  (string) A field name from the result below\n"
+            "      ,...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\" : n,            (numeric) The block height\n"
+            "  \"blockhash\" : \"hash\",    (string) The block hash\n"
+            "  \"time\" : ttt,            (numeric) The block time in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"txs\" : n,               (numeric) Number of transactions\n"
+            "  \"total_size\" : n,        (numeric) Serialized block size\n"
+            "  \"mintxsize\" : n,         (numeric) Smallest transaction size\n"
+            "  \"maxtxsize\" : n,         (numeric) Largest transaction size\n"
+            "  \"mediantxsize\" : n,      (numeric) Median transaction size\n"
+            "  \"ins\" : n,               (numeric) Number of inputs\n"
+            "  \"outs\" : n,              (numeric) Number of outputs\n"
+            "  \"total_out\" : n,         (numeric) Sum of non-coinbase output values, in satoshis\n"
+            "  \"totalfee\" : n,          (numeric) Total fees, in satoshis\n"
+            "  \"minfeerate\" : n,        (numeric) Lowest feerate, in satoshis per kB\n"
+            "  \"maxfeerate\" : n,        (numeric) Highest feerate, in satoshis per kB\n"
+            "  \"feerate_percentiles\" : [ (array of numeric) 10th, 25th, 50th, 75th, 90th percentile feerates, in satoshis per kB\n"
+            "     n, n, n, n, n\n"
+            "  ],\n"
+            "  \"claimnames\" : n,        (numeric) OP_CLAIM_NAME outputs\n"
+            "  \"claimupdates\" : n,      (numeric) OP_UPDATE_CLAIM outputs\n"
+            "  \"claimsupports\" : n,     (numeric) OP_SUPPORT_CLAIM outputs\n"
+            "  \"claimspends\" : n        (numeric) claim-bearing prevouts spent\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockstats", "1000")
+            + HelpExampleCli("getblockstats", "1000 '[\"totalfee\",\"claimnames\"]'")
+            + HelpExampleRpc("getblockstats", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+        );
+
+    LOCK(cs_main);
+
+    CBlockIndex* pblockindex = NULL;
+    if (params[0].isNum())
+    {
+        int nHeight = params[0].get_int();
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        pblockindex = chainActive[nHeight];
+    }
+    else
+    {
+        uint256 hash(uint256S(params[0].get_str()));
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mapBlockIndex[hash];
+    }
+
+    if (!fBlockStatsIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Block stats are not maintained (use -blockstatsindex)");
+
+    std::set<std::string> setSelected;
+    if (params.size() > 1)
+    {
+        UniValue stats = params[1].get_array();
+        for (unsigned int idx = 0; idx < stats.size(); idx++)
+            setSelected.insert(stats[idx].get_str());
+    }
+
+    CBlockStats blockstats;
+    if (!pblocktree->ReadBlockStats(pblockindex->GetBlockHash(), blockstats))
+        throw JSONRPCError(RPC_MISC_ERROR, "No stats record for this block (connected before -blockstatsindex was enabled?)");
+
+    UniValue all(UniValue::VOBJ);
+    all.push_back(Pair("height", (int64_t)blockstats.nHeight));
+    all.push_back(Pair("blockhash", pblockindex->GetBlockHash().GetHex()));
+    all.push_back(Pair("time", pblockindex->GetBlockTime()));
+    all.push_back(Pair("txs", (int64_t)blockstats.nTxCount));
+    all.push_back(Pair("total_size", (int64_t)blockstats.nTotalSize));
+    all.push_back(Pair("mintxsize", (int64_t)blockstats.nMinTxSize));
+    all.push_back(Pair("maxtxsize", (int64_t)blockstats.nMaxTxSize));
+    all.push_back(Pair("mediantxsize", (int64_t)blockstats.nMedianTxSize));
+    all.push_back(Pair("ins", (int64_t)blockstats.nInputs));
+    all.push_back(Pair("outs", (int64_t)blockstats.nOutputs));
+    all.push_back(Pair("total_out", blockstats.nTotalOut));
+    all.push_back(Pair("totalfee", blockstats.nTotalFee));
+    all.push_back(Pair("minfeerate", blockstats.nMinFeeRate));
+    all.push_back(Pair("maxfeerate", blockstats.nMaxFeeRate));
+    UniValue percentiles(UniValue::VARR);
+    percentiles.push_back(blockstats.nFeeRatePct10);
+    percentiles.push_back(blockstats.nFeeRatePct25);
+    percentiles.push_back(blockstats.nFeeRatePct50);
+    percentiles.push_back(blockstats.nFeeRatePct75);
+    percentiles.push_back(blockstats.nFeeRatePct90);
+    all.push_back(Pair("feerate_percentiles", percentiles));
+    all.push_back(Pair("claimnames", (int64_t)blockstats.nClaimNames));
+    all.push_back(Pair("claimupdates", (int64_t)blockstats.nClaimUpdates));
+    all.push_back(Pair("claimsupports", (int64_t)blockstats.nClaimSupports));
+    all.push_back(Pair("claimspends", (int64_t)blockstats.nClaimSpends));
+
+    if (setSelected.empty())
+        return all;
+
+    UniValue ret(UniValue::VOBJ);
+    std::vector<std::string> keys = all.getKeys();
+    for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+    {
+        if (setSelected.count(*it))
+        {
+            ret.push_back(Pair(*it, all[*it]));
+            setSelected.erase(*it);
+        }
+    }
+    if (!setSelected.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid selected statistic " + *setSelected.begin());
+    return ret;
 }
 
 struct CCoinsStats
@@ -451,6 +646,7 @@ struct CCoinsStats
     uint64_t nTransactionOutputs;
     uint64_t nSerializedSize;
     uint256 hashSerialized;
+    arith_uint256 hashRolling;
     CAmount nTotalAmount;
 
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
@@ -482,6 +678,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
                     stats.nTransactionOutputs++;
                     ss << VARINT(i+1);
                     ss << out;
+                    stats.hashRolling += UtxoElementHash(key, i, out);
                     nTotalAmount += out.nValue;
                 }
             }
@@ -499,19 +696,26 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( fullscan )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The first call scans the whole database and may take some time;\n"
+            "the statistics are then maintained incrementally as blocks connect\n"
+            "and disconnect, so later calls return instantly. A full scan also\n"
+            "reports \"bytes_serialized\" and \"hash_serialized\", which are not\n"
+            "tracked incrementally.\n"
+            "\nArguments:\n"
+            "1. fullscan        (boolean, optional, default=false) force a full database scan\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"bytes_serialized\": n,  (numeric, full scan only) The serialized size\n"
+            "  \"hash_serialized\": \"hash\",   (string, full scan only) The serialized hash\n"
+            "  \"hash_rolling\": \"hash\",      (string) incremental order-independent hash of the set\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
@@ -519,22 +723,315 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    bool fFullScan = params.size() > 0 ? params[0].get_bool() : false;
+
     UniValue ret(UniValue::VOBJ);
 
+    LOCK(cs_main);
+    if (!fFullScan && utxoSetStats.fValid) {
+        BlockMap::iterator mi = mapBlockIndex.find(utxoSetStats.hashBlock);
+        ret.push_back(Pair("height", (int64_t)(mi != mapBlockIndex.end() ? mi->second->nHeight : -1)));
+        ret.push_back(Pair("bestblock", utxoSetStats.hashBlock.GetHex()));
+        ret.push_back(Pair("transactions", (int64_t)utxoSetStats.nTransactions));
+        ret.push_back(Pair("txouts", (int64_t)utxoSetStats.nTransactionOutputs));
+        ret.push_back(Pair("hash_rolling", utxoSetStats.hashRolling.GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(utxoSetStats.nTotalAmount)));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsTip, stats)) {
+        // seed the rolling tracker so subsequent calls return instantly
+        utxoSetStats.fValid = true;
+        utxoSetStats.hashBlock = stats.hashBlock;
+        utxoSetStats.nTransactions = stats.nTransactions;
+        utxoSetStats.nTransactionOutputs = stats.nTransactionOutputs;
+        utxoSetStats.nTotalAmount = stats.nTotalAmount;
+        utxoSetStats.hashRolling = stats.hashRolling;
+
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_rolling", stats.hashRolling.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+//! format version of snapshot files produced by dumpchainstate
+static const int CHAINSTATE_SNAPSHOT_VERSION = 1;
+//! records applied per leveldb write batch when loading a snapshot
+static const size_t CHAINSTATE_SNAPSHOT_CHUNK = 16384;
+
+UniValue dumpchainstate(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumpchainstate \"filename\"\n"
+            "\nWrites the full UTXO set and claim trie state at the current tip to a\n"
+            "snapshot file. The file records the tip hash, the claim trie root and a\n"
+            "hash of each section, so loadchainstate can verify what it provisions.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The output file\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filename\": \"xxx\",      (string) the written file\n"
+            "  \"bestblock\": \"hex\",     (string) the block hash the snapshot is valid at\n"
+            "  \"height\": n,              (numeric) the height of that block\n"
+            "  \"claimtrieroot\": \"hex\", (string) the claim trie root hash at that block\n"
+            "  \"coins\": n,               (numeric) number of coin records written\n"
+            "  \"claimtrierecords\": n     (numeric) number of claim trie records written\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpchainstate", "\"snapshot.dat\"")
+            + HelpExampleRpc("dumpchainstate", "\"snapshot.dat\"")
+        );
+
+    boost::filesystem::path path = params[0].get_str();
+
+    LOCK(cs_main);
+
+    // Make the databases agree with the tip before dumping them.
+    FlushStateToDisk();
+    pclaimTrie->WriteToDisk();
+    pclaimTrie->waitForPendingFlush();
+
+    uint256 hashBlock = pcoinsdbview->GetBestBlock();
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Best block of the coin database is not in the block index");
+    int nHeight = mi->second->nHeight;
+    uint256 hashTrie = pclaimTrie->getMerkleHash();
+
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file for writing");
+    fileout << CHAINSTATE_SNAPSHOT_VERSION;
+    fileout << hashBlock;
+    fileout << nHeight;
+    fileout << hashTrie;
+
+    // UTXO section: (txid, coins) records behind continuation markers, sealed
+    // with the record count and a running hash for verification on load.
+    uint64_t nCoins = 0;
+    CHashWriter ssCoinsHash(SER_GETHASH, PROTOCOL_VERSION);
+    {
+        boost::scoped_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            CCoins coins;
+            if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read the coin database");
+            if (!coins.IsPruned()) {
+                fileout << (unsigned char)1;
+                fileout << txid;
+                fileout << coins;
+                ssCoinsHash << txid;
+                ssCoinsHash << coins;
+                nCoins++;
+            }
+            pcursor->Next();
+        }
+    }
+    fileout << (unsigned char)0;
+    fileout << nCoins;
+    fileout << ssCoinsHash.GetHash();
+
+    // Claim trie section: every record of the claim trie database verbatim
+    // (nodes, queues, supports and the claim index), so the loaded node can
+    // sync forward through takeovers and expirations.
+    uint64_t nTrieRecords = 0;
+    CHashWriter ssTrieHash(SER_GETHASH, PROTOCOL_VERSION);
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(pclaimTrie->db.NewIterator());
+        pcursor->SeekToFirst();
+        std::vector<unsigned char> vchKey;
+        std::vector<unsigned char> vchValue;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            pcursor->GetKeyRaw(vchKey);
+            pcursor->GetValueRaw(vchValue);
+            fileout << (unsigned char)1;
+            fileout << vchKey;
+            fileout << vchValue;
+            ssTrieHash << vchKey;
+            ssTrieHash << vchValue;
+            nTrieRecords++;
+            pcursor->Next();
+        }
+    }
+    fileout << (unsigned char)0;
+    fileout << nTrieRecords;
+    fileout << ssTrieHash.GetHash();
+    FileCommit(fileout.Get());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filename", path.string()));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("claimtrieroot", hashTrie.GetHex()));
+    ret.push_back(Pair("coins", (int64_t)nCoins));
+    ret.push_back(Pair("claimtrierecords", (int64_t)nTrieRecords));
+    return ret;
+}
+
+UniValue loadchainstate(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "loadchainstate \"filename\"\n"
+            "\nProvisions the UTXO set and claim trie from a snapshot file written by\n"
+            "dumpchainstate, instead of rebuilding them through initial block download.\n"
+            "The node must be freshly initialized (no blocks connected past genesis)\n"
+            "and must already have the block headers covering the snapshot block.\n"
+            "Both sections are checked against the hashes recorded in the file, and\n"
+            "the rebuilt claim trie root must match the recorded commitment.\n"
+            "Restart the node afterwards (with -checkblocks=0, since the block data\n"
+            "below the snapshot is not on disk) to activate the loaded state and sync\n"
+            "forward from the snapshot block. If the load fails part way, restart\n"
+            "with -reindex to return to a clean state.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The snapshot file\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bestblock\": \"hex\",     (string) the block hash the loaded state is valid at\n"
+            "  \"height\": n,              (numeric) the height of that block\n"
+            "  \"coins\": n,               (numeric) number of coin records loaded\n"
+            "  \"claimtrierecords\": n     (numeric) number of claim trie records loaded\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadchainstate", "\"snapshot.dat\"")
+            + HelpExampleRpc("loadchainstate", "\"snapshot.dat\"")
+        );
+
+    boost::filesystem::path path = params[0].get_str();
+
+    LOCK(cs_main);
+
+    // Only a freshly initialized node may be provisioned: loading over an
+    // existing chainstate would leave stale records behind.
+    uint256 hashCurrent = pcoinsdbview->GetBestBlock();
+    if (!hashCurrent.IsNull() && hashCurrent != Params().GetConsensus().hashGenesisBlock)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "The coin database is not fresh; loadchainstate can only provision a new node");
+    if (!(pclaimTrie->empty() && pclaimTrie->queueEmpty() && pclaimTrie->supportEmpty() &&
+          pclaimTrie->supportQueueEmpty() && pclaimTrie->expirationQueueEmpty() &&
+          pclaimTrie->supportExpirationQueueEmpty()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "The claim trie is not empty; loadchainstate can only provision a new node");
+
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file");
+
+    uint256 hashBlock;
+    uint256 hashTrie;
+    int nHeight;
+    uint64_t nCoins = 0;
+    uint64_t nTrieRecords = 0;
+    try {
+        int nVersion;
+        filein >> nVersion;
+        if (nVersion != CHAINSTATE_SNAPSHOT_VERSION)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Unknown snapshot format version %d", nVersion));
+        filein >> hashBlock;
+        filein >> nHeight;
+        filein >> hashTrie;
+
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Snapshot block is not in the block index; sync the block headers first");
+
+        // UTXO section. The best-block fence is only written once the whole
+        // section has verified against the recorded count and hash.
+        CHashWriter ssCoinsHash(SER_GETHASH, PROTOCOL_VERSION);
+        CCoinsMap mapChunk;
+        unsigned char fMore;
+        while (true) {
+            filein >> fMore;
+            if (!fMore)
+                break;
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            filein >> txid;
+            CCoinsCacheEntry& entry = mapChunk[txid];
+            filein >> entry.coins;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            ssCoinsHash << txid;
+            ssCoinsHash << entry.coins;
+            nCoins++;
+            if (mapChunk.size() >= CHAINSTATE_SNAPSHOT_CHUNK) {
+                if (!pcoinsdbview->BatchWrite(mapChunk, uint256()))
+                    throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the coin database");
+            }
+        }
+        uint64_t nCoinsExpected;
+        uint256 hashCoinsExpected;
+        filein >> nCoinsExpected;
+        filein >> hashCoinsExpected;
+        if (nCoins != nCoinsExpected || ssCoinsHash.GetHash() != hashCoinsExpected)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Snapshot UTXO section failed verification");
+        if (!pcoinsdbview->BatchWrite(mapChunk, hashBlock))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the coin database");
+
+        // Claim trie section: verbatim database records.
+        CHashWriter ssTrieHash(SER_GETHASH, PROTOCOL_VERSION);
+        CDBBatch batch(&pclaimTrie->db.GetObfuscateKey());
+        size_t nBatched = 0;
+        std::vector<unsigned char> vchKey;
+        std::vector<unsigned char> vchValue;
+        while (true) {
+            filein >> fMore;
+            if (!fMore)
+                break;
+            boost::this_thread::interruption_point();
+            filein >> vchKey;
+            filein >> vchValue;
+            ssTrieHash << vchKey;
+            ssTrieHash << vchValue;
+            batch.WriteRaw(vchKey, vchValue);
+            nTrieRecords++;
+            if (++nBatched >= CHAINSTATE_SNAPSHOT_CHUNK) {
+                if (!pclaimTrie->db.WriteBatch(batch))
+                    throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the claim trie database");
+                batch.Clear();
+                nBatched = 0;
+            }
+        }
+        uint64_t nTrieExpected;
+        uint256 hashTrieExpected;
+        filein >> nTrieExpected;
+        filein >> hashTrieExpected;
+        if (nTrieRecords != nTrieExpected || ssTrieHash.GetHash() != hashTrieExpected)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Snapshot claim trie section failed verification");
+        if (!pclaimTrie->db.WriteBatch(batch, true))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the claim trie database");
+    } catch (const std::ios_base::failure& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Snapshot file is truncated or corrupt: %s", e.what()));
+    }
+
+    // Rebuild the in-memory trie from the loaded database and check the root
+    // against the commitment recorded at dump time.
+    if (!pclaimTrie->ReadFromDisk(false))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to reload the claim trie");
+    if (pclaimTrie->getMerkleHash() != hashTrie)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Claim trie root does not match the snapshot commitment");
+
+    LogPrintf("Loaded chainstate snapshot at height %d (%s): %u coins, %u claim trie records\n",
+              nHeight, hashBlock.GetHex(), (unsigned long)nCoins, (unsigned long)nTrieRecords);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("coins", (int64_t)nCoins));
+    ret.push_back(Pair("claimtrierecords", (int64_t)nTrieRecords));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -711,7 +1208,7 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) heighest block available\n"
-            "  \"softforks\": [            (array) status of softforks in progress\n"
+            "  \"softforks\": [            (array) status of softforks in progress (omitted if cs_main is busy)\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
             "        \"version\": xx,         (numeric) block version\n"
@@ -738,37 +1235,61 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockchaininfo", "")
         );
 
-    LOCK(cs_main);
+    CChainTipSnapshot snapshot;
+    if (!GetChainTipSnapshot(snapshot))
+    {
+        // No tip published yet (early startup); read the chain state directly
+        LOCK(cs_main);
+        CBlockIndex* tip = chainActive.Tip();
+        if (tip != NULL)
+        {
+            snapshot.nHeight = tip->nHeight;
+            snapshot.nHeaderHeight = pindexBestHeader ? pindexBestHeader->nHeight : tip->nHeight;
+            snapshot.hashTip = tip->GetBlockHash();
+            snapshot.hashClaimTrie = tip->hashClaimTrie;
+            snapshot.nChainWork = ArithToUint256(tip->nChainWork);
+            snapshot.nBits = tip->nBits;
+            snapshot.nMedianTime = tip->GetMedianTimePast();
+            snapshot.dVerificationProgress = Checkpoints::GuessVerificationProgress(Params().Checkpoints(), tip);
+        }
+    }
 
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("chain",                 Params().NetworkIDString()));
-    obj.push_back(Pair("blocks",                (int)chainActive.Height()));
-    obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
-    obj.push_back(Pair("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex()));
-    obj.push_back(Pair("difficulty",            (double)GetDifficulty()));
-    obj.push_back(Pair("mediantime",            (int64_t)chainActive.Tip()->GetMedianTimePast()));
-    obj.push_back(Pair("verificationprogress",  Checkpoints::GuessVerificationProgress(Params().Checkpoints(), chainActive.Tip())));
-    obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("blocks",                snapshot.nHeight));
+    obj.push_back(Pair("headers",               snapshot.nHeaderHeight));
+    obj.push_back(Pair("bestblockhash",         snapshot.hashTip.GetHex()));
+    obj.push_back(Pair("difficulty",            GetDifficultyFromBits(snapshot.nBits)));
+    obj.push_back(Pair("mediantime",            snapshot.nMedianTime));
+    obj.push_back(Pair("verificationprogress",  snapshot.dVerificationProgress));
+    obj.push_back(Pair("chainwork",             snapshot.nChainWork.GetHex()));
     obj.push_back(Pair("pruned",                fPruneMode));
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CBlockIndex* tip = chainActive.Tip();
-    UniValue softforks(UniValue::VARR);
-    UniValue bip9_softforks(UniValue::VOBJ);
-    softforks.push_back(SoftForkDesc("bip34", 2, tip, consensusParams));
-    softforks.push_back(SoftForkDesc("bip66", 3, tip, consensusParams));
-    softforks.push_back(SoftForkDesc("bip65", 4, tip, consensusParams));
-    bip9_softforks.push_back(Pair("csv", BIP9SoftForkDesc(consensusParams, Consensus::DEPLOYMENT_CSV)));
-    obj.push_back(Pair("softforks",             softforks));
-    obj.push_back(Pair("bip9_softforks", bip9_softforks));
-
-    if (fPruneMode)
+    // The softfork and prune sections need the block index. Health checks
+    // only care about the fields above, so rather than stall behind
+    // validation we omit these sections when cs_main is busy.
+    TRY_LOCK(cs_main, lockMain);
+    if (lockMain)
     {
-        CBlockIndex *block = chainActive.Tip();
-        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
-            block = block->pprev;
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        CBlockIndex* tip = chainActive.Tip();
+        UniValue softforks(UniValue::VARR);
+        UniValue bip9_softforks(UniValue::VOBJ);
+        softforks.push_back(SoftForkDesc("bip34", 2, tip, consensusParams));
+        softforks.push_back(SoftForkDesc("bip66", 3, tip, consensusParams));
+        softforks.push_back(SoftForkDesc("bip65", 4, tip, consensusParams));
+        bip9_softforks.push_back(Pair("csv", BIP9SoftForkDesc(consensusParams, Consensus::DEPLOYMENT_CSV)));
+        obj.push_back(Pair("softforks",             softforks));
+        obj.push_back(Pair("bip9_softforks", bip9_softforks));
+
+        if (fPruneMode)
+        {
+            CBlockIndex *block = chainActive.Tip();
+            while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+                block = block->pprev;
 
-        obj.push_back(Pair("pruneheight",        block->nHeight));
+            obj.push_back(Pair("pruneheight",        block->nHeight));
+        }
     }
     return obj;
 }
@@ -913,6 +1434,59 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getvalidationstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getvalidationstats ( reset )\n"
+            "\nReturns timing statistics gathered from the validation pipeline.\n"
+            "Each entry aggregates one instrumented phase (ConnectBlock phases,\n"
+            "state flushes, database reads and writes); durations are in\n"
+            "microseconds and percentiles cover a window of recent samples.\n"
+            "\nArguments:\n"
+            "1. reset   (boolean, optional, default=false) clear the counters after reading them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"connectblock.connect\": {\n"
+            "    \"count\": xxxxx,           (numeric) number of samples\n"
+            "    \"total\": xxxxx,           (numeric) sum of all samples\n"
+            "    \"avg\": xxxxx,             (numeric) mean sample\n"
+            "    \"min\": xxxxx,             (numeric) smallest sample\n"
+            "    \"max\": xxxxx,             (numeric) largest sample\n"
+            "    \"p50\": xxxxx,             (numeric) median of recent samples\n"
+            "    \"p99\": xxxxx              (numeric) 99th percentile of recent samples\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+        );
+
+    bool fReset = false;
+    if (params.size() > 0)
+        fReset = params[0].get_bool();
+
+    std::vector<std::pair<std::string, CPerfCounter*> > vCounters;
+    PerfGetCounters(vCounters);
+
+    UniValue ret(UniValue::VOBJ);
+    for (std::vector<std::pair<std::string, CPerfCounter*> >::iterator it = vCounters.begin(); it != vCounters.end(); it++) {
+        CPerfCounter* pcounter = it->second;
+        UniValue stats(UniValue::VOBJ);
+        stats.push_back(Pair("count", (int64_t)pcounter->GetCount()));
+        stats.push_back(Pair("total", pcounter->GetTotal()));
+        stats.push_back(Pair("avg", pcounter->GetAverage()));
+        stats.push_back(Pair("min", pcounter->GetMin()));
+        stats.push_back(Pair("max", pcounter->GetMax()));
+        stats.push_back(Pair("p50", pcounter->GetPercentile(50)));
+        stats.push_back(Pair("p99", pcounter->GetPercentile(99)));
+        ret.push_back(Pair(it->first, stats));
+        if (fReset)
+            pcounter->Reset();
+    }
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -998,6 +1572,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
     { "blockchain",         "getblock",               &getblock,               true  },
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
+    { "blockchain",         "getblockstats",          &getblockstats,          true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
@@ -1005,7 +1580,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "dumpchainstate",         &dumpchainstate,         true  },
+    { "blockchain",         "loadchainstate",         &loadchainstate,         true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true  },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        true  },
@@ -1,3 +1,4 @@
+#include "base58.h"
 #include "main.h"
 #include "nameclaim.h"
 #include "rpc/server.h"
@@ -9,12 +10,18 @@ const int MAX_RPC_BLOCK_DECREMENTS = 50;
 
 UniValue getclaimsintrie(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 0)
+    if (fHelp || params.size() > 2)
         throw std::runtime_error(
             "getclaimsintrie\n"
-            "Return all claims in the name trie.\n"
+            "Return claims in the name trie.\n"
             "Arguments:\n"
-            "None\n"
+            "1. \"start\"         (string, optional) resume listing at this\n"
+            "                                        name; names are returned\n"
+            "                                        in trie (lexicographic)\n"
+            "                                        order\n"
+            "2. \"count\"         (numeric, optional) return at most this\n"
+            "                                         many names; 0 or\n"
+            "                                         omitted returns all\n"
             "Result: \n"
             "[\n"
             "  {\n"
@@ -33,11 +40,20 @@ UniValue getclaimsintrie(const UniValue& params, bool fHelp)
             "]\n"
         );
     
+    std::string sStart;
+    size_t nMaxNames = std::numeric_limits<size_t>::max();
+    if (params.size() > 0)
+        sStart = params[0].get_str();
+    if (params.size() > 1 && params[1].get_int() > 0)
+        nMaxNames = params[1].get_int();
+
     LOCK(cs_main);
     UniValue ret(UniValue::VARR);
 
     CCoinsViewCache view(pcoinsTip);
-    std::vector<namedNodeType> nodes = pclaimTrie->flattenTrie();
+    // collect only the requested page instead of flattening the whole
+    // trie (and copying every node) just to walk a slice of it
+    std::vector<namedNodeType> nodes = pclaimTrie->getClaimedNames(sStart, nMaxNames);
 
     for (std::vector<namedNodeType>::iterator it = nodes.begin(); it != nodes.end(); ++it)
     {
@@ -86,6 +102,547 @@ UniValue getclaimsintrie(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getnamesbyprefix(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw std::runtime_error(
+            "getnamesbyprefix \"prefix\"\n"
+            "Return claimed names beginning with the given prefix, in trie\n"
+            "(lexicographic) order. The trie serves these queries directly,\n"
+            "so only the matching subtree is visited.\n"
+            "Arguments:\n"
+            "1. \"prefix\"        (string, required) return only names\n"
+            "                                        starting with this;\n"
+            "                                        the empty string\n"
+            "                                        matches every name\n"
+            "2. \"count\"         (numeric, optional) return at most this\n"
+            "                                         many names; 0 or\n"
+            "                                         omitted returns all\n"
+            "3. \"start\"         (string, optional) resume listing at this\n"
+            "                                        name; pass the last\n"
+            "                                        name of the previous\n"
+            "                                        page (which is\n"
+            "                                        repeated) to page\n"
+            "                                        through large results\n"
+            "Result: \n"
+            "[\n"
+            "  \"name\"           (string) a claimed name with the prefix\n"
+            "]\n"
+        );
+
+    std::string sPrefix = params[0].get_str();
+    size_t nMaxNames = std::numeric_limits<size_t>::max();
+    if (params.size() > 1 && params[1].get_int() > 0)
+        nMaxNames = params[1].get_int();
+    std::string sStart;
+    if (params.size() > 2)
+        sStart = params[2].get_str();
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VARR);
+
+    std::vector<std::string> names = pclaimTrie->getNamesByPrefix(sPrefix, sStart, nMaxNames);
+    for (std::vector<std::string>::iterator it = names.begin(); it != names.end(); ++it)
+        ret.push_back(*it);
+    return ret;
+}
+
+UniValue getpendingclaims(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getpendingclaims \"name\"\n"
+            "Return claims and supports for a name which are in the\n"
+            "activation queue but not yet in effect, along with the height\n"
+            "at which each will activate. Only the queue rows for the given\n"
+            "name are read.\n"
+            "Arguments:\n"
+            "1. \"name\"                (string) the name to look up\n"
+            "Result: \n"
+            "{\n"
+            "  \"height\"              (numeric) the current trie height\n"
+            "  \"claims\"              (array) pending claims for the name\n"
+            "  [\n"
+            "    {\n"
+            "      \"claimId\"         (string) the claimId of the claim\n"
+            "      \"txid\"            (string) the txid of the claim\n"
+            "      \"n\"               (numeric) the vout value of the claim\n"
+            "      \"amount\"          (numeric) txout amount\n"
+            "      \"height\"          (numeric) the height at which the claim was made\n"
+            "      \"valid at height\" (numeric) the height at which the claim will take effect\n"
+            "    }\n"
+            "  ]\n"
+            "  \"supports\"            (array) pending supports for the name\n"
+            "  [\n"
+            "    {\n"
+            "      \"txid\"            (string) the txid of the support\n"
+            "      \"n\"               (numeric) the vout value of the support\n"
+            "      \"supported claimId\" (string) the claimId of the supported claim\n"
+            "      \"amount\"          (numeric) txout amount\n"
+            "      \"height\"          (numeric) the height at which the support was made\n"
+            "      \"valid at height\" (numeric) the height at which the support will take effect\n"
+            "    }\n"
+            "  ]\n"
+            "}\n"
+        );
+    LOCK(cs_main);
+    std::string name = params[0].get_str();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", pclaimTrie->nCurrentHeight));
+    UniValue claimObjs(UniValue::VARR);
+    std::vector<CClaimValue> claims;
+    pclaimTrie->getPendingClaimsForName(name, claims);
+    for (std::vector<CClaimValue>::const_iterator itClaims = claims.begin(); itClaims != claims.end(); ++itClaims)
+    {
+        UniValue claim(UniValue::VOBJ);
+        claim.push_back(Pair("claimId", itClaims->claimId.GetHex()));
+        claim.push_back(Pair("txid", itClaims->outPoint.hash.GetHex()));
+        claim.push_back(Pair("n", (int)itClaims->outPoint.n));
+        claim.push_back(Pair("amount", ValueFromAmount(itClaims->nAmount)));
+        claim.push_back(Pair("height", itClaims->nHeight));
+        claim.push_back(Pair("valid at height", itClaims->nValidAtHeight));
+        claimObjs.push_back(claim);
+    }
+    ret.push_back(Pair("claims", claimObjs));
+    UniValue supportObjs(UniValue::VARR);
+    std::vector<CSupportValue> supports;
+    pclaimTrie->getPendingSupportsForName(name, supports);
+    for (std::vector<CSupportValue>::const_iterator itSupports = supports.begin(); itSupports != supports.end(); ++itSupports)
+    {
+        UniValue support(UniValue::VOBJ);
+        support.push_back(Pair("txid", itSupports->outPoint.hash.GetHex()));
+        support.push_back(Pair("n", (int)itSupports->outPoint.n));
+        support.push_back(Pair("supported claimId", itSupports->supportedClaimId.GetHex()));
+        support.push_back(Pair("amount", ValueFromAmount(itSupports->nAmount)));
+        support.push_back(Pair("height", itSupports->nHeight));
+        support.push_back(Pair("valid at height", itSupports->nValidAtHeight));
+        supportObjs.push_back(support);
+    }
+    ret.push_back(Pair("supports", supportObjs));
+    return ret;
+}
+
+UniValue getexpirationforecast(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getexpirationforecast ( blocks )\n"
+            "Return the claims and supports which will expire within the\n"
+            "given number of blocks, grouped by expiration height. The\n"
+            "expiration rows for the whole window are read in one batched\n"
+            "pass rather than one point read per height.\n"
+            "Arguments:\n"
+            "1. \"blocks\"        (numeric, optional) number of blocks to\n"
+            "                                         look ahead; defaults\n"
+            "                                         to 100\n"
+            "Result: \n"
+            "[\n"
+            "  {\n"
+            "    \"height\"       (numeric) the height at which these expire\n"
+            "    \"claims\"       (array) claims expiring at this height\n"
+            "    [\n"
+            "      {\n"
+            "        \"name\"     (string) the name the claim is for\n"
+            "        \"txid\"     (string) the txid of the claim\n"
+            "        \"n\"        (numeric) the vout value of the claim\n"
+            "      }\n"
+            "    ]\n"
+            "    \"supports\"     (array) supports expiring at this height\n"
+            "    [\n"
+            "      {\n"
+            "        \"name\"     (string) the name the support is for\n"
+            "        \"txid\"     (string) the txid of the support\n"
+            "        \"n\"        (numeric) the vout value of the support\n"
+            "      }\n"
+            "    ]\n"
+            "  }\n"
+            "]\n"
+        );
+
+    int nBlocks = 100;
+    if (params.size() > 0 && params[0].get_int() > 0)
+        nBlocks = params[0].get_int();
+
+    LOCK(cs_main);
+    int nStartHeight = pclaimTrie->nCurrentHeight;
+    expirationQueueType mapClaimExpirations;
+    expirationQueueType mapSupportExpirations;
+    pclaimTrie->getExpirationForecast(nStartHeight, nStartHeight + nBlocks, mapClaimExpirations, mapSupportExpirations);
+
+    UniValue ret(UniValue::VARR);
+    for (int i = nStartHeight; i < nStartHeight + nBlocks; ++i)
+    {
+        expirationQueueType::const_iterator itClaims = mapClaimExpirations.find(i);
+        expirationQueueType::const_iterator itSupports = mapSupportExpirations.find(i);
+        if (itClaims == mapClaimExpirations.end() && itSupports == mapSupportExpirations.end())
+            continue;
+        UniValue heightObj(UniValue::VOBJ);
+        heightObj.push_back(Pair("height", i));
+        UniValue claimObjs(UniValue::VARR);
+        if (itClaims != mapClaimExpirations.end())
+        {
+            for (expirationQueueRowType::const_iterator itRow = itClaims->second.begin(); itRow != itClaims->second.end(); ++itRow)
+            {
+                UniValue claim(UniValue::VOBJ);
+                claim.push_back(Pair("name", itRow->name));
+                claim.push_back(Pair("txid", itRow->outPoint.hash.GetHex()));
+                claim.push_back(Pair("n", (int)itRow->outPoint.n));
+                claimObjs.push_back(claim);
+            }
+        }
+        heightObj.push_back(Pair("claims", claimObjs));
+        UniValue supportObjs(UniValue::VARR);
+        if (itSupports != mapSupportExpirations.end())
+        {
+            for (expirationQueueRowType::const_iterator itRow = itSupports->second.begin(); itRow != itSupports->second.end(); ++itRow)
+            {
+                UniValue support(UniValue::VOBJ);
+                support.push_back(Pair("name", itRow->name));
+                support.push_back(Pair("txid", itRow->outPoint.hash.GetHex()));
+                support.push_back(Pair("n", (int)itRow->outPoint.n));
+                supportObjs.push_back(support);
+            }
+        }
+        heightObj.push_back(Pair("supports", supportObjs));
+        ret.push_back(heightObj);
+    }
+    return ret;
+}
+
+const char* ClaimOpName(unsigned char nOp)
+{
+    switch (nOp)
+    {
+    case CClaimOpJournalEntry::CLAIM_ADDED: return "claimadded";
+    case CClaimOpJournalEntry::CLAIM_UPDATED: return "claimupdated";
+    case CClaimOpJournalEntry::CLAIM_SPENT: return "claimspent";
+    case CClaimOpJournalEntry::CLAIM_EXPIRED: return "claimexpired";
+    case CClaimOpJournalEntry::CLAIM_ACTIVATED: return "claimactivated";
+    case CClaimOpJournalEntry::SUPPORT_ADDED: return "supportadded";
+    case CClaimOpJournalEntry::SUPPORT_SPENT: return "supportspent";
+    case CClaimOpJournalEntry::SUPPORT_EXPIRED: return "supportexpired";
+    case CClaimOpJournalEntry::SUPPORT_ACTIVATED: return "supportactivated";
+    case CClaimOpJournalEntry::NAME_TAKEOVER: return "takeover";
+    }
+    return "unknown";
+}
+
+UniValue getclaimchangesbyheight(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getclaimchangesbyheight height\n"
+            "Return the claim trie operations recorded for the block at the\n"
+            "given height. Requires the node to have been running with\n"
+            "-claimjournal when the block was connected.\n"
+            "Arguments:\n"
+            "1. \"height\"            (numeric) the block height to look up\n"
+            "Result: \n"
+            "[\n"
+            "  {\n"
+            "    \"op\"              (string) the type of operation\n"
+            "    \"name\"            (string) the name the operation is for\n"
+            "    \"txid\"            (string) the txid of the claim or support\n"
+            "    \"n\"               (numeric) the vout value of the claim or support\n"
+            "    \"claimId\"         (string) the claimId involved, if known\n"
+            "    \"amount\"          (numeric) txout amount, if known\n"
+            "    \"valid at height\" (numeric) activation height, for queue operations\n"
+            "  }\n"
+            "]\n"
+        );
+    int nHeight = params[0].get_int();
+    LOCK(cs_main);
+    UniValue ret(UniValue::VARR);
+    claimOpJournalRowType row;
+    if (!pclaimTrie->getClaimOpJournal(nHeight, row))
+        return ret;
+    for (claimOpJournalRowType::const_iterator it = row.begin(); it != row.end(); ++it)
+    {
+        UniValue op(UniValue::VOBJ);
+        op.push_back(Pair("op", ClaimOpName(it->nOp)));
+        op.push_back(Pair("name", it->name));
+        op.push_back(Pair("txid", it->outPoint.hash.GetHex()));
+        op.push_back(Pair("n", (int)it->outPoint.n));
+        if (!it->claimId.IsNull())
+            op.push_back(Pair("claimId", it->claimId.GetHex()));
+        op.push_back(Pair("amount", ValueFromAmount(it->nAmount)));
+        if (it->nValidAtHeight != 0)
+            op.push_back(Pair("valid at height", it->nValidAtHeight));
+        ret.push_back(op);
+    }
+    return ret;
+}
+
+UniValue getclaimhistory(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw std::runtime_error(
+            "getclaimhistory \"name\" ( fromheight toheight )\n"
+            "Return the recorded claim trie operations for a name, oldest\n"
+            "first. Requires the node to have been running with\n"
+            "-claimhistoryindex when the blocks were connected.\n"
+            "Arguments:\n"
+            "1. \"name\"              (string) the name to look up\n"
+            "2. \"fromheight\"        (numeric, optional) only return operations\n"
+            "                                             from this height on\n"
+            "3. \"toheight\"          (numeric, optional) only return operations\n"
+            "                                             up to this height\n"
+            "Result: \n"
+            "[\n"
+            "  {\n"
+            "    \"height\"          (numeric) the height of the operation\n"
+            "    \"op\"              (string) the type of operation\n"
+            "    \"txid\"            (string) the txid of the claim or support\n"
+            "    \"n\"               (numeric) the vout value of the claim or support\n"
+            "    \"claimId\"         (string) the claimId involved, if known\n"
+            "    \"amount\"          (numeric) txout amount, if known\n"
+            "  }\n"
+            "]\n"
+        );
+    std::string name = params[0].get_str();
+    int nFromHeight = 0;
+    if (params.size() > 1)
+        nFromHeight = params[1].get_int();
+    int nToHeight = std::numeric_limits<int>::max();
+    if (params.size() > 2)
+        nToHeight = params[2].get_int();
+
+    if (!fClaimHistoryIndex)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Claim history index is not enabled (-claimhistoryindex)");
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VARR);
+    claimHistoryRowType row;
+    if (!pclaimTrie->getClaimHistory(name, row))
+        return ret;
+    for (claimHistoryRowType::const_iterator it = row.begin(); it != row.end(); ++it)
+    {
+        if (it->nHeight < nFromHeight || it->nHeight > nToHeight)
+            continue;
+        UniValue op(UniValue::VOBJ);
+        op.push_back(Pair("height", it->nHeight));
+        op.push_back(Pair("op", ClaimOpName(it->nOp)));
+        op.push_back(Pair("txid", it->outPoint.hash.GetHex()));
+        op.push_back(Pair("n", (int)it->outPoint.n));
+        if (!it->claimId.IsNull())
+            op.push_back(Pair("claimId", it->claimId.GetHex()));
+        op.push_back(Pair("amount", ValueFromAmount(it->nAmount)));
+        ret.push_back(op);
+    }
+    return ret;
+}
+
+UniValue getclaimsbyaddress(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getclaimsbyaddress \"address\"\n"
+            "Return the claims whose unspent outputs pay to the given\n"
+            "address. Requires the node to have been running with\n"
+            "-claimaddressindex when the blocks were connected. Claims\n"
+            "that expired without being spent are included; \"active\"\n"
+            "reports whether the claim is still in the trie or its queue.\n"
+            "Arguments:\n"
+            "1. \"address\"           (string) the address to look up\n"
+            "Result: \n"
+            "[\n"
+            "  {\n"
+            "    \"claimId\"         (string) the claimId of the claim\n"
+            "    \"name\"            (string) the name the claim is for, if active\n"
+            "    \"txid\"            (string) the txid of the claim, if active\n"
+            "    \"n\"               (numeric) the vout value of the claim, if active\n"
+            "    \"amount\"          (numeric) txout amount, if active\n"
+            "    \"height\"          (numeric) the height of the claim, if active\n"
+            "    \"active\"          (boolean) whether the claim is in the trie or its queue\n"
+            "  }\n"
+            "]\n"
+        );
+    if (!fClaimAddressIndex)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Claim address index is not enabled (-claimaddressindex)");
+
+    CBitcoinAddress address(params[0].get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    CScript script = GetScriptForDestination(address.Get());
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VARR);
+    std::vector<uint160> claimIds;
+    if (!pclaimTrie->getClaimsForScriptHash(Hash160(script), claimIds))
+        return ret;
+    for (std::vector<uint160>::const_iterator it = claimIds.begin(); it != claimIds.end(); ++it)
+    {
+        UniValue claimObj(UniValue::VOBJ);
+        claimObj.push_back(Pair("claimId", it->GetHex()));
+        std::string name;
+        CClaimValue claim;
+        if (pclaimTrie->getClaimById(*it, name, claim))
+        {
+            claimObj.push_back(Pair("name", name));
+            claimObj.push_back(Pair("txid", claim.outPoint.hash.GetHex()));
+            claimObj.push_back(Pair("n", (int)claim.outPoint.n));
+            claimObj.push_back(Pair("amount", ValueFromAmount(claim.nAmount)));
+            claimObj.push_back(Pair("height", claim.nHeight));
+            claimObj.push_back(Pair("active", true));
+        }
+        else
+            claimObj.push_back(Pair("active", false));
+        ret.push_back(claimObj);
+    }
+    return ret;
+}
+
+UniValue simulateclaim(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw std::runtime_error(
+            "simulateclaim \"name\" [{\"claim\":amount},{\"support\":\"claimid\",\"amount\":amount},...] ( blocks )\n"
+            "Apply hypothetical claim and support operations for a name to a\n"
+            "throwaway overlay of the claim trie, advance the overlay until\n"
+            "they activate, and report the resulting winner and activation\n"
+            "schedule. Nothing is written; the real trie is unchanged.\n"
+            "Arguments:\n"
+            "1. \"name\"              (string) the name to simulate operations on\n"
+            "2. \"operations\"        (array) hypothetical operations\n"
+            "   [\n"
+            "     {\n"
+            "       \"claim\": n      (numeric) add a new claim with this amount in COIN, or\n"
+            "       \"support\": \"id\" (string) support the claim with this claimId\n"
+            "       \"amount\": n     (numeric) amount in COIN, required with \"support\"\n"
+            "     }\n"
+            "   ]\n"
+            "3. \"blocks\"            (numeric, optional) simulate at most this many\n"
+            "                                             blocks (default 10000)\n"
+            "Result: \n"
+            "{\n"
+            "  \"height\"             (numeric) the height the simulation started from\n"
+            "  \"blocks simulated\"   (numeric) blocks advanced in the overlay\n"
+            "  \"winner before\"      (object) the winning claim before the operations, if any\n"
+            "  \"winner after\"       (object) the winning claim after activation, if any\n"
+            "  \"takeover\"           (boolean) whether the winner changed\n"
+            "  \"activations\"        (array) the height at which each operation takes effect\n"
+            "  [\n"
+            "    {\n"
+            "      \"txid\"           (string) the synthetic txid of the operation\n"
+            "      \"n\"              (numeric) the synthetic vout of the operation\n"
+            "      \"valid at height\" (numeric) the height at which it takes effect\n"
+            "    }\n"
+            "  ]\n"
+            "}\n"
+        );
+
+    std::string name = params[0].get_str();
+    UniValue ops = params[1].get_array();
+    if (ops.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No operations given");
+    int nMaxBlocks = 10000;
+    if (params.size() > 2 && params[2].get_int() > 0)
+        nMaxBlocks = params[2].get_int();
+
+    LOCK(cs_main);
+    int nStartHeight = pclaimTrie->nCurrentHeight;
+
+    CClaimValue winnerBefore;
+    bool fHadWinner = pclaimTrie->getInfoForName(name, winnerBefore);
+
+    CClaimTrieCache trieCache(pclaimTrie);
+    std::set<COutPoint> pendingOutPoints;
+    for (size_t i = 0; i < ops.size(); ++i)
+    {
+        const UniValue& op = ops[i];
+        // synthetic txid so the hypothetical outputs cannot collide with
+        // real ones or each other
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << name << (uint32_t)i;
+        COutPoint outPoint(ss.GetHash(), i);
+        const UniValue& claimAmount = find_value(op, "claim");
+        const UniValue& supportId = find_value(op, "support");
+        if (!claimAmount.isNull())
+        {
+            CAmount nAmount = AmountFromValue(claimAmount);
+            if (!trieCache.addClaim(name, outPoint, ClaimIdHash(outPoint.hash, outPoint.n), nAmount, nStartHeight))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to apply hypothetical claim");
+        }
+        else if (!supportId.isNull())
+        {
+            uint160 supportedClaimId;
+            supportedClaimId.SetHex(supportId.get_str());
+            CAmount nAmount = AmountFromValue(find_value(op, "amount"));
+            if (!trieCache.addSupport(name, outPoint, nAmount, supportedClaimId, nStartHeight))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to apply hypothetical support");
+        }
+        else
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Each operation needs a \"claim\" or \"support\" key");
+        pendingOutPoints.insert(outPoint);
+    }
+
+    UniValue activations(UniValue::VARR);
+    int nBlocksSimulated = 0;
+    while (!pendingOutPoints.empty() && nBlocksSimulated < nMaxBlocks)
+    {
+        insertUndoType insertUndo;
+        claimQueueRowType expireUndo;
+        insertUndoType insertSupportUndo;
+        supportQueueRowType expireSupportUndo;
+        std::vector<std::pair<std::string, int> > takeoverHeightUndo;
+        if (!trieCache.incrementBlock(insertUndo, expireUndo, insertSupportUndo, expireSupportUndo, takeoverHeightUndo))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to advance the overlay");
+        ++nBlocksSimulated;
+        for (insertUndoType::const_iterator it = insertUndo.begin(); it != insertUndo.end(); ++it)
+        {
+            if (it->name == name && pendingOutPoints.erase(it->outPoint))
+            {
+                UniValue activation(UniValue::VOBJ);
+                activation.push_back(Pair("txid", it->outPoint.hash.GetHex()));
+                activation.push_back(Pair("n", (int)it->outPoint.n));
+                activation.push_back(Pair("valid at height", nStartHeight + nBlocksSimulated));
+                activations.push_back(activation);
+            }
+        }
+        for (insertUndoType::const_iterator it = insertSupportUndo.begin(); it != insertSupportUndo.end(); ++it)
+        {
+            if (it->name == name && pendingOutPoints.erase(it->outPoint))
+            {
+                UniValue activation(UniValue::VOBJ);
+                activation.push_back(Pair("txid", it->outPoint.hash.GetHex()));
+                activation.push_back(Pair("n", (int)it->outPoint.n));
+                activation.push_back(Pair("valid at height", nStartHeight + nBlocksSimulated));
+                activations.push_back(activation);
+            }
+        }
+    }
+
+    CClaimValue winnerAfter;
+    bool fHasWinner = trieCache.getInfoForName(name, winnerAfter);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", nStartHeight));
+    ret.push_back(Pair("blocks simulated", nBlocksSimulated));
+    if (fHadWinner)
+    {
+        UniValue winner(UniValue::VOBJ);
+        winner.push_back(Pair("claimId", winnerBefore.claimId.GetHex()));
+        winner.push_back(Pair("txid", winnerBefore.outPoint.hash.GetHex()));
+        winner.push_back(Pair("n", (int)winnerBefore.outPoint.n));
+        winner.push_back(Pair("amount", ValueFromAmount(winnerBefore.nAmount)));
+        winner.push_back(Pair("effective amount", ValueFromAmount(winnerBefore.nEffectiveAmount)));
+        ret.push_back(Pair("winner before", winner));
+    }
+    if (fHasWinner)
+    {
+        UniValue winner(UniValue::VOBJ);
+        winner.push_back(Pair("claimId", winnerAfter.claimId.GetHex()));
+        winner.push_back(Pair("txid", winnerAfter.outPoint.hash.GetHex()));
+        winner.push_back(Pair("n", (int)winnerAfter.outPoint.n));
+        winner.push_back(Pair("amount", ValueFromAmount(winnerAfter.nAmount)));
+        winner.push_back(Pair("effective amount", ValueFromAmount(winnerAfter.nEffectiveAmount)));
+        ret.push_back(Pair("winner after", winner));
+    }
+    ret.push_back(Pair("takeover", !(fHadWinner && fHasWinner && winnerBefore.claimId == winnerAfter.claimId)));
+    ret.push_back(Pair("activations", activations));
+    return ret;
+}
+
 UniValue getclaimtrie(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 0)
@@ -305,10 +862,47 @@ UniValue getclaimsforname(const UniValue& params, bool fHelp)
             "}\n"   
         );
 
-    LOCK(cs_main);
+    // hot names are asked for repeatedly between blocks, so the composed
+    // result is cached per (tip hash, name); a new tip changes the key,
+    // which invalidates every entry without tracking touched names
+    static std::map<std::pair<uint256, std::string>, claimsForNameType> claimsForNameCache;
+    static const size_t MAX_CLAIMS_FOR_NAME_CACHE_SIZE = 1000;
+    static CCriticalSection cs_claimsForNameCache;
+
     std::string name = params[0].get_str();
-    claimsForNameType claimsForName = pclaimTrie->getClaimsForName(name);
-    int nCurrentHeight = chainActive.Height();
+    uint256 hashTip;
+    int nCurrentHeight;
+    {
+        LOCK(cs_main);
+        hashTip = chainActive.Tip() != NULL ? chainActive.Tip()->GetBlockHash() : uint256();
+        nCurrentHeight = chainActive.Height();
+    }
+    claimsForNameType claimsForName(std::vector<CClaimValue>(), std::vector<CSupportValue>(), 0);
+    bool fCached = false;
+    {
+        LOCK(cs_claimsForNameCache);
+        std::map<std::pair<uint256, std::string>, claimsForNameType>::const_iterator itCache = claimsForNameCache.find(std::make_pair(hashTip, name));
+        if (itCache != claimsForNameCache.end())
+        {
+            claimsForName = itCache->second;
+            fCached = true;
+        }
+    }
+    if (!fCached)
+    {
+        LOCK(cs_main);
+        // the tip may have moved since it was first read; key the entry by
+        // the tip the result was actually computed against
+        hashTip = chainActive.Tip() != NULL ? chainActive.Tip()->GetBlockHash() : uint256();
+        nCurrentHeight = chainActive.Height();
+        claimsForName = pclaimTrie->getClaimsForName(name);
+        {
+            LOCK(cs_claimsForNameCache);
+            if (claimsForNameCache.size() >= MAX_CLAIMS_FOR_NAME_CACHE_SIZE)
+                claimsForNameCache.clear();
+            claimsForNameCache.insert(std::make_pair(std::make_pair(hashTip, name), claimsForName));
+        }
+    }
 
     claimSupportMapType claimSupportMap;
     supportsWithoutClaimsMapType supportsWithoutClaims;
@@ -742,10 +1336,160 @@ UniValue getnameproof(const UniValue& params, bool fHelp)
     return proofToJSON(proof);
 }
 
+UniValue getnameproofs(const UniValue& params, bool fHelp)
+{
+    if (fHelp || (params.size() != 1 && params.size() != 2))
+        throw std::runtime_error(
+            "getnameproofs\n"
+            "Return cryptographic proofs for a batch of names, with path\n"
+            "nodes shared between consecutive names given only once.\n"
+            "The names are sorted and deduplicated before proofs are\n"
+            "generated, so that names with a common prefix (e.g. a channel\n"
+            "and its claims) are adjacent and share the most nodes. Each\n"
+            "proof after the first omits its leading \"shared nodes\" nodes;\n"
+            "to reconstruct it, prepend that many nodes from the previous\n"
+            "(reconstructed) proof.\n"
+            "Arguments:\n"
+            "1. \"names\"          (array of string) the names to get proofs for\n"
+            "2. \"blockhash\"      (string, optional) the hash of the block\n"
+            "                                            which is the basis\n"
+            "                                            of the proofs. If\n"
+            "                                            none is given, \n"
+            "                                            the latest block\n"
+            "                                            will be used.\n"
+            "Result: \n"
+            "[\n"
+            "  {\n"
+            "    \"name\"          (string) the name this proof is for\n"
+            "    \"shared nodes\"  (numeric) how many leading nodes to take\n"
+            "                                from the previous proof\n"
+            "    \"proof\"         (object) the rest of the proof, in the\n"
+            "                               same format as getnameproof\n"
+            "  }, ...\n"
+            "]\n");
+
+    LOCK(cs_main);
+    UniValue nameParams = params[0].get_array();
+    std::vector<std::string> vNames;
+    for (size_t i = 0; i < nameParams.size(); i++)
+    {
+        vNames.push_back(nameParams[i].get_str());
+    }
+    if (vNames.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "No names given");
+    std::sort(vNames.begin(), vNames.end());
+    vNames.erase(std::unique(vNames.begin(), vNames.end()), vNames.end());
+
+    uint256 blockHash;
+    if (params.size() == 2)
+    {
+        std::string strBlockHash = params[1].get_str();
+        blockHash = uint256S(strBlockHash);
+    }
+    else
+    {
+        blockHash = chainActive.Tip()->GetBlockHash();
+    }
+
+    if (mapBlockIndex.count(blockHash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockIndex = mapBlockIndex[blockHash];
+    if (!chainActive.Contains(pblockIndex))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not in main chain");
+
+    if (chainActive.Tip()->nHeight > (pblockIndex->nHeight + MAX_RPC_BLOCK_DECREMENTS))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block too deep to generate proof");
+
+    std::vector<CClaimTrieProof> proofs;
+    if (!GetProofsForNames(pblockIndex, vNames, proofs))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to generate proofs");
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < vNames.size(); i++)
+    {
+        // proof nodes at depths shallower than the common prefix of two
+        // consecutive sorted names are identical; the node where the
+        // paths diverge differs and must be given in full
+        size_t nShared = 0;
+        if (i > 0)
+        {
+            const std::string& prev = vNames[i - 1];
+            const std::string& cur = vNames[i];
+            size_t nPrefix = 0;
+            while (nPrefix < prev.size() && nPrefix < cur.size() && prev[nPrefix] == cur[nPrefix])
+                nPrefix++;
+            nShared = std::min(nPrefix, std::min(proofs[i - 1].nodes.size(), proofs[i].nodes.size()));
+        }
+        CClaimTrieProof tailProof(std::vector<CClaimTrieProofNode>(proofs[i].nodes.begin() + nShared, proofs[i].nodes.end()),
+                                  proofs[i].hasValue, proofs[i].outPoint,
+                                  proofs[i].nHeightOfLastTakeover);
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", vNames[i]));
+        entry.push_back(Pair("shared nodes", (int)nShared));
+        entry.push_back(Pair("proof", proofToJSON(tailProof)));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+UniValue gettrieinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "gettrieinfo\n"
+            "Return statistics and performance counters for the claim trie\n"
+            "Arguments:\n"
+            "None\n"
+            "Result: \n"
+            "\"nodes\"             (numeric) total number of nodes in the trie\n"
+            "\"nodeswithclaims\"   (numeric) number of nodes holding at least one claim\n"
+            "\"maxdepth\"          (numeric) length of the longest name in the trie\n"
+            "\"memoryusage\"       (numeric) dynamic memory used by the trie, in bytes\n"
+            "\"height\"            (numeric) the height the trie is synced to\n"
+            "\"roothash\"          (string) the legacy (consensus) claim trie root hash\n"
+            "\"compactroothash\"   (string) the compact commitment root, present once the\n"
+            "                      dual-computation fork window is open\n"
+            "\"hashescomputed\"    (numeric) node hashes computed since startup\n"
+            "\"blocksincremented\" (numeric) blocks applied to the trie since startup\n"
+            "\"lastdirtynodes\"    (numeric) cached nodes dirtied by the last block\n"
+            "\"lastflushrows\"     (numeric) rows written by the last flush\n"
+            "\"flushes\"           (numeric) flushes to disk since startup\n"
+        );
+
+    LOCK(cs_main);
+    uint64_t nNodes;
+    uint64_t nNodesWithClaims;
+    uint32_t nMaxDepth;
+    pclaimTrie->getNodeStats(nNodes, nNodesWithClaims, nMaxDepth);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("nodes", (int64_t)nNodes));
+    ret.push_back(Pair("nodeswithclaims", (int64_t)nNodesWithClaims));
+    ret.push_back(Pair("maxdepth", (int64_t)nMaxDepth));
+    ret.push_back(Pair("memoryusage", (int64_t)pclaimTrie->DynamicMemoryUsage()));
+    ret.push_back(Pair("height", pclaimTrie->nCurrentHeight - 1));
+    ret.push_back(Pair("roothash", pclaimTrie->getMerkleHash().GetHex()));
+    if (pclaimTrie->nCurrentHeight >= Params().GetConsensus().nClaimTrieCompactHashForkHeight)
+        ret.push_back(Pair("compactroothash", pclaimTrie->getMerkleHashCompact().GetHex()));
+    ret.push_back(Pair("hashescomputed", claimTrieStats.nHashesComputed));
+    ret.push_back(Pair("blocksincremented", claimTrieStats.nBlocksIncremented));
+    ret.push_back(Pair("lastdirtynodes", claimTrieStats.nLastDirtyNodes));
+    ret.push_back(Pair("lastflushrows", claimTrieStats.nLastFlushRows));
+    ret.push_back(Pair("flushes", claimTrieStats.nFlushes));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                           actor (function)        okSafeMode
   //  --------------------- ------------------------     -----------------------  ----------
     { "Claimtrie",             "getclaimsintrie",         &getclaimsintrie,         true  },
+    { "Claimtrie",             "getnamesbyprefix",        &getnamesbyprefix,        true  },
+    { "Claimtrie",             "getpendingclaims",        &getpendingclaims,        true  },
+    { "Claimtrie",             "getexpirationforecast",   &getexpirationforecast,   true  },
+    { "Claimtrie",             "getclaimchangesbyheight", &getclaimchangesbyheight, true  },
+    { "Claimtrie",             "simulateclaim",           &simulateclaim,           true  },
+    { "Claimtrie",             "getclaimhistory",         &getclaimhistory,         true  },
+    { "Claimtrie",             "getclaimsbyaddress",      &getclaimsbyaddress,      true  },
     { "Claimtrie",             "getclaimtrie",            &getclaimtrie,            true  },
     { "Claimtrie",             "getvalueforname",         &getvalueforname,         true  },
     { "Claimtrie",             "getclaimsforname",        &getclaimsforname,        true  },
@@ -754,7 +1498,9 @@ static const CRPCCommand commands[] =
     { "Claimtrie",             "gettotalvalueofclaims",   &gettotalvalueofclaims,   true  },
     { "Claimtrie",             "getclaimsfortx",          &getclaimsfortx,          true  },
     { "Claimtrie",             "getnameproof",            &getnameproof,            true  },
+    { "Claimtrie",             "getnameproofs",           &getnameproofs,           true  },
     { "Claimtrie",             "getclaimbyid",            &getclaimbyid,            true  },
+    { "Claimtrie",             "gettrieinfo",             &gettrieinfo,             true  },
 };
 
 void RegisterClaimTrieRPCCommands(CRPCTable &tableRPC)
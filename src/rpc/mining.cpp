@@ -408,7 +408,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             "       \"capabilities\":[       (array, optional) A list of strings\n"
             "           \"support\"           (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'\n"
             "           ,...\n"
-            "         ]\n"
+            "         ],\n"
+            "       \"templateid\":n         (numeric, optional) templateid from a prior response; if it still matches the previous template, only the transaction delta is returned\n"
             "     }\n"
             "\n"
 
@@ -458,6 +459,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
+    int64_t nClientTemplateId = 0;
     if (params.size() > 0)
     {
         const UniValue& oparam = params[0].get_obj();
@@ -471,6 +473,9 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
         lpval = find_value(oparam, "longpollid");
+        const UniValue& tidval = find_value(oparam, "templateid");
+        if (tidval.isNum())
+            nClientTemplateId = tidval.get_int64();
 
         if (strMode == "proposal")
         {
@@ -564,6 +569,16 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
+    // The serialized template transactions are cached alongside the template
+    // itself, so several pool connections polling the same template share one
+    // hex encoding pass. The previous template's txid set is kept so a client
+    // still holding its templateid can be sent just the delta.
+    static int64_t nTemplateId = 0;
+    static UniValue transactionsCached(UniValue::VARR);
+    static std::map<uint256, UniValue> mapTemplateEntries;
+    static int64_t nPrevTemplateId = 0;
+    static std::set<uint256> setPrevTemplateTxids;
+    static uint256 hashPrevTemplateChain;
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
@@ -588,45 +603,56 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
-    }
-    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
-    // Update nTime
-    UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
-    pblock->nNonce = 0;
+        // Roll the old template into the "previous" slot for delta clients,
+        // then serialize the new one once.
+        nPrevTemplateId = nTemplateId;
+        hashPrevTemplateChain = pblocktemplate->block.hashPrevBlock;
+        setPrevTemplateTxids.clear();
+        for (std::map<uint256, UniValue>::const_iterator it = mapTemplateEntries.begin(); it != mapTemplateEntries.end(); ++it)
+            setPrevTemplateTxids.insert(it->first);
+        nTemplateId++;
+        mapTemplateEntries.clear();
+        transactionsCached = UniValue(UniValue::VARR);
 
-    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
+        map<uint256, int64_t> setTxIndex;
+        int i = 0;
+        BOOST_FOREACH (const CTransaction& tx, pblocktemplate->block.vtx) {
+            uint256 txHash = tx.GetHash();
+            setTxIndex[txHash] = i++;
 
-    UniValue transactions(UniValue::VARR);
-    map<uint256, int64_t> setTxIndex;
-    int i = 0;
-    BOOST_FOREACH (const CTransaction& tx, pblock->vtx) {
-        uint256 txHash = tx.GetHash();
-        setTxIndex[txHash] = i++;
+            if (tx.IsCoinBase())
+                continue;
 
-        if (tx.IsCoinBase())
-            continue;
+            UniValue entry(UniValue::VOBJ);
+
+            entry.push_back(Pair("data", EncodeHexTx(tx)));
 
-        UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("hash", txHash.GetHex()));
 
-        entry.push_back(Pair("data", EncodeHexTx(tx)));
+            UniValue deps(UniValue::VARR);
+            BOOST_FOREACH (const CTxIn &in, tx.vin)
+            {
+                if (setTxIndex.count(in.prevout.hash))
+                    deps.push_back(setTxIndex[in.prevout.hash]);
+            }
+            entry.push_back(Pair("depends", deps));
 
-        entry.push_back(Pair("hash", txHash.GetHex()));
+            int index_in_template = i - 1;
+            entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
+            entry.push_back(Pair("sigops", pblocktemplate->vTxSigOps[index_in_template]));
 
-        UniValue deps(UniValue::VARR);
-        BOOST_FOREACH (const CTxIn &in, tx.vin)
-        {
-            if (setTxIndex.count(in.prevout.hash))
-                deps.push_back(setTxIndex[in.prevout.hash]);
+            transactionsCached.push_back(entry);
+            mapTemplateEntries[txHash] = entry;
         }
-        entry.push_back(Pair("depends", deps));
+    }
+    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
-        int index_in_template = i - 1;
-        entry.push_back(Pair("fee", pblocktemplate->vTxFees[index_in_template]));
-        entry.push_back(Pair("sigops", pblocktemplate->vTxSigOps[index_in_template]));
+    // Update nTime
+    UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
+    pblock->nNonce = 0;
 
-        transactions.push_back(entry);
-    }
+    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
     UniValue aux(UniValue::VOBJ);
     aux.push_back(Pair("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end())));
@@ -645,10 +671,35 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     result.push_back(Pair("capabilities", aCaps));
     result.push_back(Pair("version", pblock->nVersion));
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
+    // A client holding the previous template on the same chain tip gets only
+    // the transactions that came and went, plus the refreshed claimtrie root
+    // commitment below; everyone else gets the cached full list.
+    if (nClientTemplateId != 0 && nClientTemplateId == nPrevTemplateId &&
+        hashPrevTemplateChain == pblock->hashPrevBlock)
+    {
+        UniValue added(UniValue::VARR);
+        UniValue removed(UniValue::VARR);
+        for (std::map<uint256, UniValue>::const_iterator it = mapTemplateEntries.begin(); it != mapTemplateEntries.end(); ++it)
+            if (!setPrevTemplateTxids.count(it->first))
+                added.push_back(it->second);
+        BOOST_FOREACH (const uint256& txid, setPrevTemplateTxids)
+            if (!mapTemplateEntries.count(txid))
+                removed.push_back(txid.GetHex());
+        result.push_back(Pair("transactionsadded", added));
+        result.push_back(Pair("transactionsremoved", removed));
+    }
+    else if (nClientTemplateId != 0 && nClientTemplateId == nTemplateId)
+    {
+        // Nothing changed since the client's template.
+        result.push_back(Pair("transactionsadded", UniValue(UniValue::VARR)));
+        result.push_back(Pair("transactionsremoved", UniValue(UniValue::VARR)));
+    }
+    else
+        result.push_back(Pair("transactions", transactionsCached));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("templateid", nTemplateId));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
     result.push_back(Pair("mutable", aMutable));
@@ -773,6 +824,39 @@ UniValue estimatefee(const UniValue& params, bool fHelp)
     return ValueFromAmount(feeRate.GetFeePerK());
 }
 
+UniValue estimateclaimfee(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "estimateclaimfee nblocks\n"
+            "\nEstimates the approximate fee per kilobyte needed for a transaction containing\n"
+            "a claim script to begin confirmation within nblocks blocks. Claim-bearing\n"
+            "transactions are tracked separately because the per-character name claim fee\n"
+            "dominates their fee dynamics.\n"
+            "\nArguments:\n"
+            "1. nblocks     (numeric)\n"
+            "\nResult:\n"
+            "n              (numeric) estimated fee-per-kilobyte\n"
+            "\n"
+            "A negative value is returned if not enough transactions and blocks\n"
+            "have been observed to make an estimate.\n"
+            "\nExample:\n"
+            + HelpExampleCli("estimateclaimfee", "6")
+            );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VNUM));
+
+    int nBlocks = params[0].get_int();
+    if (nBlocks < 1)
+        nBlocks = 1;
+
+    CFeeRate feeRate = mempool.estimateClaimFee(nBlocks);
+    if (feeRate == CFeeRate(0))
+        return -1.0;
+
+    return ValueFromAmount(feeRate.GetFeePerK());
+}
+
 UniValue estimatepriority(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -888,6 +972,7 @@ static const CRPCCommand commands[] =
     { "generating",         "generatetoaddress",      &generatetoaddress,      true  },
 
     { "util",               "estimatefee",            &estimatefee,            true  },
+    { "util",               "estimateclaimfee",       &estimateclaimfee,       true  },
     { "util",               "estimatepriority",       &estimatepriority,       true  },
     { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
     { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
@@ -5,12 +5,16 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "dbwrapper.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
+#include "perf.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "timedata.h"
+#include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #ifdef ENABLE_WALLET
@@ -19,6 +23,9 @@
 #endif
 
 #include <stdint.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #include <boost/assign/list_of.hpp>
 
@@ -397,10 +404,381 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue getperfstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getperfstats\n"
+            "\nReturns the process-wide performance counters: event counters\n"
+            "(monotonically increasing totals), gauges (current values computed\n"
+            "at scrape time) and timing summaries from the validation\n"
+            "instrumentation. Reading them costs microseconds and takes no\n"
+            "chain locks, so this is safe to scrape frequently. The same data\n"
+            "is served in Prometheus text format at the /metrics REST endpoint.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"counters\": {              (object) event totals since startup\n"
+            "    \"net.msgs.recv\": n, ...\n"
+            "  },\n"
+            "  \"gauges\": {                (object) current values\n"
+            "    \"mempool.size\": n, ...\n"
+            "  },\n"
+            "  \"timings\": {               (object) duration summaries in microseconds\n"
+            "    \"connectblock.connect\": { \"count\": n, \"total\": n, \"avg\": n, \"p50\": n, \"p99\": n }, ...\n"
+            "  },\n"
+            "  \"startup\": {               (object) startup phase durations in milliseconds\n"
+            "    \"block-index\": n, \"claim-trie\": n, ...\n"
+            "  },\n"
+            "  \"numa\": {                  (object) NUMA topology and the node bound via -numanode\n"
+            "    \"nodes\": n, \"bound_node\": n, \"cpus\": {\"node0\": \"0-7\", ...}\n"
+            "  },\n"
+            "  \"leveldb\": {               (object) internals of each open database\n"
+            "    \"chainstate\": {\n"
+            "      \"files\": [n, ...],     (array) table files per level; level-0 backlog means compaction pressure\n"
+            "      \"stats\": \"...\"         (string) leveldb's per-level size and compaction table\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getperfstats", "")
+            + HelpExampleRpc("getperfstats", "")
+        );
+
+    UniValue counters(UniValue::VOBJ);
+    std::vector<std::pair<std::string, CStatCounter*> > vCounters;
+    StatGetCounters(vCounters);
+    for (std::vector<std::pair<std::string, CStatCounter*> >::iterator it = vCounters.begin(); it != vCounters.end(); it++)
+        counters.push_back(Pair(it->first, it->second->Get()));
+
+    UniValue gauges(UniValue::VOBJ);
+    std::vector<std::pair<std::string, int64_t> > vGauges;
+    StatGetGauges(vGauges);
+    for (std::vector<std::pair<std::string, int64_t> >::iterator it = vGauges.begin(); it != vGauges.end(); it++)
+        gauges.push_back(Pair(it->first, it->second));
+
+    UniValue timings(UniValue::VOBJ);
+    std::vector<std::pair<std::string, CPerfCounter*> > vTimers;
+    PerfGetCounters(vTimers);
+    for (std::vector<std::pair<std::string, CPerfCounter*> >::iterator it = vTimers.begin(); it != vTimers.end(); it++) {
+        CPerfCounter* pcounter = it->second;
+        UniValue stats(UniValue::VOBJ);
+        stats.push_back(Pair("count", (int64_t)pcounter->GetCount()));
+        stats.push_back(Pair("total", pcounter->GetTotal()));
+        stats.push_back(Pair("avg", pcounter->GetAverage()));
+        stats.push_back(Pair("p50", pcounter->GetPercentile(50)));
+        stats.push_back(Pair("p99", pcounter->GetPercentile(99)));
+        timings.push_back(Pair(it->first, stats));
+    }
+
+    UniValue leveldb(UniValue::VOBJ);
+    std::vector<CDBStats> vDBStats;
+    GetDBWrapperStats(vDBStats);
+    for (std::vector<CDBStats>::iterator it = vDBStats.begin(); it != vDBStats.end(); it++) {
+        UniValue db(UniValue::VOBJ);
+        UniValue files(UniValue::VARR);
+        for (size_t nLevel = 0; nLevel < it->vFilesPerLevel.size(); nLevel++)
+            files.push_back(it->vFilesPerLevel[nLevel]);
+        db.push_back(Pair("files", files));
+        db.push_back(Pair("stats", it->strStats));
+        leveldb.push_back(Pair(it->name, db));
+    }
+
+    UniValue startup(UniValue::VOBJ);
+    std::vector<std::pair<std::string, int64_t> > vPhases;
+    GetStartupPhases(vPhases);
+    for (std::vector<std::pair<std::string, int64_t> >::iterator it = vPhases.begin(); it != vPhases.end(); it++)
+        startup.push_back(Pair(it->first, it->second));
+
+    UniValue numa(UniValue::VOBJ);
+    int nNumaNodes = GetNumaNodeCount();
+    numa.push_back(Pair("nodes", nNumaNodes));
+    numa.push_back(Pair("bound_node", GetArg("-numanode", -1)));
+    UniValue cpus(UniValue::VOBJ);
+    for (int nNode = 0; nNode < nNumaNodes; nNode++)
+        cpus.push_back(Pair(strprintf("node%d", nNode), GetNumaNodeCpuList(nNode)));
+    numa.push_back(Pair("cpus", cpus));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("counters", counters));
+    ret.push_back(Pair("gauges", gauges));
+    ret.push_back(Pair("timings", timings));
+    ret.push_back(Pair("startup", startup));
+    ret.push_back(Pair("leveldb", leveldb));
+    ret.push_back(Pair("numa", numa));
+    return ret;
+}
+
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "Returns dynamic memory usage per subsystem, in bytes.\n"
+            "When the node's resident size grows unexpectedly, these show\n"
+            "which cache is responsible.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins\": xxxxx,           (numeric) coins cache (-dbcache)\n"
+            "  \"claimtrie\": xxxxx,       (numeric) in-memory claim trie\n"
+            "  \"mempool\": xxxxx,         (numeric) transaction memory pool\n"
+            "  \"orphanpool\": xxxxx,      (numeric) orphan transactions and their indexes\n"
+            "  \"sigcache\": xxxxx,        (numeric) signature verification cache\n"
+            "  \"net\": xxxxx,             (numeric) bytes queued in peer send/receive buffers\n"
+            "  \"wallet\": xxxxx,          (numeric) wallet state, if a wallet is loaded\n"
+            "  \"malloc\": {               (object) allocator statistics (glibc only)\n"
+            "    \"arena\": xxxxx,         (numeric) non-mmapped bytes obtained from the system\n"
+            "    \"mmapped\": xxxxx,       (numeric) bytes in mmapped regions\n"
+            "    \"used\": xxxxx,          (numeric) allocated bytes in use\n"
+            "    \"free\": xxxxx,          (numeric) free bytes within the arenas\n"
+            "    \"keepcost\": xxxxx       (numeric) releasable top-of-heap bytes\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleRpc("getmemoryinfo", "")
+        );
+
+    UniValue obj(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        obj.push_back(Pair("coins", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+        obj.push_back(Pair("claimtrie", (int64_t)pclaimTrie->DynamicMemoryUsage()));
+    }
+    obj.push_back(Pair("mempool", (int64_t)mempool.DynamicMemoryUsage()));
+    obj.push_back(Pair("orphanpool", (int64_t)GetOrphanPoolMemoryUsage()));
+    obj.push_back(Pair("sigcache", (int64_t)SignatureCacheMemoryUsage()));
+    obj.push_back(Pair("net", (int64_t)GetNetMemoryUsage()));
+#ifdef ENABLE_WALLET
+    if (pwalletMain)
+        obj.push_back(Pair("wallet", (int64_t)pwalletMain->DynamicMemoryUsage()));
+#endif
+#if defined(__GLIBC__)
+    UniValue malloced(UniValue::VOBJ);
+#if __GLIBC_PREREQ(2, 33)
+    // glibc 2.33 added mallinfo2 with size_t fields and deprecated
+    // mallinfo, whose int fields wrap past 2 GiB.
+    struct mallinfo2 mi = mallinfo2();
+    malloced.push_back(Pair("arena", (int64_t)mi.arena));
+    malloced.push_back(Pair("mmapped", (int64_t)mi.hblkhd));
+    malloced.push_back(Pair("used", (int64_t)mi.uordblks));
+    malloced.push_back(Pair("free", (int64_t)mi.fordblks));
+    malloced.push_back(Pair("keepcost", (int64_t)mi.keepcost));
+#else
+    // mallinfo's fields are ints and wrap past 2 GiB; they are still useful
+    // for telling arena growth from mmapped allocations on an edge node.
+    struct mallinfo mi = mallinfo();
+    malloced.push_back(Pair("arena", (int64_t)(unsigned int)mi.arena));
+    malloced.push_back(Pair("mmapped", (int64_t)(unsigned int)mi.hblkhd));
+    malloced.push_back(Pair("used", (int64_t)(unsigned int)mi.uordblks));
+    malloced.push_back(Pair("free", (int64_t)(unsigned int)mi.fordblks));
+    malloced.push_back(Pair("keepcost", (int64_t)(unsigned int)mi.keepcost));
+#endif
+    obj.push_back(Pair("malloc", malloced));
+#endif
+    return obj;
+}
+
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getlockstats\n"
+            "Returns the lock profile collected since startup: per-lock-name\n"
+            "acquisition counts, wait times (time spent blocked on a\n"
+            "contended lock) and hold times. Requires -lockstats; without it\n"
+            "the result is empty. Times are microseconds; the histograms\n"
+            "use power-of-two buckets, so entry i counts events below 2^i\n"
+            "microseconds (and at or above 2^(i-1)), with the last bucket\n"
+            "open-ended.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"cs_main\": {\n"
+            "    \"acquisitions\": n,      (numeric) times the lock was taken\n"
+            "    \"contended\": n,         (numeric) acquisitions that had to wait\n"
+            "    \"wait_total\": n,        (numeric) total blocked time\n"
+            "    \"wait_max\": n,          (numeric) longest single wait\n"
+            "    \"hold_total\": n,        (numeric) total time held\n"
+            "    \"hold_max\": n,          (numeric) longest single hold\n"
+            "    \"wait_histogram\": [n, ...],\n"
+            "    \"hold_histogram\": [n, ...]\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    std::vector<CLockStatSnapshot> vStats;
+    GetLockStats(vStats);
+    UniValue ret(UniValue::VOBJ);
+    for (std::vector<CLockStatSnapshot>::const_iterator it = vStats.begin(); it != vStats.end(); ++it) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("acquisitions", it->nAcquisitions));
+        obj.push_back(Pair("contended", it->nContended));
+        obj.push_back(Pair("wait_total", it->nWaitTotalMicros));
+        obj.push_back(Pair("wait_max", it->nWaitMaxMicros));
+        obj.push_back(Pair("hold_total", it->nHoldTotalMicros));
+        obj.push_back(Pair("hold_max", it->nHoldMaxMicros));
+        UniValue waitHist(UniValue::VARR);
+        UniValue holdHist(UniValue::VARR);
+        for (int i = 0; i < LOCKSTAT_HIST_BUCKETS; i++) {
+            waitHist.push_back(it->waitHist[i]);
+            holdHist.push_back(it->holdHist[i]);
+        }
+        obj.push_back(Pair("wait_histogram", waitHist));
+        obj.push_back(Pair("hold_histogram", holdHist));
+        ret.push_back(Pair(it->name, obj));
+    }
+    return ret;
+}
+
+UniValue getthreadpoolinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getthreadpoolinfo\n"
+            "\nReturns the named worker pools with their spawned thread counts\n"
+            "and the option controlling each, plus the current validation\n"
+            "thread budget (adjustable at runtime with setvalidationthreads).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"pools\": [\n"
+            "    {\n"
+            "      \"name\": \"scriptcheck\",  (string) pool name\n"
+            "      \"threads\": n,           (numeric) threads spawned\n"
+            "      \"knob\": \"-par\"          (string) option controlling the size, empty if hardcoded\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"validationbudget\": n       (numeric) validation threads currently in use, <= the scriptcheck pool size\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getthreadpoolinfo", "")
+            + HelpExampleRpc("getthreadpoolinfo", "")
+        );
+
+    UniValue pools(UniValue::VARR);
+    std::vector<CThreadPoolInfo> vPools = GetRegisteredThreadPools();
+    for (std::vector<CThreadPoolInfo>::const_iterator it = vPools.begin(); it != vPools.end(); ++it) {
+        UniValue pool(UniValue::VOBJ);
+        pool.push_back(Pair("name", it->strName));
+        pool.push_back(Pair("threads", it->nThreads));
+        pool.push_back(Pair("knob", it->strKnob));
+        pools.push_back(pool);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("pools", pools));
+    ret.push_back(Pair("validationbudget", GetValidationThreadBudget()));
+    return ret;
+}
+
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns per-method RPC latency histograms, the worker-queue wait\n"
+            "histogram, and the calls recently traced by -rpcslowms with their\n"
+            "lock-wait breakdown. All durations are in microseconds and the\n"
+            "percentiles are computed over a window of recent calls.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"commands\": {               (object) one entry per method called so far\n"
+            "    \"getblock\": { \"count\": n, \"total\": n, \"avg\": n, \"min\": n, \"max\": n, \"p50\": n, \"p90\": n, \"p99\": n }, ...\n"
+            "  },\n"
+            "  \"queuetime\": { ... },       (object) wait between arrival and a worker picking the request up, same fields\n"
+            "  \"slowthresholdms\": n,       (numeric) the -rpcslowms threshold, 0 when tracing is off\n"
+            "  \"slowcalls\": [              (array) most recent traced calls, newest last\n"
+            "    {\n"
+            "      \"method\": \"xxx\",        (string) method name\n"
+            "      \"time\": n,              (numeric) unix time the call finished\n"
+            "      \"duration\": n,          (numeric) total wall time in microseconds\n"
+            "      \"lockwait\": n           (numeric) of which, blocked waiting on locks\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    UniValue methods(UniValue::VOBJ);
+    UniValue queuetime(UniValue::VOBJ);
+    std::vector<std::pair<std::string, CPerfCounter*> > vTimers;
+    PerfGetCounters(vTimers);
+    for (std::vector<std::pair<std::string, CPerfCounter*> >::iterator it = vTimers.begin(); it != vTimers.end(); it++) {
+        if (it->first.compare(0, 4, "rpc.") != 0)
+            continue;
+        CPerfCounter* pcounter = it->second;
+        UniValue stats(UniValue::VOBJ);
+        stats.push_back(Pair("count", (int64_t)pcounter->GetCount()));
+        stats.push_back(Pair("total", pcounter->GetTotal()));
+        stats.push_back(Pair("avg", pcounter->GetAverage()));
+        stats.push_back(Pair("min", pcounter->GetMin()));
+        stats.push_back(Pair("max", pcounter->GetMax()));
+        stats.push_back(Pair("p50", pcounter->GetPercentile(50)));
+        stats.push_back(Pair("p90", pcounter->GetPercentile(90)));
+        stats.push_back(Pair("p99", pcounter->GetPercentile(99)));
+        if (it->first == "rpc.queuetime")
+            queuetime = stats;
+        else
+            methods.push_back(Pair(it->first.substr(4), stats));
+    }
+
+    UniValue slowcalls(UniValue::VARR);
+    std::vector<CRPCSlowCall> vSlow = GetRPCSlowCalls();
+    for (std::vector<CRPCSlowCall>::const_iterator it = vSlow.begin(); it != vSlow.end(); ++it) {
+        UniValue call(UniValue::VOBJ);
+        call.push_back(Pair("method", it->strMethod));
+        call.push_back(Pair("time", it->nTime));
+        call.push_back(Pair("duration", it->nDurationMicros));
+        call.push_back(Pair("lockwait", it->nLockWaitMicros));
+        slowcalls.push_back(call);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("commands", methods));
+    ret.push_back(Pair("queuetime", queuetime));
+    ret.push_back(Pair("slowthresholdms", nRPCSlowThresholdMS));
+    ret.push_back(Pair("slowcalls", slowcalls));
+    return ret;
+}
+
+UniValue setvalidationthreads(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "setvalidationthreads n\n"
+            "\nCaps how many of the -par script verification threads validation\n"
+            "uses, without a restart. Spare workers park until the budget is\n"
+            "raised again, freeing cores for RPC or other components; passing\n"
+            "the full -par count (or 0) restores the full allotment.\n"
+            "\nArguments:\n"
+            "1. n    (numeric, required) threads validation may use, 1 to the -par count (0 for all)\n"
+            "\nResult:\n"
+            "n       (numeric) the budget now in effect\n"
+            "\nExamples:\n"
+            + HelpExampleCli("setvalidationthreads", "2")
+            + HelpExampleRpc("setvalidationthreads", "2")
+        );
+
+    int nBudget = params[0].get_int();
+    if (nBudget < 0 || nBudget > nScriptCheckThreads)
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+            strprintf("Thread budget out of range (0-%d)", nScriptCheckThreads));
+    SetValidationThreadBudget(nBudget);
+    return GetValidationThreadBudget();
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true  },
+    { "control",            "getlockstats",           &getlockstats,           true  },
+    { "control",            "getperfstats",           &getperfstats,           true  },
+    { "control",            "getrpcinfo",             &getrpcinfo,             true  },
+    { "control",            "getthreadpoolinfo",      &getthreadpoolinfo,      true  },
+    { "control",            "setvalidationthreads",   &setvalidationthreads,   true  },
     { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true  },
     { "util",               "verifymessage",          &verifymessage,          true  },
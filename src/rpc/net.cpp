@@ -6,6 +6,7 @@
 
 #include "chainparams.h"
 #include "clientversion.h"
+#include "httpserver.h"
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
@@ -95,6 +96,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"lastrecv\": ttt,           (numeric) The time in seconds since epoch (Jan 1 1970 GMT) of the last receive\n"
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
             "    \"bytesrecv\": n,            (numeric) The total bytes received\n"
+            "    \"historicalbytesserved\": n, (numeric) Bytes of historical blocks served to this peer\n"
+            "    \"historicalthrottled\": n,  (numeric) Times a historical block request from this peer was deferred by the bandwidth scheduler\n"
             "    \"conntime\": ttt,           (numeric) The connection time in seconds since epoch (Jan 1 1970 GMT)\n"
             "    \"timeoffset\": ttt,         (numeric) The time offset in seconds\n"
             "    \"pingtime\": n,             (numeric) ping time (if available)\n"
@@ -148,6 +151,8 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         obj.push_back(Pair("lastrecv", stats.nLastRecv));
         obj.push_back(Pair("bytessent", stats.nSendBytes));
         obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+        obj.push_back(Pair("historicalbytesserved", stats.nHistoricalBytesServed));
+        obj.push_back(Pair("historicalthrottled", stats.nHistoricalThrottled));
         obj.push_back(Pair("conntime", stats.nTimeConnected));
         obj.push_back(Pair("timeoffset", stats.nTimeOffset));
         if (stats.dPingTime > 0.0)
@@ -629,6 +634,38 @@ UniValue clearbanned(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue gethttpinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gethttpinfo\n"
+            "Returns an object containing HTTP/RPC server statistics.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"requests\": n,        (numeric) total requests dispatched\n"
+            "  \"slowrequests\": n,    (numeric) requests routed to the slow-method queue\n"
+            "  \"shedrequests\": n,    (numeric) requests rejected with 503 because a queue was full\n"
+            "  \"fastqueuedepth\": n,  (numeric) current depth of the main work queue\n"
+            "  \"slowqueuedepth\": n   (numeric) current depth of the slow-method work queue\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gethttpinfo", "")
+            + HelpExampleRpc("gethttpinfo", "")
+        );
+
+    uint64_t nTotal, nSlow, nShed;
+    size_t nFastDepth, nSlowDepth;
+    GetHTTPServerStats(nTotal, nSlow, nShed, nFastDepth, nSlowDepth);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("requests", nTotal));
+    obj.push_back(Pair("slowrequests", nSlow));
+    obj.push_back(Pair("shedrequests", nShed));
+    obj.push_back(Pair("fastqueuedepth", (uint64_t)nFastDepth));
+    obj.push_back(Pair("slowqueuedepth", (uint64_t)nSlowDepth));
+    return obj;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -639,6 +676,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true  },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "gethttpinfo",            &gethttpinfo,            true  },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
     { "network",            "setban",                 &setban,                 true  },
     { "network",            "listbanned",             &listbanned,             true  },
@@ -202,6 +202,83 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
     return result;
 }
 
+UniValue gettransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "gettransactions [\"txid\",...] ( verbose )\n"
+            "\nBatched form of getrawtransaction: resolves all txids in one pass over\n"
+            "the transaction index and reads each block file once, in offset order.\n"
+            "Only the mempool and the transaction index are consulted, so confirmed\n"
+            "transactions require the -txindex command line option.\n"
+
+            "\nArguments:\n"
+            "1. \"txids\"       (string, required) A json array of transaction ids\n"
+            "    [\n"
+            "      \"txid\"     (string) A transaction hash\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. verbose       (numeric, optional, default=0) If 0, return hex strings, other return json objects\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"data\"|{...},  (string or object) Hex data, or a json object as in\n"
+            "                            getrawtransaction if verbose > 0. Transactions that were\n"
+            "                            not found are returned as null.\n"
+            "  ,...\n"
+            "}\n"
+
+            "\nExamples:\n"
+            + HelpExampleCli("gettransactions", "\"[\\\"mytxid\\\"]\"")
+            + HelpExampleCli("gettransactions", "\"[\\\"mytxid\\\"]\" 1")
+            + HelpExampleRpc("gettransactions", "[\"mytxid\"], 1")
+        );
+
+    set<uint256> setTxids;
+    vector<uint256> vHashes;
+    UniValue txids = params[0].get_array();
+    for (unsigned int idx = 0; idx < txids.size(); idx++) {
+        const UniValue& txid = txids[idx];
+        if (txid.get_str().length() != 64 || !IsHex(txid.get_str()))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid txid ")+txid.get_str());
+        uint256 hash(uint256S(txid.get_str()));
+        if (setTxids.count(hash))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, string("Invalid parameter, duplicated txid: ")+txid.get_str());
+        setTxids.insert(hash);
+        vHashes.push_back(hash);
+    }
+
+    bool fVerbose = false;
+    if (params.size() > 1)
+        fVerbose = (params[1].get_int() != 0);
+
+    vector<CTransaction> vTx;
+    vector<uint256> vHashBlock;
+    vector<bool> vFound;
+    GetTransactionsBatch(vHashes, vTx, vHashBlock, vFound);
+
+    UniValue result(UniValue::VOBJ);
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        if (!vFound[i]) {
+            result.push_back(Pair(vHashes[i].GetHex(), NullUniValue));
+            continue;
+        }
+        string strHex = EncodeHexTx(vTx[i]);
+        if (!fVerbose) {
+            result.push_back(Pair(vHashes[i].GetHex(), strHex));
+            continue;
+        }
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("hex", strHex));
+        {
+            LOCK(cs_main);
+            TxToJSON(vTx[i], vHashBlock[i], entry);
+        }
+        result.push_back(Pair(vHashes[i].GetHex(), entry));
+    }
+    return result;
+}
+
 UniValue gettxoutproof(const UniValue& params, bool fHelp)
 {
     if (fHelp || (params.size() != 1 && params.size() != 2))
@@ -842,14 +919,97 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "\nThe transactions are admitted to the memory pool under a single lock and announced to each\n"
+            "peer with a single inventory push, which is considerably cheaper than calling\n"
+            "sendrawtransaction in a loop. A rejected transaction does not abort the batch.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                       (array) One entry per transaction, in the order submitted\n"
+            "  {\n"
+            "    \"txid\" : \"id\"       (string) The transaction hash, if accepted\n"
+            "    \"error\" : \"reason\"  (string) The rejection reason, if not accepted\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex1\\\",\\\"signedhex2\\\"]\"")
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex1\",\"signedhex2\"]")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+    UniValue txs = params[0].get_array();
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (params.size() > 1 && params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    UniValue ret(UniValue::VARR);
+    std::vector<std::pair<CTransaction, CFeeRate> > vRelay;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t idx = 0; idx < txs.size(); idx++) {
+            UniValue entry(UniValue::VOBJ);
+            CTransaction tx;
+            if (!DecodeHexTx(tx, txs[idx].get_str())) {
+                entry.push_back(Pair("error", "TX decode failed"));
+                ret.push_back(entry);
+                continue;
+            }
+            uint256 hashTx = tx.GetHash();
+
+            const CCoins* existingCoins = view.AccessCoins(hashTx);
+            bool fHaveMempool = mempool.exists(hashTx);
+            bool fHaveChain = existingCoins && existingCoins->nHeight < 1000000000;
+            if (fHaveChain) {
+                entry.push_back(Pair("error", "transaction already in block chain"));
+                ret.push_back(entry);
+                continue;
+            }
+            CFeeRate txFeeRate = CFeeRate(0);
+            if (!fHaveMempool) {
+                CValidationState state;
+                bool fMissingInputs;
+                if (!AcceptToMemoryPool(mempool, state, tx, false, &fMissingInputs, &txFeeRate, false, nMaxRawTxFee)) {
+                    if (state.IsInvalid())
+                        entry.push_back(Pair("error", strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason())));
+                    else if (fMissingInputs)
+                        entry.push_back(Pair("error", "Missing inputs"));
+                    else
+                        entry.push_back(Pair("error", state.GetRejectReason()));
+                    ret.push_back(entry);
+                    continue;
+                }
+            }
+            vRelay.push_back(std::make_pair(tx, txFeeRate));
+            entry.push_back(Pair("txid", hashTx.GetHex()));
+            ret.push_back(entry);
+        }
+    }
+    if (!vRelay.empty())
+        RelayTransactions(vRelay);
+
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
+    { "rawtransactions",    "gettransactions",        &gettransactions,        true  },
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
     { "rawtransactions",    "decodescript",           &decodescript,           true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
@@ -7,6 +7,8 @@
 
 #include "base58.h"
 #include "init.h"
+#include "main.h"
+#include "perf.h"
 #include "random.h"
 #include "sync.h"
 #include "ui_interface.h"
@@ -15,6 +17,8 @@
 
 #include <univalue.h>
 
+#include <deque>
+
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
@@ -409,15 +413,100 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+//! Longest run of batch calls executed under a single cs_main hold, so a
+//! huge batch cannot starve validation and net processing of the lock
+static const unsigned int MAX_BATCH_LOCK_RUN = 100;
+
+static std::set<std::string> MakeBatchLockableSet()
+{
+    std::set<std::string> setLockable;
+    setLockable.insert("getbestblockhash");
+    setLockable.insert("getblock");
+    setLockable.insert("getblockcount");
+    setLockable.insert("getblockhash");
+    setLockable.insert("getblockheader");
+    setLockable.insert("getclaimsforname");
+    setLockable.insert("getclaimsintrie");
+    setLockable.insert("getclaimtrie");
+    setLockable.insert("getnameproof");
+    setLockable.insert("getrawtransaction");
+    setLockable.insert("gettxout");
+    setLockable.insert("getvalueforname");
+    return setLockable;
+}
+
+//! Read-only methods that take cs_main themselves. Holding it across a run
+//! of these turns the per-call acquisition into a cheap recursive one.
+static bool IsBatchLockable(const UniValue& req)
+{
+    // Magic static: initialization is thread safe, unlike the lazy
+    // populate-if-empty pattern, and HTTP workers call this concurrently.
+    static const std::set<std::string> setLockable = MakeBatchLockableSet();
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    return valMethod.isStr() && setLockable.count(valMethod.get_str()) > 0;
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        // Find how many consecutive calls can share one cs_main hold
+        unsigned int runEnd = reqIdx;
+        while (runEnd < vReq.size() && runEnd - reqIdx < MAX_BATCH_LOCK_RUN && IsBatchLockable(vReq[runEnd]))
+            runEnd++;
+        if (runEnd - reqIdx >= 2)
+        {
+            LOCK(cs_main);
+            for (; reqIdx < runEnd; reqIdx++)
+                ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+        }
+        else
+        {
+            ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+            reqIdx++;
+        }
+    }
 
     return ret.write() + "\n";
 }
 
+int64_t nRPCSlowThresholdMS = 0;
+
+static const size_t MAX_RPC_SLOW_CALLS = 32;
+static CCriticalSection cs_rpcSlowCalls;
+static std::deque<CRPCSlowCall> rpcSlowCalls;
+
+std::vector<CRPCSlowCall> GetRPCSlowCalls()
+{
+    LOCK(cs_rpcSlowCalls);
+    return std::vector<CRPCSlowCall>(rpcSlowCalls.begin(), rpcSlowCalls.end());
+}
+
+//! Sample the call's duration into its per-method histogram and, when the
+//! -rpcslowms tracer is armed, keep a record of calls over the threshold.
+static void RPCRecordTiming(const std::string& strMethod, int64_t nStartMicros)
+{
+    int64_t nElapsed = GetTimeMicros() - nStartMicros;
+    PerfSample("rpc." + strMethod, nElapsed);
+    if (nRPCSlowThresholdMS <= 0 || nElapsed < nRPCSlowThresholdMS * 1000)
+        return;
+    CRPCSlowCall rec;
+    rec.strMethod = strMethod;
+    rec.nTime = GetTime();
+    rec.nDurationMicros = nElapsed;
+    rec.nLockWaitMicros = LockWaitGetThread();
+    LogPrintf("Slow RPC call: %s took %dus, %dus of it blocked on locks\n",
+              strMethod, rec.nDurationMicros, rec.nLockWaitMicros);
+    LOCK(cs_rpcSlowCalls);
+    rpcSlowCalls.push_back(rec);
+    while (rpcSlowCalls.size() > MAX_RPC_SLOW_CALLS)
+        rpcSlowCalls.pop_front();
+}
+
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
 {
     // Return immediately if in warmup
@@ -434,13 +523,20 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    int64_t nStart = GetTimeMicros();
+    if (fLockWaitTrace)
+        LockWaitResetThread();
+
     try
     {
         // Execute
-        return pcmd->actor(params, false);
+        UniValue result = pcmd->actor(params, false);
+        RPCRecordTiming(strMethod, nStart);
+        return result;
     }
     catch (const std::exception& e)
     {
+        RPCRecordTiming(strMethod, nStart);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 
@@ -162,6 +162,20 @@ public:
 
 extern CRPCTable tableRPC;
 
+/** One slow RPC call recorded by the -rpcslowms tracer */
+struct CRPCSlowCall
+{
+    std::string strMethod;
+    int64_t nTime;             //!< unix time the call finished
+    int64_t nDurationMicros;   //!< total wall time of the call
+    int64_t nLockWaitMicros;   //!< of which, blocked waiting on locks
+};
+
+/** Threshold in milliseconds above which calls are traced; 0 disables */
+extern int64_t nRPCSlowThresholdMS;
+/** Most recent slow calls, newest last (see getrpcinfo) */
+std::vector<CRPCSlowCall> GetRPCSlowCalls();
+
 /**
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
@@ -107,15 +107,27 @@ void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds)
     schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds));
 }
 
+// Align a periodic task's next run to the next whole multiple of its period
+// since the epoch. Tasks whose periods share a divisor then come due at the
+// same instant and are serviced in one wakeup of the scheduler thread,
+// instead of one wakeup per task scattered across their start phases.
+static boost::chrono::system_clock::time_point AlignedTime(int64_t deltaSeconds)
+{
+    int64_t nNowSeconds = boost::chrono::duration_cast<boost::chrono::seconds>(
+        boost::chrono::system_clock::now().time_since_epoch()).count();
+    int64_t nNextSeconds = (nNowSeconds / deltaSeconds + 1) * deltaSeconds;
+    return boost::chrono::system_clock::time_point(boost::chrono::seconds(nNextSeconds));
+}
+
 static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->schedule(boost::bind(&Repeat, s, f, deltaSeconds), AlignedTime(deltaSeconds));
 }
 
 void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+    schedule(boost::bind(&Repeat, this, f, deltaSeconds), AlignedTime(deltaSeconds));
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
@@ -48,10 +48,11 @@ public:
     void scheduleFromNow(Function f, int64_t deltaSeconds);
 
     // Another convenience method: call f approximately
-    // every deltaSeconds forever, starting deltaSeconds from now.
-    // To be more precise: every time f is finished, it
-    // is rescheduled to run deltaSeconds later. If you
-    // need more accurate scheduling, don't use this method.
+    // every deltaSeconds forever. Runs are aligned to whole multiples of
+    // deltaSeconds, so periodic tasks with related periods coalesce into
+    // shared wakeups of the service thread rather than each waking it on
+    // its own phase. If you need more accurate scheduling, don't use this
+    // method.
     void scheduleEvery(Function f, int64_t deltaSeconds);
 
     // To keep things as simple as possible, there is no unschedule.
@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 #include <iostream>
 
@@ -207,29 +208,33 @@ bool static CheckPubKeyEncoding(const valtype &vchSig, unsigned int flags, Scrip
     return true;
 }
 
-bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
-    if (data.size() == 0) {
+bool static CheckMinimalPush(const unsigned char* pdata, size_t nSize, opcodetype opcode) {
+    if (nSize == 0) {
         // Could have used OP_0.
         return opcode == OP_0;
-    } else if (data.size() == 1 && data[0] >= 1 && data[0] <= 16) {
+    } else if (nSize == 1 && pdata[0] >= 1 && pdata[0] <= 16) {
         // Could have used OP_1 .. OP_16.
-        return opcode == OP_1 + (data[0] - 1);
-    } else if (data.size() == 1 && data[0] == 0x81) {
+        return opcode == OP_1 + (pdata[0] - 1);
+    } else if (nSize == 1 && pdata[0] == 0x81) {
         // Could have used OP_1NEGATE.
         return opcode == OP_1NEGATE;
-    } else if (data.size() <= 75) {
+    } else if (nSize <= 75) {
         // Could have used a direct push (opcode indicating number of bytes pushed + those bytes).
-        return opcode == data.size();
-    } else if (data.size() <= 255) {
+        return opcode == nSize;
+    } else if (nSize <= 255) {
         // Could have used OP_PUSHDATA.
         return opcode == OP_PUSHDATA1;
-    } else if (data.size() <= 65535) {
+    } else if (nSize <= 65535) {
         // Could have used OP_PUSHDATA2.
         return opcode == OP_PUSHDATA2;
     }
     return true;
 }
 
+bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
+    return CheckMinimalPush(data.empty() ? NULL : &data[0], data.size(), opcode);
+}
+
 bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
@@ -253,6 +258,55 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     int nOpCount = 0;
     bool fRequireMinimal = (flags & SCRIPT_VERIFY_MINIMALDATA) != 0;
 
+    // Nearly every scriptPubKey on this chain starts with one of the three
+    // claim prefixes, and the prefix is stack-neutral: the claim op pushes a
+    // zero, the two or three parameter pushes follow, and the trailing drop
+    // pair removes everything again. Recognize the exact shapes up front and
+    // resume at the embedded payment script, charging the same op count and
+    // enforcing the same push rules the opcode loop would. Any deviation
+    // from the expected shape falls through to the loop untouched.
+    do
+    {
+        CScript::const_iterator pcFast = pc;
+        CScript::const_iterator pvchBegin = pc;
+        CScript::const_iterator pvchEnd = pc;
+        opcodetype opcodeClaim;
+        if (!script.GetOpView(pcFast, opcodeClaim, pvchBegin, pvchEnd))
+            break;
+        if (opcodeClaim != OP_CLAIM_NAME && opcodeClaim != OP_SUPPORT_CLAIM && opcodeClaim != OP_UPDATE_CLAIM)
+            break;
+        int nParams = (opcodeClaim == OP_UPDATE_CLAIM) ? 3 : 2;
+        // The interpreted prefix transiently holds nParams + 1 extra stack
+        // elements before the drops, and the opcode loop enforces the 1000
+        // element limit after each of them. Near the limit, fall through so
+        // such scripts still fail with SCRIPT_ERR_STACK_SIZE.
+        if (stack.size() + nParams + 1 > 1000)
+            break;
+        bool fShapeOk = true;
+        for (int n = 0; fShapeOk && n < nParams; n++)
+        {
+            // The parameter pushes only get inspected, never kept, so read
+            // them as views rather than copying the (possibly huge) values.
+            opcodetype opcodePush;
+            if (!script.GetOpView(pcFast, opcodePush, pvchBegin, pvchEnd) ||
+                opcodePush > OP_PUSHDATA4 ||
+                (size_t)(pvchEnd - pvchBegin) > MAX_SCRIPT_ELEMENT_SIZE ||
+                (fRequireMinimal && !CheckMinimalPush(pvchBegin == pvchEnd ? NULL : &pvchBegin[0], pvchEnd - pvchBegin, opcodePush)))
+                fShapeOk = false;
+        }
+        if (!fShapeOk)
+            break;
+        opcodetype opcodeDrop1;
+        opcodetype opcodeDrop2;
+        if (!script.GetOpView(pcFast, opcodeDrop1, pvchBegin, pvchEnd) || opcodeDrop1 != OP_2DROP)
+            break;
+        if (!script.GetOpView(pcFast, opcodeDrop2, pvchBegin, pvchEnd) || opcodeDrop2 != (nParams == 3 ? OP_2DROP : OP_DROP))
+            break;
+        // the claim op and the two drops are the prefix's countable opcodes
+        nOpCount += 3;
+        pc = pcFast;
+    } while (false);
+
     try
     {
         while (pc < pend)
@@ -292,7 +346,10 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                // Push by swapping rather than copying; claim scripts carry
+                // large value blobs and GetOp refills vchPushValue anyway.
+                stack.push_back(valtype());
+                stack.back().swap(vchPushValue);
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -1021,6 +1078,29 @@ namespace {
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
  */
+/** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
+template<typename S>
+static void SerializeScriptCodeStripped(S &s, const CScript& scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
 class CTransactionSignatureSerializer {
 private:
     const CTransaction& txTo;  //!< reference to the spending transaction (the one being serialized)
@@ -1040,24 +1120,7 @@ public:
     /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
     template<typename S>
     void SerializeScriptCode(S &s, int nType, int nVersion) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
+        SerializeScriptCodeStripped(s, scriptCode);
     }
 
     /** Serialize an input of txTo */
@@ -1114,7 +1177,28 @@ public:
 
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+void PrecomputedTransactionData::Init(const CTransaction& tx)
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << tx.nVersion;
+    WriteCompactSize(ss, tx.vin.size());
+    vScriptSigOffset.clear();
+    vScriptSigOffset.reserve(tx.vin.size());
+    for (unsigned int n = 0; n < tx.vin.size(); n++) {
+        ss << tx.vin[n].prevout;
+        vScriptSigOffset.push_back(ss.size());
+        WriteCompactSize(ss, 0); // blanked scriptSig
+        ss << tx.vin[n].nSequence;
+    }
+    WriteCompactSize(ss, tx.vout.size());
+    for (unsigned int n = 0; n < tx.vout.size(); n++)
+        ss << tx.vout[n];
+    ss << tx.nLockTime;
+    vchBody.assign(ss.begin(), ss.end());
+    fReady = true;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1130,6 +1214,23 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         }
     }
 
+    // For the common SIGHASH_ALL layout (all inputs, all outputs, no
+    // ANYONECANPAY) the serialization differs from the precomputed body only
+    // in this input's scriptSig slot, so splice the scriptCode in rather than
+    // reserializing the whole transaction.
+    if (cache && cache->fReady &&
+        (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE &&
+        !(nHashType & SIGHASH_ANYONECANPAY)) {
+        const std::vector<unsigned char>& body = cache->vchBody;
+        const size_t pos = cache->vScriptSigOffset[nIn];
+        CHashWriter ss(SER_GETHASH, 0);
+        ss.write((const char*)&body[0], pos);
+        SerializeScriptCodeStripped(ss, scriptCode);
+        ss.write((const char*)&body[pos + 1], body.size() - pos - 1);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
@@ -1157,7 +1258,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1259,7 +1360,9 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
     if (!EvalScript(stack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
+    // The copy is only ever consumed by the pay-to-script-hash branch below,
+    // so don't deep-copy the scriptSig stack for ordinary outputs.
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash())
         stackCopy = stack;
     if (!EvalScript(stack, scriptPubKey, flags, checker, serror))
         // serror is set
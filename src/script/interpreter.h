@@ -90,7 +90,27 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/** Precomputed per-transaction data for SignatureHash().
+ *
+ * Holds the transaction serialized once with every scriptSig blanked, plus
+ * the offset of each input's blank script byte, so the common SIGHASH_ALL
+ * case can splice the scriptCode into the cached body instead of
+ * reserializing the whole transaction for every input. Built once per
+ * transaction and shared by all of its script checks. */
+class PrecomputedTransactionData
+{
+public:
+    std::vector<unsigned char> vchBody;   //!< tx serialized with all scriptSigs blanked
+    std::vector<size_t> vScriptSigOffset; //!< per input, offset of the blank script byte
+    bool fReady;
+
+    PrecomputedTransactionData() : fReady(false) {}
+    explicit PrecomputedTransactionData(const CTransaction& tx) : fReady(false) { Init(tx); }
+
+    void Init(const CTransaction& tx);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
@@ -118,12 +138,14 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn), txdata(NULL) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckSequence(const CScriptNum& nSequence) const;
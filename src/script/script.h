@@ -502,9 +502,28 @@ public:
 
     bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
     {
-        opcodeRet = OP_INVALIDOPCODE;
+        const_iterator pvchBegin = end();
+        const_iterator pvchEnd = end();
         if (pvchRet)
             pvchRet->clear();
+        if (!GetOpView(pc, opcodeRet, pvchBegin, pvchEnd))
+            return false;
+        if (pvchRet)
+            pvchRet->assign(pvchBegin, pvchEnd);
+        return true;
+    }
+
+    /**
+     * Non-copying variant of GetOp2: the pushed data (if any) is returned
+     * as an iterator range into this script rather than copied into a
+     * vector. Claim values can be tens of kilobytes, so decoders that only
+     * inspect or selectively keep the pushes should prefer this. The range
+     * is only valid while the script stays alive and unmodified.
+     */
+    bool GetOpView(const_iterator& pc, opcodetype& opcodeRet, const_iterator& pvchBegin, const_iterator& pvchEnd) const
+    {
+        opcodeRet = OP_INVALIDOPCODE;
+        pvchBegin = pvchEnd = end();
         if (pc >= end())
             return false;
 
@@ -543,8 +562,8 @@ public:
             }
             if (end() - pc < 0 || (unsigned int)(end() - pc) < nSize)
                 return false;
-            if (pvchRet)
-                pvchRet->assign(pc, pc + nSize);
+            pvchBegin = pc;
+            pvchEnd = pc + nSize;
             pc += nSize;
         }
 
@@ -31,17 +31,29 @@ public:
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
+ * again when accepted into the block chain).
+ *
+ * The cache is striped into segments selected by the entry hash, each with
+ * its own lock, so parallel script-check threads do not serialize on a
+ * single mutex. The memory budget is divided evenly across segments.
  */
 class CSignatureCache
 {
 private:
+    static const size_t SIGCACHE_SEGMENTS = 16;
+
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
     typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    map_type setValid[SIGCACHE_SEGMENTS];
+    boost::shared_mutex cs_sigcache[SIGCACHE_SEGMENTS];
 
+    //! The entry is uniformly distributed hash output, so any byte selects
+    //! the segment without correlating with the set's own bucket choice.
+    size_t Segment(const uint256& entry) const
+    {
+        return entry.begin()[31] % SIGCACHE_SEGMENTS;
+    }
 
 public:
     CSignatureCache()
@@ -58,40 +70,75 @@ public:
     bool
     Get(const uint256& entry)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        size_t seg = Segment(entry);
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache[seg]);
+        return setValid[seg].count(entry);
     }
 
     void Erase(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        size_t seg = Segment(entry);
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache[seg]);
+        setValid[seg].erase(entry);
     }
 
     void Set(const uint256& entry)
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+        // -maxsigcachesize does not change at runtime; avoid the arg-map
+        // lookup on every insert from the script-check threads.
+        static const size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20) / SIGCACHE_SEGMENTS;
         if (nMaxCacheSize <= 0) return;
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
+        size_t seg = Segment(entry);
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache[seg]);
+        // Pick eviction buckets with a cheap LCG seeded from the entry
+        // instead of GetRand(): placement is already attacker-independent
+        // thanks to the secret nonce, and GetRand serializes on the global
+        // RNG while we hold the segment write lock.
+        uint64_t nRand = entry.GetCheapHash();
+        while (memusage::DynamicUsage(setValid[seg]) > nMaxCacheSize)
         {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
+            nRand = nRand * 6364136223846793005ULL + 1442695040888963407ULL;
+            map_type::size_type s = nRand % setValid[seg].bucket_count();
+            map_type::local_iterator it = setValid[seg].begin(s);
+            if (it != setValid[seg].end(s)) {
+                setValid[seg].erase(*it);
             }
         }
 
-        setValid.insert(entry);
+        setValid[seg].insert(entry);
+    }
+
+    size_t DynamicMemoryUsage()
+    {
+        size_t nUsage = 0;
+        for (size_t seg = 0; seg < SIGCACHE_SEGMENTS; seg++)
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_sigcache[seg]);
+            nUsage += memusage::DynamicUsage(setValid[seg]);
+        }
+        return nUsage;
     }
 };
 
+/** Construction draws from the RNG, so defer it to first use rather than
+ *  running at static initialization time. */
+static CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+
+}
+
+size_t SignatureCacheMemoryUsage()
+{
+    return GetSignatureCache().DynamicMemoryUsage();
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
@@ -66,6 +66,28 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
         return true;
     }
 
+    // Shortcut for the canonical pay-to-pubkey-hash form, which repeated
+    // wallet and indexing scans hit for nearly every output:
+    // OP_DUP OP_HASH160 20 [20 byte hash] OP_EQUALVERIFY OP_CHECKSIG
+    if (scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 &&
+        scriptPubKey[2] == 20 && scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG)
+    {
+        typeRet = TX_PUBKEYHASH;
+        vSolutionsRet.push_back(vector<unsigned char>(scriptPubKey.begin()+3, scriptPubKey.begin()+23));
+        return true;
+    }
+
+    // Shortcut for canonical pay-to-pubkey: one direct push of a 33- or
+    // 65-byte key followed by OP_CHECKSIG. Other push encodings and key
+    // sizes still go through the template scan below.
+    if (scriptPubKey.size() >= 35 && (scriptPubKey[0] == 33 || scriptPubKey[0] == 65) &&
+        scriptPubKey.size() == (size_t)scriptPubKey[0] + 2 && scriptPubKey.back() == OP_CHECKSIG)
+    {
+        typeRet = TX_PUBKEY;
+        vSolutionsRet.push_back(vector<unsigned char>(scriptPubKey.begin()+1, scriptPubKey.end()-1));
+        return true;
+    }
+
     // Provably prunable, data-carrying output
     //
     // So long as script passes the IsUnspendable() test and all but the first
@@ -84,7 +106,11 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
         vSolutionsRet.clear();
 
         opcodetype opcode1, opcode2;
-        vector<unsigned char> vch1, vch2;
+        vector<unsigned char> vch2;
+        // Data pushed by the script under test is read as a view and only
+        // copied once it is known to belong in vSolutionsRet.
+        CScript::const_iterator vch1Begin = script1.begin();
+        CScript::const_iterator vch1End = script1.begin();
 
         // Compare
         CScript::const_iterator pc1 = script1.begin();
@@ -105,20 +131,26 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
                 }
                 return true;
             }
-            if (!script1.GetOp(pc1, opcode1, vch1))
+            if (!script1.GetOpView(pc1, opcode1, vch1Begin, vch1End))
                 break;
             if (!script2.GetOp(pc2, opcode2, vch2))
                 break;
 
+            size_t nSize1 = vch1End - vch1Begin;
+
             // Template matching opcodes:
             if (opcode2 == OP_PUBKEYS)
             {
-                while (vch1.size() >= 33 && vch1.size() <= 65)
+                while (nSize1 >= 33 && nSize1 <= 65)
                 {
-                    vSolutionsRet.push_back(vch1);
-                    if (!script1.GetOp(pc1, opcode1, vch1))
+                    vSolutionsRet.push_back(valtype(vch1Begin, vch1End));
+                    if (!script1.GetOpView(pc1, opcode1, vch1Begin, vch1End))
                         break;
+                    nSize1 = vch1End - vch1Begin;
                 }
+                // A failed GetOpView leaves an empty view, so nSize1 stays
+                // accurate for the checks below.
+                nSize1 = vch1End - vch1Begin;
                 if (!script2.GetOp(pc2, opcode2, vch2))
                     break;
                 // Normal situation is to fall through
@@ -127,15 +159,15 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
 
             if (opcode2 == OP_PUBKEY)
             {
-                if (vch1.size() < 33 || vch1.size() > 65)
+                if (nSize1 < 33 || nSize1 > 65)
                     break;
-                vSolutionsRet.push_back(vch1);
+                vSolutionsRet.push_back(valtype(vch1Begin, vch1End));
             }
             else if (opcode2 == OP_PUBKEYHASH)
             {
-                if (vch1.size() != sizeof(uint160))
+                if (nSize1 != sizeof(uint160))
                     break;
-                vSolutionsRet.push_back(vch1);
+                vSolutionsRet.push_back(valtype(vch1Begin, vch1End));
             }
             else if (opcode2 == OP_SMALLINTEGER)
             {   // Single-byte small integer pushed onto vSolutions
@@ -148,7 +180,8 @@ bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, vector<vector<unsi
                 else
                     break;
             }
-            else if (opcode1 != opcode2 || vch1 != vch2)
+            else if (opcode1 != opcode2 || nSize1 != vch2.size() ||
+                     !std::equal(vch2.begin(), vch2.end(), vch1Begin))
             {
                 // Others must match exactly
                 break;
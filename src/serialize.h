@@ -833,9 +833,13 @@ void Unserialize(Stream& is, std::map<K, T, Pred, A>& m, int nType, int nVersion
     typename std::map<K, T, Pred, A>::iterator mi = m.begin();
     for (unsigned int i = 0; i < nSize; i++)
     {
-        std::pair<K, T> item;
-        Unserialize(is, item, nType, nVersion);
-        mi = m.insert(mi, item);
+        K key;
+        Unserialize(is, key, nType, nVersion);
+        // Insert a default-constructed element and deserialize straight into
+        // it, so the mapped value is built in place instead of being
+        // deep-copied out of a temporary pair.
+        mi = m.insert(mi, std::make_pair(key, T()));
+        Unserialize(is, mi->second, nType, nVersion);
     }
 }
 
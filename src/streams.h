@@ -22,6 +22,49 @@
 #include <utility>
 #include <vector>
 
+/** XOR a buffer with a repeating key.
+ *
+ * When the key evenly tiles a machine word (the dbwrapper obfuscation key is
+ * 8 bytes), it is replicated into a word and the bulk of the buffer is
+ * processed word-at-a-time; the compiler turns the memcpy/XOR loop into
+ * SSE2/NEON code on platforms that have it. The byte loop finishes any
+ * unaligned tail and handles other key sizes.
+ */
+inline void XorData(unsigned char* pch, size_t nSize, const std::vector<unsigned char>& key)
+{
+    if (key.size() == 0) {
+        return;
+    }
+
+    size_t i = 0, j = 0;
+
+    if (sizeof(uint64_t) % key.size() == 0 && nSize >= sizeof(uint64_t)) {
+        uint64_t nKeyWord;
+        unsigned char* pKeyWord = (unsigned char*)&nKeyWord;
+        for (size_t k = 0; k < sizeof(uint64_t); k++)
+            pKeyWord[k] = key[k % key.size()];
+
+        size_t nWordEnd = nSize - (nSize % sizeof(uint64_t));
+        for (; i != nWordEnd; i += sizeof(uint64_t)) {
+            uint64_t nWord;
+            memcpy(&nWord, &pch[i], sizeof(uint64_t));
+            nWord ^= nKeyWord;
+            memcpy(&pch[i], &nWord, sizeof(uint64_t));
+        }
+    }
+
+    for (; i != nSize; i++) {
+        pch[i] ^= key[j++];
+
+        // This potentially acts on very many bytes of data, so it's
+        // important that we calculate `j`, i.e. the `key` index in this
+        // way instead of doing a %, which would effectively be a division
+        // for each byte Xor'd -- much slower than need be.
+        if (j == key.size())
+            j = 0;
+    }
+}
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -297,6 +340,14 @@ public:
         clear();
     }
 
+    void swap(CDataStream& rhs)
+    {
+        vch.swap(rhs.vch);
+        std::swap(nReadPos, rhs.nReadPos);
+        std::swap(nType, rhs.nType);
+        std::swap(nVersion, rhs.nVersion);
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
@@ -304,20 +355,50 @@ public:
      */
     void Xor(const std::vector<unsigned char>& key)
     {
-        if (key.size() == 0) {
-            return;
-        }
+        if (!vch.empty())
+            XorData((unsigned char*)&vch[0], vch.size(), key);
+    }
+};
 
-        for (size_type i = 0, j = 0; i != size(); i++) {
-            vch[i] ^= key[j++];
+/** Minimal stream for deserializing straight out of an existing byte buffer.
+ *
+ * Nothing is copied: the caller guarantees the buffer outlives the reader.
+ * Obfuscated data should be de-obfuscated in place (XorData) beforehand.
+ */
+class CSpanReader
+{
+private:
+    const char* pch;
+    size_t nSize;
+    size_t nReadPos;
 
-            // This potentially acts on very many bytes of data, so it's
-            // important that we calculate `j`, i.e. the `key` index in this
-            // way instead of doing a %, which would effectively be a division
-            // for each byte Xor'd -- much slower than need be.
-            if (j == key.size())
-                j = 0;
-        }
+public:
+    int nType;
+    int nVersion;
+
+    CSpanReader(const char* pchIn, size_t nSizeIn, int nTypeIn, int nVersionIn)
+        : pch(pchIn), nSize(nSizeIn), nReadPos(0), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    size_t size() const { return nSize - nReadPos; }
+    bool empty() const { return nSize == nReadPos; }
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    void read(char* pchDest, size_t nReadSize)
+    {
+        if (nReadSize == 0)
+            return;
+        if (nReadPos + nReadSize > nSize)
+            throw std::ios_base::failure("CSpanReader::read(): end of data");
+        memcpy(pchDest, pch + nReadPos, nReadSize);
+        nReadPos += nReadSize;
+    }
+
+    template <typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
     }
 };
 
@@ -465,6 +546,19 @@ private:
     std::vector<char> vchBuf; // the buffer
 
 protected:
+    // fread without taking the stdio stream lock. The CBufferedFile owning a
+    // FILE* is its only reader, so the per-call lock/unlock in plain fread is
+    // pure overhead on the hot import path.
+    static size_t ReadNoLock(void* pv, size_t nBytes, FILE* file) {
+#if defined(WIN32)
+        return _fread_nolock(pv, 1, nBytes, file);
+#elif defined(__GLIBC__)
+        return fread_unlocked(pv, 1, nBytes, file);
+#else
+        return fread(pv, 1, nBytes, file);
+#endif
+    }
+
     // read data from the source to fill the buffer
     bool Fill() {
         unsigned int pos = nSrcPos % vchBuf.size();
@@ -474,7 +568,7 @@ protected:
             readNow = nAvail;
         if (readNow == 0)
             return false;
-        size_t read = fread((void*)&vchBuf[pos], 1, readNow, src);
+        size_t read = ReadNoLock((void*)&vchBuf[pos], readNow, src);
         if (read == 0) {
             throw std::ios_base::failure(feof(src) ? "CBufferedFile::Fill: end of file" : "CBufferedFile::Fill: fread failed");
         } else {
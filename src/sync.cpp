@@ -9,9 +9,170 @@
 
 #include <stdio.h>
 
+#include <map>
+
+#include <boost/atomic.hpp>
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+bool fLockStats = false;
+bool fLockWaitTrace = false;
+
+namespace {
+
+// Accumulator for the calling thread's blocked lock-wait time. Only threads
+// that opt in via LockWaitResetThread allocate a slot, so worker threads
+// that never trace pay one TLS load on the contended path and nothing more.
+boost::thread_specific_ptr<int64_t> threadLockWaitMicros;
+
+} // anon namespace
+
+void LockWaitResetThread()
+{
+    if (threadLockWaitMicros.get() == NULL)
+        threadLockWaitMicros.reset(new int64_t(0));
+    else
+        *threadLockWaitMicros = 0;
+}
+
+int64_t LockWaitGetThread()
+{
+    int64_t* pn = threadLockWaitMicros.get();
+    return pn ? *pn : 0;
+}
+
+void LockWaitRecord(int64_t nMicros)
+{
+    int64_t* pn = threadLockWaitMicros.get();
+    if (pn)
+        *pn += nMicros;
+}
+
+namespace {
+
+struct CLockStat
+{
+    std::string name;
+    boost::atomic<uint64_t> nAcquisitions;
+    boost::atomic<uint64_t> nContended;
+    boost::atomic<uint64_t> nWaitTotalMicros;
+    boost::atomic<uint64_t> nWaitMaxMicros;
+    boost::atomic<uint64_t> nHoldTotalMicros;
+    boost::atomic<uint64_t> nHoldMaxMicros;
+    boost::atomic<uint64_t> waitHist[LOCKSTAT_HIST_BUCKETS];
+    boost::atomic<uint64_t> holdHist[LOCKSTAT_HIST_BUCKETS];
+
+    CLockStat(const std::string& nameIn) : name(nameIn), nAcquisitions(0), nContended(0),
+        nWaitTotalMicros(0), nWaitMaxMicros(0), nHoldTotalMicros(0), nHoldMaxMicros(0)
+    {
+        for (int i = 0; i < LOCKSTAT_HIST_BUCKETS; i++) {
+            waitHist[i].store(0, boost::memory_order_relaxed);
+            holdHist[i].store(0, boost::memory_order_relaxed);
+        }
+    }
+};
+
+//! bucket 0 is <1us; each further bucket doubles, the last is open-ended
+int HistBucket(uint64_t nMicros)
+{
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < LOCKSTAT_HIST_BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+void AtomicMax(boost::atomic<uint64_t>& target, uint64_t value)
+{
+    uint64_t cur = target.load(boost::memory_order_relaxed);
+    while (cur < value && !target.compare_exchange_weak(cur, value, boost::memory_order_relaxed)) {}
+}
+
+// A plain mutex, not a CCriticalSection: the profiler must never recurse
+// into its own instrumentation. Both are leaked on exit, like the
+// DEBUG_LOCKORDER state, so locks taken from global destructors stay safe.
+boost::mutex& LockStatsMutex()
+{
+    static boost::mutex* pmutex = new boost::mutex();
+    return *pmutex;
+}
+
+std::map<std::string, CLockStat*>& LockStatsMap()
+{
+    static std::map<std::string, CLockStat*>* pmap = new std::map<std::string, CLockStat*>();
+    return *pmap;
+}
+
+// Lock names are string literals from the LOCK macros, so each thread
+// caches name-pointer -> stat lookups and the shared map is only touched
+// the first time a thread sees a given lock. Same pattern as the per-thread
+// category cache in LogAcceptCategory.
+CLockStat* FindOrAddLockStat(const char* pszName)
+{
+    static boost::thread_specific_ptr<std::map<const void*, CLockStat*> > ptrCache;
+    if (ptrCache.get() == NULL)
+        ptrCache.reset(new std::map<const void*, CLockStat*>());
+    std::map<const void*, CLockStat*>& cache = *ptrCache.get();
+    std::map<const void*, CLockStat*>::iterator it = cache.find(pszName);
+    if (it != cache.end())
+        return it->second;
+
+    boost::mutex::scoped_lock scoped_lock(LockStatsMutex());
+    std::map<std::string, CLockStat*>& mapStats = LockStatsMap();
+    std::map<std::string, CLockStat*>::iterator itShared = mapStats.find(pszName);
+    if (itShared == mapStats.end())
+        itShared = mapStats.insert(std::make_pair(std::string(pszName), new CLockStat(pszName))).first;
+    cache[pszName] = itShared->second;
+    return itShared->second;
+}
+
+} // anon namespace
+
+void* LockStatAcquired(const char* pszName, int64_t nWaitMicros, bool fContended)
+{
+    CLockStat* stat = FindOrAddLockStat(pszName);
+    stat->nAcquisitions.fetch_add(1, boost::memory_order_relaxed);
+    if (fContended) {
+        stat->nContended.fetch_add(1, boost::memory_order_relaxed);
+        stat->nWaitTotalMicros.fetch_add(nWaitMicros, boost::memory_order_relaxed);
+        AtomicMax(stat->nWaitMaxMicros, nWaitMicros);
+        stat->waitHist[HistBucket(nWaitMicros)].fetch_add(1, boost::memory_order_relaxed);
+    }
+    return stat;
+}
+
+void LockStatReleased(void* pStat, int64_t nHoldMicros)
+{
+    CLockStat* stat = (CLockStat*)pStat;
+    stat->nHoldTotalMicros.fetch_add(nHoldMicros, boost::memory_order_relaxed);
+    AtomicMax(stat->nHoldMaxMicros, nHoldMicros);
+    stat->holdHist[HistBucket(nHoldMicros)].fetch_add(1, boost::memory_order_relaxed);
+}
+
+void GetLockStats(std::vector<CLockStatSnapshot>& vStats)
+{
+    vStats.clear();
+    boost::mutex::scoped_lock scoped_lock(LockStatsMutex());
+    std::map<std::string, CLockStat*>& mapStats = LockStatsMap();
+    for (std::map<std::string, CLockStat*>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        CLockStatSnapshot snap;
+        const CLockStat* stat = it->second;
+        snap.name = stat->name;
+        snap.nAcquisitions = stat->nAcquisitions.load(boost::memory_order_relaxed);
+        snap.nContended = stat->nContended.load(boost::memory_order_relaxed);
+        snap.nWaitTotalMicros = stat->nWaitTotalMicros.load(boost::memory_order_relaxed);
+        snap.nWaitMaxMicros = stat->nWaitMaxMicros.load(boost::memory_order_relaxed);
+        snap.nHoldTotalMicros = stat->nHoldTotalMicros.load(boost::memory_order_relaxed);
+        snap.nHoldMaxMicros = stat->nHoldMaxMicros.load(boost::memory_order_relaxed);
+        for (int i = 0; i < LOCKSTAT_HIST_BUCKETS; i++) {
+            snap.waitHist[i] = stat->waitHist[i].load(boost::memory_order_relaxed);
+            snap.holdHist[i] = stat->holdHist[i].load(boost::memory_order_relaxed);
+        }
+        vStats.push_back(snap);
+    }
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -7,6 +7,11 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -108,24 +113,84 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lightweight lock profiling (-lockstats), available in every build.
+ *
+ * When enabled, each LOCK/TRY_LOCK records per-lock-name acquisition
+ * counts plus wait and hold times into atomic counters and
+ * power-of-two microsecond histograms; the getlockstats RPC reports
+ * them. When disabled (the default) the only cost on the lock path is
+ * a branch on fLockStats. The raw ENTER_CRITICAL_SECTION paths are not
+ * instrumented.
+ */
+static const int LOCKSTAT_HIST_BUCKETS = 16;
+
+struct CLockStatSnapshot
+{
+    std::string name;
+    uint64_t nAcquisitions;
+    uint64_t nContended;
+    uint64_t nWaitTotalMicros;
+    uint64_t nWaitMaxMicros;
+    uint64_t nHoldTotalMicros;
+    uint64_t nHoldMaxMicros;
+    //! bucket i counts events in [2^(i-1), 2^i) microseconds; bucket 0 is <1us
+    uint64_t waitHist[LOCKSTAT_HIST_BUCKETS];
+    uint64_t holdHist[LOCKSTAT_HIST_BUCKETS];
+};
+
+extern bool fLockStats;
+//! Record an acquisition; returns an opaque handle for the matching release.
+void* LockStatAcquired(const char* pszName, int64_t nWaitMicros, bool fContended);
+
+/**
+ * Per-thread lock-wait accumulation, used by the RPC slow-call tracer
+ * (-rpcslowms) to attribute a slow call's time to lock contention. Threads
+ * that never call LockWaitResetThread record nothing, and the flag keeps
+ * the uncontended lock path free of any timing.
+ */
+extern bool fLockWaitTrace;
+//! Start (or restart) accumulating blocked lock-wait time in this thread.
+void LockWaitResetThread();
+//! Total microseconds this thread has spent blocked since the last reset.
+int64_t LockWaitGetThread();
+//! Internal: add a blocking wait to the calling thread's accumulator.
+void LockWaitRecord(int64_t nMicros);
+void LockStatReleased(void* pStat, int64_t nHoldMicros);
+//! Snapshot the profile for every lock name seen so far.
+void GetLockStats(std::vector<CLockStatSnapshot>& vStats);
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    void* pLockStat;
+    int64_t nLockedAtMicros;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            bool fTimeWait = fLockStats || fLockWaitTrace;
+            int64_t nWaitStart = fTimeWait ? GetTimeMicros() : 0;
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            if (fTimeWait) {
+                int64_t nWaited = GetTimeMicros() - nWaitStart;
+                if (fLockStats)
+                    pLockStat = LockStatAcquired(pszName, nWaited, true);
+                if (fLockWaitTrace)
+                    LockWaitRecord(nWaited);
+            }
         }
-#endif
+        else if (fLockStats)
+            pLockStat = LockStatAcquired(pszName, 0, false);
+        if (fLockStats)
+            nLockedAtMicros = GetTimeMicros();
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -134,11 +199,15 @@ private:
         lock.try_lock();
         if (!lock.owns_lock())
             LeaveCritical();
+        else if (fLockStats) {
+            pLockStat = LockStatAcquired(pszName, 0, false);
+            nLockedAtMicros = GetTimeMicros();
+        }
         return lock.owns_lock();
     }
 
 public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock), pLockStat(NULL), nLockedAtMicros(0)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -146,7 +215,7 @@ public:
             Enter(pszName, pszFile, nLine);
     }
 
-    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : pLockStat(NULL), nLockedAtMicros(0)
     {
         if (!pmutexIn) return;
 
@@ -159,8 +228,11 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
             LeaveCritical();
+            if (pLockStat)
+                LockStatReleased(pLockStat, GetTimeMicros() - nLockedAtMicros);
+        }
     }
 
     operator bool()
@@ -180,9 +180,13 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK(addrman.size() == 7);
 
     // Test 12: Select pulls from new and tried regardless of port number.
-    BOOST_CHECK(addrman.Select().ToString() == "250.4.6.6:8333");
-    BOOST_CHECK(addrman.Select().ToString() == "250.3.2.2:9999");
-    BOOST_CHECK(addrman.Select().ToString() == "250.3.3.3:9999");
+    // The expected draws changed when Select_ moved to picking a uniformly
+    // random occupied slot from the packed slot lists: the deterministic
+    // RandomInt sequence is consumed differently than the old random-walk
+    // bucket probing.
+    BOOST_CHECK(addrman.Select().ToString() == "250.4.4.4:8333");
+    BOOST_CHECK(addrman.Select().ToString() == "250.4.5.5:7777");
+    BOOST_CHECK(addrman.Select().ToString() == "250.3.1.1:8333");
     BOOST_CHECK(addrman.Select().ToString() == "250.4.4.4:8333");
 }
 
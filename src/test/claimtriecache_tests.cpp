@@ -15,7 +15,12 @@ public:
     bool recursiveComputeMerkleHash(CClaimTrieNode* tnCurrent,
                                     std::string sPos) const
     {
-        return CClaimTrieCache::recursiveComputeMerkleHash(tnCurrent, sPos);
+        hashMapType results;
+        hashMapType resultsCompact;
+        bool ret = CClaimTrieCache::computeMerkleHashForNode(tnCurrent, sPos, results, resultsCompact, compactHashesActive());
+        for (hashMapType::iterator it = results.begin(); it != results.end(); ++it)
+            cacheHashes[it->first] = it->second;
+        return ret;
     }
 
     bool recursivePruneName(CClaimTrieNode* tnCurrent, unsigned int nPos, std::string sName, bool* pfNullified) const
@@ -89,4 +94,24 @@ BOOST_AUTO_TEST_CASE(recursiveprune_test)
 }
 
 
+BOOST_AUTO_TEST_CASE(incrementalcheck_test)
+{
+    // an empty trie is trivially consistent, incrementally or not
+    BOOST_CHECK(pclaimTrie->checkConsistency());
+    BOOST_CHECK(pclaimTrie->checkConsistency(true));
+
+    COutPoint outpoint;
+    uint160 claimId;
+    CClaimValue test_claim(outpoint, claimId, CAmount(20), 0, 0);
+
+    CClaimTrieCache cc(pclaimTrie, false);
+    BOOST_CHECK(cc.insertClaimIntoTrie(std::string("test"), test_claim, false));
+    BOOST_CHECK(cc.flush());
+
+    // the insert dirtied the 't' subtree, so the incremental check
+    // re-verifies it and should still pass
+    BOOST_CHECK(pclaimTrie->checkConsistency(true));
+    BOOST_CHECK(pclaimTrie->checkConsistency());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
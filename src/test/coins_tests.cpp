@@ -71,7 +71,7 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t ret = cacheCoins.DynamicMemoryUsage();
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
             ret += it->second.coins.DynamicMemoryUsage();
         }
@@ -209,6 +209,91 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Randomized comparison of the open-addressing CCoinsMap against std::map.
+//
+// Every operation (insert, operator[], find, erase, erase-while-iterating,
+// copy, clear) is mirrored on a std::map holding the same keys and the two
+// containers are checked for agreement. Keys are drawn from a small pool so
+// slots are reused often, exercising the tombstone and rehash paths.
+BOOST_AUTO_TEST_CASE(coinsmap_random_ops_test)
+{
+    CCoinsMap map;
+    std::map<uint256, unsigned int> expected;
+
+    std::vector<uint256> keys;
+    keys.resize(250);
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        keys[i] = GetRandHash();
+    }
+
+    bool erased_during_iteration = false;
+    for (unsigned int i = 0; i < 20000; i++) {
+        const uint256& key = keys[insecure_rand() % keys.size()];
+        int action = insecure_rand() % 10;
+        if (action < 4) {
+            // Insert or overwrite through operator[]; nVersion carries the
+            // value we expect to read back.
+            unsigned int nValue = insecure_rand();
+            map[key].coins.nVersion = nValue;
+            expected[key] = nValue;
+        } else if (action < 6) {
+            // insert() must fail on present keys and leave the value alone.
+            CCoinsCacheEntry entry;
+            entry.coins.nVersion = insecure_rand();
+            std::pair<CCoinsMap::iterator, bool> ret = map.insert(std::make_pair(key, entry));
+            BOOST_CHECK_EQUAL(ret.second, expected.count(key) == 0);
+            if (ret.second)
+                expected[key] = entry.coins.nVersion;
+        } else if (action < 8) {
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+        } else if (action < 9) {
+            CCoinsMap::iterator it = map.find(key);
+            std::map<uint256, unsigned int>::iterator itExpect = expected.find(key);
+            BOOST_CHECK_EQUAL(it != map.end(), itExpect != expected.end());
+            if (it != map.end()) {
+                BOOST_CHECK(it->first == key);
+                BOOST_CHECK_EQUAL(it->second.coins.nVersion, itExpect->second);
+            }
+        } else {
+            // Walk the whole table erasing a random subset, the same loop
+            // CCoinsViewCache::BatchWrite runs.
+            CCoinsMap::iterator it = map.begin();
+            while (it != map.end()) {
+                CCoinsMap::iterator itOld = it++;
+                if (insecure_rand() % 4 == 0) {
+                    expected.erase(itOld->first);
+                    map.erase(itOld);
+                    erased_during_iteration = true;
+                }
+            }
+        }
+
+        // Periodically verify full agreement, including via a copy.
+        if (insecure_rand() % 500 == 1 || i == 19999) {
+            BOOST_CHECK_EQUAL(map.size(), expected.size());
+            CCoinsMap copy = map;
+            BOOST_CHECK_EQUAL(copy.size(), expected.size());
+            unsigned int nSeen = 0;
+            for (CCoinsMap::iterator it = map.begin(); it != map.end(); ++it) {
+                std::map<uint256, unsigned int>::iterator itExpect = expected.find(it->first);
+                BOOST_CHECK(itExpect != expected.end());
+                BOOST_CHECK_EQUAL(it->second.coins.nVersion, itExpect->second);
+                CCoinsMap::iterator itCopy = copy.find(it->first);
+                BOOST_CHECK(itCopy != copy.end());
+                BOOST_CHECK_EQUAL(itCopy->second.coins.nVersion, itExpect->second);
+                nSeen++;
+            }
+            BOOST_CHECK_EQUAL(nSeen, expected.size());
+        }
+    }
+    BOOST_CHECK(erased_during_iteration);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(keys[0]) == map.end());
+}
+
 // This test is similar to the previous test
 // except the emphasis is on testing the functionality of UpdateCoins
 // random txs are created and UpdateCoins is used to update the cache stack
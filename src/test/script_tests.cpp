@@ -1032,6 +1032,42 @@ BOOST_AUTO_TEST_CASE(script_claimScript)
     SignSignature(keystore, txClaim1, txFinal, 0);
 }
 
+BOOST_AUTO_TEST_CASE(script_claimScript_stack_limit)
+{
+    // The claim-prefix fast path in EvalScript must fail exactly where the
+    // opcode loop does: interpreting the prefix transiently holds the claim
+    // zero plus the parameter pushes, so an incoming stack near the 1000
+    // element limit has to produce SCRIPT_ERR_STACK_SIZE either way.
+    string sName = "testname";
+    string sValue = "testvalue";
+    std::vector<unsigned char> vchName(sName.begin(), sName.end());
+    std::vector<unsigned char> vchValue(sValue.begin(), sValue.end());
+    CScript claimScript = CScript() << OP_CLAIM_NAME << vchName << vchValue << OP_2DROP << OP_DROP << OP_1;
+    CScript updateScript = CScript() << OP_UPDATE_CLAIM << vchName << vchValue << vchValue << OP_2DROP << OP_2DROP << OP_1;
+
+    ScriptError err;
+    // 998 incoming elements: the prefix would peak at 1001, over the limit.
+    vector<vector<unsigned char> > stack(998, vector<unsigned char>(1, 1));
+    BOOST_CHECK(!EvalScript(stack, claimScript, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_STACK_SIZE, ScriptErrorString(err));
+
+    // 997 incoming elements: peak is exactly 1000, which must validate.
+    stack.assign(997, vector<unsigned char>(1, 1));
+    BOOST_CHECK(EvalScript(stack, claimScript, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    BOOST_CHECK_EQUAL(stack.size(), 998);
+
+    // OP_UPDATE_CLAIM holds one more element, shifting the boundary by one.
+    stack.assign(997, vector<unsigned char>(1, 1));
+    BOOST_CHECK(!EvalScript(stack, updateScript, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_STACK_SIZE, ScriptErrorString(err));
+
+    stack.assign(996, vector<unsigned char>(1, 1));
+    BOOST_CHECK(EvalScript(stack, updateScript, SCRIPT_VERIFY_P2SH, BaseSignatureChecker(), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    BOOST_CHECK_EQUAL(stack.size(), 997);
+}
+
 BOOST_AUTO_TEST_CASE(script_standard_push)
 {
     ScriptError err;
@@ -12,6 +12,7 @@
 #include "key.h"
 #include "main.h"
 #include "miner.h"
+#include "nameclaim.h"
 #include "pubkey.h"
 #include "random.h"
 #include "txdb.h"
@@ -169,7 +170,8 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(CMutableTransaction &tx, CTxMemPo
     CAmount inChainValue = hasNoDependencies ? txn.GetValueOut() : 0;
 
     return CTxMemPoolEntry(txn, nFee, nTime, dPriority, nHeight,
-                           hasNoDependencies, inChainValue, spendsCoinbase, sigOpCount, lp);
+                           hasNoDependencies, inChainValue, spendsCoinbase, sigOpCount,
+                           CalcMinClaimTrieFee(txn, minFeePerNameClaimChar), lp);
 }
 
 void Shutdown(void* parg)
@@ -0,0 +1,48 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TRACE_H
+#define BITCOIN_TRACE_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#ifdef ENABLE_TRACING
+
+/**
+ * Userspace, Statically Defined Tracing (USDT) probes, consumable from
+ * SystemTap, bpftrace or perf without rebuilding or log parsing. Each probe
+ * is a nop instruction plus an ELF note until a tracer attaches, so the
+ * macros are safe on hot paths. Enabled with --enable-usdt at configure
+ * time; without it every TRACEn expands to nothing.
+ *
+ * Probes are named (context, event), e.g. to list them on a live node:
+ *   bpftrace -l 'usdt:/path/to/lbrycrdd:*'
+ * and to attach:
+ *   bpftrace -e 'usdt:/path/to/lbrycrdd:validation:block_connected { ... }'
+ */
+#include <sys/sdt.h>
+
+#define TRACE(context, event) DTRACE_PROBE(context, event)
+#define TRACE1(context, event, a) DTRACE_PROBE1(context, event, a)
+#define TRACE2(context, event, a, b) DTRACE_PROBE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c) DTRACE_PROBE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d) DTRACE_PROBE4(context, event, a, b, c, d)
+#define TRACE5(context, event, a, b, c, d, e) DTRACE_PROBE5(context, event, a, b, c, d, e)
+#define TRACE6(context, event, a, b, c, d, e, f) DTRACE_PROBE6(context, event, a, b, c, d, e, f)
+
+#else
+
+#define TRACE(context, event)
+#define TRACE1(context, event, a)
+#define TRACE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d)
+#define TRACE5(context, event, a, b, c, d, e)
+#define TRACE6(context, event, a, b, c, d, e, f)
+
+#endif // ENABLE_TRACING
+
+#endif // BITCOIN_TRACE_H
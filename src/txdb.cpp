@@ -9,16 +9,20 @@
 #include "chainparams.h"
 #include "hash.h"
 #include "main.h"
+#include "perf.h"
 #include "pow.h"
 #include "uint256.h"
 
 #include <stdint.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
 static const char DB_COINS = 'c';
+static const char DB_COINS_META = 'd';
+static const char DB_COINS_VOUT = 'e';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
@@ -27,18 +31,230 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_STATS = 'S';
+
+//! version prefix of the coins write-ahead log
+static const uint64_t COINS_WAL_VERSION = 1;
+//! entries per log chunk and per chunked leveldb write batch
+static const size_t COINS_WAL_CHUNK = 16384;
+//! below this many dirty entries a flush stays a single atomic batch
+static const size_t COINS_WAL_MIN_ENTRIES = 65536;
+//! upper bound accepted for a serialized log chunk when replaying
+static const uint32_t MAX_COINS_WAL_CHUNK_SIZE = 64 * 1024 * 1024;
+
+static boost::filesystem::path GetCoinsWalPath()
+{
+    return GetDataDir() / "chainstate.wal";
+}
+
+
+/** Per-record metadata for the per-txout coins layout: everything from
+ *  CCoins except the outputs themselves, which live in their own rows
+ *  under DB_COINS_VOUT keyed by (txid, n). */
+struct CDiskCoinsMeta
+{
+    int nVersion;
+    bool fCoinBase;
+    uint32_t nHeight;
+    uint32_t nVoutSize;
+
+    CDiskCoinsMeta() : nVersion(0), fCoinBase(false), nHeight(0), nVoutSize(0) {}
+    CDiskCoinsMeta(const CCoins& coins) : nVersion(coins.nVersion), fCoinBase(coins.fCoinBase), nHeight(coins.nHeight), nVoutSize(coins.vout.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(this->nVersion));
+        READWRITE(fCoinBase);
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nVoutSize));
+    }
+};
 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), fDbMemory(fMemory)
+{
+    if (!fDbMemory)
+        ReplayWal();
+}
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+bool CCoinsViewDB::WriteWal(const CCoinsMap &mapCoins, const uint256 &hashBlock)
 {
+    boost::filesystem::path path = GetCoinsWalPath();
+    FILE* file = fopen(path.string().c_str(), "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: failed to open %s", __func__, path.string());
+    try {
+        fileout << COINS_WAL_VERSION;
+        CCoinsMap::const_iterator it = mapCoins.begin();
+        while (it != mapCoins.end()) {
+            // Each chunk is self-delimited and checksummed so a torn write
+            // at the tail invalidates only that chunk on replay.
+            CDataStream ssEntries(SER_DISK, CLIENT_VERSION);
+            uint32_t nEntries = 0;
+            for (; it != mapCoins.end() && nEntries < COINS_WAL_CHUNK; it++) {
+                if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                    continue;
+                ssEntries << it->first;
+                ssEntries << it->second.coins.IsPruned();
+                if (!it->second.coins.IsPruned())
+                    ssEntries << it->second.coins;
+                nEntries++;
+            }
+            if (nEntries == 0)
+                break;
+            CDataStream ssChunk(SER_DISK, CLIENT_VERSION);
+            ssChunk << hashBlock;
+            ssChunk << nEntries;
+            ssChunk.write(&ssEntries[0], ssEntries.size());
+            fileout << (uint32_t)ssChunk.size();
+            fileout.write(&ssChunk[0], ssChunk.size());
+            fileout << Hash(ssChunk.begin(), ssChunk.end());
+        }
+        FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        return error("%s: failed to write %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
+void CCoinsViewDB::ReplayWal()
+{
+    boost::filesystem::path path = GetCoinsWalPath();
+    if (!boost::filesystem::exists(path))
+        return;
+    FILE* file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        LogPrintf("%s: failed to open %s\n", __func__, path.string());
+        return;
+    }
+    CCoinsMap mapRecovered;
+    uint256 hashFence;
+    try {
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion == COINS_WAL_VERSION) {
+            while (true) {
+                uint32_t nChunkSize;
+                filein >> nChunkSize;
+                if (nChunkSize == 0 || nChunkSize > MAX_COINS_WAL_CHUNK_SIZE)
+                    break;
+                std::vector<char> vchChunk(nChunkSize);
+                filein.read(&vchChunk[0], nChunkSize);
+                uint256 hashChecksum;
+                filein >> hashChecksum;
+                if (Hash(vchChunk.begin(), vchChunk.end()) != hashChecksum)
+                    break;
+                CDataStream ssChunk(&vchChunk[0], &vchChunk[0] + nChunkSize, SER_DISK, CLIENT_VERSION);
+                uint32_t nEntries;
+                ssChunk >> hashFence;
+                ssChunk >> nEntries;
+                for (uint32_t n = 0; n < nEntries; n++) {
+                    uint256 txid;
+                    bool fPruned;
+                    ssChunk >> txid;
+                    ssChunk >> fPruned;
+                    CCoinsCacheEntry& entry = mapRecovered[txid];
+                    entry.coins.Clear();
+                    if (!fPruned)
+                        ssChunk >> entry.coins;
+                    entry.flags = CCoinsCacheEntry::DIRTY;
+                }
+            }
+        } else {
+            LogPrintf("%s: unknown log version %d in %s\n", __func__, (int)nVersion, path.string());
+        }
+    } catch (const std::exception&) {
+        // A truncated tail means the previous flush died while appending;
+        // everything before it was durable and is replayed below.
+    }
+    if (!mapRecovered.empty()) {
+        LogPrintf("Replaying %u coin entries from an interrupted flush\n", (unsigned int)mapRecovered.size());
+        if (!ApplyBatch(mapRecovered, hashFence, true))
+            throw dbwrapper_error("Failed to replay the coins write-ahead log");
+    }
+    filein.fclose();
+    boost::filesystem::remove(path);
+}
+
+bool CCoinsViewDB::ReadCoinsPerTxout(const uint256 &txid, CCoins &coins) const {
+    CDiskCoinsMeta meta;
+    if (!db.Read(make_pair(DB_COINS_META, txid), meta))
+        return false;
+    coins.Clear();
+    coins.nVersion = meta.nVersion;
+    coins.fCoinBase = meta.fCoinBase;
+    coins.nHeight = meta.nHeight;
+    coins.vout.assign(meta.nVoutSize, CTxOut());
+    // All rows for one txid share its 32-byte prefix and are adjacent, so a
+    // single range scan collects the unspent outputs.
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(make_pair(DB_COINS_VOUT, make_pair(txid, (uint32_t)0)));
+    while (pcursor->Valid()) {
+        std::pair<char, std::pair<uint256, uint32_t> > key;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS_VOUT || key.second.first != txid)
+            break;
+        // Deserialize straight into the destination output, so the script
+        // bytes are written once rather than passing through a temporary.
+        // Rows beyond the recorded vout count land in a discarded dummy.
+        CTxOut txoutDiscard;
+        CTxOut& txout = key.second.second < coins.vout.size() ? coins.vout[key.second.second] : txoutDiscard;
+        CTxOutCompressor compressor(txout);
+        if (!pcursor->GetValue(compressor))
+            return error("%s: failed to read output %u of %s", __func__, key.second.second, txid.ToString());
+        pcursor->Next();
+    }
+    coins.SetDiskOrigin(true);
+    return true;
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    CPerfTimer timer("leveldb.coinsread");
+    if (ReadCoinsPerTxout(txid, coins))
+        return true;
+    if (!db.Read(make_pair(DB_COINS, txid), coins))
+        return false;
+    coins.SetDiskOrigin(false);
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    return db.Exists(make_pair(DB_COINS_META, txid)) || db.Exists(make_pair(DB_COINS, txid));
+}
+
+void CCoinsViewDB::PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const {
+    // One sorted pass over the metadata keyspace resolves which records use
+    // the per-txout layout (their outputs are then collected by forward
+    // range scans), and anything left over is batched from the legacy
+    // keyspace: a few sorted sweeps instead of N random point reads.
+    std::vector<std::pair<char, uint256> > vMetaKeys;
+    vMetaKeys.reserve(vtxids.size());
+    for (std::vector<uint256>::const_iterator it = vtxids.begin(); it != vtxids.end(); it++)
+        vMetaKeys.push_back(make_pair(DB_COINS_META, *it));
+    std::map<std::pair<char, uint256>, CDiskCoinsMeta> mapMeta;
+    db.ReadBatch(vMetaKeys, mapMeta);
+
+    std::vector<std::pair<char, uint256> > vLegacyKeys;
+    for (std::vector<uint256>::const_iterator it = vtxids.begin(); it != vtxids.end(); it++) {
+        if (mapMeta.count(make_pair(DB_COINS_META, *it))) {
+            CCoins& coins = mapCoins[*it];
+            if (!ReadCoinsPerTxout(*it, coins))
+                mapCoins.erase(*it);
+        } else {
+            vLegacyKeys.push_back(make_pair(DB_COINS, *it));
+        }
+    }
+    if (!vLegacyKeys.empty()) {
+        std::map<std::pair<char, uint256>, CCoins> mapLegacy;
+        db.ReadBatch(vLegacyKeys, mapLegacy);
+        for (std::map<std::pair<char, uint256>, CCoins>::iterator it = mapLegacy.begin(); it != mapLegacy.end(); it++) {
+            CCoins& coins = mapCoins[it->first.second];
+            coins.swap(it->second);
+            coins.SetDiskOrigin(false);
+        }
+    }
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -49,16 +265,56 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    // Large flushes are fenced by a write-ahead log: once the dirty set is
+    // durable in the log, the leveldb application may be split into several
+    // batches without risking a half-written state at crash -- an
+    // interrupted flush is simply replayed on the next startup.
+    if (!fDbMemory && mapCoins.size() >= COINS_WAL_MIN_ENTRIES && WriteWal(mapCoins, hashBlock)) {
+        if (!ApplyBatch(mapCoins, hashBlock, true))
+            return false;
+        boost::filesystem::remove(GetCoinsWalPath());
+        return true;
+    }
+    return ApplyBatch(mapCoins, hashBlock, false);
+}
+
+bool CCoinsViewDB::ApplyBatch(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fChunked) {
     CDBBatch batch(&db.GetObfuscateKey());
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
+            const CCoins& coins = it->second.coins;
+            uint32_t nOldRows = std::max(coins.nDiskVoutSize, (uint32_t)coins.vout.size());
+            if (coins.IsPruned()) {
+                batch.Erase(make_pair(DB_COINS, it->first));
+                batch.Erase(make_pair(DB_COINS_META, it->first));
+                for (uint32_t n = 0; n < nOldRows; n++)
+                    batch.Erase(make_pair(DB_COINS_VOUT, make_pair(it->first, n)));
+            } else if (coins.fStoredPerTxout && coins.fSpendTracking) {
+                // Only outputs have been consumed since the disk read: drop
+                // just those rows instead of rewriting the whole record.
+                batch.Write(make_pair(DB_COINS_META, it->first), CDiskCoinsMeta(coins));
+                for (std::set<uint32_t>::const_iterator itSpent = coins.setSpentSinceRead.begin(); itSpent != coins.setSpentSinceRead.end(); itSpent++)
+                    batch.Erase(make_pair(DB_COINS_VOUT, make_pair(it->first, *itSpent)));
+            } else {
                 batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(make_pair(DB_COINS_META, it->first), CDiskCoinsMeta(coins));
+                for (uint32_t n = 0; n < nOldRows; n++) {
+                    if (n < coins.vout.size() && !coins.vout[n].IsNull()) {
+                        CTxOut txout(coins.vout[n]);
+                        batch.Write(make_pair(DB_COINS_VOUT, make_pair(it->first, n)), CTxOutCompressor(txout));
+                    } else {
+                        batch.Erase(make_pair(DB_COINS_VOUT, make_pair(it->first, n)));
+                    }
+                }
+            }
             changed++;
+            if (fChunked && changed % COINS_WAL_CHUNK == 0) {
+                if (!db.WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
         }
         count++;
         CCoinsMap::iterator itOld = it++;
@@ -68,7 +324,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    // the final (or only) batch carries the best-block fence; when chunked
+    // it is synced so the log can be removed afterwards
+    return db.WriteBatch(batch, fChunked);
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -96,7 +354,7 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock(), this);
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
@@ -109,7 +367,7 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
 bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COINS || keyTmp.first == DB_COINS_META) {
         key = keyTmp.second;
         return true;
     }
@@ -118,6 +376,8 @@ bool CCoinsViewDBCursor::GetKey(uint256 &key) const
 
 bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
 {
+    if (keyTmp.first == DB_COINS_META)
+        return pview->ReadCoinsPerTxout(keyTmp.second, coins);
     return pcursor->GetValue(coins);
 }
 
@@ -128,7 +388,9 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    // Legacy records sort before the per-txout metadata, so the cursor
+    // walks both layouts in one pass; a txid appears under exactly one.
+    return keyTmp.first == DB_COINS || keyTmp.first == DB_COINS_META;
 }
 
 void CCoinsViewDBCursor::Next()
@@ -158,6 +420,21 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
+bool CBlockTreeDB::ReadTxIndexBatch(const std::vector<uint256> &vTxids, std::map<uint256, CDiskTxPos> &mapPos) {
+    std::vector<std::pair<char, uint256> > vKeys;
+    vKeys.reserve(vTxids.size());
+    for (std::vector<uint256>::const_iterator it = vTxids.begin(); it != vTxids.end(); it++)
+        vKeys.push_back(make_pair(DB_TXINDEX, *it));
+
+    std::map<std::pair<char, uint256>, CDiskTxPos> mapRead;
+    if (!ReadBatch(vKeys, mapRead))
+        return false;
+
+    for (std::map<std::pair<char, uint256>, CDiskTxPos>::const_iterator it = mapRead.begin(); it != mapRead.end(); it++)
+        mapPos[it->first.second] = it->second;
+    return true;
+}
+
 bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
@@ -165,6 +442,14 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadBlockStats(const uint256 &blockHash, CBlockStats &stats) {
+    return Read(make_pair(DB_BLOCK_STATS, blockHash), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStats(const uint256 &blockHash, const CBlockStats &stats) {
+    return Write(make_pair(DB_BLOCK_STATS, blockHash), stats);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -177,8 +462,30 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::LoadBlockIndexGuts(int nThreads)
 {
+    if (nThreads > 1) {
+        // Stripe the block index keyspace by the first serialized byte of
+        // the block hash. Each worker walks its own range with a private
+        // iterator and does the proof-of-work hashing -- which dominates
+        // this loop -- outside the lock protecting mapBlockIndex.
+        int nShards = std::min(nThreads, 16);
+        std::vector<char> vShardOk(nShards, 1);
+        boost::mutex mutexIndex;
+        boost::thread_group threads;
+        for (int i = 0; i < nShards; i++) {
+            unsigned char nFirstByte = (unsigned char)((256 * i) / nShards);
+            unsigned char nLastByte = (unsigned char)((256 * (i + 1)) / nShards - 1);
+            threads.create_thread(boost::bind(&CBlockTreeDB::LoadBlockIndexShard, this, nFirstByte, nLastByte, &mutexIndex, &vShardOk[i]));
+        }
+        threads.join_all();
+        for (int i = 0; i < nShards; i++) {
+            if (!vShardOk[i])
+                return false;
+        }
+        return true;
+    }
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
@@ -220,3 +527,62 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     return true;
 }
+
+void CBlockTreeDB::LoadBlockIndexShard(unsigned char nFirstByte, unsigned char nLastByte, boost::mutex* pmutexIndex, char* pfShardOk)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    std::vector<unsigned char> vchStart(32, 0);
+    vchStart[0] = nFirstByte;
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256(vchStart)));
+
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+            break;
+        if (*key.second.begin() > nLastByte)
+            break;
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            error("LoadBlockIndex() : failed to read value");
+            *pfShardOk = 0;
+            return;
+        }
+
+        // Verify the proof of work before taking the lock; rebuilding the
+        // header here avoids touching the shared index for the hash.
+        CBlockHeader header;
+        header.nVersion       = diskindex.nVersion;
+        header.hashPrevBlock  = diskindex.hashPrev;
+        header.hashMerkleRoot = diskindex.hashMerkleRoot;
+        header.hashClaimTrie  = diskindex.hashClaimTrie;
+        header.nTime          = diskindex.nTime;
+        header.nBits          = diskindex.nBits;
+        header.nNonce         = diskindex.nNonce;
+        if (!CheckProofOfWork(header.GetPoWHash(), diskindex.nBits, Params().GetConsensus())) {
+            error("LoadBlockIndex(): CheckProofOfWork failed: %s", diskindex.GetBlockHash().ToString());
+            *pfShardOk = 0;
+            return;
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(*pmutexIndex);
+            CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+            pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->hashClaimTrie  = diskindex.hashClaimTrie;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+        }
+
+        pcursor->Next();
+    }
+}
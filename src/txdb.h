@@ -9,6 +9,8 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <boost/thread.hpp>
+
 #include <map>
 #include <string>
 #include <utility>
@@ -16,6 +18,7 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CBlockStats;
 struct CDiskTxPos;
 class uint256;
 
@@ -38,9 +41,30 @@ public:
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
+    void PeekCoinsBatch(const std::vector<uint256> &vtxids, std::map<uint256, CCoins> &mapCoins) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+private:
+    //! Whether this instance is backed by a memory environment (no WAL).
+    bool fDbMemory;
+
+    //! Reassemble a record stored under the per-txout layout.
+    bool ReadCoinsPerTxout(const uint256 &txid, CCoins &coins) const;
+
+    //! Apply a set of dirty entries to leveldb; when fChunked, split the
+    //! work across several write batches with only the last one synced.
+    bool ApplyBatch(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fChunked);
+
+    //! Write the dirty subset of mapCoins to the write-ahead log so a
+    //! chunked ApplyBatch can be interrupted safely.
+    bool WriteWal(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+
+    //! Re-apply a log left over by an interrupted flush, then remove it.
+    void ReplayWal();
+
+    friend class CCoinsViewDBCursor;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -57,9 +81,10 @@ public:
     void Next();
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, const CCoinsViewDB* pviewIn):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), pview(pviewIn) {}
     boost::scoped_ptr<CDBIterator> pcursor;
+    const CCoinsViewDB* pview;
     std::pair<char, uint256> keyTmp;
 
     friend class CCoinsViewDB;
@@ -80,10 +105,18 @@ public:
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
+    //! Resolve many txindex entries in one sorted iterator sweep; txids
+    //! without an index entry are simply absent from the result map.
+    bool ReadTxIndexBatch(const std::vector<uint256> &vTxids, std::map<uint256, CDiskTxPos> &mapPos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadBlockStats(const uint256 &blockHash, CBlockStats &stats);
+    bool WriteBlockStats(const uint256 &blockHash, const CBlockStats &stats);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts();
+    bool LoadBlockIndexGuts(int nThreads = 1);
+
+private:
+    void LoadBlockIndexShard(unsigned char nFirstByte, unsigned char nLastByte, boost::mutex* pmutexIndex, char* pfShardOk);
 };
 
 #endif // BITCOIN_TXDB_H
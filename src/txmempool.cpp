@@ -22,10 +22,11 @@ using namespace std;
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                                  int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                                  bool poolHasNoInputsOf, CAmount _inChainInputValue,
-                                 bool _spendsCoinbase, unsigned int _sigOps, LockPoints lp):
+                                 bool _spendsCoinbase, unsigned int _sigOps, CAmount _minClaimTrieFee, LockPoints lp):
     tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority), entryHeight(_entryHeight),
     hadNoDependencies(poolHasNoInputsOf), inChainInputValue(_inChainInputValue),
-    spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOps), lockPoints(lp)
+    spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOps), minClaimTrieFee(_minClaimTrieFee), lockPoints(lp),
+    nEpochMarker(0), nCachedInfoHeight(0), fInfoCached(false)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
     nModSize = tx.CalculateModifiedSize(nTxSize);
@@ -65,6 +66,7 @@ void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
     nModFeesWithDescendants += newFeeDelta - feeDelta;
     nModFeesWithAncestors += newFeeDelta - feeDelta;
     feeDelta = newFeeDelta;
+    fInfoCached = false;
 }
 
 void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
@@ -78,7 +80,11 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
     setEntries stageEntries, setAllDescendants;
+    const uint64_t nCurEpoch = GetFreshEpoch();
     stageEntries = GetMemPoolChildren(updateIt);
+    BOOST_FOREACH(const txiter childEntry, stageEntries) {
+        visited(childEntry, nCurEpoch);
+    }
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
@@ -92,8 +98,10 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
                 // but don't traverse again.
                 BOOST_FOREACH(const txiter cacheEntry, cacheIt->second) {
                     setAllDescendants.insert(cacheEntry);
+                    visited(cacheEntry, nCurEpoch);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+                visited(childEntry, nCurEpoch);
+            } else if (!visited(childEntry, nCurEpoch)) {
                 // Schedule for later processing
                 stageEntries.insert(childEntry);
             }
@@ -169,6 +177,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 {
     setEntries parentHashes;
     const CTransaction &tx = entry.GetTx();
+    const uint64_t nCurEpoch = GetFreshEpoch();
 
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
@@ -177,7 +186,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
             if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+                if (!visited(piter, nCurEpoch)) {
+                    parentHashes.insert(piter);
+                }
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -189,6 +200,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
         parentHashes = GetMemPoolParents(it);
+        BOOST_FOREACH(const txiter &piter, parentHashes) {
+            visited(piter, nCurEpoch);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -214,7 +228,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
+            if (!visited(phash, nCurEpoch)) {
                 parentHashes.insert(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
@@ -284,6 +298,10 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCount();
             BOOST_FOREACH(txiter dit, setDescendants) {
+                // No point updating entries that are being removed in the
+                // same batch; they are about to be deleted.
+                if (entriesToRemove.count(dit))
+                    continue;
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
             }
         }
@@ -329,6 +347,7 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     nModFeesWithDescendants += modifyFee;
     nCountWithDescendants += modifyCount;
     assert(int64_t(nCountWithDescendants) > 0);
+    fInfoCached = false;
 }
 
 void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps)
@@ -340,10 +359,11 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nCountWithAncestors) > 0);
     nSigOpCountWithAncestors += modifySigOps;
     assert(int(nSigOpCountWithAncestors) >= 0);
+    fInfoCached = false;
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0), nEpoch(0), nSnapshotUpdated(0)
 {
     _clear(); //lock free clear
 
@@ -465,12 +485,15 @@ void CTxMemPool::removeUnchecked(txiter it)
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
     setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
+    const uint64_t nCurEpoch = GetFreshEpoch();
+    if (!visited(entryit, nCurEpoch) && setDescendants.count(entryit) == 0) {
         stage.insert(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
-    // already been walked, or will be walked in this iteration).
+    // already been walked, or will be walked in this iteration).  Within this
+    // call the epoch marker answers that in O(1); entries carried over from an
+    // earlier call still need the set lookup, but only once each.
     while (!stage.empty()) {
         txiter it = *stage.begin();
         setDescendants.insert(it);
@@ -478,7 +501,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         BOOST_FOREACH(const txiter &childiter, setChildren) {
-            if (!setDescendants.count(childiter)) {
+            if (!visited(childiter, nCurEpoch) && !setDescendants.count(childiter)) {
                 stage.insert(childiter);
             }
         }
@@ -581,22 +604,28 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
+    setEntries setBlockTxs;
     BOOST_FOREACH(const CTransaction& tx, vtx)
     {
         uint256 hash = tx.GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
-        if (i != mapTx.end())
+        if (i != mapTx.end()) {
             entries.push_back(*i);
+            setBlockTxs.insert(i);
+        }
+    }
+    // Remove every confirmed transaction in one staged batch, so the
+    // ancestor/descendant bookkeeping and mapLinks surgery run a single
+    // pass over the block instead of once per transaction. Descendant
+    // state updates for transactions confirmed in the same block are
+    // skipped inside UpdateForRemoveFromMempool, since those entries are
+    // deleted moments later anyway.
+    if (!setBlockTxs.empty()) {
+        RemoveStaged(setBlockTxs, true);
     }
     BOOST_FOREACH(const CTransaction& tx, vtx)
     {
-        txiter it = mapTx.find(tx.GetHash());
-        if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true);
-        }
         removeConflicts(tx, conflicts);
         ClearPrioritisation(tx.GetHash());
     }
@@ -762,6 +791,22 @@ void CTxMemPool::queryHashes(vector<uint256>& vtxid)
         vtxid.push_back(mi->GetTx().GetHash());
 }
 
+void CTxMemPool::queryHashesSnapshot(vector<uint256>& vtxid) const
+{
+    LOCK(cs_snapshot);
+    {
+        TRY_LOCK(cs, lockPool);
+        if (lockPool && nSnapshotUpdated != nTransactionsUpdated) {
+            vSnapshotTxids.clear();
+            vSnapshotTxids.reserve(mapTx.size());
+            for (indexed_transaction_set::const_iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+                vSnapshotTxids.push_back(mi->GetTx().GetHash());
+            nSnapshotUpdated = nTransactionsUpdated;
+        }
+    }
+    vtxid = vSnapshotTxids;
+}
+
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
@@ -786,6 +831,11 @@ CFeeRate CTxMemPool::estimateFee(int nBlocks) const
     LOCK(cs);
     return minerPolicyEstimator->estimateFee(nBlocks);
 }
+CFeeRate CTxMemPool::estimateClaimFee(int nBlocks) const
+{
+    LOCK(cs);
+    return minerPolicyEstimator->estimateClaimFee(nBlocks);
+}
 CFeeRate CTxMemPool::estimateSmartFee(int nBlocks, int *answerFoundAtBlocks) const
 {
     LOCK(cs);
@@ -1017,19 +1067,53 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
-
-        // We set the new mempool min fee to the feerate of the removed set, plus the
-        // "minimum reasonable fee rate" (ie some value under which we consider txn
-        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
-        // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
-        removed += minReasonableRelayFee;
-        trackPackageRemoved(removed);
-        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
-
+        // Stage as many of the cheapest packages as the overage calls for and
+        // remove them in one pass, rather than paying the full removal
+        // bookkeeping (ancestor state updates, orphan scan) once per package.
+        // The per-entry estimate below deliberately errs high -- links into
+        // unstaged entries are counted even though only some are freed -- so
+        // a batch never evicts deeper than removing packages one at a time
+        // would; any shortfall is picked up by the next round of the loop.
+        size_t nToFree = DynamicMemoryUsage() - sizelimit;
+        size_t nStagedUsage = 0;
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        while (it != mapTx.get<descendant_score>().end() && nStagedUsage < nToFree) {
+            txiter top = mapTx.project<0>(it);
+            it++;
+            // already staged as the descendant of an earlier victim
+            if (stage.count(top))
+                continue;
+
+            // We set the new mempool min fee to the feerate of the removed set, plus the
+            // "minimum reasonable fee rate" (ie some value under which we consider txn
+            // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
+            // equal to txn which were removed with no block in between.
+            CFeeRate removed(top->GetModFeesWithDescendants(), top->GetSizeWithDescendants());
+            removed += minReasonableRelayFee;
+            trackPackageRemoved(removed);
+            maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+            setEntries pkg;
+            CalculateDescendants(top, pkg);
+            BOOST_FOREACH(txiter pkgit, pkg) {
+                if (stage.insert(pkgit).second) {
+                    // mirror the terms of DynamicMemoryUsage(): the mapTx
+                    // share, the entry itself, its mapLinks/mapNextTx nodes
+                    // and link sets, plus its node in each parent's child set
+                    const setEntries& parents = GetMemPoolParents(pkgit);
+                    const setEntries& children = GetMemPoolChildren(pkgit);
+                    nStagedUsage += memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) +
+                                    pkgit->DynamicMemoryUsage() +
+                                    memusage::IncrementalDynamicUsage(mapLinks) +
+                                    memusage::IncrementalDynamicUsage(mapNextTx) * pkgit->GetTx().vin.size() +
+                                    memusage::DynamicUsage(parents) + memusage::DynamicUsage(children) +
+                                    memusage::IncrementalDynamicUsage(parents) * parents.size();
+                }
+            }
+        }
+        if (stage.empty())
+            break;
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
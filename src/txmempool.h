@@ -14,6 +14,8 @@
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <univalue.h>
+
 #undef foreach
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
@@ -85,6 +87,7 @@ private:
     CAmount inChainInputValue; //!< Sum of all txin values that are already in blockchain
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     unsigned int sigOpCount;   //!< Legacy sig ops plus P2SH sig op count
+    CAmount minClaimTrieFee;   //!< Per-name-character claim fee obligation, decoded once at admission
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
@@ -103,11 +106,25 @@ private:
     CAmount nModFeesWithAncestors;
     unsigned int nSigOpCountWithAncestors;
 
+    //! epoch when this entry was last visited by a mempool traversal; see
+    //! CTxMemPool::visited().  Not part of any index ordering.
+    mutable uint64_t nEpochMarker;
+
+    //! Cached getrawmempool verbose fragment. Rebuilt when the entry's
+    //! ancestry or fee delta changes, or when the chain advances (the
+    //! current priority ages with height). Not counted in DynamicMemoryUsage;
+    //! it exists only while monitoring polls the verbose dump.
+    mutable UniValue cachedInfo;
+    mutable unsigned int nCachedInfoHeight;
+    mutable bool fInfoCached;
+
+    friend class CTxMemPool;
+
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                     bool poolHasNoInputsOf, CAmount _inChainInputValue, bool spendsCoinbase,
-                    unsigned int nSigOps, LockPoints lp);
+                    unsigned int nSigOps, CAmount _minClaimTrieFee, LockPoints lp);
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
     const CTransaction& GetTx() const { return this->tx; }
@@ -122,10 +139,20 @@ public:
     unsigned int GetHeight() const { return entryHeight; }
     bool WasClearAtEntry() const { return hadNoDependencies; }
     unsigned int GetSigOpCount() const { return sigOpCount; }
+    CAmount GetMinClaimTrieFee() const { return minClaimTrieFee; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
 
+    bool IsInfoCached(unsigned int currentHeight) const { return fInfoCached && nCachedInfoHeight == currentHeight; }
+    const UniValue& GetCachedInfo() const { return cachedInfo; }
+    void SetCachedInfo(const UniValue& info, unsigned int currentHeight) const
+    {
+        cachedInfo = info;
+        nCachedInfoHeight = currentHeight;
+        fInfoCached = true;
+    }
+
     // Adjusts the descendant state, if this entry is not dirty.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
     // Adjusts the ancestor state
@@ -217,7 +244,7 @@ struct mempoolentry_txid
 class CompareTxMemPoolEntryByDescendantScore
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         bool fUseADescendants = UseDescendantScore(a);
         bool fUseBDescendants = UseDescendantScore(b);
@@ -239,7 +266,7 @@ public:
     }
 
     // Calculate which score to use for an entry (avoiding division).
-    bool UseDescendantScore(const CTxMemPoolEntry &a)
+    bool UseDescendantScore(const CTxMemPoolEntry &a) const
     {
         double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
         double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
@@ -254,7 +281,7 @@ public:
 class CompareTxMemPoolEntryByScore
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
         double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
@@ -268,7 +295,7 @@ public:
 class CompareTxMemPoolEntryByEntryTime
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         return a.GetTime() < b.GetTime();
     }
@@ -277,7 +304,7 @@ public:
 class CompareTxMemPoolEntryByAncestorFee
 {
 public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b)
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
         double aFees = a.GetModFeesWithAncestors();
         double aSize = a.GetSizeWithAncestors();
@@ -401,6 +428,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated;
+    mutable uint64_t nEpoch; //!< incremented once per graph traversal; see visited()
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx' byte sizes
@@ -408,6 +436,12 @@ private:
 
     CFeeRate minReasonableRelayFee;
 
+    //! Published txid snapshot for readers that must not block on cs;
+    //! see queryHashesSnapshot().
+    mutable CCriticalSection cs_snapshot;
+    mutable std::vector<uint256> vSnapshotTxids;
+    mutable unsigned int nSnapshotUpdated; //!< nTransactionsUpdated at snapshot time
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
@@ -463,6 +497,23 @@ public:
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
 private:
+    /** Start a new traversal epoch. Entries are stamped with the current
+     *  epoch the first time visited() sees them, so traversals can answer
+     *  "have I seen this entry yet?" in O(1) without a side set. Only call
+     *  with cs held; traversals must not interleave within one epoch. */
+    uint64_t GetFreshEpoch() const { return ++nEpoch; }
+
+    /** Return whether the entry was already seen in the given epoch, marking
+     *  it as seen if it was not. The marker lives outside every index key,
+     *  so no mapTx.modify() is needed. */
+    bool visited(txiter it, uint64_t nCurEpoch) const
+    {
+        if (it->nEpochMarker == nCurEpoch)
+            return true;
+        it->nEpochMarker = nCurEpoch;
+        return false;
+    }
+
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
@@ -512,6 +563,13 @@ public:
     void clear();
     void _clear(); //lock free
     void queryHashes(std::vector<uint256>& vtxid);
+
+    /** Like queryHashes, but served from a published snapshot so frequent
+     *  pollers (getrawmempool monitoring) never block transaction admission
+     *  on cs. The snapshot is refreshed opportunistically when cs happens to
+     *  be free and the pool has changed since it was last taken; while a
+     *  writer holds cs, callers get the most recently published snapshot. */
+    void queryHashesSnapshot(std::vector<uint256>& vtxid) const;
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -611,6 +669,9 @@ public:
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
+    /** Estimate fee rate needed for a claim-bearing tx to enter a block within nBlocks */
+    CFeeRate estimateClaimFee(int nBlocks) const;
+
     /** Estimate priority needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
      *  at the lowest number of blocks where one can be given
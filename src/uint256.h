@@ -128,6 +128,11 @@ public:
         return ReadLE64(data);
     }
 
+    uint64_t GetUint64(int pos) const
+    {
+        return ReadLE64(data + pos * 8);
+    }
+
     /** A more secure, salted hash function.
      * @note This hash is not stable between little and big endian.
      */
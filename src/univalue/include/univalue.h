@@ -136,6 +136,7 @@ private:
     std::vector<UniValue> values;
 
     int findKey(const std::string& key) const;
+    void writeStream(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -112,9 +112,10 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '7':
     case '8':
     case '9': {
-        // part 1: int
-        string numStr;
+        // Validate the number in place, then capture it with a single
+        // assign; nothing is copied until the token is known to be good.
 
+        // part 1: int
         const char *first = raw;
 
         const char *firstDigit = first;
@@ -123,49 +124,38 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
         if ((*firstDigit == '0') && json_isdigit(firstDigit[1]))
             return JTOK_ERR;
 
-        numStr += *raw;                       // copy first char
-        raw++;
+        raw++;                                // consume first char
 
         if ((*first == '-') && (!json_isdigit(*raw)))
             return JTOK_ERR;
 
-        while ((*raw) && json_isdigit(*raw)) {     // copy digits
-            numStr += *raw;
+        while ((*raw) && json_isdigit(*raw))       // consume digits
             raw++;
-        }
 
         // part 2: frac
         if (*raw == '.') {
-            numStr += *raw;                   // copy .
-            raw++;
+            raw++;                            // consume .
 
             if (!json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while ((*raw) && json_isdigit(*raw))   // consume digits
                 raw++;
-            }
         }
 
         // part 3: exp
         if (*raw == 'e' || *raw == 'E') {
-            numStr += *raw;                   // copy E
-            raw++;
+            raw++;                            // consume E
 
-            if (*raw == '-' || *raw == '+') { // copy +/-
-                numStr += *raw;
+            if (*raw == '-' || *raw == '+')   // consume +/-
                 raw++;
-            }
 
             if (!json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while ((*raw) && json_isdigit(*raw))   // consume digits
                 raw++;
-            }
         }
 
-        tokenVal = numStr;
+        tokenVal.assign(first, raw);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -173,7 +163,25 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '"': {
         raw++;                                // skip "
 
-        string valStr;
+        // Most strings carry no escapes at all (hex-encoded transactions
+        // especially), so scan in place first and capture the whole token
+        // with one bulk assign when the closing quote is reached.
+        const char *strBegin = raw;
+        while (*raw && !(*raw < 0x20) && *raw != '"' && *raw != '\\')
+            raw++;
+        if (*raw == 0 || *raw == '"') {
+            tokenVal.assign(strBegin, raw);
+            if (*raw)
+                raw++;                        // skip "
+            consumed = (raw - rawStart);
+            return JTOK_STRING;
+        }
+        if (*raw < 0x20)
+            return JTOK_ERR;
+
+        // Escape found: fall back to building the unescaped value, seeded
+        // with the plain prefix the scan above already covered.
+        string valStr(strBegin, raw);
 
         while (*raw) {
             if (*raw < 0x20)
@@ -226,12 +234,15 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
             }
 
             else {
-                valStr += *raw;
-                raw++;
+                // append the whole run of plain characters at once
+                const char *runBegin = raw;
+                while (*raw && !(*raw < 0x20) && *raw != '"' && *raw != '\\')
+                    raw++;
+                valStr.append(runBegin, raw);
             }
         }
 
-        tokenVal = valStr;
+        tokenVal.swap(valStr);
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -406,9 +417,12 @@ bool UniValue::read(const char *raw)
             if (!stack.size())
                 return false;
 
-            UniValue tmpVal(VNUM, tokenVal);
+            // Push an empty node and swap the token in; the tokenizer
+            // refills tokenVal next iteration, so the buffer it already
+            // allocated becomes the node's storage instead of a copy.
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(UniValue(VNUM));
+            top->values.back().val.swap(tokenVal);
 
             setExpect(NOT_VALUE);
             break;
@@ -421,12 +435,13 @@ bool UniValue::read(const char *raw)
             UniValue *top = stack.back();
 
             if (expect(OBJ_NAME)) {
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(string());
+                top->keys.back().swap(tokenVal);
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
-                top->values.push_back(tmpVal);
+                top->values.push_back(UniValue(VSTR));
+                top->values.back().val.swap(tokenVal);
             }
 
             setExpect(NOT_VALUE);
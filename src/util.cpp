@@ -72,6 +72,12 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef __linux__
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+#endif
+
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
@@ -112,6 +118,7 @@ bool fServer = false;
 string strMiscWarning;
 bool fLogTimestamps = DEFAULT_LOGTIMESTAMPS;
 bool fLogTimeMicros = DEFAULT_LOGTIMEMICROS;
+bool fLogTimeNanos = DEFAULT_LOGTIMENANOS;
 bool fLogIPs = DEFAULT_LOGIPS;
 volatile bool fReopenDebugLog = false;
 CTranslationInterface translationInterface;
@@ -268,10 +275,16 @@ static std::string LogTimestampStr(const std::string &str, bool *fStartedNewLine
         return str;
 
     if (*fStartedNewLine) {
-        int64_t nTimeMicros = GetLogTimeMicros();
-        strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros/1000000);
-        if (fLogTimeMicros)
-            strStamped += strprintf(".%06d", nTimeMicros%1000000);
+        if (fLogTimeNanos) {
+            int64_t nTimeNanos = GetLogTimeNanos();
+            strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeNanos/1000000000);
+            strStamped += strprintf(".%09d", (int)(nTimeNanos%1000000000));
+        } else {
+            int64_t nTimeMicros = GetLogTimeMicros();
+            strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros/1000000);
+            if (fLogTimeMicros)
+                strStamped += strprintf(".%06d", nTimeMicros%1000000);
+        }
         strStamped += ' ' + str;
     } else
         strStamped = str;
@@ -284,6 +297,118 @@ static std::string LogTimestampStr(const std::string &str, bool *fStartedNewLine
     return strStamped;
 }
 
+static int LogWriteToFile(const std::string& strTimestamped)
+{
+    int ret = 0;
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+
+    // buffer if we haven't opened the log yet
+    if (fileout == NULL) {
+        assert(vMsgsBeforeOpenLog);
+        ret = strTimestamped.length();
+        vMsgsBeforeOpenLog->push_back(strTimestamped);
+    }
+    else
+    {
+        // reopen the log file, if requested
+        if (fReopenDebugLog) {
+            fReopenDebugLog = false;
+            boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
+            if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
+                setbuf(fileout, NULL); // unbuffered
+        }
+
+        ret = FileWriteStr(strTimestamped, fileout);
+    }
+    return ret;
+}
+
+/**
+ * Asynchronous sink for the debug log (-logasync). Formatted lines are
+ * queued under a short lock and written out by a dedicated thread, so
+ * callers never stall on the unbuffered fwrite. The queue is bounded:
+ * when a logging burst outruns the writer, whole lines are dropped and
+ * the loss is reported in-line once the writer catches up. The state is
+ * leaked on exit for the same reason as mutexDebugLog above.
+ */
+static const size_t DEFAULT_LOG_ASYNC_BUFFER = 1 << 20;
+
+struct CAsyncLogState
+{
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::list<std::string> queue;
+    size_t nQueuedBytes;
+    uint64_t nDropped;
+    //! accepting new lines; cleared to fall back to synchronous writes
+    bool fAccepting;
+    bool fStop;
+
+    CAsyncLogState() : nQueuedBytes(0), nDropped(0), fAccepting(false), fStop(false) {}
+};
+
+static CAsyncLogState* asyncLogState = NULL;
+static boost::thread* pthreadAsyncLog = NULL;
+static size_t nAsyncLogBufferSize = DEFAULT_LOG_ASYNC_BUFFER;
+
+static void ThreadAsyncLogWriter()
+{
+    RenameThread("bitcoin-logwriter");
+    CAsyncLogState* state = asyncLogState;
+    boost::mutex::scoped_lock lock(state->mutex);
+    while (true) {
+        while (state->queue.empty() && !state->fStop)
+            state->cond.wait(lock);
+        std::list<std::string> batch;
+        batch.swap(state->queue);
+        state->nQueuedBytes = 0;
+        uint64_t nDropped = state->nDropped;
+        state->nDropped = 0;
+        bool fStopping = state->fStop;
+        lock.unlock();
+        for (std::list<std::string>::const_iterator it = batch.begin(); it != batch.end(); ++it)
+            LogWriteToFile(*it);
+        if (nDropped > 0)
+            LogWriteToFile(strprintf("*** async logger dropped %d lines (writer fell behind, -logasyncbuffer=%u bytes) ***\n",
+                                     nDropped, (unsigned int)nAsyncLogBufferSize));
+        lock.lock();
+        if (fStopping && state->queue.empty())
+            break;
+    }
+}
+
+void StartAsyncLogging()
+{
+    if (!fPrintToDebugLog || fPrintToConsole || !GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+        return;
+    nAsyncLogBufferSize = GetArg("-logasyncbuffer", DEFAULT_LOG_ASYNC_BUFFER);
+    if (asyncLogState == NULL)
+        asyncLogState = new CAsyncLogState();
+    asyncLogState->fStop = false;
+    asyncLogState->fAccepting = true;
+    pthreadAsyncLog = new boost::thread(&ThreadAsyncLogWriter);
+}
+
+void StopAsyncLogging()
+{
+    if (asyncLogState == NULL)
+        return;
+    {
+        boost::mutex::scoped_lock lock(asyncLogState->mutex);
+        // everything logged from here on is written synchronously, so the
+        // shutdown sequence cannot be lost if the process dies abruptly
+        asyncLogState->fAccepting = false;
+        asyncLogState->fStop = true;
+        asyncLogState->cond.notify_one();
+    }
+    if (pthreadAsyncLog != NULL) {
+        pthreadAsyncLog->join();
+        delete pthreadAsyncLog;
+        pthreadAsyncLog = NULL;
+    }
+}
+
 int LogPrintStr(const std::string &str)
 {
     int ret = 0; // Returns total number of characters written
@@ -299,27 +424,20 @@ int LogPrintStr(const std::string &str)
     }
     else if (fPrintToDebugLog)
     {
-        boost::call_once(&DebugPrintInit, debugPrintInitFlag);
-        boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
-
-        // buffer if we haven't opened the log yet
-        if (fileout == NULL) {
-            assert(vMsgsBeforeOpenLog);
-            ret = strTimestamped.length();
-            vMsgsBeforeOpenLog->push_back(strTimestamped);
-        }
-        else
-        {
-            // reopen the log file, if requested
-            if (fReopenDebugLog) {
-                fReopenDebugLog = false;
-                boost::filesystem::path pathDebug = GetDataDir() / "debug.log";
-                if (freopen(pathDebug.string().c_str(),"a",fileout) != NULL)
-                    setbuf(fileout, NULL); // unbuffered
+        if (asyncLogState != NULL) {
+            boost::mutex::scoped_lock lock(asyncLogState->mutex);
+            if (asyncLogState->fAccepting) {
+                if (asyncLogState->nQueuedBytes + strTimestamped.size() > nAsyncLogBufferSize) {
+                    asyncLogState->nDropped++;
+                    return 0;
+                }
+                asyncLogState->queue.push_back(strTimestamped);
+                asyncLogState->nQueuedBytes += strTimestamped.size();
+                asyncLogState->cond.notify_one();
+                return strTimestamped.size();
             }
-
-            ret = FileWriteStr(strTimestamped, fileout);
         }
+        ret = LogWriteToFile(strTimestamped);
     }
     return ret;
 }
@@ -695,6 +813,35 @@ void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length) {
 #endif
 }
 
+/**
+ * Tell the kernel we are about to read this file front to back, so it can
+ * enlarge its read-ahead window. Advisory; a no-op where posix_fadvise is
+ * unavailable.
+ */
+void AdviseSequentialAccess(FILE *file)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)file;
+#endif
+}
+
+/**
+ * Ask the kernel to start fetching the given range of the file into the page
+ * cache ahead of the reads that will follow. Advisory, like AllocateFileRange.
+ */
+void AdviseWillNeed(FILE *file, unsigned int offset, unsigned int length)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fileno(file), offset, length, POSIX_FADV_WILLNEED);
+#else
+    (void)file;
+    (void)offset;
+    (void)length;
+#endif
+}
+
 void ShrinkDebugFile()
 {
     // Scroll debug.log if it's getting too big
@@ -759,6 +906,118 @@ void RenameThread(const char* name)
 #endif
 }
 
+static boost::mutex mutexThreadPools;
+static std::vector<CThreadPoolInfo> vThreadPools; // guarded by mutexThreadPools
+
+void RegisterThreadPool(const std::string& strName, const std::string& strKnob, int nThreads)
+{
+    boost::unique_lock<boost::mutex> lock(mutexThreadPools);
+    for (std::vector<CThreadPoolInfo>::iterator it = vThreadPools.begin(); it != vThreadPools.end(); ++it) {
+        if (it->strName == strName) {
+            it->strKnob = strKnob;
+            it->nThreads = nThreads;
+            return;
+        }
+    }
+    CThreadPoolInfo info;
+    info.strName = strName;
+    info.strKnob = strKnob;
+    info.nThreads = nThreads;
+    vThreadPools.push_back(info);
+}
+
+std::vector<CThreadPoolInfo> GetRegisteredThreadPools()
+{
+    boost::unique_lock<boost::mutex> lock(mutexThreadPools);
+    return vThreadPools;
+}
+
+/** Startup phase durations, accumulated while AppInit2 runs and reported once
+ *  init finishes; getperfstats serves them afterwards. Kept here rather than
+ *  in init.cpp so RPC code can report them without linking init.o. */
+static boost::mutex mutexStartupPhases;
+static std::vector<std::pair<std::string, int64_t> > vStartupPhases; // guarded by mutexStartupPhases
+
+void RecordStartupPhase(const std::string& strPhase, int64_t nDurationMs)
+{
+    boost::unique_lock<boost::mutex> lock(mutexStartupPhases);
+    vStartupPhases.push_back(std::make_pair(strPhase, nDurationMs));
+}
+
+void GetStartupPhases(std::vector<std::pair<std::string, int64_t> >& vPhases)
+{
+    boost::unique_lock<boost::mutex> lock(mutexStartupPhases);
+    vPhases = vStartupPhases;
+}
+
+#ifdef __linux__
+//! Parse a sysfs cpulist string ("0-7,16-23") into CPU numbers.
+static bool ParseCpuList(const std::string& strList, std::vector<int>& vCpus)
+{
+    std::stringstream ss(strList);
+    std::string strRange;
+    while (std::getline(ss, strRange, ',')) {
+        int nFirst = -1;
+        int nLast = -1;
+        size_t nDash = strRange.find('-');
+        if (nDash == std::string::npos) {
+            nFirst = nLast = atoi(strRange.c_str());
+        } else {
+            nFirst = atoi(strRange.substr(0, nDash).c_str());
+            nLast = atoi(strRange.substr(nDash + 1).c_str());
+        }
+        if (nFirst < 0 || nLast < nFirst)
+            return false;
+        for (int n = nFirst; n <= nLast; n++)
+            vCpus.push_back(n);
+    }
+    return !vCpus.empty();
+}
+#endif
+
+int GetNumaNodeCount()
+{
+#ifdef __linux__
+    int nNodes = 0;
+    while (boost::filesystem::exists(strprintf("/sys/devices/system/node/node%d", nNodes)))
+        nNodes++;
+    return nNodes;
+#else
+    return 0;
+#endif
+}
+
+std::string GetNumaNodeCpuList(int nNode)
+{
+#ifdef __linux__
+    std::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", nNode).c_str());
+    std::string strList;
+    if (file.is_open())
+        std::getline(file, strList);
+    return strList;
+#else
+    (void)nNode;
+    return "";
+#endif
+}
+
+bool BindCurrentThreadToNumaNode(int nNode)
+{
+#ifdef __linux__
+    std::vector<int> vCpus;
+    if (!ParseCpuList(GetNumaNodeCpuList(nNode), vCpus))
+        return false;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (size_t i = 0; i < vCpus.size(); i++)
+        CPU_SET(vCpus[i], &cpuset);
+    return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0;
+#else
+    (void)nNode;
+    return false;
+#endif
+}
+
 void SetupEnvironment()
 {
     // On most POSIX systems (e.g. Linux, but not BSD) the environment's locale
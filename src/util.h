@@ -29,8 +29,10 @@
 #include <boost/thread/exceptions.hpp>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
+static const bool DEFAULT_LOGTIMENANOS  = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC      = false;
 
 /** Signals for translation. */
 class CTranslationInterface
@@ -49,6 +51,7 @@ extern bool fServer;
 extern std::string strMiscWarning;
 extern bool fLogTimestamps;
 extern bool fLogTimeMicros;
+extern bool fLogTimeNanos;
 extern bool fLogIPs;
 extern volatile bool fReopenDebugLog;
 extern CTranslationInterface translationInterface;
@@ -119,6 +122,8 @@ void FileCommit(FILE *fileout);
 bool TruncateFile(FILE *file, unsigned int length);
 int RaiseFileDescriptorLimit(int nMinFD);
 void AllocateFileRange(FILE *file, unsigned int offset, unsigned int length);
+void AdviseSequentialAccess(FILE *file);
+void AdviseWillNeed(FILE *file, unsigned int offset, unsigned int length);
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 bool TryCreateDirectory(const boost::filesystem::path& p);
 boost::filesystem::path GetDefaultDataDir();
@@ -134,6 +139,11 @@ void ReadConfigFile(std::map<std::string, std::string>& mapSettingsRet, std::map
 boost::filesystem::path GetSpecialFolderPath(int nFolder, bool fCreate = true);
 #endif
 void OpenDebugLog();
+/** Start the background debug.log writer thread (honors -logasync). */
+void StartAsyncLogging();
+/** Drain the async log queue, stop the writer thread, and fall back to
+ *  synchronous writes for everything logged afterwards. */
+void StopAsyncLogging();
 void ShrinkDebugFile();
 void runCommand(const std::string& strCommand);
 
@@ -218,6 +228,37 @@ int GetNumCores();
 void SetThreadPriority(int nPriority);
 void RenameThread(const char* name);
 
+/** One named worker pool, recorded where its threads are spawned so the
+ *  per-component CPU budgets can be inspected in one place (see the
+ *  getthreadpoolinfo RPC) instead of chased across modules. */
+struct CThreadPoolInfo
+{
+    std::string strName;    //!< pool name, e.g. "scriptcheck"
+    std::string strKnob;    //!< option controlling the size, "" if hardcoded
+    int nThreads;           //!< threads spawned for the pool
+};
+
+/** Record (or update) the registry entry for a named worker pool. */
+void RegisterThreadPool(const std::string& strName, const std::string& strKnob, int nThreads);
+std::vector<CThreadPoolInfo> GetRegisteredThreadPools();
+
+/** Record the wall-clock duration of a named startup phase, for the startup
+ *  timing report. Also called from the import thread for the mempool load. */
+void RecordStartupPhase(const std::string& strPhase, int64_t nDurationMs);
+/** Copy the recorded startup phases, in completion order. */
+void GetStartupPhases(std::vector<std::pair<std::string, int64_t> >& vPhases);
+
+/**
+ * NUMA topology helpers, backed by Linux sysfs; on other platforms the
+ * node count is 0 and binding fails. Binding restricts the calling thread
+ * (and any thread it subsequently creates, which inherit the mask) to the
+ * CPUs of the given node, so memory the bound threads touch is also
+ * first-touch allocated there.
+ */
+int GetNumaNodeCount();
+std::string GetNumaNodeCpuList(int nNode);
+bool BindCurrentThreadToNumaNode(int nNode);
+
 /**
  * .. and a wrapper that just calls func once
  */
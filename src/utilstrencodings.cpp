@@ -70,6 +70,7 @@ vector<unsigned char> ParseHex(const char* psz)
 {
     // convert hex dump to vector
     vector<unsigned char> vch;
+    vch.reserve(strlen(psz) / 2);
     while (true)
     {
         while (isspace(*psz))
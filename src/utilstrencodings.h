@@ -83,11 +83,24 @@ std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
     std::string rv;
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    if (!fSpaces) {
+        // Common case (2MB blocks go through here for getblock): size the
+        // string once and store by index instead of push_back per nibble.
+        rv.resize((itend-itbegin)*2);
+        size_t i = 0;
+        for(T it = itbegin; it < itend; ++it)
+        {
+            unsigned char val = (unsigned char)(*it);
+            rv[i++] = hexmap[val>>4];
+            rv[i++] = hexmap[val&15];
+        }
+        return rv;
+    }
     rv.reserve((itend-itbegin)*3);
     for(T it = itbegin; it < itend; ++it)
     {
         unsigned char val = (unsigned char)(*it);
-        if(fSpaces && it != itbegin)
+        if(it != itbegin)
             rv.push_back(' ');
         rv.push_back(hexmap[val>>4]);
         rv.push_back(hexmap[val&15]);
@@ -54,6 +54,21 @@ int64_t GetLogTimeMicros()
     return GetTimeMicros();
 }
 
+/** Return a nanosecond-precision time for the debug log. boost's
+ *  microsec_clock tops out at microseconds, so read the system clock
+ *  directly where we can. */
+int64_t GetLogTimeNanos()
+{
+    if (nMockTime) return nMockTime*1000000000;
+
+#ifndef WIN32
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == 0)
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    return GetTimeMicros() * 1000;
+}
+
 void MilliSleep(int64_t n)
 {
 
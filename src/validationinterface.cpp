@@ -5,6 +5,10 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+
+#include <boost/foreach.hpp>
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -15,6 +19,8 @@ CMainSignals& GetMainSignals()
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
+    g_signals.SyncBlockTransactions.connect(boost::bind(&CValidationInterface::SyncBlockTransactions, pwalletIn, _1, _2, _3));
+    g_signals.ClaimEvent.connect(boost::bind(&CValidationInterface::ClaimEvent, pwalletIn, _1, _2, _3, _4));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
@@ -32,6 +38,8 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
+    g_signals.ClaimEvent.disconnect(boost::bind(&CValidationInterface::ClaimEvent, pwalletIn, _1, _2, _3, _4));
+    g_signals.SyncBlockTransactions.disconnect(boost::bind(&CValidationInterface::SyncBlockTransactions, pwalletIn, _1, _2, _3));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
@@ -44,6 +52,8 @@ void UnregisterAllValidationInterfaces() {
     g_signals.Inventory.disconnect_all_slots();
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
+    g_signals.ClaimEvent.disconnect_all_slots();
+    g_signals.SyncBlockTransactions.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
@@ -51,3 +61,15 @@ void UnregisterAllValidationInterfaces() {
 void SyncWithWallets(const CTransaction &tx, const CBlockIndex *pindex, const CBlock *pblock) {
     g_signals.SyncTransaction(tx, pindex, pblock);
 }
+
+void SyncWithWallets(const std::list<CTransaction> &txConflicted, const CBlockIndex *pindex, const CBlock *pblock) {
+    g_signals.SyncBlockTransactions(txConflicted, pindex, pblock);
+}
+
+void CValidationInterface::SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlockIndex *pindex, const CBlock *pblock)
+{
+    BOOST_FOREACH(const CTransaction &tx, txConflicted)
+        SyncTransaction(tx, pindex, NULL);
+    BOOST_FOREACH(const CTransaction &tx, pblock->vtx)
+        SyncTransaction(tx, pindex, pblock);
+}
@@ -6,6 +6,9 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <list>
+#include <string>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -17,6 +20,7 @@ class CReserveScript;
 class CTransaction;
 class CValidationInterface;
 class CValidationState;
+class uint160;
 class uint256;
 
 // These functions dispatch to one or all registered wallets
@@ -29,11 +33,20 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterAllValidationInterfaces();
 /** Push an updated transaction to all registered wallets */
 void SyncWithWallets(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock = NULL);
+/** Push all transactions of a newly connected block (and the mempool
+ *  transactions it conflicted) to all registered wallets in one call */
+void SyncWithWallets(const std::list<CTransaction>& txConflicted, const CBlockIndex *pindex, const CBlock* pblock);
 
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, const CBlock *pblock) {}
+    /** Called once per connected block with all of its transactions. The
+     *  default implementation just replays SyncTransaction for each of them;
+     *  listeners that can amortize per-transaction work over the whole block
+     *  (e.g. the wallet's database writes) override it. */
+    virtual void SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlockIndex *pindex, const CBlock *pblock);
+    virtual void ClaimEvent(const std::string &eventType, const std::string &name, const uint160 &claimId, int nHeight) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
@@ -51,6 +64,11 @@ struct CMainSignals {
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of all transactions in a newly connected block in one call. */
+    boost::signals2::signal<void (const std::list<CTransaction> &, const CBlockIndex *pindex, const CBlock *)> SyncBlockTransactions;
+    /** Notifies listeners of a claim trie event: claim or support added, spent or
+     *  updated, or a name takeover. Fired while the block is being connected. */
+    boost::signals2::signal<void (const std::string &, const std::string &, const uint160 &, int)> ClaimEvent;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -10,7 +10,9 @@
 
 #include <string>
 #include <vector>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
 #include <openssl/aes.h>
 #include <openssl/evp.h>
 
@@ -160,6 +162,28 @@ bool CCryptoKeyStore::Lock()
     return true;
 }
 
+/** Worker for Unlock: decrypts and verifies a strided subset of the encrypted
+ * keys. Records a pass as soon as one key checks out and a failure as soon as
+ * one does not; stops early once any worker has seen a failure. */
+static void UnlockCheckWorker(const CKeyingMaterial* pvMasterKey,
+                              const std::vector<const std::pair<CPubKey, std::vector<unsigned char> >*>* pvKeys,
+                              size_t nWorker, size_t nWorkers,
+                              unsigned char* pfPass, bool* pfAnyFail)
+{
+    for (size_t i = nWorker; i < pvKeys->size(); i += nWorkers)
+    {
+        if (*pfAnyFail)
+            return;
+        CKey key;
+        if (!DecryptKey(*pvMasterKey, (*pvKeys)[i]->second, (*pvKeys)[i]->first, key))
+        {
+            *pfAnyFail = true;
+            return;
+        }
+        *pfPass = 1;
+    }
+}
+
 bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 {
     {
@@ -169,20 +193,59 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 
         bool keyPass = false;
         bool keyFail = false;
-        CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
+        if (fDecryptionThoroughlyChecked)
         {
-            const CPubKey &vchPubKey = (*mi).second.first;
-            const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            CKey key;
-            if (!DecryptKey(vMasterKeyIn, vchCryptedSecret, vchPubKey, key))
+            // Every key was already verified against the master key on a
+            // previous unlock, so checking a single key suffices here.
+            CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
+            if (mi != mapCryptedKeys.end())
+            {
+                CKey key;
+                if (DecryptKey(vMasterKeyIn, (*mi).second.second, (*mi).second.first, key))
+                    keyPass = true;
+                else
+                    keyFail = true;
+            }
+        }
+        else if (!mapCryptedKeys.empty())
+        {
+            // First unlock: every key has to be decrypted and verified against
+            // its public key. The AES step is cheap (OpenSSL picks the AES-NI
+            // code path at runtime) but the pubkey verification is not, so
+            // spread the keys over all cores.
+            std::vector<const std::pair<CPubKey, std::vector<unsigned char> >*> vKeys;
+            vKeys.reserve(mapCryptedKeys.size());
+            for (CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin(); mi != mapCryptedKeys.end(); ++mi)
+                vKeys.push_back(&(*mi).second);
+
+            size_t nWorkers = boost::thread::hardware_concurrency();
+            if (nWorkers < 1)
+                nWorkers = 1;
+            if (nWorkers > vKeys.size())
+                nWorkers = vKeys.size();
+            if (nWorkers > 1)
+            {
+                std::vector<unsigned char> vPass(nWorkers, 0);
+                bool fAnyFail = false;
+                boost::thread_group threads;
+                for (size_t nWorker = 0; nWorker < nWorkers; nWorker++)
+                    threads.create_thread(boost::bind(&UnlockCheckWorker, &vMasterKeyIn, &vKeys,
+                                                      nWorker, nWorkers,
+                                                      &vPass[nWorker], &fAnyFail));
+                threads.join_all();
+                keyFail = fAnyFail;
+                for (size_t nWorker = 0; nWorker < nWorkers; nWorker++)
+                    if (vPass[nWorker])
+                        keyPass = true;
+            }
+            else
             {
-                keyFail = true;
-                break;
+                unsigned char fPass = 0;
+                bool fAnyFail = false;
+                UnlockCheckWorker(&vMasterKeyIn, &vKeys, 0, 1, &fPass, &fAnyFail);
+                keyPass = fPass != 0;
+                keyFail = fAnyFail;
             }
-            keyPass = true;
-            if (fDecryptionThoroughlyChecked)
-                break;
         }
         if (keyPass && keyFail)
         {
@@ -228,6 +291,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        AddOwnedScriptsForKey(vchPubKey);
     }
     return true;
 }
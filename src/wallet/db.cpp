@@ -18,6 +18,7 @@
 #endif
 
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 #include <boost/version.hpp>
 
@@ -230,6 +231,134 @@ bool CDBEnv::Salvage(const std::string& strFile, bool fAggressive, std::vector<C
     return (result == 0);
 }
 
+void CDBEnv::MarkKeyDirty(const std::string& strFile, const CDataStream& ssKey)
+{
+    LOCK(cs_db);
+    mapDirtyKeys[strFile].insert(std::vector<unsigned char>(ssKey.begin(), ssKey.end()));
+}
+
+// Delta file format: the magic bytes, the writing client's version, the number
+// of records, then for each record a status byte (1 = write, 2 = erasure), the
+// serialized key and, for writes, the current value.
+static const unsigned char pchDeltaMagic[4] = { 'W', 'D', 'L', 'T' };
+
+bool CDBEnv::WriteBackupDelta(const std::string& strFile, const std::set<std::vector<unsigned char> >& setDirty, const boost::filesystem::path& pathDest)
+{
+    LOCK(cs_db);
+    assert(mapFileUseCount.count(strFile) == 0);
+
+    Db db(dbenv, 0);
+    int result = db.open(NULL, strFile.c_str(), "main", DB_BTREE, DB_RDONLY, 0);
+    if (result != 0) {
+        LogPrintf("CDBEnv::WriteBackupDelta: Cannot open %s (%d)\n", strFile, result);
+        return false;
+    }
+
+    bool fOk = true;
+    {
+        CAutoFile fileout(fopen(pathDest.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (fileout.IsNull()) {
+            LogPrintf("CDBEnv::WriteBackupDelta: Cannot open %s for writing\n", pathDest.string());
+            db.close(0);
+            return false;
+        }
+        try {
+            fileout << FLATDATA(pchDeltaMagic);
+            fileout << CLIENT_VERSION;
+            fileout << (uint64_t)setDirty.size();
+            BOOST_FOREACH(const std::vector<unsigned char>& vchKey, setDirty) {
+                Dbt datKey((void*)&vchKey[0], vchKey.size());
+                Dbt datValue;
+                datValue.set_flags(DB_DBT_MALLOC);
+                int ret = db.get(NULL, &datKey, &datValue, 0);
+                if (ret == 0) {
+                    fileout << (unsigned char)1;
+                    fileout << vchKey;
+                    fileout << std::vector<unsigned char>((unsigned char*)datValue.get_data(), (unsigned char*)datValue.get_data() + datValue.get_size());
+                    memset(datValue.get_data(), 0, datValue.get_size());
+                    free(datValue.get_data());
+                } else if (ret == DB_NOTFOUND) {
+                    // The key was erased since the last backup
+                    fileout << (unsigned char)2;
+                    fileout << vchKey;
+                } else {
+                    LogPrintf("CDBEnv::WriteBackupDelta: Error %d reading %s\n", ret, strFile);
+                    fOk = false;
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("CDBEnv::WriteBackupDelta: Error writing %s: %s\n", pathDest.string(), e.what());
+            fOk = false;
+        }
+    }
+    db.close(0);
+    return fOk;
+}
+
+bool CDBEnv::ReplayBackupDelta(const std::string& strFile, const boost::filesystem::path& pathDelta)
+{
+    LOCK(cs_db);
+    if (mapFileUseCount.count(strFile) != 0 && mapFileUseCount[strFile] != 0) {
+        LogPrintf("CDBEnv::ReplayBackupDelta: %s is in use\n", strFile);
+        return false;
+    }
+    CloseDb(strFile);
+
+    CAutoFile filein(fopen(pathDelta.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        LogPrintf("CDBEnv::ReplayBackupDelta: Cannot open %s\n", pathDelta.string());
+        return false;
+    }
+
+    Db db(dbenv, 0);
+    int result = db.open(NULL, strFile.c_str(), "main", DB_BTREE, DB_CREATE, 0);
+    if (result != 0) {
+        LogPrintf("CDBEnv::ReplayBackupDelta: Cannot open %s (%d)\n", strFile, result);
+        return false;
+    }
+
+    bool fOk = true;
+    uint64_t nRecords = 0;
+    try {
+        unsigned char pchMagic[4];
+        filein >> FLATDATA(pchMagic);
+        if (memcmp(pchMagic, pchDeltaMagic, sizeof(pchMagic)) != 0)
+            throw std::runtime_error("bad magic bytes; not a wallet delta file");
+        int nVersion;
+        filein >> nVersion;
+        filein >> nRecords;
+        for (uint64_t i = 0; i < nRecords; i++) {
+            unsigned char chStatus;
+            std::vector<unsigned char> vchKey;
+            filein >> chStatus;
+            filein >> vchKey;
+            Dbt datKey(&vchKey[0], vchKey.size());
+            if (chStatus == 1) {
+                std::vector<unsigned char> vchValue;
+                filein >> vchValue;
+                Dbt datValue(&vchValue[0], vchValue.size());
+                if (db.put(NULL, &datKey, &datValue, 0) != 0)
+                    throw std::runtime_error("database write failed");
+                memory_cleanse(&vchValue[0], vchValue.size());
+            } else if (chStatus == 2) {
+                int ret = db.del(NULL, &datKey, 0);
+                if (ret != 0 && ret != DB_NOTFOUND)
+                    throw std::runtime_error("database erase failed");
+            } else
+                throw std::runtime_error("unknown record type");
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("CDBEnv::ReplayBackupDelta: Failed to replay %s: %s\n", pathDelta.string(), e.what());
+        fOk = false;
+    }
+    db.close(0);
+    if (fOk) {
+        CheckpointLSN(strFile);
+        LogPrintf("CDBEnv::ReplayBackupDelta: Replayed %u records from %s onto %s\n", nRecords, pathDelta.string(), strFile);
+    }
+    return fOk;
+}
 
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
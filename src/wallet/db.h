@@ -13,6 +13,7 @@
 #include "version.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -41,6 +42,10 @@ public:
     DbEnv *dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    //! Serialized keys written or erased since the last backup, per database
+    //! file. Consumed (and cleared) by BackupWalletIncremental; a full
+    //! snapshot resets the tracking.
+    std::map<std::string, std::set<std::vector<unsigned char> > > mapDirtyKeys;
 
     CDBEnv();
     ~CDBEnv();
@@ -69,6 +74,21 @@ public:
     typedef std::pair<std::vector<unsigned char>, std::vector<unsigned char> > KeyValPair;
     bool Salvage(const std::string& strFile, bool fAggressive, std::vector<KeyValPair>& vResult);
 
+    //! Record a key of strFile as changed since the last backup.
+    void MarkKeyDirty(const std::string& strFile, const CDataStream& ssKey);
+    /**
+     * Write the current values of the given keys of strFile to an incremental
+     * backup (delta) file at pathDest. Keys no longer present in the database
+     * are recorded as erasures. The database must be flushed and closed.
+     */
+    bool WriteBackupDelta(const std::string& strFile, const std::set<std::vector<unsigned char> >& setDirty, const boost::filesystem::path& pathDest);
+    /**
+     * Re-apply the writes and erasures recorded in a delta file written by
+     * WriteBackupDelta on top of strFile. Used to restore a chain of
+     * incremental backups onto their full snapshot (-replaywalletdelta).
+     */
+    bool ReplayBackupDelta(const std::string& strFile, const boost::filesystem::path& pathDelta);
+
     bool Open(const boost::filesystem::path& path);
     void Close();
     void Flush(bool fShutdown);
@@ -168,6 +188,8 @@ protected:
 
         // Write
         int ret = pdb->put(activeTxn, &datKey, &datValue, (fOverwrite ? 0 : DB_NOOVERWRITE));
+        if (ret == 0)
+            bitdb.MarkKeyDirty(strFile, ssKey);
 
         // Clear memory in case it was a private key
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -191,6 +213,8 @@ protected:
 
         // Erase
         int ret = pdb->del(activeTxn, &datKey, 0);
+        if (ret == 0)
+            bitdb.MarkKeyDirty(strFile, ssKey);
 
         // Clear memory
         memset(datKey.get_data(), 0, datKey.get_size());
@@ -130,8 +130,8 @@ UniValue getnewaddress(const UniValue& params, bool fHelp)
     if (params.size() > 0)
         strAccount = AccountFromValue(params[0]);
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+    // The key pool is kept topped up by the background refill thread;
+    // GetKeyFromPool generates inline only if it has run dry
 
     // Generate a new key that is added to wallet
     CPubKey newKey;
@@ -232,9 +232,7 @@ UniValue getrawchangeaddress(const UniValue& params, bool fHelp)
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
-
+    // The key pool is kept topped up by the background refill thread
     CReserveKey reservekey(pwalletMain);
     CPubKey vchPubKey;
     if (!reservekey.GetReservedKey(vchPubKey))
@@ -749,6 +747,11 @@ void ListNameClaims(const CWalletTx& wtx, const string& strAccount, int nMinDept
 
 
 
+static bool CompareWalletTxOrderPosDesc(const CWalletTx* a, const CWalletTx* b)
+{
+    return a->nOrderPos > b->nOrderPos;
+}
+
 UniValue listnameclaims(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -806,12 +809,30 @@ UniValue listnameclaims(const UniValue& params, bool fHelp)
 
     UniValue ret(UniValue::VARR);
 
-    const CWallet::TxItems& txOrdered = pwalletMain->wtxOrdered;
+    LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+    // Collect the transactions holding our claim and support outputs from
+    // the wallet claims index instead of walking the whole ordered
+    // transaction list and decoding every output
+    std::set<uint256> setClaimTxids;
+    for (std::multimap<std::string, COutPoint>::const_iterator it = pwalletMain->mapWalletClaimsByName.begin();
+         it != pwalletMain->mapWalletClaimsByName.end(); ++it)
+        setClaimTxids.insert(it->second.hash);
+
+    std::vector<const CWalletTx*> vClaimTxs;
+    vClaimTxs.reserve(setClaimTxids.size());
+    BOOST_FOREACH(const uint256& txid, setClaimTxids)
     {
-        CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0 && pwtx->GetDepthInMainChain() >= nMinDepth)
+        std::map<uint256, CWalletTx>::const_iterator mi = pwalletMain->mapWallet.find(txid);
+        if (mi != pwalletMain->mapWallet.end())
+            vClaimTxs.push_back(&mi->second);
+    }
+    // Newest first, matching the ordered transaction list walk
+    std::sort(vClaimTxs.begin(), vClaimTxs.end(), CompareWalletTxOrderPosDesc);
+
+    BOOST_FOREACH(const CWalletTx* pwtx, vClaimTxs)
+    {
+        if (pwtx->GetDepthInMainChain() >= nMinDepth)
             ListNameClaims(*pwtx, strAccount, 0, ret, claim_filter, fListSpent);
     }
 
@@ -1964,6 +1985,30 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Un
     }
 }
 
+/**
+ * Conservative prefilter for an account-scoped listtransactions scan.
+ * Returns false only when the transaction provably cannot produce an entry
+ * for strAccount, so the caller can skip the (much more expensive)
+ * GetAmounts/ListTransactions work. setAccountScripts holds the scriptPubKeys
+ * of every address-book entry labelled with strAccount.
+ */
+static bool CouldIncludeAccount(const CWalletTx& wtx, const string& strAccount, const set<CScript>& setAccountScripts)
+{
+    if (wtx.strFromAccount == strAccount)
+        return true;
+    BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+    {
+        // Claim outputs wrap the payment script in a claim prefix, so an
+        // exact script match would miss them; let them through to the full
+        // per-transaction handling
+        if (HasClaimScriptPrefix(txout.scriptPubKey))
+            return true;
+        if (setAccountScripts.count(txout.scriptPubKey))
+            return true;
+    }
+    return false;
+}
+
 UniValue listtransactions(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -2051,13 +2096,28 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
 
     UniValue ret(UniValue::VARR);
 
+    // Push a specific account filter into the scan: collect the account's
+    // scriptPubKeys once, then discard non-matching transactions before
+    // decomposing them. The default account "" also covers addresses that
+    // are not in the book at all, so it cannot use the prefilter.
+    bool fFilterByAccount = strAccount != "*" && !strAccount.empty();
+    set<CScript> setAccountScripts;
+    if (fFilterByAccount)
+    {
+        for (map<CTxDestination, CAddressBookData>::const_iterator it = pwalletMain->mapAddressBook.begin(); it != pwalletMain->mapAddressBook.end(); ++it)
+        {
+            if (it->second.name == strAccount)
+                setAccountScripts.insert(GetScriptForDestination(it->first));
+        }
+    }
+
     const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
 
     // iterate backwards until we have nCount items to return:
     for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
         CWalletTx *const pwtx = (*it).second.first;
-        if (pwtx != 0)
+        if (pwtx != 0 && (!fFilterByAccount || CouldIncludeAccount(*pwtx, strAccount, setAccountScripts)))
             ListTransactions(*pwtx, strAccount, 0, true, ret, filter);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
@@ -2382,12 +2442,16 @@ UniValue backupwallet(const UniValue& params, bool fHelp)
     if (!EnsureWalletIsAvailable(fHelp))
         return NullUniValue;
 
-    if (fHelp || params.size() != 1)
+    if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "backupwallet \"destination\"\n"
+            "backupwallet \"destination\" ( incremental )\n"
             "\nSafely copies current wallet file to destination, which can be a directory or a path with filename.\n"
             "\nArguments:\n"
             "1. \"destination\"   (string) The destination directory or file\n"
+            "2. incremental     (boolean, optional, default=false) Write only the records changed since the previous\n"
+            "                   backup to a compact delta file next to the destination. A full copy is still taken\n"
+            "                   for the first backup and every -walletbackupfullinterval incremental backups; deltas\n"
+            "                   are restored by starting with -replaywalletdelta=<file> for each delta in order.\n"
             "\nExamples:\n"
             + HelpExampleCli("backupwallet", "\"backup.dat\"")
             + HelpExampleRpc("backupwallet", "\"backup.dat\"")
@@ -2396,7 +2460,10 @@ UniValue backupwallet(const UniValue& params, bool fHelp)
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
     string strDest = params[0].get_str();
-    if (!BackupWallet(*pwalletMain, strDest))
+    bool fIncremental = false;
+    if (params.size() > 1)
+        fIncremental = params[1].get_bool();
+    if (fIncremental ? !BackupWalletIncremental(*pwalletMain, strDest) : !BackupWallet(*pwalletMain, strDest))
         throw JSONRPCError(RPC_WALLET_ERROR, "Error: Wallet backup failed!");
 
     return NullUniValue;
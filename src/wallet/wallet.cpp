@@ -11,6 +11,7 @@
 #include "coincontrol.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
 #include "key.h"
 #include "keystore.h"
 #include "main.h"
@@ -129,6 +130,10 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
+        if (pwalletdbBatch)
+            return pwalletdbBatch->WriteKey(pubkey,
+                                            secret.GetPrivKey(),
+                                            mapKeyMetadata[pubkey.GetID()]);
         return CWalletDB(strWalletFile).WriteKey(pubkey,
                                                  secret.GetPrivKey(),
                                                  mapKeyMetadata[pubkey.GetID()]);
@@ -149,6 +154,10 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
             return pwalletdbEncryption->WriteCryptedKey(vchPubKey,
                                                         vchCryptedSecret,
                                                         mapKeyMetadata[vchPubKey.GetID()]);
+        else if (pwalletdbBatch)
+            return pwalletdbBatch->WriteCryptedKey(vchPubKey,
+                                                   vchCryptedSecret,
+                                                   mapKeyMetadata[vchPubKey.GetID()]);
         else
             return CWalletDB(strWalletFile).WriteCryptedKey(vchPubKey,
                                                             vchCryptedSecret,
@@ -299,6 +308,30 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
     walletdb.WriteBestBlock(loc);
 }
 
+CWalletDB* CWallet::OpenBatch()
+{
+    AssertLockHeld(cs_wallet);
+    if (!fFileBacked || pwalletdbBatch)
+        return pwalletdbBatch;
+    pwalletdbBatch = new CWalletDB(strWalletFile, "r+", false);
+    if (!pwalletdbBatch->TxnBegin()) {
+        delete pwalletdbBatch;
+        pwalletdbBatch = NULL;
+    }
+    return pwalletdbBatch;
+}
+
+void CWallet::CommitBatch()
+{
+    AssertLockHeld(cs_wallet);
+    if (!pwalletdbBatch)
+        return;
+    if (!pwalletdbBatch->TxnCommit())
+        pwalletdbBatch->TxnAbort();
+    delete pwalletdbBatch;
+    pwalletdbBatch = NULL;
+}
+
 bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn, bool fExplicit)
 {
     LOCK(cs_wallet); // nWalletVersion
@@ -418,7 +451,16 @@ bool CWallet::Verify()
         if (!CWalletDB::Recover(bitdb, walletFile, true))
             return false;
     }
-    
+
+    if (mapArgs.count("-replaywalletdelta"))
+    {
+        // Re-apply incremental backup deltas (in the order given) on top of a
+        // restored full snapshot
+        BOOST_FOREACH(const std::string& strDelta, mapMultiArgs["-replaywalletdelta"])
+            if (!bitdb.ReplayBackupDelta(walletFile, strDelta))
+                return UIError(strprintf(_("Failed to replay wallet delta file %s"), strDelta));
+    }
+
     if (boost::filesystem::exists(GetDataDir() / walletFile))
     {
         CDBEnv::VerifyResult r = bitdb.Verify(walletFile, CWalletDB::Recover);
@@ -500,12 +542,95 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    // If the spender later turns out to be conflicted or abandoned, the
+    // MarkConflicted/AbandonTransaction hooks put the outpoint back
+    RemoveFromUTXOIndex(outpoint);
 
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
 }
 
+void CWallet::AddToUTXOIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        COutPoint outpoint(hash, i);
+        if (mapWalletUTXOInv.count(outpoint))
+            continue;
+        if (IsMine(wtx.vout[i]) == ISMINE_NO || IsSpent(hash, i))
+            continue;
+        WalletUTXOByValue::iterator it = mapWalletUTXO.insert(make_pair(wtx.vout[i].nValue, outpoint));
+        mapWalletUTXOInv[outpoint] = it;
+    }
+}
+
+void CWallet::RemoveFromUTXOIndex(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<COutPoint, WalletUTXOByValue::iterator>::iterator it = mapWalletUTXOInv.find(outpoint);
+    if (it != mapWalletUTXOInv.end())
+    {
+        mapWalletUTXO.erase(it->second);
+        mapWalletUTXOInv.erase(it);
+    }
+}
+
+void CWallet::AddToClaimsIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        int op;
+        std::vector<std::vector<unsigned char> > vvchParams;
+        if (!DecodeClaimScript(wtx.vout[i].scriptPubKey, op, vvchParams))
+            continue;
+        if (!(IsMine(wtx.vout[i]) & (ISMINE_CLAIM | ISMINE_SUPPORT)))
+            continue;
+
+        COutPoint outpoint(hash, i);
+        if (op == OP_CLAIM_NAME)
+            mapWalletClaims[ClaimIdHash(hash, i)] = outpoint;
+        else if (op == OP_UPDATE_CLAIM && vvchParams.size() > 1)
+            mapWalletClaims[uint160(vvchParams[1])] = outpoint;
+
+        std::string name(vvchParams[0].begin(), vvchParams[0].end());
+        bool fKnown = false;
+        std::pair<std::multimap<std::string, COutPoint>::const_iterator,
+                  std::multimap<std::string, COutPoint>::const_iterator> range = mapWalletClaimsByName.equal_range(name);
+        for (std::multimap<std::string, COutPoint>::const_iterator it = range.first; it != range.second; ++it)
+        {
+            if (it->second == outpoint)
+            {
+                fKnown = true;
+                break;
+            }
+        }
+        if (!fKnown)
+            mapWalletClaimsByName.insert(make_pair(name, outpoint));
+    }
+}
+
+/**
+ * Put an outpoint back into the UTXO index after the transaction spending it
+ * became conflicted or abandoned.
+ */
+void CWallet::RestoreToUTXOIndex(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+    if (mi == mapWallet.end() || outpoint.n >= mi->second.vout.size())
+        return;
+    const CTxOut& txout = mi->second.vout[outpoint.n];
+    if (mapWalletUTXOInv.count(outpoint) || IsMine(txout) == ISMINE_NO || IsSpent(outpoint.hash, outpoint.n))
+        return;
+    WalletUTXOByValue::iterator it = mapWalletUTXO.insert(make_pair(txout.nValue, outpoint));
+    mapWalletUTXOInv[outpoint] = it;
+}
+
 
 void CWallet::AddToSpends(const uint256& wtxid)
 {
@@ -632,6 +757,19 @@ void CWallet::MarkDirty()
     }
 }
 
+size_t CWallet::DynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    // The transaction map dominates; the per-transaction figure counts the
+    // embedded transaction but not the cached credit/debit bookkeeping.
+    size_t nUsage = memusage::DynamicUsage(mapWallet);
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        nUsage += RecursiveDynamicUsage(it->second);
+    nUsage += memusage::DynamicUsage(mapAddressBook);
+    nUsage += memusage::DynamicUsage(setKeyPool);
+    return nUsage;
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb)
 {
     uint256 hash = wtxIn.GetHash();
@@ -743,6 +881,12 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
+        // Index the unspent outputs for coin selection and any claim
+        // outputs for the claims index; running this on updates too picks
+        // up outputs that became ours after a key import
+        AddToUTXOIndex(wtx);
+        AddToClaimsIndex(wtx);
+
         // Write to disk
         if (fInsertedNew || fUpdated)
             if (!wtx.WriteToDisk(pwalletdb))
@@ -802,6 +946,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pbl
 
             // Do not flush the wallet here for performance reasons
             // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our SetBestChain-mechanism
+            if (pwalletdbBatch)
+                return AddToWallet(wtx, false, pwalletdbBatch);
+
             CWalletDB walletdb(strWalletFile, "r+", false);
 
             return AddToWallet(wtx, false, &walletdb);
@@ -860,7 +1007,10 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             BOOST_FOREACH(const CTxIn& txin, wtx.vin)
             {
                 if (mapWallet.count(txin.prevout.hash))
+                {
                     mapWallet[txin.prevout.hash].MarkDirty();
+                    RestoreToUTXOIndex(txin.prevout);
+                }
             }
         }
     }
@@ -886,8 +1036,12 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
     if (conflictconfirms >= 0)
         return;
 
-    // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(strWalletFile, "r+", false);
+    // Do not flush the wallet here for performance reasons. Reuse the open
+    // block batch when there is one, so the conflict markings share its
+    // commit and do not collide with its still-uncommitted pages.
+    CWalletDB* pwalletdb = pwalletdbBatch;
+    if (!pwalletdb)
+        pwalletdb = new CWalletDB(strWalletFile, "r+", false);
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -907,7 +1061,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
-            wtx.WriteToDisk(&walletdb);
+            wtx.WriteToDisk(pwalletdb);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -921,10 +1075,16 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             BOOST_FOREACH(const CTxIn& txin, wtx.vin)
             {
                 if (mapWallet.count(txin.prevout.hash))
+                {
                     mapWallet[txin.prevout.hash].MarkDirty();
+                    RestoreToUTXOIndex(txin.prevout);
+                }
             }
         }
     }
+
+    if (pwalletdb != pwalletdbBatch)
+        delete pwalletdb;
 }
 
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock)
@@ -944,6 +1104,24 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
     }
 }
 
+void CWallet::SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlockIndex *pindex, const CBlock *pblock)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    // Every record this block produces goes into a single database
+    // transaction with a single commit, instead of one synchronous commit
+    // per record. cs_wallet is held across the whole block, so no other
+    // writer can collide with the open transaction. A crash before the
+    // commit loses nothing: the block is rescanned on startup through the
+    // SetBestChain mechanism.
+    OpenBatch();
+    BOOST_FOREACH(const CTransaction &tx, txConflicted)
+        SyncTransaction(tx, pindex, NULL);
+    BOOST_FOREACH(const CTransaction &tx, pblock->vtx)
+        SyncTransaction(tx, pindex, pblock);
+    CommitBatch();
+}
+
 
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
@@ -1217,12 +1395,49 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
+//! Number of blocks fetched ahead of the rescan merge cursor per round
+static const size_t RESCAN_CHUNK_SIZE = 64;
+
+/**
+ * Read-ahead worker for ScanForWalletTransactions. Reads a strided subset of
+ * the chunk's blocks from disk and records which transactions pay a keystore
+ * script. Only the keystore is consulted (its own lock), never mapWallet, so
+ * workers are safe to run while the scanning thread holds cs_wallet.
+ */
+static void RescanChunkWorker(const CWallet* pwallet, const std::vector<CBlockIndex*>* pvChunk,
+                              std::vector<CBlock>* pvBlocks, std::vector<std::vector<char> >* pvRelevant,
+                              size_t nWorker, size_t nWorkers)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    for (size_t i = nWorker; i < pvChunk->size(); i += nWorkers)
+    {
+        CBlock& block = (*pvBlocks)[i];
+        if (!ReadBlockFromDisk(block, (*pvChunk)[i], consensusParams))
+            continue; // the merge loop re-reads serially and reports the failure
+        std::vector<char>& vRelevant = (*pvRelevant)[i];
+        vRelevant.assign(block.vtx.size(), 0);
+        for (size_t j = 0; j < block.vtx.size(); j++)
+        {
+            if (pwallet->IsMine(block.vtx[j]))
+                vRelevant[j] = 1;
+        }
+    }
+}
+
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
     const CChainParams& chainParams = Params();
 
+    size_t nWorkers = (size_t)GetArg("-rescanthreads", 0);
+    if (nWorkers == 0)
+        nWorkers = boost::thread::hardware_concurrency();
+    if (nWorkers < 1)
+        nWorkers = 1;
+    if (nWorkers > RESCAN_CHUNK_SIZE)
+        nWorkers = RESCAN_CHUNK_SIZE;
+
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
@@ -1237,18 +1452,68 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
         while (pindex)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+            if (dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+            // Fetch the next chunk of blocks in parallel. Workers read from
+            // disk and run the expensive keystore script matching; the merge
+            // below stays strictly in block order.
+            std::vector<CBlockIndex*> vChunk;
+            while (pindex && vChunk.size() < RESCAN_CHUNK_SIZE)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+                vChunk.push_back(pindex);
+                pindex = chainActive.Next(pindex);
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
+
+            std::vector<CBlock> vBlocks(vChunk.size());
+            std::vector<std::vector<char> > vRelevant(vChunk.size());
+            if (nWorkers >= 2 && vChunk.size() > 1)
+            {
+                boost::thread_group group;
+                for (size_t nWorker = 0; nWorker < nWorkers; nWorker++)
+                    group.create_thread(boost::bind(&RescanChunkWorker, this, &vChunk, &vBlocks, &vRelevant, nWorker, nWorkers));
+                group.join_all();
+            }
+            else
+            {
+                RescanChunkWorker(this, &vChunk, &vBlocks, &vRelevant, 0, 1);
+            }
+
+            // Batch the whole chunk's wallet writes into one database
+            // transaction; a hot wallet rescanning otherwise pays one
+            // commit per found record
+            OpenBatch();
+            for (size_t i = 0; i < vChunk.size(); i++)
+            {
+                CBlock& block = vBlocks[i];
+                if (vRelevant[i].size() != block.vtx.size())
+                {
+                    // Worker could not read this block; retry here so the
+                    // failure is at least logged per block
+                    if (!ReadBlockFromDisk(block, vChunk[i], Params().GetConsensus()))
+                    {
+                        LogPrintf("%s: failed to read block %s from disk\n", __func__, vChunk[i]->GetBlockHash().ToString());
+                        continue;
+                    }
+                    vRelevant[i].assign(block.vtx.size(), 1);
+                }
+                for (size_t j = 0; j < block.vtx.size(); j++)
+                {
+                    const CTransaction& tx = block.vtx[j];
+                    // The worker already checked the keystore scripts; spends
+                    // of our own outputs and updates of known transactions
+                    // are decided here, where mapWallet reflects everything
+                    // merged so far
+                    if (vRelevant[i][j] || mapWallet.count(tx.GetHash()) != 0 || IsFromMe(tx))
+                    {
+                        if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                            ret++;
+                    }
+                }
+            }
+            CommitBatch();
+
+            if (pindex && GetTime() >= nNow + 60) {
                 nNow = GetTime();
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
             }
@@ -1542,12 +1807,21 @@ std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime)
             continue;
         mapSorted.insert(make_pair(wtx.nTimeReceived, &wtx));
     }
+    // Relay the whole batch with one announcement pass over the peer list
+    std::vector<std::pair<CTransaction, CFeeRate> > vRelay;
     BOOST_FOREACH(PAIRTYPE(const unsigned int, CWalletTx*)& item, mapSorted)
     {
         CWalletTx& wtx = *item.second;
-        if (wtx.RelayWalletTransaction())
-            result.push_back(wtx.GetHash());
-    }
+        if (wtx.IsCoinBase() || wtx.GetDepthInMainChain() != 0 || wtx.isAbandoned() || !wtx.InMempool())
+            continue;
+        LogPrintf("Relaying wtx %s\n", wtx.GetHash().ToString());
+        CFeeRate feeRate;
+        mempool.lookupFeeRate(wtx.GetHash(), feeRate);
+        vRelay.push_back(make_pair((CTransaction)wtx, feeRate));
+        result.push_back(wtx.GetHash());
+    }
+    if (!vRelay.empty())
+        RelayTransactions(vRelay);
     return result;
 }
 
@@ -1681,38 +1955,75 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
 
-            if (!CheckFinalTx(*pcoin))
-                continue;
+        // Walk the value-sorted UTXO index instead of every output in
+        // mapWallet. The transaction-level checks are shared by all outputs
+        // of a transaction, so each verdict is remembered; a payout
+        // transaction with hundreds of our outputs pays for IsTrusted once.
+        map<uint256, int> mapAccepted; // passing transactions and their depth
+        set<uint256> setRejected;
 
-            if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+        WalletUTXOByValue::iterator it = mapWalletUTXO.begin();
+        while (it != mapWalletUTXO.end())
+        {
+            const COutPoint outpoint = it->second;
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
 
-            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+            // Lazily prune entries whose transaction is gone or whose
+            // output has been spent since the entry was made
+            if (mi == mapWallet.end() || outpoint.n >= mi->second.vout.size() ||
+                IsSpent(outpoint.hash, outpoint.n))
+            {
+                mapWalletUTXOInv.erase(outpoint);
+                mapWalletUTXO.erase(it++);
                 continue;
+            }
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < 0)
+            const CWalletTx* pcoin = &mi->second;
+            if (setRejected.count(outpoint.hash))
+            {
+                ++it;
                 continue;
+            }
 
-            // We should not consider coins which aren't at least in our mempool
-            // It's possible for these to be conflicted via ancestors which we may never be able to detect
-            if (nDepth == 0 && !pcoin->InMempool())
-                continue;
+            int nDepth;
+            map<uint256, int>::const_iterator itDepth = mapAccepted.find(outpoint.hash);
+            if (itDepth != mapAccepted.end())
+                nDepth = itDepth->second;
+            else
+            {
+                nDepth = pcoin->GetDepthInMainChain();
+                if (!CheckFinalTx(*pcoin) ||
+                    (fOnlyConfirmed && !pcoin->IsTrusted()) ||
+                    (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) ||
+                    nDepth < 0 ||
+                    // We should not consider coins which aren't at least in our mempool
+                    // It's possible for these to be conflicted via ancestors which we may never be able to detect
+                    (nDepth == 0 && !pcoin->InMempool()))
+                {
+                    setRejected.insert(outpoint.hash);
+                    ++it;
+                    continue;
+                }
+                mapAccepted[outpoint.hash] = nDepth;
+            }
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i))))
-                        vCoins.push_back(COutput(pcoin, i, nDepth,
-                                                 ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                                                  (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO)));
+            isminetype mine = IsMine(pcoin->vout[outpoint.n]);
+            if (mine == ISMINE_NO)
+            {
+                // Keys are never removed but watch-only scripts can be;
+                // drop the stale entry
+                mapWalletUTXOInv.erase(outpoint);
+                mapWalletUTXO.erase(it++);
+                continue;
             }
+
+            if (!IsLockedCoin(outpoint.hash, outpoint.n) && (pcoin->vout[outpoint.n].nValue > 0 || fIncludeZeroValue) &&
+                (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(outpoint)))
+                    vCoins.push_back(COutput(pcoin, outpoint.n, nDepth,
+                                             ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                                              (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO)));
+            ++it;
         }
     }
 }
@@ -2418,6 +2729,18 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
+    // Build the UTXO index in one pass now that every transaction and spend
+    // is in memory; doing it per record during the load would see partial
+    // spend information
+    {
+        LOCK2(cs_main, cs_wallet);
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        {
+            AddToUTXOIndex(it->second);
+            AddToClaimsIndex(it->second);
+        }
+    }
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -2565,8 +2888,6 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
-
         // Top up key pool
         unsigned int nTargetSize;
         if (kpSize > 0)
@@ -2574,16 +2895,35 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         else
             nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
 
-        while (setKeyPool.size() < (nTargetSize + 1))
-        {
-            int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool(): writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+        if (setKeyPool.size() >= nTargetSize + 1)
+            return true;
+
+        // Write all generated keys and pool entries in one database
+        // transaction instead of two synchronous commits per key
+        CWalletDB* pwalletdb = OpenBatch();
+        CWalletDB* pwalletdbLocal = NULL;
+        if (!pwalletdb)
+            pwalletdb = pwalletdbLocal = new CWalletDB(strWalletFile);
+
+        try {
+            while (setKeyPool.size() < (nTargetSize + 1))
+            {
+                int64_t nEnd = 1;
+                if (!setKeyPool.empty())
+                    nEnd = *(--setKeyPool.end()) + 1;
+                if (!pwalletdb->WritePool(nEnd, CKeyPool(GenerateNewKey())))
+                    throw runtime_error("TopUpKeyPool(): writing generated key failed");
+                setKeyPool.insert(nEnd);
+                LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            }
+        } catch (...) {
+            // Keys already generated are in the keystore; keep their records
+            CommitBatch();
+            delete pwalletdbLocal;
+            throw;
         }
+        CommitBatch();
+        delete pwalletdbLocal;
     }
     return true;
 }
@@ -2595,7 +2935,9 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
     {
         LOCK(cs_wallet);
 
-        if (!IsLocked())
+        // The background refill thread keeps the pool above its low
+        // watermark; only refill inline when it has actually run dry
+        if (!IsLocked() && setKeyPool.empty())
             TopUpKeyPool();
 
         // Get the oldest key
@@ -2615,6 +2957,35 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
     }
 }
 
+void ThreadKeyPoolRefill()
+{
+    // Refill the key pool in the background once it drains below the low
+    // watermark (half the configured size), so address allocation is a pop
+    // from a ready queue instead of paying for key generation and database
+    // writes inline
+    RenameThread("bitcoin-keypool");
+
+    unsigned int nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
+    while (true)
+    {
+        MilliSleep(500);
+        boost::this_thread::interruption_point();
+
+        if (!pwalletMain || pwalletMain->IsLocked())
+            continue;
+
+        bool fRefill = false;
+        {
+            TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
+            if (!lockWallet)
+                continue;
+            fRefill = pwalletMain->setKeyPool.size() < nTargetSize / 2 + 1;
+        }
+        if (fRefill)
+            pwalletMain->TopUpKeyPool();
+    }
+}
+
 void CWallet::KeepKey(int64_t nIndex)
 {
     // Remove from key pool
@@ -3064,6 +3435,9 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", _("Number of block fetch and script matching threads used during wallet rescan (default: number of cores)"));
+    strUsage += HelpMessageOpt("-walletloadthreads=<n>", _("Number of threads used to deserialize wallet transactions at startup (default: number of cores)"));
+    strUsage += HelpMessageOpt("-replaywalletdelta=<file>", _("Re-apply an incremental backup delta file to the wallet on startup (may be used multiple times; deltas are applied in the order given)"));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
@@ -3071,6 +3445,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-walletbackupfullinterval=<n>", strprintf(_("Number of incremental wallet backups to take between full snapshots (default: %u)"), DEFAULT_WALLET_BACKUP_FULL_INTERVAL));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
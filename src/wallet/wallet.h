@@ -30,6 +30,9 @@
 
 extern CWallet* pwalletMain;
 
+/** Background thread that tops up the key pool when it runs low */
+void ThreadKeyPoolRefill();
+
 /**
  * Settings
  */
@@ -550,6 +553,17 @@ private:
 
     CWalletDB *pwalletdbEncryption;
 
+    /**
+     * Database handle carrying the open transaction that batches all writes
+     * for the block currently being synced; non-NULL only while
+     * SyncBlockTransactions or ScanForWalletTransactions is merging a block.
+     * Protected by cs_wallet.
+     */
+    CWalletDB *pwalletdbBatch;
+
+    CWalletDB* OpenBatch();
+    void CommitBatch();
+
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
 
@@ -570,6 +584,23 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    typedef std::multimap<CAmount, COutPoint> WalletUTXOByValue;
+    /**
+     * Unspent outputs the wallet owns, sorted by value, so coin selection
+     * starts from sorted candidates instead of enumerating every output in
+     * mapWallet. Kept as a conservative superset: entries are re-checked
+     * against the wallet and lazily pruned in AvailableCoins, so a stale
+     * entry costs a lookup, never a wrong coin. Protected by cs_wallet.
+     */
+    mutable WalletUTXOByValue mapWalletUTXO;
+    mutable std::map<COutPoint, WalletUTXOByValue::iterator> mapWalletUTXOInv;
+
+    void AddToUTXOIndex(const CWalletTx& wtx);
+    void RemoveFromUTXOIndex(const COutPoint& outpoint);
+    void RestoreToUTXOIndex(const COutPoint& outpoint);
+
+    void AddToClaimsIndex(const CWalletTx& wtx);
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
@@ -612,6 +643,8 @@ public:
     {
         delete pwalletdbEncryption;
         pwalletdbEncryption = NULL;
+        delete pwalletdbBatch;
+        pwalletdbBatch = NULL;
     }
 
     void SetNull()
@@ -621,6 +654,7 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        pwalletdbBatch = NULL;
         nOrderPosNext = 0;
         nNextResend = 0;
         nLastResend = 0;
@@ -631,6 +665,16 @@ public:
     std::map<uint256, CWalletTx> mapWallet;
     std::list<CAccountingEntry> laccentries;
 
+    /**
+     * Claim, update and support outputs the wallet has ever owned:
+     * claimId to the output that made (or last updated) the claim, and
+     * claimed name to every claim and support output for it. Entries are
+     * never removed, so spent claims stay listable; consumers re-check
+     * spent status and trie membership themselves. Protected by cs_wallet.
+     */
+    std::map<uint160, COutPoint> mapWalletClaims;
+    std::multimap<std::string, COutPoint> mapWalletClaimsByName;
+
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
@@ -721,8 +765,11 @@ public:
     int64_t IncOrderPosNext(CWalletDB *pwalletdb = NULL);
 
     void MarkDirty();
+    //! Dynamic memory used by the wallet's in-memory state (dominated by mapWallet)
+    size_t DynamicMemoryUsage() const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock);
+    void SyncBlockTransactions(const std::list<CTransaction> &txConflicted, const CBlockIndex *pindex, const CBlock *pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
@@ -61,6 +61,14 @@ isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
         }
     }
 
+    // Cheap negative test: a canonical single-key script that is not in the
+    // keystore's owned-script set cannot be mine, sparing the solver and the
+    // per-map lookups for the vast majority of outputs in connected blocks.
+    // Claim scripts skip the test (the watch-only set is keyed on the
+    // unstripped script) and take the full path below.
+    if (strippedScriptPubKey == scriptPubKey && !keystore.PossiblyMine(scriptPubKey))
+        return ISMINE_NO;
+
     if (!Solver(strippedScriptPubKey, whichType, vSolutions)) {
         if (keystore.HaveWatchOnly(scriptPubKey))
             return ISMINE_WATCH_UNSOLVABLE;
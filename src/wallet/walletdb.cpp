@@ -15,7 +15,10 @@
 #include "utiltime.h"
 #include "wallet/wallet.h"
 
+#include <deque>
+
 #include <boost/version.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -328,6 +331,21 @@ DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
     return DB_LOAD_OK;
 }
 
+/**
+ * A deferred transaction record. The cursor scan only stores the raw value
+ * bytes; the bodies are unserialized by worker threads once the scan is done,
+ * which is where a large wallet spends nearly all of its load time.
+ */
+class CWalletTxRecord {
+public:
+    uint256 hash;
+    CDataStream ssValue;
+    CWalletTx wtx;
+    bool fValid;
+
+    CWalletTxRecord() : ssValue(SER_DISK, CLIENT_VERSION), fValid(false) {}
+};
+
 class CWalletScanState {
 public:
     unsigned int nKeys;
@@ -337,6 +355,7 @@ public:
     bool fAnyUnordered;
     int nFileVersion;
     vector<uint256> vWalletUpgrade;
+    std::deque<CWalletTxRecord> vTxRecords;
 
     CWalletScanState() {
         nKeys = nCKeys = nKeyMeta = 0;
@@ -346,6 +365,21 @@ public:
     }
 };
 
+static void LoadWalletTxWorker(std::deque<CWalletTxRecord>* pvRecords, size_t nWorker, size_t nWorkers)
+{
+    for (size_t i = nWorker; i < pvRecords->size(); i += nWorkers)
+    {
+        CWalletTxRecord& rec = (*pvRecords)[i];
+        try {
+            rec.ssValue >> rec.wtx;
+            CValidationState state;
+            rec.fValid = CheckTransaction(rec.wtx, state) && (rec.wtx.GetHash() == rec.hash) && state.IsValid();
+        } catch (...) {
+            rec.fValid = false;
+        }
+    }
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -369,38 +403,13 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
-                return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true, NULL);
+            // Defer the expensive body deserialization; LoadWallet
+            // unserializes all transaction records on worker threads once
+            // the scan is done, then adds them in record order
+            wss.vTxRecords.push_back(CWalletTxRecord());
+            CWalletTxRecord& rec = wss.vTxRecords.back();
+            ssKey >> rec.hash;
+            rec.ssValue = ssValue;
         }
         else if (strType == "acentry")
         {
@@ -672,6 +681,66 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // Unserialize the deferred transaction bodies in parallel, then add
+        // them to the wallet in the order they were read
+        if (!wss.vTxRecords.empty())
+        {
+            size_t nWorkers = (size_t)GetArg("-walletloadthreads", 0);
+            if (nWorkers == 0)
+                nWorkers = boost::thread::hardware_concurrency();
+            if (nWorkers < 1)
+                nWorkers = 1;
+
+            if (nWorkers >= 2 && wss.vTxRecords.size() > 1)
+            {
+                boost::thread_group group;
+                for (size_t nWorker = 0; nWorker < nWorkers; nWorker++)
+                    group.create_thread(boost::bind(&LoadWalletTxWorker, &wss.vTxRecords, nWorker, nWorkers));
+                group.join_all();
+            }
+            else
+            {
+                LoadWalletTxWorker(&wss.vTxRecords, 0, 1);
+            }
+
+            BOOST_FOREACH(CWalletTxRecord& rec, wss.vTxRecords)
+            {
+                if (!rec.fValid)
+                {
+                    // Rescan if there is a bad transaction record:
+                    fNoncriticalErrors = true;
+                    SoftSetBoolArg("-rescan", true);
+                    continue;
+                }
+                CWalletTx& wtx = rec.wtx;
+
+                // Undo serialize changes in 31600
+                if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+                {
+                    if (!rec.ssValue.empty())
+                    {
+                        char fTmp;
+                        char fUnused;
+                        rec.ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+                        LogPrintf("LoadWallet() upgrading tx ver=%d %d '%s' %s\n",
+                                  wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, rec.hash.ToString());
+                        wtx.fTimeReceivedIsTxTime = fTmp;
+                    }
+                    else
+                    {
+                        LogPrintf("LoadWallet() repairing tx ver=%d %s\n", wtx.fTimeReceivedIsTxTime, rec.hash.ToString());
+                        wtx.fTimeReceivedIsTxTime = 0;
+                    }
+                    wss.vWalletUpgrade.push_back(rec.hash);
+                }
+
+                if (wtx.nOrderPos == -1)
+                    wss.fAnyUnordered = true;
+
+                pwallet->AddToWallet(wtx, true, NULL);
+            }
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -943,6 +1012,63 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
     return false;
 }
 
+bool BackupWalletIncremental(const CWallet& wallet, const string& strDest)
+{
+    if (!wallet.fFileBacked)
+        return false;
+
+    // Take a full snapshot for the first backup of this session and
+    // periodically thereafter, so the chain of deltas to replay on restore
+    // stays short.
+    static int nDeltasSinceFull = -1;
+    int nFullInterval = GetArg("-walletbackupfullinterval", DEFAULT_WALLET_BACKUP_FULL_INTERVAL);
+    if (nDeltasSinceFull < 0 || nDeltasSinceFull >= nFullInterval)
+    {
+        {
+            LOCK(bitdb.cs_db);
+            bitdb.mapDirtyKeys[wallet.strWalletFile].clear();
+        }
+        if (!BackupWallet(wallet, strDest))
+            return false;
+        nDeltasSinceFull = 0;
+        return true;
+    }
+
+    while (true)
+    {
+        {
+            LOCK(bitdb.cs_db);
+            if (!bitdb.mapFileUseCount.count(wallet.strWalletFile) || bitdb.mapFileUseCount[wallet.strWalletFile] == 0)
+            {
+                // Flush log data to the dat file
+                bitdb.CloseDb(wallet.strWalletFile);
+                bitdb.CheckpointLSN(wallet.strWalletFile);
+                bitdb.mapFileUseCount.erase(wallet.strWalletFile);
+
+                std::set<std::vector<unsigned char> > setDirty;
+                bitdb.mapDirtyKeys[wallet.strWalletFile].swap(setDirty);
+
+                boost::filesystem::path pathDest(strDest);
+                if (boost::filesystem::is_directory(pathDest))
+                    pathDest /= wallet.strWalletFile;
+                pathDest = pathDest.string() + strprintf(".delta-%lld", GetTime());
+
+                if (!bitdb.WriteBackupDelta(wallet.strWalletFile, setDirty, pathDest))
+                {
+                    // Put the keys back so the next attempt still covers them
+                    bitdb.mapDirtyKeys[wallet.strWalletFile].insert(setDirty.begin(), setDirty.end());
+                    return false;
+                }
+                LogPrintf("wrote incremental backup of %s to %s (%u records)\n", wallet.strWalletFile, pathDest.string(), setDirty.size());
+                nDeltasSinceFull++;
+                return true;
+            }
+        }
+        MilliSleep(100);
+    }
+    return false;
+}
+
 //
 // Try to (very carefully!) recover wallet file if there is a problem.
 //
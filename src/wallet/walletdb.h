@@ -17,6 +17,8 @@
 #include <vector>
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Number of incremental backups between full snapshots
+static const int DEFAULT_WALLET_BACKUP_FULL_INTERVAL = 24;
 
 class CAccount;
 class CAccountingEntry;
@@ -142,6 +144,9 @@ private:
 };
 
 bool BackupWallet(const CWallet& wallet, const std::string& strDest);
+//! Back up only the records changed since the previous backup as a delta file
+//! next to strDest; falls back to BackupWallet for the periodic full snapshot.
+bool BackupWalletIncremental(const CWallet& wallet, const std::string& strDest);
 void ThreadFlushWalletDB(const std::string& strFile);
 
 #endif // BITCOIN_WALLET_WALLETDB_H
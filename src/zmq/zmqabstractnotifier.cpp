@@ -20,3 +20,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyClaim(const std::string &/*eventType*/, const std::string &/*name*/, const uint160 &/*claimId*/, int /*nHeight*/)
+{
+    return true;
+}
@@ -11,6 +11,7 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class uint160;
 
 class CZMQNotificationInterface : public CValidationInterface
 {
@@ -26,6 +27,7 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void ClaimEvent(const std::string &eventType, const std::string &name, const uint160 &claimId, int nHeight);
 
 private:
     CZMQNotificationInterface();
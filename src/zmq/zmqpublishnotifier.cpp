@@ -4,6 +4,7 @@
 
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
+#include "crypto/common.h"
 #include "main.h"
 #include "util.h"
 
@@ -162,6 +163,18 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return rc == 0;
 }
 
+bool CZMQPublishClaimNotifier::NotifyClaim(const std::string &eventType, const std::string &name, const uint160 &claimId, int nHeight)
+{
+    LogPrint("zmq", "zmq: Publish claim %s %s %s at height %d\n", eventType, name, claimId.GetHex(), nHeight);
+    std::string payload = strprintf("%s:%s:%s:%d", eventType, name, claimId.GetHex(), nHeight);
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], nSequence);
+    int rc = zmq_send_multipart(psocket, "claim", 5, payload.data(), payload.size(), msgseq, (size_t)sizeof(uint32_t), 0);
+    if (rc == 0)
+        nSequence++;
+    return rc == 0;
+}
+
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
@@ -40,4 +40,16 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+class CZMQPublishClaimNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishClaimNotifier() : nSequence(0) { }
+    bool NotifyClaim(const std::string &eventType, const std::string &name, const uint160 &claimId, int nHeight);
+
+private:
+    //! Monotonic per-socket sequence number appended to every message so
+    //! subscribers can detect gaps after a reconnect
+    uint32_t nSequence;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H